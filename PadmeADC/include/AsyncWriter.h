@@ -0,0 +1,154 @@
+#ifndef _ASYNCWRITER_H_
+#define _ASYNCWRITER_H_
+
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include "Histo.h"
+#include "WriteBack.h"
+
+// Asynchronous writer of output files and streams.
+// The acquisition (or processing) thread fills blocks taken from a pool of page aligned buffers and queues them,
+// together with file changes, to a writer thread. The writer thread keeps several blocks in flight with io_uring
+// or, if io_uring is not available, with a pool of I/O threads. It opens, closes and rotates the output files
+// itself, writing their head and tail with create_file_head()/create_file_tail(), so the calling thread never
+// waits for the disk unless all buffers are in use.
+// Blocks written to a regular file go to their own offset and can complete in any order; blocks written to a
+// stream (FIFO) are written one at a time. Blocks are given back in the order they were queued, so that the page
+// cache use of the file can be controlled by a write back (see WriteBack.h) as for sequential writes.
+// A minimum completion time can be imposed on each write to simulate a slow disk.
+// Output files can be written with O_DIRECT, bypassing the page cache. Blocks must then be written whole pages at a
+// time at page aligned offsets: the head of a new file is handed to the caller (async_writer_prefix()) to start the
+// data of its first block, the caller queues only whole pages except at the end of a file, and the part of the last
+// block of a file which does not fill a page is written together with the tail as a padded page, after which the file
+// is truncated to its real size. Files are thus identical to those written through the page cache. If a block which
+// does not fill its last page is followed by more data, the rest of the file is written through the page cache.
+
+#define ASYNC_WRITER_MAX_BUFFERS 256
+#define ASYNC_WRITER_MAX_THREADS 16
+#define ASYNC_WRITER_ALIGN 4096   // Alignment of buffers and of O_DIRECT writes
+#define ASYNC_WRITER_HEAD_MAX 64  // Max size of a file head in bytes
+
+typedef struct async_block_s {
+  char* data;        // Page aligned buffer
+  size_t size;       // Size of buffer
+  size_t used;       // Bytes to write (set by the caller)
+  uint32_t events;   // Events in block (set by the caller)
+  // Used by the writer
+  int fd;
+  off_t offset;      // Offset in file (-1: stream)
+  size_t done;       // Bytes already written
+  int result;        // 0: written, errno if error
+  struct iovec iov;  // Part still to write (io_uring backend)
+  uint64_t t_submit; // Time when the block was queued (ns)
+  uint64_t t_start;  // Time when the write was started (ns)
+  uint64_t t_ready;  // Time when the write can be considered completed (ns)
+  int released;      // Write completed, waiting for the writes queued before it
+  struct async_block_s* next;
+} async_block_t;
+
+typedef struct async_op_s {
+  int type;              // Write block, open file, close file
+  async_block_t* block;  // Block to write
+  char* path;            // File to create (NULL: use fd)
+  int fd;                // Stream already opened by the caller
+  int raw;               // Write head of a raw BLT file (DAQRAW mode)
+  unsigned int index;    // Head information
+  int run_number;
+  int board_id;
+  uint32_t board_sn;
+  time_t time;           // Open time (head) or close time (tail)
+  int prefix;            // Head is written by the caller at the start of the data (O_DIRECT)
+  char head[ASYNC_WRITER_HEAD_MAX]; // Head not taken by the caller, written with the tail
+  unsigned int head_len;
+} async_op_t;
+
+typedef struct async_writer_s {
+
+  int uring;               // 1: io_uring backend, 0: I/O threads backend
+  unsigned int n_threads;  // I/O threads (I/O threads backend)
+  uint64_t test_delay;     // Minimum completion time of each write (ns, 0: none)
+  int direct;              // Write output files with O_DIRECT
+  char prefix[ASYNC_WRITER_HEAD_MAX]; // Head of the new file to be taken by the caller (O_DIRECT)
+  unsigned int prefix_len;
+
+  async_block_t block[ASYNC_WRITER_MAX_BUFFERS];
+  unsigned int n_blocks;
+
+  pthread_mutex_t lock;    // Protects free blocks, operation queue and error
+  pthread_cond_t cond;     // Signals free blocks and queue space to the caller
+  async_block_t* free;     // Free blocks
+  async_op_t* op;          // Queue of operations
+  unsigned int op_size, op_head, op_count;
+  int error;               // errno of first failed operation (0 if none)
+  int quit;                // Set to stop the writer thread when all operations are done
+
+  int wake_fd;             // eventfd waking the writer thread (new operation or completion)
+  pthread_t thread;
+
+  // State of the writer thread
+  int fd;                  // Current output (-1: none)
+  int stream;              // Output is not a regular file
+  off_t file_pos;          // Next offset in file
+  uint64_t file_size;      // Bytes written to current file
+  uint32_t file_events;    // Events written to current file
+  unsigned int in_flight;  // Blocks being written
+  async_block_t* held;     // Writes completed before their simulated completion time
+  async_block_t* order[ASYNC_WRITER_MAX_BUFFERS]; // Writes in flight in the order they were started
+  unsigned int order_head, order_count;
+  write_back_t wb;         // Preallocation and writeback of output files
+  int sync;                // Call fsync() before closing a file
+  int file_direct;         // Current file is written with O_DIRECT
+  char* carry;             // End of the file data not filling a page, followed by the tail (page aligned)
+  size_t carry_len;
+
+  // I/O threads backend
+  pthread_t io_thread[ASYNC_WRITER_MAX_THREADS];
+  pthread_mutex_t io_lock;
+  pthread_cond_t io_cond;
+  async_block_t *io_jobs, *io_jobs_last, *io_done;
+  int io_quit;
+
+  // io_uring backend
+  int ring_fd;
+  void *sq_ptr, *cq_ptr, *sqes;
+  size_t sq_len, cq_len, sqes_len;
+  unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+  unsigned *cq_head, *cq_tail, *cq_mask;
+  void* cqes;
+  int cur_pos;             // Kernel supports writing streams at current position
+
+  // Statistics
+  uint64_t n_bytes;        // Bytes written
+  uint64_t n_writes;       // Blocks written
+  uint64_t n_files;        // Files closed
+  uint64_t n_waits;        // Times the caller had to wait for a free block
+  uint64_t n_direct;       // Files written with O_DIRECT
+  uint64_t n_direct_fail;  // Files for which O_DIRECT could not be set
+  uint64_t n_direct_off;   // Files continued through the page cache after a block not filling a page
+  unsigned int max_in_flight;
+  histo_t h_depth;         // Blocks in flight when a new one is started
+  histo_t h_latency;       // Time from queueing of a block to its completion (ns)
+  histo_t h_wait;          // Time waited by the caller for a free block (ns)
+
+} async_writer_t;
+
+async_writer_t* async_writer_create(const char*,unsigned int,size_t,unsigned int,unsigned int); // backend ("ASYNC": io_uring if available, "URING", "THREADS"), number of buffers, buffer size, I/O threads, simulated write time (usecs) - Return NULL if error
+int async_writer_destroy(async_writer_t*); // writer - Write all queued data and stop. Return 0 if OK, -1 if a write failed
+const char* async_writer_backend(async_writer_t*); // writer - Return name of backend in use
+void async_writer_set_write_back(async_writer_t*,uint64_t,uint64_t,int); // writer, bytes to preallocate for each file (0: none), writeback chunk size (0: none), sync on close (0/1) - Call before the first file is opened
+int async_writer_set_direct(async_writer_t*,int); // writer, write files with O_DIRECT (0/1) - Call before the first file is opened. Return 0 if OK, -1 if buffer size is not a multiple of ASYNC_WRITER_ALIGN
+size_t async_writer_prefix(async_writer_t*,char*); // writer, start of an empty block - Copy data which must start the next block (head of a new O_DIRECT file) and return their size
+
+async_block_t* async_writer_get_block(async_writer_t*); // writer - Return an empty block, waiting for one if needed (NULL if a write failed)
+int async_writer_submit(async_writer_t*,async_block_t*); // writer, block with used bytes and events set - Return 0 if OK, -1 if a write failed
+int async_writer_open(async_writer_t*,const char*,int,int,unsigned int,int,int,uint32_t,time_t); // writer, path of file to create (NULL: use fd), fd of open stream, raw head (0/1), file_index, run_number, board_id, board_sn, time - Return size of head, -1 if a write failed
+int async_writer_close(async_writer_t*,time_t); // writer, time - Write tail of current file and close it. Return size of tail, -1 if a write failed
+int async_writer_sync(async_writer_t*); // writer - Wait for all queued operations. Return 0 if OK, -1 if a write failed
+
+void async_writer_report(async_writer_t*,const char*); // writer, name - Print statistics and histograms
+
+#endif
@@ -29,7 +29,8 @@ typedef struct config_s {
   // Process id in PadmeDAQ DB
   int process_id;
 
-  // Define PadmeDAQ functioning mode (can be "DAQ", "ZSUP", or "FAKE")
+  // Define PadmeDAQ functioning mode (can be "DAQ", "DAQRAW", "ZSUP", or "FAKE")
+  // DAQRAW: same as DAQ but readout buffers are written without decoding (see RawBLT.h)
   char process_mode[16];
 
   // File used to read configuration
@@ -54,14 +55,20 @@ typedef struct config_s {
   int run_number;
 
   // Name of virtual file used for streaming in data. Only used when process_mode is "ZSUP"
+  // Use "shm:<file>" to read from the shared memory ring created by a DAQ process in SHM output mode
   char input_stream[MAX_DATA_FILE_LEN];
 
-  // Output mode (can be "FILE" or "STREAM").
+  // Output mode (can be "FILE", "STREAM", or "SHM").
+  // SHM: events are passed to the ZSUP process through a shared memory ring mapped from output_stream
   char output_mode[16];
 
-  // Name of the virtual file used for streaming out data. Only used when output_mode is "STREAM"
+  // Name of the virtual file used for streaming out data. Only used when output_mode is "STREAM" or "SHM"
+  // In SHM mode this is a regular file, better placed on tmpfs (e.g. /dev/shm)
   char output_stream[MAX_DATA_FILE_LEN];
 
+  // Size in bytes of the shared memory ring used in SHM output mode
+  unsigned int shm_ring_size;
+
   // Directory path where data files will be written. Only used when output_mode is "FILE"
   char data_dir[MAX_DATA_DIR_LEN];
 
@@ -88,6 +95,13 @@ typedef struct config_s {
   int conet2_link;
   int conet2_slot;
 
+  // List of boards read by this process (multi-board mode). Each "add_board <id>:<link>:<slot>" line adds one board
+  // If no board is added, only the board defined by board_id, conet2_link, and conet2_slot is read
+  unsigned int n_boards;
+  int board_list_id[MAX_N_BOARDS];
+  int board_list_link[MAX_N_BOARDS];
+  int board_list_slot[MAX_N_BOARDS];
+
   // Choose start DAQ mode (0 = SW control, 1 = S_IN control, 2 = Frist trg)
   int startdaq_mode;
 
@@ -127,14 +141,88 @@ typedef struct config_s {
   // Enable/disable application of DRS4 corrections to sampled data
   int drs4corr_enable;
 
-  // Delay in the DAQ main loop (usecs)
+  // Event decoding mode (can be "CAEN" or "NATIVE")
+  // CAEN: decode events to float samples with CAEN_DGTZ_DecodeEvent, then round them to int16
+  // NATIVE: unpack 12 bits samples directly to int16 and apply DRS4 corrections in the integer domain
+  char decode_mode[8];
+
+  // Directory where DRS4 correction tables are cached (NATIVE decode mode). If "none", tables are not cached
+  char drs4_cache_dir[MAX_DATA_DIR_LEN];
+
+  // Delay in the DAQ main loop (usecs). Only used in POLL readout mode
   useconds_t daq_loop_delay;
 
+  // Readout mode (can be "POLL" or "IRQ")
+  // POLL: read acquisition status register at each loop iteration and sleep daq_loop_delay usecs
+  // IRQ: wait for board interrupt (OPTICAL connection only)
+  char readout_mode[8];
+
+  // Number of events ready in board memory which will raise an interrupt (IRQ mode, <= max_num_events_blt)
+  unsigned int irq_num_events;
+
+  // Max time (msecs) to wait for an interrupt before polling the board and checking stop conditions (IRQ mode)
+  unsigned int irq_timeout;
+
+  // Readout control (can be "FIXED" or "ADAPTIVE")
+  // FIXED: poll every daq_loop_delay usecs and transfer up to max_num_events_blt events in each readout
+  // ADAPTIVE: follow the trigger rate observed at each readout, adjusting the poll delay (between
+  //           adaptive_min_delay and daq_loop_delay) and the BLT size (up to max_num_events_blt)
+  //           so that about adaptive_occupancy% of max_num_events_blt events are read each time
+  char readout_control[16];
+
+  // Target number of events in board memory at each readout (percent of max_num_events_blt, ADAPTIVE control)
+  unsigned int adaptive_occupancy;
+
+  // Shortest delay (usecs) between two polls of the board (ADAPTIVE control)
+  useconds_t adaptive_min_delay;
+
+  // Number of threads used to decode and format the events of each readout buffer (>1 requires decode_mode NATIVE)
+  unsigned int encode_threads;
+
+  // Pin event encoding threads to cpus (0: no, 1: yes)
+  int encode_pin_cpus;
+
+  // Cpu where the readout loop runs (-1: no pinning)
+  // In multi-board mode all readout threads are pinned to this cpu
+  int readout_cpu;
+
+  // Cpu where the writer thread runs (-1: no pinning, only used with the readout ring)
+  int writer_cpu;
+
+  // SCHED_FIFO priority of the readout loop (0: normal scheduling, 1-99: real-time priority)
+  int readout_rt_priority;
+
+  // Prefault readout and output buffers and lock process memory in RAM (0: no, 1: yes)
+  int lock_memory;
+
+  // Number of BLT buffers in the readout ring used to decouple readout from event writing
+  // If 0, readout, event formatting, and writing are all done in the main DAQ loop
+  unsigned int daq_ring_size;
+
+  // Policy used when the output side falls behind the readout (can be "DROP" or "MISSING")
+  // DROP: readout buffers which do not fit in the readout ring are dropped
+  // MISSING: when the readout ring is filled above overload_level, events are written as header-only
+  //          events with the MISSING status bit set until the ring is back below half that level
+  char overload_policy[8];
+
+  // Readout ring occupancy (percent of slots) above which events are written without data (MISSING policy)
+  unsigned int overload_level;
+
   // Zero-suppression
   // Parameter is 100*mode+algorithm where mode=(0:rejection, 1:flagging)
   // and algorithm=(0:OFF, 1-15:ON with selection of the algorithm)
   int zero_suppression;
 
+  // Apply zero-suppression while formatting events in the DAQ process (0:no, left to ZSUP process - 1:yes)
+  int daq_zero_suppression;
+
+  // Number of threads applying zero-suppression in the ZSUP process
+  // With more than one thread events are handled in batches and written in their original order
+  unsigned int zsup_threads;
+
+  // Pin zero-suppression threads to cpus (0: no, 1: yes)
+  int zsup_pin_cpus;
+
   // Zero-suppression algorithm 1 parameters
   int zs1_head; // Number of samples to use to compute mean and rms
   int zs1_tail; // Number of samples to reject at the end (see V1742 manual)
@@ -163,9 +251,50 @@ typedef struct config_s {
   // After writing this number of events, output file will be closed and a new one will be opened
   unsigned int file_max_events;
 
+  // Prepare the next output file in a helper thread (0:no, 1:yes) so that a file change only swaps file descriptors
+  // The old file is closed by the helper thread, after an fsync() if file_sync_close is set (0:no, 1:yes)
+  // Only used in FILE output mode with the SYNC output writer (the asynchronous writer changes files itself)
+  int file_preopen;
+  int file_sync_close;
+
+  // Preallocate file_max_size bytes for each output file (0:no, 1:yes): unused space is released on close
+  // Written data are sent to disk and dropped from the page cache every file_flush_size bytes (0: left to the kernel)
+  // Only used in FILE output mode
+  int file_prealloc;
+  unsigned int file_flush_size;
+
+  // Write an index of the events of each output file to the sidecar file '<file>.idx' (0:no, 1:yes)
+  // Only used in FILE output mode and not for raw files (DAQRAW). See EventIndex.h for the format
+  int file_index;
+
+  // Events are collected in an output buffer of this size (bytes) and written with a single system call
+  // The buffer is also written when it holds output_buffer_events events (0: no limit) or when its
+  // oldest event has been waiting for output_buffer_delay msecs (0: no limit)
+  // If output_buffer_size is 0 (default), each event is written on its own. Not used in SHM output mode
+  unsigned int output_buffer_size;
+  unsigned int output_buffer_events;
+  unsigned int output_buffer_delay;
+
+  // Output writer: SYNC (output buffer written by the processing thread), ASYNC (writer thread using
+  // io_uring if available, I/O threads otherwise), URING or THREADS (force one of the two backends)
+  // The asynchronous writer keeps up to output_writer_buffers buffers of output_buffer_size bytes in flight
+  // and opens/closes the output files itself: output_buffer_size must be set. Not used in SHM output mode
+  // output_writer_test_delay (usecs) sets a minimum completion time for each write to simulate a slow disk
+  // output_writer_direct makes the asynchronous writer write the output files with O_DIRECT, bypassing the page cache
+  // (0:no, 1:yes): FILE output mode only, output_buffer_size must be a multiple of 4096
+  char output_writer[8];
+  unsigned int output_writer_buffers;
+  unsigned int output_writer_threads;
+  unsigned int output_writer_test_delay;
+  int output_writer_direct;
+
   // Define how often program will write trigger to debug output (once every debug_scale triggers)
   unsigned short int debug_scale;
 
+  // Interval (secs) between reports of the latency histograms of the processing stages
+  // If 0, histograms are only reported at the end of the run
+  unsigned int latency_report_time;
+
 } config_t;
 
 extern config_t* Config; // Declare pointer to common configuration structure
@@ -0,0 +1,18 @@
+#ifndef _CONVERT_H_
+#define _CONVERT_H_
+
+#include <stdint.h>
+
+// Conversion of the float samples returned by CAEN_DGTZ_DecodeEvent to the int16 samples of PEvent events.
+// Each sample is rounded with roundf (halfway cases away from zero) and narrowed to int16, exactly as
+// "int16_t s = roundf(f)" does: vector kernels give the same output as the scalar code for all samples
+// in the int16 range. The kernels are selected at runtime according to the instructions supported by the cpu.
+
+void convert_init(); // Select fastest kernels supported by the cpu (and check them against the scalar ones)
+int convert_select(const char*); // kernels name ("scalar", "sse2" or "neon", "avx2") - Return 0 if OK, 1 if not supported or not exact
+const char* convert_name(); // Return name of the kernels in use
+
+void convert_samples(const float*,int16_t*,unsigned int); // input samples, output samples, number of samples
+unsigned int convert_trigger(const float*,int16_t*,unsigned int,uint32_t); // input, output, number of samples, threshold - Return number of samples below threshold
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef _DRS4_H_
+#define _DRS4_H_
+
+#include <stdint.h>
+
+// Integer DRS4 corrections used by the native V1742 decoder
+// Cell (start index cell dependent) and index (sample number dependent) offsets are subtracted from the
+// int16 samples of channels and trigger, then spikes common to all channels of a group are removed from
+// channels and trigger with the same conditions used by the CAEN library.
+// Time corrections (sample resampling) are not applied: with decode_mode NATIVE the PEVT_STATUS_DRS4CORR_BIT of
+// the event status only means that offset and spike corrections were applied, while CAEN_DGTZ_DecodeEvent
+// also applies the time correction.
+
+// Tag used in the header of DRS4 correction tables cache files
+#define DRS4_CACHE_TAG 0xD454C0DE
+
+// Correction tables of one board (see DRS4.c)
+typedef struct drs4_table_s drs4_table_t;
+
+int DRS4_init(int,int,uint32_t,int); // handle, board id, board serial number, sampling frequency
+const drs4_table_t* DRS4_table(int); // board id - Return tables loaded by DRS4_init, NULL if none
+void DRS4_correct_group(const drs4_table_t*,unsigned int,unsigned int,unsigned int,int16_t**,int16_t*,unsigned int); // tables, group, start index cell, n samples, 8 channels, trigger (NULL: none), n trigger samples
+
+#endif
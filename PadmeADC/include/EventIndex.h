@@ -0,0 +1,80 @@
+#ifndef _EVENTINDEX_H_
+#define _EVENTINDEX_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+
+// Index of the events of a PEvent file, written next to it as the sidecar file '<data file>.idx'.
+// The sidecar starts with a head of 4 words (magic 'PIDX', version, size of an entry in bytes, 0) followed by one
+// entry per event, in file order. Entries are appended while the data file is written, so the sidecar of a file
+// which was not closed holds the events written up to the last flush of the index.
+// Event counter and time tag are extended to 32 and 64 bits, counting their wraps (22 and 32 bits): within a file
+// both grow with the file offset and an event or a time range can be found with a binary search. The time tag is
+// extended correctly if there is at least one event per wrap of the board clock (~36 s).
+// Raw (DAQRAW) files are not indexed.
+
+#define EVENT_INDEX_MAGIC   0x58444950 // 'PIDX'
+#define EVENT_INDEX_VERSION 1
+#define EVENT_INDEX_HEAD_LEN 4
+#define EVENT_INDEX_SUFFIX  ".idx"
+#define EVENT_INDEX_BUFFER  2048   // Entries buffered between writes by the DAQ, ZSUP and FAKE processes (64 KiB)
+
+typedef struct event_index_entry_s {
+  uint64_t offset;  // Offset of the event in the data file (bytes)
+  uint64_t time;    // Event time tag (header line 3) extended to 64 bits
+  uint32_t counter; // Event counter (bit 0-21 of header line 2) extended to 32 bits
+  uint32_t mask;    // Accepted channel mask (header line 5)
+  uint32_t size;    // Event size in bytes
+  uint32_t status;  // Event status (bit 22-31 of header line 2)
+} event_index_entry_t;
+
+// Writer: entries are collected in a buffer and appended to the sidecar when it is full and when the file is closed
+
+typedef struct event_index_s {
+
+  int fd;                     // Sidecar of the current data file (-1: none)
+  event_index_entry_t* entry; // Entries waiting to be written
+  unsigned int n_entries;
+  unsigned int max_entries;
+
+  uint64_t file_entries;      // Entries of the current file
+  uint32_t last_counter;      // Raw counter and time tag of the last event
+  uint32_t last_time;
+  uint32_t counter;           // Extended counter and time tag of the last event
+  uint64_t time;
+
+  // Statistics
+  uint64_t n_files;
+  uint64_t n_entries_total;
+  uint64_t n_writes;
+
+} event_index_t;
+
+event_index_t* event_index_create(unsigned int); // entries buffered between writes - Return NULL if error
+void event_index_destroy(event_index_t*); // index (an open sidecar is closed)
+
+int event_index_open(event_index_t*,const char*); // index, path of data file - Create the sidecar. Return 0 if OK, -1 if error
+int event_index_add(event_index_t*,const void*,uint64_t); // index, event, offset in data file - Return 0 if OK, -1 if error
+int event_index_add_events(event_index_t*,const void*,size_t,uint64_t); // index, consecutive events, total size, offset of first event - Return 0 if OK, -1 if error
+int event_index_close(event_index_t*); // index - Write waiting entries and close the sidecar. Return 0 if OK, -1 if error
+
+void event_index_report(event_index_t*,const char*); // index, name - Print statistics
+
+// Reader: the sidecar of a data file is mapped in memory and searched in O(log n)
+
+typedef struct event_index_map_s {
+  const event_index_entry_t* entry; // Entries in file order
+  size_t n_entries;
+  void* map;
+  size_t map_len;
+} event_index_map_t;
+
+event_index_map_t* event_index_load(const char*); // path of data file - Map its sidecar. Return NULL if error
+void event_index_unload(event_index_map_t*); // index map
+
+ssize_t event_index_find_event(event_index_map_t*,uint32_t); // index map, extended event counter - Return entry of the first event with this or a higher counter, -1 if none
+ssize_t event_index_find_time(event_index_map_t*,uint64_t); // index map, extended time tag - Return entry of the first event at this time or later, -1 if none
+size_t event_index_time_range(event_index_map_t*,uint64_t,uint64_t,size_t*); // index map, start time, end time (excluded), first entry (output) - Return number of events in range
+off_t event_index_seek(event_index_map_t*,int,size_t); // index map, descriptor of data file, entry - Move the file to the event. Return its offset, -1 if error
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef _FILEROTATOR_H_
+#define _FILEROTATOR_H_
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "Histo.h"
+
+#define FILE_ROTATOR_MAX_CLOSE 8
+
+// Background preparation of output files, so that a file change in the processing loop only swaps file descriptors.
+// A helper thread keeps the next output file already created in the data directory: as an unnamed file (O_TMPFILE)
+// if the filesystem supports it, otherwise under a hidden temporary name.
+// When the processing thread changes file it takes the prepared descriptor, gives it its final name, and hands over
+// the old one: the helper then prepares the following file and syncs (optionally) and closes the old one. Naming
+// is done by file_rotator_open(), so that a file is never written without its final name. Errors of the helper
+// are reported by the next call.
+// The final name is set with a link or rename which never replaces an existing file, as the O_EXCL open it replaces.
+// Prepared files can have their blocks preallocated: on close the unused ones are released, truncating the file at
+// its current offset (files are written sequentially with write()). Closed files are dropped from the page cache.
+
+typedef struct file_rotator_s {
+
+  char* dir;              // Data directory
+  char* tmp_path;         // Name of the prepared file when O_TMPFILE is not supported
+  int sync;               // Call fsync() before closing a file
+  uint64_t prealloc;      // Bytes preallocated for each file (0: none)
+
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  pthread_t thread;
+  int next_fd;            // Prepared file (-1: not ready)
+  int next_anon;          // Prepared file has no name (O_TMPFILE)
+  int want_next;          // A new file must be prepared
+  int close_fd[FILE_ROTATOR_MAX_CLOSE]; // Files waiting to be closed
+  unsigned int n_close;
+  int error;              // errno of first failure (0 if none)
+  int quit;
+
+  // Statistics
+  uint64_t n_files;       // Files handed to the processing thread
+  uint64_t n_waits;       // Times the processing thread had to wait for the prepared file
+  uint64_t n_prealloc_fail; // Files which could not be preallocated
+  histo_t h_open;         // Time to create a file in the helper thread (ns)
+  histo_t h_close;        // Time to sync and close a file in the helper thread (ns)
+  histo_t h_wait;         // Time the processing thread waited for the prepared file (ns)
+  histo_t h_name;         // Time to give its final name to a file in the processing thread (ns)
+
+} file_rotator_t;
+
+file_rotator_t* file_rotator_create(const char*,const char*,int,uint64_t); // data directory, tag of temporary file, sync on close (0/1), bytes to preallocate (0: none) - Return NULL if error
+int file_rotator_destroy(file_rotator_t*); // rotator - Close all files and remove the unused prepared one. Return 0 if OK, -1 if an operation failed
+
+int file_rotator_open(file_rotator_t*,const char*); // rotator, final path - Return descriptor of prepared file with its final name, -1 if error
+int file_rotator_close(file_rotator_t*,int); // rotator, descriptor - Sync and close file in background. Return 0 if OK, -1 if an operation failed
+int file_rotator_sync(file_rotator_t*); // rotator - Wait until all files are closed. Return 0 if OK, -1 if an operation failed
+
+void file_rotator_report(file_rotator_t*,const char*); // rotator, name - Print statistics and histograms
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef _HISTO_H_
+#define _HISTO_H_
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+// Histograms with log-linear bins used to monitor latencies (in ns) and sizes of the processing stages.
+// Values below 8 have their own bin, then each power of 2 is split in 8 bins of equal width,
+// so that the bin width is always within 12.5% of the value and the full uint64_t range is covered.
+// Histograms can be filled by several threads at the same time and reported while being filled.
+
+#define HISTO_SUB_BITS 3
+#define HISTO_N_SUB (1 << HISTO_SUB_BITS)
+#define HISTO_N_BINS ((64-HISTO_SUB_BITS+1)*HISTO_N_SUB)
+
+typedef struct histo_s {
+
+  const char* name; // Name of monitored quantity
+  const char* unit; // Unit of values (values in "ns" are reported in usecs)
+
+  atomic_ullong n;   // Number of entries
+  atomic_ullong sum; // Sum of values
+  atomic_ullong max; // Largest value
+  atomic_ullong bin[HISTO_N_BINS];
+
+} histo_t;
+
+void histo_init(histo_t*,const char*,const char*); // histogram, name, unit - Clear all entries
+void histo_fill(histo_t*,uint64_t); // histogram, value
+uint64_t histo_quantile(histo_t*,double); // histogram, fraction - Return upper edge of the bin holding the quantile (at most the largest value)
+void histo_print(histo_t*,int); // histogram, print all non-empty bins (0: no, 1: yes)
+
+uint64_t histo_time(); // Return monotonic time in ns
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef _OUTPUTBUFFER_H_
+#define _OUTPUTBUFFER_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include "AsyncWriter.h"
+#include "WriteBack.h"
+
+// Output stage shared by the DAQ, ZSUP and FAKE processes.
+// Events (and file head/tail) are copied to a page aligned buffer and written to the output file or stream
+// with a single system call when the buffer is full, when it holds max_events events, or when its oldest
+// event has been waiting for max_delay. Data which do not fit in the buffer are written, without being
+// copied, together with the buffered ones in the same writev call.
+// Callers update their file counters when data are added, so file changes happen after the same events
+// as with unbuffered output: the buffer must be flushed before the file tail is followed by close().
+// With a buffer size of 0 each call to output_buffer_write(v) is a system call (unbuffered output).
+// When an asynchronous writer is used, the buffer is a block of the writer: full blocks are queued to the
+// writer and all data are copied. Files are then opened and closed through the writer.
+// If the writer uses O_DIRECT, a new file starts with its head taken from the writer and only whole pages are
+// queued until output_buffer_flush() ends the file: flushes for max_events or max_delay keep the rest of a page.
+// The page cache use of output files written by the buffer is controlled with a write back (see WriteBack.h):
+// output_buffer_end_file() must then be called before a file is closed.
+
+#define OUTPUT_BUFFER_MAX_IOVEC 64
+
+typedef struct output_buffer_s {
+
+  int fd;              // Output file or stream (-1: none)
+
+  char* data;          // Buffer (page aligned)
+  size_t size;         // Size of buffer (0: unbuffered)
+  size_t used;         // Bytes waiting in buffer
+  uint32_t events;     // Events waiting in buffer
+
+  uint32_t max_events; // Flush when this many events are waiting (0: no limit)
+  uint64_t max_delay;  // Flush when the oldest waiting event is older than this (ns, 0: no limit)
+  uint64_t t_first;    // Time when the oldest waiting data were added (ns)
+
+  async_writer_t* writer; // Asynchronous writer (NULL: data are written by the calling thread)
+  async_block_t* block;   // Block of the writer used as buffer
+
+  write_back_t wb;        // Preallocation and writeback of output files
+
+  // Statistics
+  uint64_t n_bytes;        // Bytes written
+  uint64_t n_events;       // Events written
+  uint64_t n_syscalls;     // write()/writev() calls (blocks given to the asynchronous writer)
+  uint64_t n_flush_size;   // Flushes because the buffer was full
+  uint64_t n_flush_events; // Flushes because max_events were waiting
+  uint64_t n_flush_time;   // Flushes because max_delay expired
+  uint64_t n_flush_sync;   // Flushes requested by the caller (e.g. before closing a file)
+
+} output_buffer_t;
+
+output_buffer_t* output_buffer_create(size_t,uint32_t,uint32_t); // buffer size, max events, max delay (ms) - Return NULL if error
+output_buffer_t* output_buffer_create_async(async_writer_t*,uint32_t,uint32_t); // writer, max events, max delay (ms) - Return NULL if error
+void output_buffer_destroy(output_buffer_t*); // buffer (waiting data are lost: flush it first)
+
+void output_buffer_set_fd(output_buffer_t*,int); // buffer, file descriptor - Buffer must be empty
+void output_buffer_set_write_back(output_buffer_t*,uint64_t,uint64_t); // buffer, bytes to preallocate for each file (0: none), writeback chunk size (0: none)
+
+int output_buffer_write(output_buffer_t*,const void*,size_t,uint32_t); // buffer, data, size, number of events in data - Return 0 if OK, -1 if error
+int output_buffer_writev(output_buffer_t*,const struct iovec*,int,uint32_t); // buffer, vector, vector count, number of events - Return 0 if OK, -1 if error
+int output_buffer_flush(output_buffer_t*); // buffer - Write all waiting data. Return 0 if OK, -1 if error
+int output_buffer_poll(output_buffer_t*); // buffer - Flush if max_delay expired. Return 0 if OK, -1 if error
+int output_buffer_end_file(output_buffer_t*); // buffer - Flush and release unused space of the file before it is closed. Return 0 if OK, -1 if error
+
+void output_buffer_report(output_buffer_t*,const char*); // buffer, name - Print statistics
+
+#endif
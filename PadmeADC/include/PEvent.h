@@ -1,6 +1,8 @@
 #ifndef _PEVENT_H_
 #define _PEVENT_H_
 
+#include "DRS4.h"
+
 // Version 0: native CAEN V1742 raw event structure: data are unscrabled and uncorrected
 //     Use NewDecode software to read, unscrable, correct, and write to root ntuple
 // Version 1: used for all data taken after June 21, 2015. Use PadmeDigi to read them.
@@ -24,12 +26,14 @@
 #define PEVT_CHMASK_ACCEPTED_LINE 5
 
 #define PEVT_STATUS_HASDATA_BIT  0
-#define PEVT_STATUS_DRS4CORR_BIT 1
+#define PEVT_STATUS_DRS4CORR_BIT 1 // Time corrections are not included with decode_mode NATIVE (see DRS4.h)
 #define PEVT_STATUS_ZEROSUPP_BIT 2
 #define PEVT_STATUS_MISSING_BIT  3
 #define PEVT_STATUS_AUTOPASS_BIT 4
 
-int create_pevent(void*,CAEN_DGTZ_X742_EVENT_t*,void*); // evtPtr, event, pEvt
+int create_pevent(void*,CAEN_DGTZ_X742_EVENT_t*,void*,int); // evtPtr, event, pEvt, board id
+int create_pevent_native(void*,void*,int,const drs4_table_t*); // evtPtr, pEvt, board id, DRS4 correction tables (NULL: no corrections)
+int create_pevent_missing(void*,void*,int); // evtPtr, pEvt, board id
 unsigned int create_file_head(unsigned int,int,int,uint32_t,time_t,void*); // file_index,run_number,board_id,board_sn,time_tag,fHead
 unsigned int create_file_tail(unsigned int,unsigned long int,time_t,void*); // n_events,file_size,time_tag,fTail
 
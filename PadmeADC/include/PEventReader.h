@@ -0,0 +1,100 @@
+#ifndef _PEVENTREADER_H_
+#define _PEVENTREADER_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "StreamReader.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Reader of PEvent files and streams, as written by create_file_head(), create_pevent() and create_file_tail().
+// Regular files are mapped in memory, FIFOs and other streams are read into a refill buffer (see StreamReader.h):
+// in both cases events are not copied and pevent_reader_next() returns a view pointing to the data in place.
+// The view of an event stays valid until the next call to pevent_reader_next() (streams) or until the reader is
+// closed (mapped files). While a mapped file is scanned, the pages ahead of the current event are requested from
+// the kernel in windows of readahead bytes.
+// Every record is checked before its view is returned: event size and structure of groups and channels must be
+// consistent, and the event count and size reported by each file tail must match the data read after its head.
+// A stream can hold several files one after the other.
+
+#define PEVENT_READER_BUFFER    (4*1024*1024) // Refill buffer for streams: must hold the largest event
+#define PEVENT_READER_READAHEAD (8*1024*1024) // Readahead window for mapped files
+#define PEVENT_READER_MAX_GROUPS   4
+#define PEVENT_READER_MAX_CHANNELS 32
+
+typedef struct pevent_group_s {
+  const uint32_t* head;     // Group header: start index cell (bit 22-31), frequency (bit 20-21), trigger (bit 19), size (bit 0-11)
+  const int16_t* trigger;   // Trigger samples (NULL if not recorded)
+  unsigned int n_trigger;   // Number of trigger samples (rounded up to an even number)
+  uint32_t time_tag;        // Group trigger time tag
+} pevent_group_t;
+
+typedef struct pevent_view_s {
+
+  const uint32_t* data;     // Event in place (header line 0)
+  uint32_t size;            // Event size in bytes
+  uint64_t offset;          // Offset of the event in the file or stream
+
+  // Header fields
+  uint32_t board_id;        // Line 1, bit 24-31
+  uint32_t lvds;            // Line 1, bit 8-23
+  uint32_t zsup_algr;       // Line 1, bit 4-7
+  uint32_t group_mask;      // Line 1, bit 0-3
+  uint32_t counter;         // Line 2, bit 0-21
+  uint32_t status;          // Line 2, bit 22-31 (see PEVT_STATUS_* in PEvent.h)
+  uint32_t time_tag;        // Line 3
+  uint32_t active_mask;     // Line 4
+  uint32_t accepted_mask;   // Line 5
+  uint32_t present_mask;    // Channels with samples in the event (active channels if zero suppression used flagging)
+
+  // Groups and channels
+  unsigned int n_groups;
+  pevent_group_t group[PEVENT_READER_MAX_GROUPS]; // Groups present, in order
+  unsigned int n_samples;   // Samples of each channel (rounded up to an even number)
+  const int16_t* channel[PEVENT_READER_MAX_CHANNELS]; // Samples of each channel (NULL if not present)
+
+} pevent_view_t;
+
+typedef struct pevent_file_head_s {
+  unsigned int version;
+  unsigned int index;
+  int run_number;
+  uint32_t board_id;
+  uint32_t board_sn;
+  uint32_t time;            // Start of file (seconds)
+} pevent_file_head_t;
+
+typedef struct pevent_reader_s {
+
+  stream_reader_t* in;
+  uint64_t offset;          // Offset of the next record
+  size_t pending;           // Size of the last event returned, consumed at the next call
+  size_t readahead;         // Readahead window for mapped files (0: none)
+  size_t ra_next;           // Offset at which the next window is requested
+
+  pevent_file_head_t head;  // Head of the current file
+  int in_file;              // A head was read and its tail was not
+  uint64_t file_start;      // Offset of the head of the current file
+  uint64_t file_events;     // Events read since the head
+
+  // Statistics
+  uint64_t n_files;         // Complete files (head and tail) read
+  uint64_t n_events;
+  uint64_t n_bytes;         // Bytes of all records
+  uint64_t n_readahead;     // Readahead requests
+
+} pevent_reader_t;
+
+pevent_reader_t* pevent_reader_open(const char*,size_t,size_t); // path, refill buffer size for streams (0: PEVENT_READER_BUFFER), readahead window for mapped files (0: none) - Return NULL if error
+void pevent_reader_close(pevent_reader_t*); // reader
+int pevent_reader_next(pevent_reader_t*,pevent_view_t*); // reader, view of next event (output) - Return 1 if an event was read, 0 at end of data, -1 if error
+int pevent_reader_mapped(pevent_reader_t*); // reader - Return 1 if the file is mapped in memory, 0 if it is read as a stream
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
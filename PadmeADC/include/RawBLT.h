@@ -0,0 +1,33 @@
+#ifndef _RAWBLT_H_
+#define _RAWBLT_H_
+
+#include <stdint.h>
+#include <time.h>
+
+// Raw BLT file format written in DAQRAW process mode
+//
+// File head (4 words): same as PEvent file head but with RAW_FHEAD_TAG and RAW_CURRENT_VERSION
+// For each CAEN_DGTZ_ReadData buffer:
+//   BLT header (6 words):
+//     0: BLT tag (bit 28-31) + total size of BLT record in 4 bytes words, including header (bit 0-27)
+//     1: board id (bit 24-31) + board serial number (bit 0-23)
+//     2: size of raw data in bytes
+//     3: number of V1742 events contained in raw data
+//     4-5: host time of readout in usecs since the epoch (64 bits)
+//   raw data: buffer returned by CAEN_DGTZ_ReadData (sequence of V1742 raw events)
+// File tail (4 words): same as PEvent file tail (number of events counts V1742 events)
+//
+// Use PadmeRaw2PEvent to convert raw BLT files to PEvent files
+
+#define RAW_CURRENT_VERSION 1
+
+#define RAW_FHEAD_TAG 0x8
+#define RAW_BLT_TAG   0xB
+
+#define RAW_FHEAD_LEN      4
+#define RAW_BLT_HEADER_LEN 6
+
+unsigned int create_raw_file_head(unsigned int,int,int,uint32_t,time_t,void*); // file_index,run_number,board_id,board_sn,time_tag,fHead
+unsigned int create_raw_blt_header(uint32_t,uint32_t,int,uint32_t,uint64_t,void*); // read_size,n_events,board_id,board_sn,time_usec,bHead
+
+#endif
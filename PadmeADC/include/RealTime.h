@@ -0,0 +1,13 @@
+#ifndef _REALTIME_H_
+#define _REALTIME_H_
+
+#include <stddef.h>
+
+// Settings used to reduce the scheduling and paging jitter of the readout loop.
+// All functions report any setting which could not be applied and the most likely reason.
+
+int rt_set_thread(const char*,int,int); // thread name, cpu (-1: no pinning), SCHED_FIFO priority (0: normal scheduling) - Return number of settings not applied
+void rt_prefault(void*,size_t); // buffer, size - Touch each page of buffer so that no page fault happens later
+int rt_lock_memory(); // Lock all pages currently mapped by the process in RAM - Return 0 if OK, 1 if error
+
+#endif
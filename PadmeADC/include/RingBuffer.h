@@ -0,0 +1,58 @@
+#ifndef _RINGBUFFER_H_
+#define _RINGBUFFER_H_
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+// Single-producer/single-consumer ring of preallocated readout buffers.
+// The producer (readout loop) fills one slot with each CAEN_DGTZ_ReadData call,
+// the consumer (writer thread) decodes, formats, and writes the events it contains.
+// Slot buffers are allocated and freed by the user of the ring.
+// The number of slots is a power of 2, so that the free running counters select
+// the right slot also when they wrap around.
+
+typedef struct ring_slot_s {
+  char* data;       // Buffer holding the raw BLT data
+  uint32_t size;    // Number of bytes stored in the buffer
+  uint32_t nevents; // Number of events stored in the buffer
+  uint64_t time;    // Host time of readout in usecs (only set in DAQRAW mode)
+} ring_slot_t;
+
+typedef struct ring_s {
+
+  unsigned int n_slots; // Number of slots in the ring (power of 2)
+  unsigned int mask;    // n_slots-1: slot index of a counter
+  ring_slot_t* slot;    // Array of slots
+
+  // Free running counters of filled (head) and released (tail) slots
+  atomic_uint head;
+  atomic_uint tail;
+
+  // Statistics (only updated by the producer)
+  unsigned int max_used;     // Maximum number of slots in use
+  uint64_t n_pushed_blt;     // Number of BLT buffers sent to the consumer
+  uint64_t n_dropped_blt;    // Number of BLT buffers dropped because ring was full
+  uint64_t n_dropped_events; // Number of events contained in dropped BLT buffers
+
+  // Overload detection (only updated by the consumer)
+  unsigned int overload_level; // Occupancy (% of slots) above which the ring is overloaded (0: not checked)
+  int overload;                // Set while the ring is overloaded
+  uint64_t n_overloads;        // Number of times the ring became overloaded
+
+} ring_t;
+
+ring_t* ring_create(unsigned int); // number of slots (rounded up to a power of 2)
+void ring_destroy(ring_t*); // ring
+
+ring_slot_t* ring_write_slot(ring_t*); // ring - Return next free slot or NULL if ring is full
+void ring_push(ring_t*); // ring - Hand slot returned by ring_write_slot to consumer
+
+ring_slot_t* ring_read_slot(ring_t*); // ring - Return oldest filled slot or NULL if ring is empty
+void ring_pop(ring_t*); // ring - Give slot returned by ring_read_slot back to producer
+
+unsigned int ring_used(ring_t*); // ring - Return number of filled slots
+
+void ring_set_overload_level(ring_t*,unsigned int); // ring, occupancy level (% of slots, 0: not checked)
+int ring_check_overload(ring_t*); // ring - Update overload state (consumer side). Return 1 while ring is overloaded
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef _SHMRING_H_
+#define _SHMRING_H_
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+// Single-producer/single-consumer ring of variable size records shared between two processes.
+// The ring lives in a file mapped in memory by both processes (use a file on tmpfs, e.g. in /dev/shm,
+// so that data never reach a disk). Each record is stored contiguously in the ring, preceded by
+// its length, so that the consumer can process it in place. When a side has to wait for the
+// other (ring empty or full) it sleeps on a futex and is woken up when the other side moves.
+
+#define SHM_RING_MAGIC   0x50524E47 // "PRNG"
+#define SHM_RING_VERSION 1
+
+// Shared control block, stored in the first page of the mapped file
+// Counters of written (head) and released (tail) bytes are free running
+typedef struct shm_ring_ctrl_s {
+
+  uint32_t magic;   // Set by the producer when the ring is ready
+  uint32_t version;
+  uint32_t size;    // Size in bytes of the data area
+  atomic_uint closed; // Set by the producer when no more records will be written
+
+  // Producer side
+  atomic_ullong head __attribute__ ((aligned (64)));
+  atomic_uint head_seq; // Futex word: changes each time head moves
+  atomic_uint prod_wait; // Set while producer waits for space
+
+  // Consumer side
+  atomic_ullong tail __attribute__ ((aligned (64)));
+  atomic_uint tail_seq; // Futex word: changes each time tail moves
+  atomic_uint cons_wait; // Set while consumer waits for data
+
+} shm_ring_ctrl_t;
+
+typedef struct shm_ring_s {
+
+  shm_ring_ctrl_t* ctrl; // Control block
+  char* data;            // Data area
+  uint32_t size;         // Size of data area
+  size_t map_size;       // Size of mapped region
+  int fd;
+  int producer;          // 1: producer side, 0: consumer side
+
+  uint64_t pos;     // Position of the next record (head for producer, tail for consumer)
+  uint32_t rec_len; // Space used by the record currently reserved (producer) or read (consumer)
+
+  // Statistics
+  uint64_t n_records; // Records written or read
+  uint64_t n_waits;   // Times the ring was full (producer) or empty (consumer)
+
+} shm_ring_t;
+
+shm_ring_t* shm_ring_create(const char*,uint32_t); // path, size of data area - Return NULL if error
+shm_ring_t* shm_ring_open(const char*); // path - Return NULL if ring does not exist or is not ready yet
+void shm_ring_close(shm_ring_t*); // ring - Producer also tells consumer that no more records will come
+
+char* shm_ring_reserve(shm_ring_t*,uint32_t,int); // ring, record length, timeout (ms, -1: forever) - Return NULL if no space
+void shm_ring_commit(shm_ring_t*); // ring - Hand record returned by shm_ring_reserve to consumer
+int shm_ring_write(shm_ring_t*,const void*,uint32_t,int); // ring, data, length, timeout - Return 0 if OK, 1 if no space
+
+char* shm_ring_read(shm_ring_t*,uint32_t*,int); // ring, length, timeout (ms, -1: forever) - Return NULL if no record (length set to 0 if ring is closed)
+void shm_ring_release(shm_ring_t*); // ring - Give record returned by shm_ring_read back to producer
+
+#endif
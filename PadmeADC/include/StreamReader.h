@@ -0,0 +1,40 @@
+#ifndef _STREAMREADER_H_
+#define _STREAMREADER_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+
+// Buffered reader for the input stream of the ZSUP process.
+// Data from a FIFO (or any other non-seekable file) are read with large read() calls into a refill
+// buffer and handed out as pointers into it: reads returning less data than requested are normal
+// and are simply continued. When the input is a FIFO, the pipe buffer is also enlarged.
+// Regular files (offline processing) are mapped in memory and handed out in place.
+
+typedef struct stream_reader_s {
+
+  int fd;
+  int mapped;     // 1: file is mapped in memory, 0: data are read into buffer
+
+  char* data;     // Mapped file or refill buffer
+  size_t size;    // Size of mapped file or of refill buffer
+  size_t head;    // Position of first unused byte
+  size_t tail;    // End of valid data (refill buffer only)
+
+  int eof;        // End of stream reached
+  int error;      // errno of failed read (0 if none)
+
+  // Statistics
+  uint64_t n_bytes;   // Bytes handed out
+  uint64_t n_reads;   // read() calls
+  uint64_t n_short;   // read() calls which returned less data than needed
+  uint64_t n_compact; // Times unused data were moved to the beginning of the buffer
+
+} stream_reader_t;
+
+stream_reader_t* stream_reader_open(const char*,size_t,int); // path, size of refill buffer, pipe size (0: leave it) - Return NULL if error
+void stream_reader_close(stream_reader_t*); // reader
+
+char* stream_reader_peek(stream_reader_t*,size_t); // reader, length - Return pointer to next length bytes (NULL if end of stream or error)
+void stream_reader_skip(stream_reader_t*,size_t); // reader, length - Consume bytes returned by stream_reader_peek. Data stay valid until next peek
+
+#endif
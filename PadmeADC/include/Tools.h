@@ -8,6 +8,7 @@ int create_initok_file(); // Function to create initok control file
 int create_initfail_file(); // Function to create initfail control file
 
 int generate_filename(char*,const time_t); // Function to add time tag to file name
+int generate_board_filename(char*,int,const time_t); // Function to add board id and time tag to file name
 char* format_time(const time_t time); // Function to format time tags
 
 #endif
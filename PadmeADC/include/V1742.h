@@ -0,0 +1,39 @@
+#ifndef _V1742_H_
+#define _V1742_H_
+
+#include <stdint.h>
+
+// Layout of the raw V1742 event as read from the board
+//
+// Event header (4 words):
+//   0: tag 0xA (bit 28-31) + event size in 4 bytes words (bit 0-27)
+//   1: board id (bit 27-31) + board fail (bit 26) + LVDS pattern (bit 8-23) + group mask (bit 0-3)
+//   2: event counter (bit 0-21)
+//   3: event time tag
+// For each group present in the group mask:
+//   group header: start index cell (bit 20-29) + frequency (bit 16-17) + trigger flag (bit 12) + channel data size (bit 0-11)
+//   channel data: 8 channels x nSm 12 bits samples. Each 3 words hold one sample of each of the 8 channels
+//   trigger data (if trigger flag is set): nSm 12 bits samples. Each 3 words hold 8 consecutive samples
+//   group trigger time tag (bit 0-29)
+
+#define V1742_EVT_HEADER_LEN 4
+
+#define V1742_GRP_SIC(line)  (((line) >> 20) & 0x3FF)
+#define V1742_GRP_FREQ(line) (((line) >> 16) & 0x3)
+#define V1742_GRP_TR(line)   (((line) >> 12) & 0x1)
+#define V1742_GRP_SIZE(line) ((line) & 0xFFF)
+
+// Unpacking kernels are selected at runtime according to the instructions supported by the cpu:
+// "ssse3" on x86, "neon" on ARM (if enabled with SIMDFLAGS in the Makefile), "scalar" otherwise.
+void V1742_init(); // Select fastest kernels supported by the cpu (and check them against the scalar ones)
+int V1742_select(const char*); // kernels name - Return 0 if OK, 1 if not supported or not exact
+const char* V1742_unpack_kernel(); // Name of unpacking kernel in use
+
+void V1742_unpack_channels(const uint32_t*,unsigned int,int16_t**); // channel data, n samples, 8 output channels
+void V1742_unpack_trigger(const uint32_t*,unsigned int,int16_t*); // trigger data, n samples, output trigger
+
+// Scalar kernels, used as reference for the vector ones (see tools/V1742Bench.c)
+void V1742_unpack_channels_scalar(const uint32_t*,unsigned int,int16_t**); // channel data, n samples, 8 output channels
+void V1742_unpack_trigger_scalar(const uint32_t*,unsigned int,int16_t*); // trigger data, n samples, output trigger
+
+#endif
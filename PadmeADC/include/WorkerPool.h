@@ -0,0 +1,39 @@
+#ifndef _WORKERPOOL_H_
+#define _WORKERPOOL_H_
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+// Pool of worker threads processing batches of independent items in parallel.
+// The thread calling pool_run takes part in the processing as worker 0 and
+// returns when all items of the batch have been processed, so results stored
+// by item index can then be used in their original order.
+
+typedef int (*pool_func_t)(void*,unsigned int,unsigned int); // context, worker index, item index - Return 0 if OK
+
+typedef struct pool_s {
+
+  unsigned int n_workers; // Number of workers (including the calling thread)
+  pthread_t* thread;      // Worker threads 1..n_workers-1
+
+  pool_func_t func; // Function processing one item
+  void* ctx;        // Context passed to func
+
+  pthread_mutex_t mutex;
+  pthread_cond_t start;     // Signals workers that a new batch is ready
+  pthread_cond_t done;      // Signals caller that all workers finished the batch
+  unsigned int generation;  // Batch counter
+  unsigned int n_active;    // Number of worker threads still processing the current batch
+  int quit;                 // Set to stop worker threads
+
+  unsigned int n_items; // Number of items in current batch
+  atomic_uint next;     // Index of next item to process
+  atomic_int rc;        // First non-zero return code of func in current batch
+
+} pool_t;
+
+pool_t* pool_create(unsigned int,int,pool_func_t,void*); // n_workers, pin workers to cpus (0/1), func, ctx
+int pool_run(pool_t*,unsigned int); // pool, n_items - Return 0 if OK, first error code of func otherwise
+void pool_destroy(pool_t*); // pool
+
+#endif
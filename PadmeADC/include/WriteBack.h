@@ -0,0 +1,43 @@
+#ifndef _WRITEBACK_H_
+#define _WRITEBACK_H_
+
+#include <stdint.h>
+
+#include "Histo.h"
+
+// Page cache control of an output file written sequentially.
+// When a file is started its blocks are preallocated (without changing its size) up to the expected file size,
+// so that the filesystem does not allocate them one write at a time; unused blocks are released on close.
+// Every chunk of written data is sent to the disk with sync_file_range() as soon as it is complete. When the
+// next chunk is complete, the previous one is waited for and dropped from the page cache with posix_fadvise(),
+// so that at most two chunks per file are dirty or cached and writeback never comes in large bursts.
+// Waiting for a chunk also reports the errors of its writeback: the caller must treat them as write errors.
+// Files which are not regular files (e.g. FIFOs) are not touched.
+
+typedef struct write_back_s {
+
+  int fd;            // Current file (-1: none, or not a regular file)
+  uint64_t prealloc; // Bytes to preallocate for each file (0: no preallocation)
+  uint64_t chunk;    // Bytes in each chunk (0: no incremental writeback)
+
+  uint64_t pos;      // Bytes written to the current file
+  uint64_t started;  // Writeback started up to this offset
+  int allocated;     // Current file has preallocated blocks
+  int error;         // errno of first writeback failure of the current file (0 if none)
+
+  // Statistics
+  uint64_t n_files;
+  uint64_t n_prealloc_fail; // Files which could not be preallocated
+  uint64_t n_chunks;        // Chunks written back and dropped from the page cache
+  histo_t h_wait;           // Time waiting for the previous chunk to reach the disk (ns)
+
+} write_back_t;
+
+void write_back_init(write_back_t*,uint64_t,uint64_t); // write back, bytes to preallocate (0: none), chunk size (0: none)
+void write_back_start(write_back_t*,int); // write back, descriptor of new file
+int write_back_written(write_back_t*,uint64_t); // write back, bytes written to file after the previous call - Return 0 if OK, -1 if data could not be written back
+int write_back_end(write_back_t*); // write back - Release unused blocks and start writeback of the rest of the file. Return 0 if OK, -1 if error
+
+void write_back_report(write_back_t*,const char*); // write back, name - Print statistics
+
+#endif
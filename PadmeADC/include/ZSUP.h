@@ -1,9 +1,12 @@
 #ifndef _ZSUP_H_
 #define _ZSUP_H_
 
+#include <sys/uio.h>
+
+// Max number of sections of an output event: event header, trigger groups, and 32 channels
+#define ZSUP_MAX_IOVEC 34
+
 int ZSUP_readdata();
-unsigned int apply_zero_suppression (unsigned int,unsigned int,void *,void *); // flag, algorithm, in buffer, out buffer
-unsigned int zsup_algorithm_1(void *,void *); // in buffer, out buffer
-unsigned int zsup_algorithm_2(unsigned int,void *,void *); // channel, in buffer, out buffer
+unsigned int apply_zero_suppression (unsigned int,unsigned int,void *,void *,struct iovec *,int *); // flag, algorithm, in buffer, out header buffer, out vector, out vector length
 
 #endif
@@ -0,0 +1,16 @@
+#ifndef _ZSUPALGO_H_
+#define _ZSUPALGO_H_
+
+// Zero suppression algorithms applied by the ZSUP process to each 1024-sample channel.
+// The algorithm reads the samples in place and returns 1 if the channel is accepted, 0 if it is rejected.
+// Vector kernels take the same decisions as the scalar ones.
+// The kernels are selected at runtime according to the instructions supported by the cpu.
+
+void zsup_algorithm_init(); // Select fastest kernels supported by the cpu
+int zsup_algorithm_select(const char*); // kernels name ("scalar", "sse2" or "neon", "avx2") - Return 0 if OK, 1 if not supported
+const char* zsup_algorithm_name(); // Return name of the kernels in use
+
+unsigned int zsup_algorithm_1(void *); // channel samples
+unsigned int zsup_algorithm_2(unsigned int,void *); // channel, channel samples
+
+#endif
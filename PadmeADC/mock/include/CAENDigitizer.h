@@ -0,0 +1,151 @@
+#ifndef _CAENDIGITIZER_H_
+#define _CAENDIGITIZER_H_
+
+// Subset of the CAEN Digitizer library API used by PadmeADC, implemented by the mock library
+// in mock/src/CAENDigitizerMock.c. Build PadmeADC with "make CAENDIR=mock" to use it.
+// N.B. only names are compatible with the real library: numeric values of the error codes
+// and of the enumerations are not, so never mix this header with the real library.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#define MAX_X742_CHANNEL_SIZE 9
+#define MAX_X742_GROUP_SIZE   4
+
+#define CAEN_DGTZ_ACQ_STATUS_ADD              0x8104
+#define CAEN_DGTZ_CHANNEL_STATUS_BASE_ADDRESS 0x1088
+
+typedef enum {
+  CAEN_DGTZ_Success            =   0,
+  CAEN_DGTZ_CommError          =  -1,
+  CAEN_DGTZ_GenericError       =  -2,
+  CAEN_DGTZ_InvalidParam       =  -3,
+  CAEN_DGTZ_InvalidHandle      =  -6,
+  CAEN_DGTZ_OutOfMemory        = -10,
+  CAEN_DGTZ_FunctionNotAllowed = -13,
+  CAEN_DGTZ_Timeout            = -14,
+  CAEN_DGTZ_InvalidEvent       = -15,
+  CAEN_DGTZ_NotYetImplemented  = -99
+} CAEN_DGTZ_ErrorCode;
+
+typedef enum { CAEN_DGTZ_USB = 0, CAEN_DGTZ_OpticalLink = 1 } CAEN_DGTZ_ConnectionType;
+typedef enum { CAEN_DGTZ_DISABLE = 0, CAEN_DGTZ_ENABLE = 1 } CAEN_DGTZ_EnaDis_t;
+typedef enum { CAEN_DGTZ_IRQ_MODE_RORA = 0, CAEN_DGTZ_IRQ_MODE_ROAK = 1 } CAEN_DGTZ_IRQMode_t;
+typedef enum { CAEN_DGTZ_SLAVE_TERMINATED_READOUT_MBLT = 0, CAEN_DGTZ_SLAVE_TERMINATED_READOUT_2eVME = 1 } CAEN_DGTZ_ReadMode_t;
+typedef enum { CAEN_DGTZ_SW_CONTROLLED = 0, CAEN_DGTZ_S_IN_CONTROLLED = 1, CAEN_DGTZ_FIRST_TRG_CONTROLLED = 2 } CAEN_DGTZ_AcqMode_t;
+typedef enum {
+  CAEN_DGTZ_TRGMODE_DISABLED = 0,
+  CAEN_DGTZ_TRGMODE_ACQ_ONLY = 1,
+  CAEN_DGTZ_TRGMODE_EXTOUT_ONLY = 2,
+  CAEN_DGTZ_TRGMODE_ACQ_AND_EXTOUT = 3
+} CAEN_DGTZ_TriggerMode_t;
+typedef enum { CAEN_DGTZ_IOLevel_NIM = 0, CAEN_DGTZ_IOLevel_TTL = 1 } CAEN_DGTZ_IOLevel_t;
+typedef enum { CAEN_DGTZ_TriggerOnRisingEdge = 0, CAEN_DGTZ_TriggerOnFallingEdge = 1 } CAEN_DGTZ_TriggerPolarity_t;
+typedef enum { CAEN_DGTZ_DRS4_5GHz = 0, CAEN_DGTZ_DRS4_2_5GHz = 1, CAEN_DGTZ_DRS4_1GHz = 2, CAEN_DGTZ_DRS4_750MHz = 3 } CAEN_DGTZ_DRS4Frequency_t;
+
+typedef struct {
+  char     ModelName[12];
+  uint32_t Model;
+  uint32_t Channels;
+  uint32_t FormFactor;
+  uint32_t FamilyCode;
+  char     ROC_FirmwareRel[20];
+  char     AMC_FirmwareRel[40];
+  uint32_t SerialNumber;
+  char     MezzanineSerNum[4][8];
+  uint32_t PCB_Revision;
+  uint32_t ADC_NBits;
+  uint32_t SAMCorrectionDataLoaded;
+  int      CommHandle;
+  int      VMEHandle;
+  char     License[17];
+} CAEN_DGTZ_BoardInfo_t;
+
+typedef struct {
+  uint32_t EventSize;
+  uint32_t BoardId;
+  uint32_t Pattern;
+  uint32_t ChannelMask;
+  uint32_t EventCounter;
+  uint32_t TriggerTimeTag;
+} CAEN_DGTZ_EventInfo_t;
+
+typedef struct {
+  uint32_t ChSize[MAX_X742_CHANNEL_SIZE];      // the number of samples stored in DataChannel array
+  float   *DataChannel[MAX_X742_CHANNEL_SIZE]; // the array of ChSize samples
+  uint32_t TriggerTimeTag;
+  uint16_t StartIndexCell;
+} CAEN_DGTZ_X742_GROUP_t;
+
+typedef struct {
+  uint8_t                GrPresent[MAX_X742_GROUP_SIZE]; // If the group has data the value is 1 otherwise is 0
+  CAEN_DGTZ_X742_GROUP_t DataGroup[MAX_X742_GROUP_SIZE]; // the array of ChSize samples
+} CAEN_DGTZ_X742_EVENT_t;
+
+typedef struct {
+  int16_t cell[MAX_X742_CHANNEL_SIZE][1024];
+  int8_t  nsample[MAX_X742_CHANNEL_SIZE][1024];
+  float   time[1024];
+} CAEN_DGTZ_DRS4Correction_t;
+
+// Connection and board information
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_OpenDigitizer(CAEN_DGTZ_ConnectionType,int,int,uint32_t,int*); // link type, link, node, VME base address, handle
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_CloseDigitizer(int); // handle
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_GetInfo(int,CAEN_DGTZ_BoardInfo_t*); // handle, board info
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_Reset(int); // handle
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_ClearData(int); // handle
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_WriteRegister(int,uint32_t,uint32_t); // handle, address, data
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_ReadRegister(int,uint32_t,uint32_t*); // handle, address, data
+
+// Interrupts
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_SetInterruptConfig(int,CAEN_DGTZ_EnaDis_t,uint8_t,uint32_t,uint16_t,CAEN_DGTZ_IRQMode_t); // handle, state, level, status id, n events, mode
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_GetInterruptConfig(int,CAEN_DGTZ_EnaDis_t*,uint8_t*,uint32_t*,uint16_t*,CAEN_DGTZ_IRQMode_t*); // handle, state, level, status id, n events, mode
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_IRQWait(int,uint32_t); // handle, timeout (ms)
+
+// Acquisition and readout
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_SetAcquisitionMode(int,CAEN_DGTZ_AcqMode_t); // handle, mode
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_SWStartAcquisition(int); // handle
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_SWStopAcquisition(int); // handle
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_SetMaxNumEventsBLT(int,uint32_t); // handle, n events
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_GetMaxNumEventsBLT(int,uint32_t*); // handle, n events
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_MallocReadoutBuffer(int,char**,uint32_t*); // handle, buffer, size
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_FreeReadoutBuffer(char**); // buffer
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_ReadData(int,CAEN_DGTZ_ReadMode_t,char*,uint32_t*); // handle, mode, buffer, size
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_GetNumEvents(int,char*,uint32_t,uint32_t*); // handle, buffer, size, n events
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_GetEventInfo(int,char*,uint32_t,int32_t,CAEN_DGTZ_EventInfo_t*,char**); // handle, buffer, size, event index, info, event pointer
+
+// Event decoding
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_AllocateEvent(int,void**); // handle, event
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_FreeEvent(int,void**); // handle, event
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_DecodeEvent(int,char*,void**); // handle, event pointer, event
+
+// Board configuration
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_SetRecordLength(int,uint32_t); // handle, n samples
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_GetRecordLength(int,uint32_t*); // handle, n samples
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_SetChannelDCOffset(int,uint32_t,uint32_t); // handle, channel, offset
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_GetChannelDCOffset(int,uint32_t,uint32_t*); // handle, channel, offset
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_SetPostTriggerSize(int,uint32_t); // handle, percent
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_GetPostTriggerSize(int,uint32_t*); // handle, percent
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_SetSWTriggerMode(int,CAEN_DGTZ_TriggerMode_t); // handle, mode
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_SetExtTriggerInputMode(int,CAEN_DGTZ_TriggerMode_t); // handle, mode
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_SetFastTriggerMode(int,CAEN_DGTZ_TriggerMode_t); // handle, mode
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_SetFastTriggerDigitizing(int,CAEN_DGTZ_EnaDis_t); // handle, state
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_SetIOLevel(int,CAEN_DGTZ_IOLevel_t); // handle, level
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_SetTriggerPolarity(int,uint32_t,CAEN_DGTZ_TriggerPolarity_t); // handle, channel, polarity
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_GetTriggerPolarity(int,uint32_t,CAEN_DGTZ_TriggerPolarity_t*); // handle, channel, polarity
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_SetGroupFastTriggerDCOffset(int,uint32_t,uint32_t); // handle, group, offset
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_GetGroupFastTriggerDCOffset(int,uint32_t,uint32_t*); // handle, group, offset
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_SetGroupFastTriggerThreshold(int,uint32_t,uint32_t); // handle, group, threshold
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_GetGroupFastTriggerThreshold(int,uint32_t,uint32_t*); // handle, group, threshold
+
+// DRS4 sampling frequency and corrections
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_SetDRS4SamplingFrequency(int,CAEN_DGTZ_DRS4Frequency_t); // handle, frequency
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_GetDRS4SamplingFrequency(int,CAEN_DGTZ_DRS4Frequency_t*); // handle, frequency
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_LoadDRS4CorrectionData(int,CAEN_DGTZ_DRS4Frequency_t); // handle, frequency
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_GetCorrectionTables(int,int,void*); // handle, frequency, tables
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_EnableDRS4Correction(int); // handle
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_DisableDRS4Correction(int); // handle
+
+#endif
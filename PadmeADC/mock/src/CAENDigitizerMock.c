@@ -0,0 +1,767 @@
+// Mock implementation of the subset of the CAEN Digitizer library used by PadmeADC
+//
+// Each opened handle simulates a V1742 board with its own memory, registers, and DRS4 correction tables.
+// Triggers arrive at a fixed rate and are stored in the board memory (events exceeding the memory
+// depth are lost, as on the real board) until they are read with CAEN_DGTZ_ReadData.
+// Events are either synthesized (a pool of random events is generated when acquisition starts)
+// or replayed from a raw BLT file written by PadmeADC in DAQRAW process mode.
+//
+// The mock is configured with these environment variables:
+//   MOCK_TRIGGER_RATE  trigger rate in Hz (default 100). If 0, the board memory is always full,
+//                      i.e. events are produced as fast as PadmeADC can read them
+//   MOCK_TRIGGER_BURST bursty trigger pattern "on,off" (msecs): triggers arrive at MOCK_TRIGGER_RATE
+//                      for on msecs, then stop for off msecs (default: no bursts)
+//   MOCK_BOARD_MEMORY  depth of the board memory in events (default 128 as for V1742, 1024 for V1742B)
+//   MOCK_REPLAY_FILE   raw BLT file to replay (events are read in a loop)
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "CAENDigitizer.h"
+
+#include "RawBLT.h"
+
+#define MOCK_MAX_BOARDS 64
+
+// Number of events in the pool of synthetic events of each board
+#define MOCK_POOL_EVENTS 64
+
+// Max size of a V1742 event in 4 bytes words (header + 4 groups with 1024 samples and trigger)
+#define MOCK_MAX_EVENT_WORDS (4+4*(1+3072+384+1))
+
+// Serial number of the board with handle 0
+#define MOCK_SERIAL_NUMBER 1000
+
+typedef struct mock_board_s {
+
+  int open;
+  int running;
+  double t_start;     // Time of start of acquisition
+  uint64_t n_trig;    // Triggers read or lost since start of acquisition
+  uint64_t n_read;    // Events read since start of acquisition
+  uint64_t n_lost;    // Events lost because board memory was full
+
+  // Registers and settings
+  uint32_t group_mask;
+  uint32_t max_blt;
+  uint32_t record_length;
+  int freq;
+  int drs4corr;
+  uint32_t irq_events;
+  uint32_t seed;
+
+  CAEN_DGTZ_DRS4Correction_t corr[MAX_X742_GROUP_SIZE];
+
+  // Pool of synthetic events (generated at start of acquisition)
+  uint32_t* pool;
+  uint32_t pool_offset[MOCK_POOL_EVENTS];
+  uint32_t pool_group_mask; // Group mask used to generate the pool
+
+} mock_board_t;
+
+static mock_board_t Board[MOCK_MAX_BOARDS];
+static int NOpen = 0;
+
+// Global settings (read from environment at first connection)
+static double TriggerRate = 100.;
+static double BurstOn = 0.;  // Duration of trigger bursts (secs, 0: no bursts)
+static double BurstOff = 0.; // Time between trigger bursts (secs)
+static uint32_t BoardMemory = 128;
+
+// Events to replay (shared by all boards)
+static char* ReplayData = NULL;
+static uint32_t** ReplayEvent = NULL;
+static uint32_t NReplayEvents = 0;
+
+static double mock_now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return ts.tv_sec+1e-9*ts.tv_nsec;
+}
+
+static uint32_t mock_rand(mock_board_t* b)
+{
+  b->seed = b->seed*1103515245+12345;
+  return (b->seed >> 16) & 0x7FFF;
+}
+
+static mock_board_t* mock_board(int handle)
+{
+  if (handle < 0 || handle >= NOpen || ! Board[handle].open) return NULL;
+  return &Board[handle];
+}
+
+// Time (secs) during which triggers were arriving since start of acquisition
+static double mock_trigger_time(mock_board_t* b)
+{
+  double t = mock_now()-b->t_start;
+  double nPeriods,tPeriod;
+  if (BurstOn <= 0.) return t;
+  nPeriods = (double)(uint64_t)(t/(BurstOn+BurstOff));
+  tPeriod = t-nPeriods*(BurstOn+BurstOff);
+  return nPeriods*BurstOn+(tPeriod < BurstOn ? tPeriod : BurstOn);
+}
+
+// Number of events waiting in board memory
+static uint32_t mock_pending(mock_board_t* b)
+{
+  uint64_t nTot;
+  if (! b->running) return 0;
+  if (TriggerRate <= 0.) return BoardMemory;
+  nTot = (uint64_t)(mock_trigger_time(b)*TriggerRate);
+  if (nTot-b->n_trig > BoardMemory) {
+    b->n_lost += nTot-b->n_trig-BoardMemory;
+    b->n_trig = nTot-BoardMemory;
+  }
+  return (uint32_t)(nTot-b->n_trig);
+}
+
+// Pack 8 samples of 12 bits into 3 words
+static void mock_pack(uint32_t* w, const uint16_t* s)
+{
+  w[0] = (s[0] & 0xFFF) | ((s[1] & 0xFFF) << 12) | ((uint32_t)(s[2] & 0x0FF) << 24);
+  w[1] = ((s[2] >> 8) & 0x00F) | ((s[3] & 0xFFF) << 4) | ((uint32_t)(s[4] & 0xFFF) << 16) | ((uint32_t)(s[5] & 0x00F) << 28);
+  w[2] = ((s[5] >> 4) & 0x0FF) | ((s[6] & 0xFFF) << 8) | ((uint32_t)(s[7] & 0xFFF) << 20);
+}
+
+// Generate one event with noise on all channels, a pulse on one channel of each group,
+// and a trigger signal. Return event size in words
+// DRS4 spikes common to all channels and trigger of a group are added (a one sample spike, a two samples spike,
+// and in some events spikes at the first and last samples), together with a common negative step which does not
+// recover and must be left alone by the peak correction
+static uint32_t mock_event(mock_board_t* b, int handle, uint32_t* w)
+{
+
+  uint32_t n = 4;
+  uint32_t iGr,iSm,iCh,sic,pos;
+  uint16_t s[8];
+  int16_t common[1024];
+
+  w[1] = ((uint32_t)handle << 27) | (b->group_mask & 0xF);
+  w[2] = 0;
+  w[3] = 0;
+  for (iGr=0;iGr<MAX_X742_GROUP_SIZE;iGr++) {
+    if ( ! (b->group_mask & (1 << iGr)) ) continue;
+    sic = mock_rand(b)%1024;
+    w[n++] = (sic << 20) | (b->freq << 16) | (1 << 12) | 3072;
+    memset(common,0,sizeof(common));
+    common[10+mock_rand(b)%300] = -200;
+    pos = 400+mock_rand(b)%300;
+    common[pos] = common[pos+1] = -200;
+    pos = 750+mock_rand(b)%200;
+    for (iSm=pos;iSm<pos+40;iSm++) common[iSm] = -200;
+    if (mock_rand(b)%4 == 0) common[1] = -200;
+    if (mock_rand(b)%4 == 0) common[1023] = -200;
+    for (iSm=0;iSm<1024;iSm++) {
+      for (iCh=0;iCh<8;iCh++) {
+	s[iCh] = 3900 + common[iSm] + mock_rand(b)%20 - ( (iCh == (iGr+w[2])%8 && iSm > 300 && iSm < 340) ? 800 : 0 );
+      }
+      mock_pack(&w[n],s);
+      n += 3;
+    }
+    for (iSm=0;iSm<128;iSm++) {
+      for (iCh=0;iCh<8;iCh++) s[iCh] = common[iSm*8+iCh] + ( (iSm*8+iCh > 200 && iSm*8+iCh < 260) ? 0x100 : 0xC00 );
+      mock_pack(&w[n],s);
+      n += 3;
+    }
+    w[n++] = 0;
+  }
+  w[0] = (0xA << 28) | n;
+  return n;
+
+}
+
+// Generate the pool of synthetic events for the current group mask. Return 0 if OK, 1 if error
+static int mock_fill_pool(mock_board_t* b, int handle)
+{
+
+  uint32_t i,n = 0;
+
+  if (b->pool && b->pool_group_mask == b->group_mask) return 0;
+  free(b->pool);
+  b->pool = (uint32_t*)malloc(MOCK_POOL_EVENTS*MOCK_MAX_EVENT_WORDS*4);
+  if (b->pool == NULL) return 1;
+  for (i=0;i<MOCK_POOL_EVENTS;i++) {
+    b->pool_offset[i] = n;
+    n += mock_event(b,handle,b->pool+n);
+  }
+  b->pool_group_mask = b->group_mask;
+  return 0;
+
+}
+
+// Load all events of a raw BLT file. Return 0 if OK, 1 if error
+static int mock_load_replay(const char* fileName)
+{
+
+  int fd;
+  struct stat st;
+  ssize_t n;
+  uint32_t *w,*end;
+  uint32_t bltSize,bltEnd,maxEvents;
+
+  fd = open(fileName,O_RDONLY);
+  if (fd == -1 || fstat(fd,&st) == -1) {
+    printf("CAENDigitizerMock - ERROR - Unable to open replay file '%s'\n",fileName);
+    return 1;
+  }
+  ReplayData = (char*)malloc(st.st_size);
+  if (ReplayData == NULL || (n = read(fd,ReplayData,st.st_size)) != st.st_size) {
+    printf("CAENDigitizerMock - ERROR - Unable to read replay file '%s'\n",fileName);
+    close(fd);
+    return 1;
+  }
+  close(fd);
+
+  w = (uint32_t*)ReplayData;
+  end = w+st.st_size/4;
+  if ( st.st_size < RAW_FHEAD_LEN*4 || (w[0] >> 28) != RAW_FHEAD_TAG ) {
+    printf("CAENDigitizerMock - ERROR - File '%s' is not a raw BLT file\n",fileName);
+    return 1;
+  }
+  w += RAW_FHEAD_LEN;
+
+  // Each event is at least 4 words long
+  maxEvents = st.st_size/16;
+  ReplayEvent = (uint32_t**)malloc(maxEvents*sizeof(uint32_t*));
+  if (ReplayEvent == NULL) return 1;
+
+  // Index all V1742 events contained in the BLT records
+  while ( w+RAW_BLT_HEADER_LEN <= end && (w[0] >> 28) == RAW_BLT_TAG ) {
+    bltSize = w[2];
+    w += RAW_BLT_HEADER_LEN;
+    if (w+bltSize/4 > end) break;
+    bltEnd = bltSize/4;
+    n = 0;
+    while (n < bltEnd && (w[n] >> 28) == 0xA && (w[n] & 0x0FFFFFFF) > 0) {
+      ReplayEvent[NReplayEvents++] = w+n;
+      n += w[n] & 0x0FFFFFFF;
+    }
+    w += bltEnd;
+  }
+  if (NReplayEvents == 0) {
+    printf("CAENDigitizerMock - ERROR - No events found in replay file '%s'\n",fileName);
+    return 1;
+  }
+  printf("CAENDigitizerMock - Replaying %u events from file '%s'\n",NReplayEvents,fileName);
+  return 0;
+
+}
+
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_OpenDigitizer(CAEN_DGTZ_ConnectionType linkType, int link, int node, uint32_t base, int* handle)
+{
+
+  mock_board_t* b;
+  char* env;
+  int iGr,iCh,iCl;
+
+  // Read global settings at first connection
+  if (NOpen == 0) {
+    if ( (env = getenv("MOCK_TRIGGER_RATE")) ) TriggerRate = atof(env);
+    if ( (env = getenv("MOCK_TRIGGER_BURST")) && sscanf(env,"%lf,%lf",&BurstOn,&BurstOff) == 2 ) {
+      BurstOn *= 1e-3;
+      BurstOff *= 1e-3;
+    } else {
+      BurstOn = 0.;
+    }
+    if ( (env = getenv("MOCK_BOARD_MEMORY")) ) BoardMemory = atoi(env);
+    if ( (env = getenv("MOCK_REPLAY_FILE")) && mock_load_replay(env) ) return CAEN_DGTZ_GenericError;
+    printf("CAENDigitizerMock - Trigger rate %.1f Hz - board memory %u events\n",TriggerRate,BoardMemory);
+    if (BurstOn > 0.) printf("CAENDigitizerMock - Trigger bursts of %.1f ms every %.1f ms\n",1e3*BurstOn,1e3*(BurstOn+BurstOff));
+  }
+  if (NOpen >= MOCK_MAX_BOARDS) return CAEN_DGTZ_CommError;
+
+  *handle = NOpen++;
+  b = &Board[*handle];
+  memset(b,0,sizeof(mock_board_t));
+  b->open = 1;
+  b->group_mask = 0xF;
+  b->max_blt = 128;
+  b->record_length = 1024;
+  b->freq = CAEN_DGTZ_DRS4_5GHz;
+  b->seed = 12345+*handle;
+
+  // Random DRS4 correction tables
+  for (iGr=0;iGr<MAX_X742_GROUP_SIZE;iGr++) {
+    for (iCh=0;iCh<MAX_X742_CHANNEL_SIZE;iCh++) {
+      for (iCl=0;iCl<1024;iCl++) {
+	b->corr[iGr].cell[iCh][iCl] = (int16_t)(mock_rand(b)%41)-20;
+	b->corr[iGr].nsample[iCh][iCl] = (int8_t)(mock_rand(b)%7)-3;
+      }
+    }
+  }
+
+  return CAEN_DGTZ_Success;
+
+}
+
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_CloseDigitizer(int handle)
+{
+  mock_board_t* b = mock_board(handle);
+  if (b == NULL) return CAEN_DGTZ_InvalidHandle;
+  free(b->pool);
+  b->pool = NULL;
+  b->open = 0;
+  return CAEN_DGTZ_Success;
+}
+
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_GetInfo(int handle, CAEN_DGTZ_BoardInfo_t* info)
+{
+  if (mock_board(handle) == NULL) return CAEN_DGTZ_InvalidHandle;
+  memset(info,0,sizeof(CAEN_DGTZ_BoardInfo_t));
+  strcpy(info->ModelName,"V1742");
+  info->Channels = 32;
+  info->ADC_NBits = 12;
+  info->SerialNumber = MOCK_SERIAL_NUMBER+handle;
+  strcpy(info->ROC_FirmwareRel,"mock");
+  strcpy(info->AMC_FirmwareRel,"mock");
+  return CAEN_DGTZ_Success;
+}
+
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_Reset(int handle)
+{
+  mock_board_t* b = mock_board(handle);
+  if (b == NULL) return CAEN_DGTZ_InvalidHandle;
+  b->running = 0;
+  b->group_mask = 0xF;
+  b->irq_events = 0;
+  b->drs4corr = 0;
+  return CAEN_DGTZ_Success;
+}
+
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_ClearData(int handle)
+{
+  mock_board_t* b = mock_board(handle);
+  if (b == NULL) return CAEN_DGTZ_InvalidHandle;
+  b->n_trig += mock_pending(b);
+  return CAEN_DGTZ_Success;
+}
+
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_WriteRegister(int handle, uint32_t reg, uint32_t data)
+{
+  mock_board_t* b = mock_board(handle);
+  if (b == NULL) return CAEN_DGTZ_InvalidHandle;
+  if (reg == 0x8120) b->group_mask = data & 0xF;
+  return CAEN_DGTZ_Success;
+}
+
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_ReadRegister(int handle, uint32_t reg, uint32_t* data)
+{
+  uint32_t p;
+  mock_board_t* b = mock_board(handle);
+  if (b == NULL) return CAEN_DGTZ_InvalidHandle;
+  if (reg == CAEN_DGTZ_ACQ_STATUS_ADD) {
+    // bit 2: RUN, bit 3: EVENT READY, bit 4: EVENT FULL
+    p = mock_pending(b);
+    *data = (b->running ? 0x4 : 0) | (p ? 0x8 : 0) | (p >= BoardMemory ? 0x10 : 0);
+  } else if ( (reg & 0xF0FF) == CAEN_DGTZ_CHANNEL_STATUS_BASE_ADDRESS ) {
+    // bit 0: memory full
+    *data = ( mock_pending(b) >= BoardMemory );
+  } else if (reg == 0x8120) {
+    *data = b->group_mask;
+  } else {
+    *data = 0;
+  }
+  return CAEN_DGTZ_Success;
+}
+
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_SetInterruptConfig(int handle, CAEN_DGTZ_EnaDis_t state, uint8_t level, uint32_t status_id, uint16_t n_events, CAEN_DGTZ_IRQMode_t mode)
+{
+  mock_board_t* b = mock_board(handle);
+  if (b == NULL) return CAEN_DGTZ_InvalidHandle;
+  b->irq_events = (state == CAEN_DGTZ_ENABLE) ? n_events : 0;
+  return CAEN_DGTZ_Success;
+}
+
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_GetInterruptConfig(int handle, CAEN_DGTZ_EnaDis_t* state, uint8_t* level, uint32_t* status_id, uint16_t* n_events, CAEN_DGTZ_IRQMode_t* mode)
+{
+  mock_board_t* b = mock_board(handle);
+  if (b == NULL) return CAEN_DGTZ_InvalidHandle;
+  *state = b->irq_events ? CAEN_DGTZ_ENABLE : CAEN_DGTZ_DISABLE;
+  *level = 1;
+  *status_id = 0;
+  *n_events = b->irq_events;
+  *mode = CAEN_DGTZ_IRQ_MODE_ROAK;
+  return CAEN_DGTZ_Success;
+}
+
+// Wait until irq_events events are in board memory or timeout expires
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_IRQWait(int handle, uint32_t timeout)
+{
+  double tEnd = mock_now()+timeout*1e-3;
+  mock_board_t* b = mock_board(handle);
+  if (b == NULL) return CAEN_DGTZ_InvalidHandle;
+  while (mock_now() < tEnd) {
+    if ( b->irq_events && mock_pending(b) >= b->irq_events ) return CAEN_DGTZ_Success;
+    usleep(100);
+  }
+  return CAEN_DGTZ_Timeout;
+}
+
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_SetAcquisitionMode(int handle, CAEN_DGTZ_AcqMode_t mode)
+{
+  if (mock_board(handle) == NULL) return CAEN_DGTZ_InvalidHandle;
+  return CAEN_DGTZ_Success;
+}
+
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_SWStartAcquisition(int handle)
+{
+  mock_board_t* b = mock_board(handle);
+  if (b == NULL) return CAEN_DGTZ_InvalidHandle;
+  if (NReplayEvents == 0 && mock_fill_pool(b,handle)) return CAEN_DGTZ_OutOfMemory;
+  b->n_trig = 0;
+  b->n_read = 0;
+  b->n_lost = 0;
+  b->t_start = mock_now();
+  b->running = 1;
+  return CAEN_DGTZ_Success;
+}
+
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_SWStopAcquisition(int handle)
+{
+  mock_board_t* b = mock_board(handle);
+  if (b == NULL) return CAEN_DGTZ_InvalidHandle;
+  if (b->running) {
+    printf("CAENDigitizerMock - Board %d: %llu events read, %llu events lost because board memory was full\n",
+	   handle,(unsigned long long)b->n_read,(unsigned long long)b->n_lost);
+  }
+  b->running = 0;
+  return CAEN_DGTZ_Success;
+}
+
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_SetMaxNumEventsBLT(int handle, uint32_t n_events)
+{
+  mock_board_t* b = mock_board(handle);
+  if (b == NULL) return CAEN_DGTZ_InvalidHandle;
+  if (n_events == 0 || n_events > 1023) return CAEN_DGTZ_InvalidParam;
+  b->max_blt = n_events;
+  return CAEN_DGTZ_Success;
+}
+
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_GetMaxNumEventsBLT(int handle, uint32_t* n_events)
+{
+  mock_board_t* b = mock_board(handle);
+  if (b == NULL) return CAEN_DGTZ_InvalidHandle;
+  *n_events = b->max_blt;
+  return CAEN_DGTZ_Success;
+}
+
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_MallocReadoutBuffer(int handle, char** buffer, uint32_t* size)
+{
+  mock_board_t* b = mock_board(handle);
+  if (b == NULL) return CAEN_DGTZ_InvalidHandle;
+  *size = b->max_blt*MOCK_MAX_EVENT_WORDS*4;
+  *buffer = (char*)malloc(*size);
+  return (*buffer) ? CAEN_DGTZ_Success : CAEN_DGTZ_OutOfMemory;
+}
+
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_FreeReadoutBuffer(char** buffer)
+{
+  free(*buffer);
+  *buffer = NULL;
+  return CAEN_DGTZ_Success;
+}
+
+// Copy up to max_blt events from board memory to buffer. Event counter and time tag are set at readout
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_ReadData(int handle, CAEN_DGTZ_ReadMode_t mode, char* buffer, uint32_t* size)
+{
+
+  uint32_t iEv,nEv,evtSize;
+  uint32_t* src;
+  uint32_t* w = (uint32_t*)buffer;
+  uint32_t ttt;
+  mock_board_t* b = mock_board(handle);
+  if (b == NULL) return CAEN_DGTZ_InvalidHandle;
+
+  nEv = mock_pending(b);
+  if (nEv > b->max_blt) nEv = b->max_blt;
+  ttt = (uint32_t)((mock_now()-b->t_start)*1.17647e8); // Time tag counts at 117.647 MHz (8.5 ns)
+  for (iEv=0;iEv<nEv;iEv++) {
+    if (NReplayEvents) {
+      src = ReplayEvent[b->n_read%NReplayEvents];
+    } else {
+      src = b->pool+b->pool_offset[b->n_read%MOCK_POOL_EVENTS];
+    }
+    evtSize = src[0] & 0x0FFFFFFF;
+    memcpy(w,src,evtSize*4);
+    w[2] = b->n_read & 0x3FFFFF;
+    w[3] = ttt;
+    w += evtSize;
+    b->n_read++;
+  }
+  b->n_trig += nEv;
+  *size = (char*)w-buffer;
+  return CAEN_DGTZ_Success;
+
+}
+
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_GetNumEvents(int handle, char* buffer, uint32_t size, uint32_t* n_events)
+{
+  uint32_t off = 0;
+  uint32_t* w = (uint32_t*)buffer;
+  *n_events = 0;
+  while (off < size/4) {
+    if ( (w[off] & 0x0FFFFFFF) == 0 ) return CAEN_DGTZ_InvalidEvent;
+    off += w[off] & 0x0FFFFFFF;
+    (*n_events)++;
+  }
+  return CAEN_DGTZ_Success;
+}
+
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_GetEventInfo(int handle, char* buffer, uint32_t size, int32_t n_event, CAEN_DGTZ_EventInfo_t* info, char** event)
+{
+  uint32_t off = 0;
+  uint32_t* w = (uint32_t*)buffer;
+  int32_t i;
+  for (i=0;i<n_event && off<size/4;i++) off += w[off] & 0x0FFFFFFF;
+  if (off >= size/4) return CAEN_DGTZ_InvalidEvent;
+  w += off;
+  info->EventSize = w[0] & 0x0FFFFFFF;
+  info->BoardId = w[1] >> 27;
+  info->Pattern = (w[1] >> 8) & 0xFFFF;
+  info->ChannelMask = w[1] & 0xF;
+  info->EventCounter = w[2] & 0x3FFFFF;
+  info->TriggerTimeTag = w[3];
+  *event = (char*)w;
+  return CAEN_DGTZ_Success;
+}
+
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_AllocateEvent(int handle, void** event)
+{
+  CAEN_DGTZ_X742_EVENT_t* e;
+  int iGr,iCh;
+  e = (CAEN_DGTZ_X742_EVENT_t*)calloc(1,sizeof(CAEN_DGTZ_X742_EVENT_t));
+  if (e == NULL) return CAEN_DGTZ_OutOfMemory;
+  for (iGr=0;iGr<MAX_X742_GROUP_SIZE;iGr++) {
+    for (iCh=0;iCh<MAX_X742_CHANNEL_SIZE;iCh++) {
+      e->DataGroup[iGr].DataChannel[iCh] = (float*)malloc(1024*sizeof(float));
+      if (e->DataGroup[iGr].DataChannel[iCh] == NULL) return CAEN_DGTZ_OutOfMemory;
+    }
+  }
+  *event = e;
+  return CAEN_DGTZ_Success;
+}
+
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_FreeEvent(int handle, void** event)
+{
+  CAEN_DGTZ_X742_EVENT_t* e = (CAEN_DGTZ_X742_EVENT_t*)*event;
+  int iGr,iCh;
+  for (iGr=0;iGr<MAX_X742_GROUP_SIZE;iGr++) {
+    for (iCh=0;iCh<MAX_X742_CHANNEL_SIZE;iCh++) free(e->DataGroup[iGr].DataChannel[iCh]);
+  }
+  free(e);
+  *event = NULL;
+  return CAEN_DGTZ_Success;
+}
+
+// Unpack 8 samples of 12 bits from 3 words
+static void mock_unpack(const uint32_t* w, float* s)
+{
+  s[0] = (w[0]      ) & 0xFFF;
+  s[1] = (w[0] >> 12) & 0xFFF;
+  s[2] = ((w[0] >> 24) & 0x0FF) | ((w[1] & 0x00F) << 8);
+  s[3] = (w[1] >>  4) & 0xFFF;
+  s[4] = (w[1] >> 16) & 0xFFF;
+  s[5] = ((w[1] >> 28) & 0x00F) | ((w[2] & 0x0FF) << 4);
+  s[6] = (w[2] >>  8) & 0xFFF;
+  s[7] = (w[2] >> 20) & 0xFFF;
+}
+
+// Remove spikes appearing at the same sample in all 8 channels of a group, also from the trigger samples if present.
+// Same conditions and replacements used by PeakCorrection in the CAEN library
+static void mock_peak_correction(CAEN_DGTZ_X742_GROUP_t* g)
+{
+
+  int iSm,iCh,nOff;
+  int nSm = g->ChSize[0];
+  int nAll = (g->ChSize[8] == 0) ? 8 : 9;
+  float** d = g->DataChannel;
+  float* c;
+
+  for (iCh=0;iCh<nAll;iCh++) d[iCh][0] = d[iCh][1];
+  for (iSm=1;iSm<nSm;iSm++) {
+
+    nOff = 0;
+    for (iCh=0;iCh<8;iCh++) {
+      c = d[iCh];
+      if (iSm == 1) {
+	if (c[2]-c[1] > 30) {
+	  nOff++;
+	} else if ( (c[3]-c[1] > 30) && (c[3]-c[2] > 30) ) {
+	  nOff++;
+	}
+      } else if ( (iSm == nSm-1) && (c[nSm-2]-c[iSm] > 30) ) {
+	nOff++;
+      } else if (c[iSm-1]-c[iSm] > 30) {
+	if (c[iSm+1]-c[iSm] > 30) {
+	  nOff++;
+	} else if ( (iSm == nSm-2) || (c[iSm+2]-c[iSm] > 30) ) {
+	  nOff++;
+	}
+      }
+    }
+    if (nOff < 8) continue;
+
+    for (iCh=0;iCh<nAll;iCh++) {
+      c = d[iCh];
+      if (iSm == 1) {
+	if (c[2]-c[1] > 30) {
+	  c[0] = c[1] = c[2];
+	} else {
+	  c[0] = c[1] = c[2] = c[3];
+	}
+      } else if (iSm == nSm-1) {
+	c[nSm-1] = c[nSm-2];
+      } else if (c[iSm+1]-c[iSm] > 30) {
+	c[iSm] = (c[iSm+1]+c[iSm-1])/2;
+      } else if (iSm == nSm-2) {
+	c[nSm-2] = c[nSm-1] = c[nSm-3];
+      } else {
+	c[iSm] = c[iSm+1] = (c[iSm+2]+c[iSm-1])/2;
+      }
+    }
+
+  }
+
+}
+
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_DecodeEvent(int handle, char* event, void** decoded)
+{
+
+  CAEN_DGTZ_X742_EVENT_t* e = (CAEN_DGTZ_X742_EVENT_t*)*decoded;
+  CAEN_DGTZ_X742_GROUP_t* g;
+  uint32_t* w = (uint32_t*)event;
+  uint32_t n = 4;
+  uint32_t iGr,iCh,iSm,size1,size2,nSm;
+  float s[8];
+  mock_board_t* b = mock_board(handle);
+  if (b == NULL) return CAEN_DGTZ_InvalidHandle;
+
+  for (iGr=0;iGr<MAX_X742_GROUP_SIZE;iGr++) {
+
+    e->GrPresent[iGr] = (w[1] >> iGr) & 1;
+    if ( ! e->GrPresent[iGr] ) continue;
+    g = &e->DataGroup[iGr];
+
+    size1 = w[n] & 0xFFF;
+    size2 = ((w[n] >> 12) & 1) ? size1/8 : 0;
+    g->StartIndexCell = (w[n] >> 20) & 0x3FF;
+    n++;
+
+    nSm = size1/3;
+    for (iSm=0;iSm<nSm;iSm++) {
+      mock_unpack(w+n,s);
+      for (iCh=0;iCh<8;iCh++) g->DataChannel[iCh][iSm] = s[iCh];
+      n += 3;
+    }
+    for (iCh=0;iCh<8;iCh++) g->ChSize[iCh] = nSm;
+
+    for (iSm=0;iSm<size2/3;iSm++) {
+      mock_unpack(w+n,g->DataChannel[8]+8*iSm);
+      n += 3;
+    }
+    g->ChSize[8] = size2*8/3;
+
+    g->TriggerTimeTag = w[n++] & 0x3FFFFFFF;
+
+    if (b->drs4corr) {
+      for (iCh=0;iCh<MAX_X742_CHANNEL_SIZE;iCh++) {
+	for (iSm=0;iSm<g->ChSize[iCh];iSm++) {
+	  g->DataChannel[iCh][iSm] -= b->corr[iGr].cell[iCh][(g->StartIndexCell+iSm)%1024];
+	  g->DataChannel[iCh][iSm] -= b->corr[iGr].nsample[iCh][iSm];
+	}
+      }
+      mock_peak_correction(g);
+    }
+
+  }
+
+  return CAEN_DGTZ_Success;
+
+}
+
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_SetRecordLength(int handle, uint32_t size)
+{
+  mock_board_t* b = mock_board(handle);
+  if (b == NULL) return CAEN_DGTZ_InvalidHandle;
+  b->record_length = size;
+  return CAEN_DGTZ_Success;
+}
+
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_GetRecordLength(int handle, uint32_t* size)
+{
+  mock_board_t* b = mock_board(handle);
+  if (b == NULL) return CAEN_DGTZ_InvalidHandle;
+  *size = b->record_length;
+  return CAEN_DGTZ_Success;
+}
+
+// Settings which do not change the simulated data are accepted and ignored
+
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_SetChannelDCOffset(int handle, uint32_t channel, uint32_t offset) { return CAEN_DGTZ_Success; }
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_GetChannelDCOffset(int handle, uint32_t channel, uint32_t* offset) { *offset = 0x5600; return CAEN_DGTZ_Success; }
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_SetPostTriggerSize(int handle, uint32_t percent) { return CAEN_DGTZ_Success; }
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_GetPostTriggerSize(int handle, uint32_t* percent) { *percent = 65; return CAEN_DGTZ_Success; }
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_SetSWTriggerMode(int handle, CAEN_DGTZ_TriggerMode_t mode) { return CAEN_DGTZ_Success; }
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_SetExtTriggerInputMode(int handle, CAEN_DGTZ_TriggerMode_t mode) { return CAEN_DGTZ_Success; }
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_SetFastTriggerMode(int handle, CAEN_DGTZ_TriggerMode_t mode) { return CAEN_DGTZ_Success; }
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_SetFastTriggerDigitizing(int handle, CAEN_DGTZ_EnaDis_t state) { return CAEN_DGTZ_Success; }
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_SetIOLevel(int handle, CAEN_DGTZ_IOLevel_t level) { return CAEN_DGTZ_Success; }
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_SetTriggerPolarity(int handle, uint32_t channel, CAEN_DGTZ_TriggerPolarity_t polarity) { return CAEN_DGTZ_Success; }
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_GetTriggerPolarity(int handle, uint32_t channel, CAEN_DGTZ_TriggerPolarity_t* polarity) { *polarity = CAEN_DGTZ_TriggerOnFallingEdge; return CAEN_DGTZ_Success; }
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_SetGroupFastTriggerDCOffset(int handle, uint32_t group, uint32_t offset) { return CAEN_DGTZ_Success; }
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_GetGroupFastTriggerDCOffset(int handle, uint32_t group, uint32_t* offset) { *offset = 0x8000; return CAEN_DGTZ_Success; }
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_SetGroupFastTriggerThreshold(int handle, uint32_t group, uint32_t threshold) { return CAEN_DGTZ_Success; }
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_GetGroupFastTriggerThreshold(int handle, uint32_t group, uint32_t* threshold) { *threshold = 0x51C6; return CAEN_DGTZ_Success; }
+
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_SetDRS4SamplingFrequency(int handle, CAEN_DGTZ_DRS4Frequency_t freq)
+{
+  mock_board_t* b = mock_board(handle);
+  if (b == NULL) return CAEN_DGTZ_InvalidHandle;
+  b->freq = freq;
+  return CAEN_DGTZ_Success;
+}
+
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_GetDRS4SamplingFrequency(int handle, CAEN_DGTZ_DRS4Frequency_t* freq)
+{
+  mock_board_t* b = mock_board(handle);
+  if (b == NULL) return CAEN_DGTZ_InvalidHandle;
+  *freq = b->freq;
+  return CAEN_DGTZ_Success;
+}
+
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_LoadDRS4CorrectionData(int handle, CAEN_DGTZ_DRS4Frequency_t freq)
+{
+  if (mock_board(handle) == NULL) return CAEN_DGTZ_InvalidHandle;
+  return CAEN_DGTZ_Success;
+}
+
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_GetCorrectionTables(int handle, int freq, void* tables)
+{
+  mock_board_t* b = mock_board(handle);
+  if (b == NULL) return CAEN_DGTZ_InvalidHandle;
+  memcpy(tables,b->corr,sizeof(b->corr));
+  return CAEN_DGTZ_Success;
+}
+
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_EnableDRS4Correction(int handle)
+{
+  mock_board_t* b = mock_board(handle);
+  if (b == NULL) return CAEN_DGTZ_InvalidHandle;
+  b->drs4corr = 1;
+  return CAEN_DGTZ_Success;
+}
+
+CAEN_DGTZ_ErrorCode CAEN_DGTZ_DisableDRS4Correction(int handle)
+{
+  mock_board_t* b = mock_board(handle);
+  if (b == NULL) return CAEN_DGTZ_InvalidHandle;
+  b->drs4corr = 0;
+  return CAEN_DGTZ_Success;
+}
@@ -0,0 +1,907 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define ASYNC_WRITER_URING
+#endif
+#endif
+
+#include "CAENDigitizer.h"
+
+#include "PEvent.h"
+#include "RawBLT.h"
+
+#include "AsyncWriter.h"
+
+enum { ASYNC_OP_WRITE, ASYNC_OP_OPEN, ASYNC_OP_CLOSE };
+
+static void async_writer_wake(async_writer_t* w)
+{
+  uint64_t one = 1;
+  if ( write(w->wake_fd,&one,sizeof(one)) < 0 ) return; // Counter can only overflow after 2^64 wakes
+}
+
+// Write data to the current output with blocking calls (file head and tail)
+static int async_writer_write_all(async_writer_t* w, const char* data, size_t len)
+{
+  ssize_t n;
+  while (len) {
+    if (w->stream) {
+      n = write(w->fd,data,len);
+    } else {
+      n = pwrite(w->fd,data,len,w->file_pos);
+    }
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return errno;
+    }
+    data += n;
+    len -= n;
+    w->file_pos += n;
+    w->n_bytes += n;
+    if ( write_back_written(&w->wb,n) ) return w->wb.error;
+  }
+  return 0;
+}
+
+// Write the carry buffer at the current (page aligned) offset of an O_DIRECT file as whole pages
+// padded with zeros, then cut the file at the end of the real data
+static int async_writer_write_pages(async_writer_t* w)
+{
+  size_t len = (w->carry_len+ASYNC_WRITER_ALIGN-1) & ~(size_t)(ASYNC_WRITER_ALIGN-1);
+  ssize_t n;
+  memset(w->carry+w->carry_len,0,len-w->carry_len);
+  do {
+    n = pwrite(w->fd,w->carry,len,w->file_pos);
+  } while (n < 0 && errno == EINTR);
+  if (n < 0) return errno;
+  if ((size_t)n != len) return EIO;
+  if ( ftruncate(w->fd,w->file_pos+w->carry_len) == -1 ) return errno;
+  w->file_pos += w->carry_len;
+  w->n_bytes += w->carry_len;
+  if ( write_back_written(&w->wb,w->carry_len) ) return w->wb.error;
+  return 0;
+}
+
+// Record and report first error. Following writes are dropped
+static void async_writer_fail(async_writer_t* w, int err, const char* what)
+{
+  int first;
+  pthread_mutex_lock(&w->lock);
+  first = (w->error == 0);
+  if (first) w->error = err;
+  pthread_mutex_unlock(&w->lock);
+  if (first) printf("async_writer - ERROR - %s: %s\n",what,strerror(err));
+}
+
+/* ---- I/O threads backend ---- */
+
+static void* async_writer_io_thread(void* arg)
+{
+
+  async_writer_t* w = (async_writer_t*)arg;
+  async_block_t* b;
+  ssize_t n;
+  sigset_t set;
+
+  // Signals are handled by the main thread
+  sigfillset(&set);
+  pthread_sigmask(SIG_BLOCK,&set,NULL);
+
+  while(1) {
+
+    pthread_mutex_lock(&w->io_lock);
+    while (w->io_jobs == NULL && ! w->io_quit) pthread_cond_wait(&w->io_cond,&w->io_lock);
+    b = w->io_jobs;
+    if (b) {
+      w->io_jobs = b->next;
+      if (w->io_jobs == NULL) w->io_jobs_last = NULL;
+    }
+    pthread_mutex_unlock(&w->io_lock);
+    if (b == NULL) break;
+
+    while (b->done < b->used) {
+      if (b->offset < 0) {
+	n = write(b->fd,b->data+b->done,b->used-b->done);
+      } else {
+	n = pwrite(b->fd,b->data+b->done,b->used-b->done,b->offset+b->done);
+      }
+      if (n < 0) {
+	if (errno == EINTR) continue;
+	b->result = errno;
+	break;
+      }
+      b->done += n;
+    }
+
+    pthread_mutex_lock(&w->io_lock);
+    b->next = w->io_done;
+    w->io_done = b;
+    pthread_mutex_unlock(&w->io_lock);
+    async_writer_wake(w);
+
+  }
+
+  return NULL;
+
+}
+
+static int async_writer_threads_init(async_writer_t* w)
+{
+  unsigned int i;
+  pthread_mutex_init(&w->io_lock,NULL);
+  pthread_cond_init(&w->io_cond,NULL);
+  for(i=0;i<w->n_threads;i++) {
+    if ( pthread_create(&w->io_thread[i],NULL,async_writer_io_thread,w) ) {
+      printf("async_writer - ERROR - Unable to start I/O thread %u\n",i);
+      w->n_threads = i;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static void async_writer_threads_start(async_writer_t* w, async_block_t* b)
+{
+  pthread_mutex_lock(&w->io_lock);
+  b->next = NULL;
+  if (w->io_jobs_last) {
+    w->io_jobs_last->next = b;
+  } else {
+    w->io_jobs = b;
+  }
+  w->io_jobs_last = b;
+  pthread_cond_signal(&w->io_cond);
+  pthread_mutex_unlock(&w->io_lock);
+}
+
+// Return list of completed blocks
+static async_block_t* async_writer_threads_reap(async_writer_t* w)
+{
+  async_block_t* b;
+  pthread_mutex_lock(&w->io_lock);
+  b = w->io_done;
+  w->io_done = NULL;
+  pthread_mutex_unlock(&w->io_lock);
+  return b;
+}
+
+static void async_writer_threads_stop(async_writer_t* w)
+{
+  unsigned int i;
+  pthread_mutex_lock(&w->io_lock);
+  w->io_quit = 1;
+  pthread_cond_broadcast(&w->io_cond);
+  pthread_mutex_unlock(&w->io_lock);
+  for(i=0;i<w->n_threads;i++) pthread_join(w->io_thread[i],NULL);
+}
+
+/* ---- io_uring backend ---- */
+
+#ifdef ASYNC_WRITER_URING
+
+static int async_writer_uring_init(async_writer_t* w)
+{
+
+  struct io_uring_params p;
+
+  memset(&p,0,sizeof(p));
+  w->ring_fd = syscall(__NR_io_uring_setup,w->n_blocks,&p);
+  if (w->ring_fd < 0) return 1;
+
+  w->sq_len = p.sq_off.array+p.sq_entries*sizeof(unsigned);
+  w->cq_len = p.cq_off.cqes+p.cq_entries*sizeof(struct io_uring_cqe);
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    if (w->cq_len > w->sq_len) w->sq_len = w->cq_len;
+    w->cq_len = 0;
+  }
+  w->sq_ptr = mmap(NULL,w->sq_len,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,w->ring_fd,IORING_OFF_SQ_RING);
+  if (w->sq_ptr == MAP_FAILED) goto fail_sq;
+  if (w->cq_len) {
+    w->cq_ptr = mmap(NULL,w->cq_len,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,w->ring_fd,IORING_OFF_CQ_RING);
+    if (w->cq_ptr == MAP_FAILED) goto fail_cq;
+  } else {
+    w->cq_ptr = w->sq_ptr;
+  }
+  w->sqes_len = p.sq_entries*sizeof(struct io_uring_sqe);
+  w->sqes = mmap(NULL,w->sqes_len,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,w->ring_fd,IORING_OFF_SQES);
+  if (w->sqes == MAP_FAILED) goto fail_sqes;
+
+  w->sq_head = (unsigned*)((char*)w->sq_ptr+p.sq_off.head);
+  w->sq_tail = (unsigned*)((char*)w->sq_ptr+p.sq_off.tail);
+  w->sq_mask = (unsigned*)((char*)w->sq_ptr+p.sq_off.ring_mask);
+  w->sq_array = (unsigned*)((char*)w->sq_ptr+p.sq_off.array);
+  w->cq_head = (unsigned*)((char*)w->cq_ptr+p.cq_off.head);
+  w->cq_tail = (unsigned*)((char*)w->cq_ptr+p.cq_off.tail);
+  w->cq_mask = (unsigned*)((char*)w->cq_ptr+p.cq_off.ring_mask);
+  w->cqes = (char*)w->cq_ptr+p.cq_off.cqes;
+#ifdef IORING_FEAT_RW_CUR_POS
+  w->cur_pos = (p.features & IORING_FEAT_RW_CUR_POS) != 0;
+#endif
+
+  // Completions wake up the writer thread like new operations do
+  if ( syscall(__NR_io_uring_register,w->ring_fd,IORING_REGISTER_EVENTFD,&w->wake_fd,1) < 0 ) goto fail_reg;
+  return 0;
+
+ fail_reg:
+  munmap(w->sqes,w->sqes_len);
+ fail_sqes:
+  if (w->cq_len) munmap(w->cq_ptr,w->cq_len);
+ fail_cq:
+  munmap(w->sq_ptr,w->sq_len);
+ fail_sq:
+  close(w->ring_fd);
+  return 1;
+
+}
+
+// Return 0 if OK, errno if the write could not be submitted
+static int async_writer_uring_start(async_writer_t* w, async_block_t* b)
+{
+
+  unsigned tail,idx;
+  struct io_uring_sqe* sqe;
+
+  b->iov.iov_base = b->data+b->done;
+  b->iov.iov_len = b->used-b->done;
+
+  // Each block in flight uses at most one entry and the ring has one entry per block: the ring is never full
+  tail = *w->sq_tail;
+  idx = tail & *w->sq_mask;
+  sqe = (struct io_uring_sqe*)w->sqes+idx;
+  memset(sqe,0,sizeof(*sqe));
+  sqe->opcode = IORING_OP_WRITEV;
+  sqe->fd = b->fd;
+  sqe->addr = (uint64_t)(uintptr_t)&b->iov;
+  sqe->len = 1;
+  if (b->offset >= 0) {
+    sqe->off = b->offset+b->done;
+  } else {
+    sqe->off = w->cur_pos ? (uint64_t)-1 : 0;
+  }
+  sqe->user_data = (uint64_t)(uintptr_t)b;
+  w->sq_array[idx] = idx;
+  atomic_store_explicit((_Atomic unsigned*)w->sq_tail,tail+1,memory_order_release);
+
+  while ( syscall(__NR_io_uring_enter,w->ring_fd,1,0,0,NULL,0) < 0 ) {
+    if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+      // Entry was not consumed by the kernel: take it back
+      atomic_store_explicit((_Atomic unsigned*)w->sq_tail,tail,memory_order_release);
+      return errno;
+    }
+  }
+  return 0;
+
+}
+
+// Return list of completed blocks. Partial or interrupted writes are restarted
+static async_block_t* async_writer_uring_reap(async_writer_t* w)
+{
+
+  unsigned head,tail;
+  struct io_uring_cqe* cqe;
+  async_block_t *b,*list = NULL;
+  int res;
+
+  head = *w->cq_head;
+  tail = atomic_load_explicit((_Atomic unsigned*)w->cq_tail,memory_order_acquire);
+  while (head != tail) {
+    cqe = (struct io_uring_cqe*)w->cqes+(head & *w->cq_mask);
+    b = (async_block_t*)(uintptr_t)cqe->user_data;
+    res = cqe->res;
+    head++;
+    atomic_store_explicit((_Atomic unsigned*)w->cq_head,head,memory_order_release);
+    if (res < 0 && res != -EINTR && res != -EAGAIN) {
+      b->result = -res;
+    } else {
+      if (res > 0) b->done += res;
+      if ( b->done < b->used && (b->result = async_writer_uring_start(w,b)) == 0 ) continue;
+    }
+    b->next = list;
+    list = b;
+  }
+  return list;
+
+}
+
+static void async_writer_uring_stop(async_writer_t* w)
+{
+  munmap(w->sqes,w->sqes_len);
+  if (w->cq_len) munmap(w->cq_ptr,w->cq_len);
+  munmap(w->sq_ptr,w->sq_len);
+  close(w->ring_fd);
+}
+
+#endif
+
+/* ---- Writer thread ---- */
+
+// Return written blocks to the free list in the order they were started
+static void async_writer_release(async_writer_t* w, async_block_t* b)
+{
+
+  if (b->result) {
+    async_writer_fail(w,b->result,"Unable to write data block");
+  } else {
+    w->file_size += b->used;
+    w->file_events += b->events;
+    if (b->used) {
+      w->n_bytes += b->used;
+      w->n_writes++;
+      histo_fill(&w->h_latency,b->t_ready-b->t_submit);
+    }
+  }
+  b->released = 1;
+
+  while ( w->order_count && w->order[w->order_head]->released ) {
+    b = w->order[w->order_head];
+    w->order_head = (w->order_head+1) % ASYNC_WRITER_MAX_BUFFERS;
+    w->order_count--;
+    if ( b->result == 0 && write_back_written(&w->wb,b->used) ) async_writer_fail(w,w->wb.error,"Unable to write back data block");
+    pthread_mutex_lock(&w->lock);
+    w->in_flight--;
+    b->next = w->free;
+    w->free = b;
+    pthread_cond_broadcast(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+  }
+
+}
+
+// Move completed writes to the held list, then release those whose (simulated) completion time has come
+// Return time of the next simulated completion (0 if none)
+static uint64_t async_writer_complete(async_writer_t* w)
+{
+
+  async_block_t *b,*next,**prev;
+  uint64_t t_now,t_next = 0;
+
+#ifdef ASYNC_WRITER_URING
+  b = w->uring ? async_writer_uring_reap(w) : async_writer_threads_reap(w);
+#else
+  b = async_writer_threads_reap(w);
+#endif
+  t_now = histo_time();
+  for(;b;b=next) {
+    next = b->next;
+    b->t_ready = b->t_start+w->test_delay;
+    if (b->t_ready < t_now) b->t_ready = t_now;
+    b->next = w->held;
+    w->held = b;
+  }
+
+  prev = &w->held;
+  while ( (b = *prev) ) {
+    if (b->t_ready <= t_now) {
+      *prev = b->next;
+      async_writer_release(w,b);
+    } else {
+      if (t_next == 0 || b->t_ready < t_next) t_next = b->t_ready;
+      prev = &b->next;
+    }
+  }
+  return t_next;
+
+}
+
+static void async_writer_start(async_writer_t* w, async_block_t* b)
+{
+
+  size_t rest;
+  int flags,err;
+
+  // With O_DIRECT the end of a block not filling a page waits in the carry buffer to be written with the file tail.
+  // If more data follow, the file is continued through the page cache
+  if ( w->file_direct && b->used ) {
+    if (w->carry_len) {
+      w->file_direct = 0;
+      w->n_direct_off++;
+      flags = fcntl(w->fd,F_GETFL);
+      if ( flags == -1 || fcntl(w->fd,F_SETFL,flags & ~O_DIRECT) == -1 ) {
+	async_writer_fail(w,errno,"Unable to stop direct I/O on output file");
+      } else if ( ! w->error && (err = async_writer_write_all(w,w->carry,w->carry_len)) ) {
+	async_writer_fail(w,err,"Unable to write data block");
+      }
+      w->carry_len = 0;
+    } else {
+      rest = b->used % ASYNC_WRITER_ALIGN;
+      memcpy(w->carry,b->data+b->used-rest,rest);
+      w->carry_len = rest;
+      w->file_size += rest;
+      b->used -= rest;
+    }
+  }
+
+  b->fd = w->fd;
+  b->offset = w->stream ? -1 : w->file_pos;
+  b->done = 0;
+  b->result = 0;
+  b->t_start = histo_time();
+  b->released = 0;
+  w->file_pos += b->used;
+  w->order[(w->order_head+w->order_count) % ASYNC_WRITER_MAX_BUFFERS] = b;
+  w->order_count++;
+
+  pthread_mutex_lock(&w->lock);
+  w->in_flight++;
+  if (w->in_flight > w->max_in_flight) w->max_in_flight = w->in_flight;
+  pthread_mutex_unlock(&w->lock);
+  histo_fill(&w->h_depth,w->in_flight);
+
+  // Nothing is written after an error or without an output file
+  if ( b->used && (w->error || w->fd < 0) ) b->result = w->error ? w->error : EBADF;
+
+  if ( b->result == 0 && b->used ) {
+#ifdef ASYNC_WRITER_URING
+    if (w->uring) b->result = async_writer_uring_start(w,b);
+#endif
+    if (! w->uring) async_writer_threads_start(w,b);
+    if (b->result == 0) return;
+  }
+
+  // Block is completed now
+  b->t_ready = b->t_start;
+  b->next = w->held;
+  w->held = b;
+
+}
+
+static void async_writer_open_file(async_writer_t* w, async_op_t* op)
+{
+
+  char head[PEVT_FHEAD_LEN*4+RAW_FHEAD_LEN*4];
+  unsigned int len;
+  struct stat st;
+  int err;
+
+  int flags;
+
+  if (op->path) {
+    w->fd = open(op->path,O_WRONLY | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+    if (w->fd == -1) {
+      async_writer_fail(w,errno,"Unable to create output file");
+      printf("async_writer - ERROR - File was '%s'\n",op->path);
+    }
+    free(op->path);
+  } else {
+    w->fd = op->fd;
+  }
+  if (w->fd == -1) return;
+
+  w->stream = ( fstat(w->fd,&st) == -1 || ! S_ISREG(st.st_mode) );
+  w->file_pos = 0;
+  w->file_size = 0;
+  w->file_events = 0;
+  w->carry_len = 0;
+  write_back_start(&w->wb,w->fd);
+
+  // With O_DIRECT the head is at the start of the first block
+  w->file_direct = 0;
+  if (op->prefix) {
+    flags = fcntl(w->fd,F_GETFL);
+    if ( flags != -1 && fcntl(w->fd,F_SETFL,flags | O_DIRECT) == 0 ) {
+      w->file_direct = 1;
+      w->n_direct++;
+    } else {
+      if (w->n_direct_fail == 0) printf("async_writer - WARNING - Unable to use O_DIRECT for output file (%s): writing through the page cache\n",strerror(errno));
+      w->n_direct_fail++;
+    }
+    return;
+  }
+
+  if (op->raw) {
+    len = create_raw_file_head(op->index,op->run_number,op->board_id,op->board_sn,op->time,(void*)head);
+  } else {
+    len = create_file_head(op->index,op->run_number,op->board_id,op->board_sn,op->time,(void*)head);
+  }
+  if ( ! w->error && (err = async_writer_write_all(w,head,len)) ) async_writer_fail(w,err,"Unable to write file head");
+  w->file_size += len;
+
+}
+
+static void async_writer_close_file(async_writer_t* w, async_op_t* op)
+{
+
+  char tail[PEVT_FTAIL_LEN*4];
+  unsigned int len;
+  int err;
+
+  if (w->fd == -1) return;
+
+  // The tail follows the data waiting in the carry buffer, after the head if the caller did not take it
+  if (op->head_len) {
+    memcpy(w->carry+w->carry_len,op->head,op->head_len);
+    w->carry_len += op->head_len;
+    w->file_size += op->head_len;
+  }
+  len = create_file_tail(w->file_events,w->file_size,op->time,(void*)tail);
+  memcpy(w->carry+w->carry_len,tail,len);
+  w->carry_len += len;
+  if (! w->error) {
+    if (w->file_direct) {
+      err = async_writer_write_pages(w);
+    } else {
+      err = async_writer_write_all(w,w->carry,w->carry_len);
+    }
+    if (err) async_writer_fail(w,err,"Unable to write file tail");
+  }
+  w->carry_len = 0;
+  if ( write_back_end(&w->wb) ) async_writer_fail(w,EIO,"Unable to complete writeback of output file");
+  if ( ! w->stream ) {
+    if ( w->sync && fsync(w->fd) == -1 ) async_writer_fail(w,errno,"Unable to sync output file");
+    posix_fadvise(w->fd,0,0,POSIX_FADV_DONTNEED);
+  }
+  if ( close(w->fd) == -1 ) async_writer_fail(w,errno,"Unable to close output file");
+  w->fd = -1;
+  w->n_files++;
+
+}
+
+static void* async_writer_thread(void* arg)
+{
+
+  async_writer_t* w = (async_writer_t*)arg;
+  async_op_t op;
+  unsigned int depth;
+  uint64_t t_next,t_now,dt;
+  struct pollfd pfd;
+  struct timespec ts;
+  uint64_t count;
+  int progress,have;
+  sigset_t set;
+
+  sigfillset(&set);
+  pthread_sigmask(SIG_BLOCK,&set,NULL);
+
+  pfd.fd = w->wake_fd;
+  pfd.events = POLLIN;
+
+  while(1) {
+
+    t_next = async_writer_complete(w);
+
+    // Start queued operations in order. Files are opened and closed when no write is in flight
+    progress = 0;
+    while(1) {
+      pthread_mutex_lock(&w->lock);
+      have = (w->op_count > 0);
+      if (have) op = w->op[w->op_head];
+      pthread_mutex_unlock(&w->lock);
+      if (! have) break;
+      if (op.type == ASYNC_OP_WRITE) {
+	depth = w->stream ? 1 : w->n_blocks;
+	if (w->in_flight >= depth) break;
+	async_writer_start(w,op.block);
+      } else {
+	if (w->in_flight) break;
+	if (op.type == ASYNC_OP_OPEN) {
+	  async_writer_open_file(w,&op);
+	} else {
+	  async_writer_close_file(w,&op);
+	}
+      }
+      pthread_mutex_lock(&w->lock);
+      w->op_head = (w->op_head+1) % w->op_size;
+      w->op_count--;
+      pthread_cond_broadcast(&w->cond);
+      pthread_mutex_unlock(&w->lock);
+      progress = 1;
+    }
+    if (progress) continue;
+
+    pthread_mutex_lock(&w->lock);
+    if ( w->quit && w->op_count == 0 && w->in_flight == 0 ) {
+      pthread_mutex_unlock(&w->lock);
+      break;
+    }
+    pthread_mutex_unlock(&w->lock);
+
+    // Wait for a new operation, a completion, or the next simulated completion
+    if (t_next) {
+      t_now = histo_time();
+      dt = (t_next > t_now) ? t_next-t_now : 0;
+      ts.tv_sec = dt/1000000000;
+      ts.tv_nsec = dt%1000000000;
+      if ( ppoll(&pfd,1,&ts,NULL) > 0 && read(w->wake_fd,&count,sizeof(count)) < 0 ) continue;
+    } else {
+      if ( ppoll(&pfd,1,NULL,NULL) > 0 && read(w->wake_fd,&count,sizeof(count)) < 0 ) continue;
+    }
+
+  }
+
+  return NULL;
+
+}
+
+/* ---- Interface ---- */
+
+async_writer_t* async_writer_create(const char* backend, unsigned int nBuffers, size_t bufSize, unsigned int nThreads, unsigned int testDelay)
+{
+
+  async_writer_t* w;
+  unsigned int i;
+
+  if (nBuffers < 2) nBuffers = 2;
+  if (nBuffers > ASYNC_WRITER_MAX_BUFFERS) nBuffers = ASYNC_WRITER_MAX_BUFFERS;
+  if (nThreads < 1) nThreads = 1;
+  if (nThreads > ASYNC_WRITER_MAX_THREADS) nThreads = ASYNC_WRITER_MAX_THREADS;
+  if (bufSize == 0) {
+    printf("async_writer_create - ERROR - Buffer size must be larger than 0\n");
+    return NULL;
+  }
+
+  w = (async_writer_t*)malloc(sizeof(async_writer_t));
+  if (w == NULL) {
+    printf("async_writer_create - ERROR - Unable to allocate writer structure\n");
+    return NULL;
+  }
+  memset(w,0,sizeof(async_writer_t));
+  w->fd = -1;
+  w->ring_fd = -1;
+  w->n_threads = nThreads;
+  w->test_delay = (uint64_t)testDelay*1000;
+  write_back_init(&w->wb,0,0);
+
+  // Carry buffer holds less than a page of data, the head and the tail
+  if ( posix_memalign((void**)&w->carry,ASYNC_WRITER_ALIGN,2*ASYNC_WRITER_ALIGN) ) {
+    printf("async_writer_create - ERROR - Unable to allocate carry buffer\n");
+    free(w);
+    return NULL;
+  }
+
+  for(i=0;i<nBuffers;i++) {
+    if ( posix_memalign((void**)&w->block[i].data,ASYNC_WRITER_ALIGN,bufSize) ) {
+      printf("async_writer_create - ERROR - Unable to allocate buffer %u of %lu bytes\n",i,(unsigned long)bufSize);
+      while (i--) free(w->block[i].data);
+      free(w->carry);
+      free(w);
+      return NULL;
+    }
+    w->block[i].size = bufSize;
+    w->block[i].next = w->free;
+    w->free = &w->block[i];
+  }
+  w->n_blocks = nBuffers;
+
+  // All writes plus a few file changes can be queued
+  w->op_size = 2*nBuffers+8;
+  w->op = (async_op_t*)malloc(w->op_size*sizeof(async_op_t));
+  w->wake_fd = eventfd(0,EFD_CLOEXEC);
+  if (w->op == NULL || w->wake_fd == -1) {
+    printf("async_writer_create - ERROR - Unable to allocate operation queue\n");
+    goto fail;
+  }
+  pthread_mutex_init(&w->lock,NULL);
+  pthread_cond_init(&w->cond,NULL);
+
+  histo_init(&w->h_depth,"writes in flight","blk");
+  histo_init(&w->h_latency,"write completion","ns");
+  histo_init(&w->h_wait,"wait for buffer","ns");
+
+  if ( strcmp(backend,"THREADS") != 0 ) {
+#ifdef ASYNC_WRITER_URING
+    if ( async_writer_uring_init(w) == 0 ) {
+      w->uring = 1;
+    } else {
+      printf("async_writer_create - WARNING - io_uring not available (%s): using %u I/O threads\n",strerror(errno),nThreads);
+    }
+#else
+    printf("async_writer_create - WARNING - io_uring not supported by this build: using %u I/O threads\n",nThreads);
+#endif
+  }
+  if ( ! w->uring && async_writer_threads_init(w) ) {
+    async_writer_threads_stop(w);
+    goto fail;
+  }
+
+  if ( pthread_create(&w->thread,NULL,async_writer_thread,w) ) {
+    printf("async_writer_create - ERROR - Unable to start writer thread\n");
+#ifdef ASYNC_WRITER_URING
+    if (w->uring) async_writer_uring_stop(w);
+#endif
+    if (! w->uring) async_writer_threads_stop(w);
+    goto fail;
+  }
+  return w;
+
+ fail:
+  if (w->wake_fd != -1) close(w->wake_fd);
+  free(w->op);
+  for(i=0;i<w->n_blocks;i++) free(w->block[i].data);
+  free(w->carry);
+  free(w);
+  return NULL;
+
+}
+
+const char* async_writer_backend(async_writer_t* w)
+{
+  return w->uring ? "io_uring" : "I/O threads";
+}
+
+void async_writer_set_write_back(async_writer_t* w, uint64_t prealloc, uint64_t chunk, int sync)
+{
+  write_back_init(&w->wb,prealloc,chunk);
+  w->sync = sync;
+}
+
+int async_writer_set_direct(async_writer_t* w, int direct)
+{
+  if ( direct && w->block[0].size % ASYNC_WRITER_ALIGN ) {
+    printf("async_writer_set_direct - ERROR - Buffer size %lu is not a multiple of %d as needed by O_DIRECT\n",
+	   (unsigned long)w->block[0].size,ASYNC_WRITER_ALIGN);
+    return -1;
+  }
+  w->direct = direct;
+  return 0;
+}
+
+size_t async_writer_prefix(async_writer_t* w, char* data)
+{
+  size_t len = w->prefix_len;
+  memcpy(data,w->prefix,len);
+  w->prefix_len = 0;
+  return len;
+}
+
+// Add operation to the queue, waiting for space if needed. Return 0 if OK, -1 if a write failed
+static int async_writer_push(async_writer_t* w, async_op_t* op)
+{
+  int err;
+  pthread_mutex_lock(&w->lock);
+  while (w->op_count == w->op_size) pthread_cond_wait(&w->cond,&w->lock);
+  w->op[(w->op_head+w->op_count) % w->op_size] = *op;
+  w->op_count++;
+  err = w->error;
+  pthread_mutex_unlock(&w->lock);
+  async_writer_wake(w);
+  return err ? -1 : 0;
+}
+
+async_block_t* async_writer_get_block(async_writer_t* w)
+{
+
+  async_block_t* b;
+  uint64_t t0 = 0;
+  int err;
+
+  pthread_mutex_lock(&w->lock);
+  if (w->free == NULL) {
+    w->n_waits++;
+    t0 = histo_time();
+    while (w->free == NULL) pthread_cond_wait(&w->cond,&w->lock);
+  }
+  b = w->free;
+  w->free = b->next;
+  err = w->error;
+  pthread_mutex_unlock(&w->lock);
+  if (t0) histo_fill(&w->h_wait,histo_time()-t0);
+
+  b->used = 0;
+  b->events = 0;
+  if (err) {
+    // Give block back: caller stops on error
+    async_writer_submit(w,b);
+    return NULL;
+  }
+  return b;
+
+}
+
+int async_writer_submit(async_writer_t* w, async_block_t* b)
+{
+  async_op_t op;
+  memset(&op,0,sizeof(op));
+  op.type = ASYNC_OP_WRITE;
+  op.block = b;
+  b->t_submit = histo_time();
+  return async_writer_push(w,&op);
+}
+
+int async_writer_open(async_writer_t* w, const char* path, int fd, int raw, unsigned int index, int runNumber, int boardId, uint32_t boardSN, time_t tOpen)
+{
+  async_op_t op;
+  struct stat st;
+  memset(&op,0,sizeof(op));
+  op.type = ASYNC_OP_OPEN;
+  if (path) {
+    op.path = strdup(path);
+    op.fd = -1;
+  } else {
+    op.fd = fd;
+  }
+  op.raw = raw;
+  op.index = index;
+  op.run_number = runNumber;
+  op.board_id = boardId;
+  op.board_sn = boardSN;
+  op.time = tOpen;
+
+  // Files written with O_DIRECT get their head from the caller at the start of the first block
+  if ( w->direct && ( path || ( fstat(fd,&st) == 0 && S_ISREG(st.st_mode) ) ) ) {
+    op.prefix = 1;
+    if (raw) {
+      w->prefix_len = create_raw_file_head(index,runNumber,boardId,boardSN,tOpen,(void*)w->prefix);
+    } else {
+      w->prefix_len = create_file_head(index,runNumber,boardId,boardSN,tOpen,(void*)w->prefix);
+    }
+  }
+
+  if ( async_writer_push(w,&op) ) return -1;
+  return raw ? RAW_FHEAD_LEN*4 : PEVT_FHEAD_LEN*4;
+}
+
+int async_writer_close(async_writer_t* w, time_t tClose)
+{
+  async_op_t op;
+  memset(&op,0,sizeof(op));
+  op.type = ASYNC_OP_CLOSE;
+  op.time = tClose;
+  if (w->prefix_len) op.head_len = async_writer_prefix(w,op.head);
+  if ( async_writer_push(w,&op) ) return -1;
+  return PEVT_FTAIL_LEN*4;
+}
+
+int async_writer_sync(async_writer_t* w)
+{
+  int err;
+  pthread_mutex_lock(&w->lock);
+  while (w->op_count || w->in_flight) pthread_cond_wait(&w->cond,&w->lock);
+  err = w->error;
+  pthread_mutex_unlock(&w->lock);
+  return err ? -1 : 0;
+}
+
+int async_writer_destroy(async_writer_t* w)
+{
+
+  unsigned int i;
+  int rc;
+
+  rc = async_writer_sync(w);
+  pthread_mutex_lock(&w->lock);
+  w->quit = 1;
+  pthread_mutex_unlock(&w->lock);
+  async_writer_wake(w);
+  pthread_join(w->thread,NULL);
+
+#ifdef ASYNC_WRITER_URING
+  if (w->uring) async_writer_uring_stop(w);
+#endif
+  if (! w->uring) async_writer_threads_stop(w);
+
+  close(w->wake_fd);
+  free(w->op);
+  for(i=0;i<w->n_blocks;i++) free(w->block[i].data);
+  free(w->carry);
+  free(w);
+  return rc;
+
+}
+
+void async_writer_report(async_writer_t* w, const char* name)
+{
+  printf("- Writer %s (%s, %u buffers of %lu bytes): %llu bytes with %llu block writes - %llu files - max %u writes in flight - waited for a free buffer %llu times\n",
+	 name,async_writer_backend(w),w->n_blocks,(unsigned long)w->block[0].size,(unsigned long long)w->n_bytes,(unsigned long long)w->n_writes,(unsigned long long)w->n_files,w->max_in_flight,(unsigned long long)w->n_waits);
+  histo_print(&w->h_depth,0);
+  histo_print(&w->h_latency,0);
+  histo_print(&w->h_wait,0);
+  if (w->direct) printf("- Direct I/O %s: %llu files written with O_DIRECT - not supported for %llu files - %llu files continued through the page cache\n",
+			 name,(unsigned long long)w->n_direct,(unsigned long long)w->n_direct_fail,(unsigned long long)w->n_direct_off);
+  if (w->wb.n_files) write_back_report(&w->wb,name);
+}
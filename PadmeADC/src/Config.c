@@ -4,6 +4,7 @@
 #include "regex.h"
 
 #include "Config.h"
+#include "AsyncWriter.h"
 
 #define MAX_PARAM_NAME_LEN  128
 #define MAX_PARAM_VALUE_LEN 1024
@@ -53,6 +54,7 @@ int reset_config()
   strcpy(Config->output_mode,"FILE"); // Default to old functioning mode (write to file)
 
   strcpy(Config->output_stream,""); // No output stream defined when in FILE mode
+  Config->shm_ring_size = 64*1024*1024; // 64MiB shared memory ring in SHM output mode
 
   // In FILE mode all data files written to subdirectory "data" of current directory
   strcpy(Config->data_dir,"data/");
@@ -70,6 +72,8 @@ int reset_config()
   Config->conet2_link = 0;
   Config->conet2_slot = 0; // ignored for USB
 
+  Config->n_boards = 0; // Only read the board defined above
+
   Config->startdaq_mode = 0; // Default to SW controlled start/stop
 
   Config->drs4_sampfreq = 2; // Default to 1GHz sampling frequency
@@ -97,12 +101,48 @@ int reset_config()
   // Enable DRS4 corrections to sampled data
   Config->drs4corr_enable = 1;
 
+  // Decode events using CAEN library
+  strcpy(Config->decode_mode,"CAEN");
+  strcpy(Config->drs4_cache_dir,"drs4/"); // Cache DRS4 correction tables in subdirectory "drs4" of current directory
+
   // Add a delay between successive polls to the board
   Config->daq_loop_delay = 10000; // wait 10 msec after each iteration
 
+  // Poll the board status register to check for available events
+  strcpy(Config->readout_mode,"POLL");
+  Config->irq_num_events = 1; // In IRQ mode, raise an interrupt as soon as one event is ready
+  Config->irq_timeout = 100; // In IRQ mode, check stop conditions at least every 100 msec
+
+  // Use fixed poll delay and BLT size
+  strcpy(Config->readout_control,"FIXED");
+  Config->adaptive_occupancy = 50; // With ADAPTIVE control, read board when it holds half of max_num_events_blt events
+  Config->adaptive_min_delay = 100; // With ADAPTIVE control, poll board at most every 100 usecs
+
+  // Decode and format events in a single thread
+  Config->encode_threads = 1;
+  Config->encode_pin_cpus = 0;
+  Config->readout_cpu = -1; // Readout may run on any cpu
+  Config->writer_cpu = -1;
+  Config->readout_rt_priority = 0; // Readout uses normal scheduling
+  Config->lock_memory = 0;
+
+  // Do readout, event formatting, and writing in the main DAQ loop (no readout ring)
+  Config->daq_ring_size = 0;
+
+  // Drop readout buffers when the readout ring is full
+  strcpy(Config->overload_policy,"DROP");
+  Config->overload_level = 50; // With MISSING policy, stop writing event data when ring is half full
+
   // Apply zero-suppression algorithm 2 in flagging mode (test phase, this default will change in production)
   Config->zero_suppression = 102;
 
+  // Zero-suppression is applied by the ZSUP process
+  Config->daq_zero_suppression = 0;
+
+  // Zero-suppression of the ZSUP process runs on a single thread
+  Config->zsup_threads = 1;
+  Config->zsup_pin_cpus = 0;
+
   // Set default parameters for zero-suppression algorithm 1
   Config->zs1_head = 80; // Use first 80 samples to compute mean and rms
   Config->zs1_tail = 30; // Do not use final 30 samples for zero suppression
@@ -124,9 +164,35 @@ int reset_config()
   Config->file_max_size = 1024*1024*1024; // 1GiB
   Config->file_max_events = 100000; // 1E5 events
 
+  // Output files are opened and closed by the processing thread
+  Config->file_preopen = 0;
+  Config->file_sync_close = 0;
+
+  // Output files are not preallocated and their write back is left to the kernel
+  Config->file_prealloc = 0;
+  Config->file_flush_size = 0;
+
+  // No event index next to the output files
+  Config->file_index = 0;
+
+  // No output buffer: each event is written on its own (when used, write at least every 500 ms)
+  Config->output_buffer_size = 0;
+  Config->output_buffer_events = 0; // No limit
+  Config->output_buffer_delay = 500;
+
+  // Output buffers are written by the processing thread
+  strcpy(Config->output_writer,"SYNC");
+  Config->output_writer_buffers = 8;
+  Config->output_writer_threads = 2;
+  Config->output_writer_test_delay = 0;
+  Config->output_writer_direct = 0;
+
   // Rate of debug output (1=all events)
   Config->debug_scale = 100; // Info about one event on 100 is written to debug output
 
+  // Report latency histograms of processing stages every 5 min
+  Config->latency_report_time = 300;
+
   return 0;
 
 }
@@ -147,6 +213,8 @@ int read_config(char *cfgfile)
   uint64_t vul;
   float vf;
   int ch;
+  int bl,bs;
+  unsigned int i;
 
   regex_t rex_empty;
   regex_t rex_comment;
@@ -177,7 +245,7 @@ int read_config(char *cfgfile)
   // Read configuration from file
   printf("\n=== Reading configuration from file %s ===\n",cfgfile);
   if ( strlen(cfgfile)>=MAX_FILE_LEN ) {
-    printf("ERROR - Configuration file name too long (%u characters): %s\n",strlen(cfgfile),cfgfile);
+    printf("ERROR - Configuration file name too long (%zu characters): %s\n",strlen(cfgfile),cfgfile);
     return 1;
   }
   strcpy(Config->config_file,cfgfile);
@@ -200,7 +268,7 @@ int read_config(char *cfgfile)
       // Extract parameter name
       plen = rm[1].rm_eo-rm[1].rm_so;
       if (plen>=MAX_PARAM_NAME_LEN) {
-	printf("WARNING - Parameter too long (%u characters) in line:\n%s\n",plen,line);
+	printf("WARNING - Parameter too long (%zu characters) in line:\n%s\n",plen,line);
       } else {
 	strncpy(param,line+rm[1].rm_so,plen);
 	param[plen] = '\0';
@@ -209,7 +277,7 @@ int read_config(char *cfgfile)
       // Extract parameter value
       vlen = rm[2].rm_eo-rm[2].rm_so;
       if (vlen>=MAX_PARAM_VALUE_LEN) {
-	printf("WARNING - Value too long (%u characters) in line:\n%s\n",vlen,line);
+	printf("WARNING - Value too long (%zu characters) in line:\n%s\n",vlen,line);
       } else {
 	strncpy(value,line+rm[2].rm_so,vlen);
 	value[vlen] = '\0';
@@ -226,7 +294,7 @@ int read_config(char *cfgfile)
 	  printf("WARNING - Could not parse value %s to number in line:\n%s\n",value,line);
 	}
       } else if ( strcmp(param,"process_mode")==0 ) {
-	if ( strcmp(value,"DAQ")==0 || strcmp(value,"ZSUP")==0 || strcmp(value,"FAKE")==0) {
+	if ( strcmp(value,"DAQ")==0 || strcmp(value,"DAQRAW")==0 || strcmp(value,"ZSUP")==0 || strcmp(value,"FAKE")==0) {
 	  strcpy(Config->process_mode,value);
 	  printf("Parameter %s set to '%s'\n",param,value);
 	} else {
@@ -237,35 +305,35 @@ int read_config(char *cfgfile)
 	  strcpy(Config->start_file,value);
 	  printf("Parameter %s set to '%s'\n",param,value);
 	} else {
-	  printf("WARNING - start_file name too long (%u characters): %s\n",strlen(value),value);
+	  printf("WARNING - start_file name too long (%zu characters): %s\n",strlen(value),value);
 	}
       } else if ( strcmp(param,"quit_file")==0 ) {
 	if ( strlen(value)<MAX_FILE_LEN ) {
 	  strcpy(Config->quit_file,value);
 	  printf("Parameter %s set to '%s'\n",param,value);
 	} else {
-	  printf("WARNING - quit_file name too long (%u characters): %s\n",strlen(value),value);
+	  printf("WARNING - quit_file name too long (%zu characters): %s\n",strlen(value),value);
 	}
       } else if ( strcmp(param,"initok_file")==0 ) {
 	if ( strlen(value)<MAX_FILE_LEN ) {
 	  strcpy(Config->initok_file,value);
 	  printf("Parameter %s set to '%s'\n",param,value);
 	} else {
-	  printf("WARNING - initok_file name too long (%u characters): %s\n",strlen(value),value);
+	  printf("WARNING - initok_file name too long (%zu characters): %s\n",strlen(value),value);
 	}
       } else if ( strcmp(param,"initfail_file")==0 ) {
 	if ( strlen(value)<MAX_FILE_LEN ) {
 	  strcpy(Config->initfail_file,value);
 	  printf("Parameter %s set to '%s'\n",param,value);
 	} else {
-	  printf("WARNING - initfail_file name too long (%u characters): %s\n",strlen(value),value);
+	  printf("WARNING - initfail_file name too long (%zu characters): %s\n",strlen(value),value);
 	}
       } else if ( strcmp(param,"lock_file")==0 ) {
 	if ( strlen(value)<MAX_FILE_LEN ) {
 	  strcpy(Config->lock_file,value);
 	  printf("Parameter %s set to '%s'\n",param,value);
 	} else {
-	  printf("WARNING - lock_file name too long (%u characters): %s\n",strlen(value),value);
+	  printf("WARNING - lock_file name too long (%zu characters): %s\n",strlen(value),value);
 	}
       } else if ( strcmp(param,"run_number")==0 ) {
 	if ( sscanf(value,"%d",&v) ) {
@@ -279,10 +347,10 @@ int read_config(char *cfgfile)
 	  strcpy(Config->input_stream,value);
 	  printf("Parameter %s set to '%s'\n",param,value);
 	} else {
-	  printf("WARNING - input_stream name too long (%u characters): %s\n",strlen(value),value);
+	  printf("WARNING - input_stream name too long (%zu characters): %s\n",strlen(value),value);
 	}
       } else if ( strcmp(param,"output_mode")==0 ) {
-	if ( strcmp(value,"FILE")==0 || strcmp(value,"STREAM")==0 ) {
+	if ( strcmp(value,"FILE")==0 || strcmp(value,"STREAM")==0 || strcmp(value,"SHM")==0 ) {
 	  strcpy(Config->output_mode,value);
 	  printf("Parameter %s set to '%s'\n",param,value);
 	} else {
@@ -293,21 +361,28 @@ int read_config(char *cfgfile)
 	  strcpy(Config->output_stream,value);
 	  printf("Parameter %s set to '%s'\n",param,value);
 	} else {
-	  printf("WARNING - output_stream name too long (%u characters): %s\n",strlen(value),value);
+	  printf("WARNING - output_stream name too long (%zu characters): %s\n",strlen(value),value);
+	}
+      } else if ( strcmp(param,"shm_ring_size")==0 ) {
+	if ( sscanf(value,"%u",&vu) ) {
+	  Config->shm_ring_size = vu;
+	  printf("Parameter %s set to %u\n",param,vu);
+	} else {
+	  printf("WARNING - Could not parse value %s to number in line:\n%s\n",value,line);
 	}
       } else if ( strcmp(param,"data_dir")==0 ) {
 	if ( strlen(value)<MAX_DATA_DIR_LEN ) {
 	  strcpy(Config->data_dir,value);
 	  printf("Parameter %s set to '%s'\n",param,value);
 	} else {
-	  printf("WARNING - data_dir name too long (%u characters): %s\n",strlen(value),value);
+	  printf("WARNING - data_dir name too long (%zu characters): %s\n",strlen(value),value);
 	}
       } else if ( strcmp(param,"data_file")==0 ) {
 	if ( strlen(value)<MAX_DATA_FILE_LEN ) {
 	  strcpy(Config->data_file,value);
 	  printf("Parameter %s set to '%s'\n",param,value);
 	} else {
-	  printf("WARNING - data_file name too long (%u characters): %s\n",strlen(value),value);
+	  printf("WARNING - data_file name too long (%zu characters): %s\n",strlen(value),value);
 	}
       } else if ( strcmp(param,"total_daq_time")==0 ) {
 	if ( sscanf(value,"%d",&v) ) {
@@ -327,6 +402,13 @@ int read_config(char *cfgfile)
 	} else {
 	  printf("WARNING - Could not parse value %s to number in line:\n%s\n",value,line);
 	}
+      } else if ( strcmp(param,"connect_mode")==0 ) {
+	if ( strcmp(value,"USB")==0 || strcmp(value,"OPTICAL")==0 ) {
+	  strcpy(Config->connect_mode,value);
+	  printf("Parameter %s set to '%s'\n",param,value);
+	} else {
+	  printf("WARNING - Value %s not valid for parameter %s: use USB or OPTICAL\n",value,param);
+	}
       } else if ( strcmp(param,"conet2_link")==0 ) {
 	if ( sscanf(value,"%d",&v) ) {
 	  if (v<MAX_N_CONET2_LINKS) {
@@ -349,6 +431,29 @@ int read_config(char *cfgfile)
 	} else {
 	  printf("WARNING - Could not parse value %s to number in line:\n%s\n",value,line);
 	}
+      } else if ( strcmp(param,"add_board")==0 ) {
+	if ( sscanf(value,"%d:%d:%d",&v,&bl,&bs) == 3 ) {
+	  if (v<0 || v>=MAX_N_BOARDS || bl<0 || bl>=MAX_N_CONET2_LINKS || bs<0 || bs>=MAX_N_CONET2_SLOTS) {
+	    printf("WARNING - add_board %s not valid: board must be < %d, link < %d, slot < %d\n",value,MAX_N_BOARDS,MAX_N_CONET2_LINKS,MAX_N_CONET2_SLOTS);
+	  } else if (Config->n_boards>=MAX_N_BOARDS) {
+	    printf("WARNING - Too many boards: ignoring add_board %s\n",value);
+	  } else {
+	    for(i=0;i<Config->n_boards;i++) {
+	      if (Config->board_list_id[i] == v || (Config->board_list_link[i] == bl && Config->board_list_slot[i] == bs)) break;
+	    }
+	    if (i<Config->n_boards) {
+	      printf("WARNING - Board %d or link %d slot %d already added: ignoring add_board %s\n",v,bl,bs,value);
+	    } else {
+	      Config->board_list_id[Config->n_boards] = v;
+	      Config->board_list_link[Config->n_boards] = bl;
+	      Config->board_list_slot[Config->n_boards] = bs;
+	      Config->n_boards++;
+	      printf("Parameter %s: board %d on link %d slot %d\n",param,v,bl,bs);
+	    }
+	  }
+	} else {
+	  printf("WARNING - Could not parse value %s as <board>:<link>:<slot> in line:\n%s\n",value,line);
+	}
       } else if ( strcmp(param,"startdaq_mode")==0 ) {
 	if ( sscanf(value,"%d",&v) ) {
 	  if ( v>2 ) {
@@ -439,6 +544,137 @@ int read_config(char *cfgfile)
 	} else {
 	  printf("WARNING - Could not parse value %s to number in line:\n%s\n",value,line);
 	}
+      } else if ( strcmp(param,"decode_mode")==0 ) {
+	if ( strcmp(value,"CAEN")==0 || strcmp(value,"NATIVE")==0 ) {
+	  strcpy(Config->decode_mode,value);
+	  printf("Parameter %s set to '%s'\n",param,value);
+	} else {
+	  printf("WARNING - Unknown decode mode '%s' selected: ignoring\n",value);
+	}
+      } else if ( strcmp(param,"drs4_cache_dir")==0 ) {
+	if ( strlen(value)<MAX_DATA_DIR_LEN ) {
+	  strcpy(Config->drs4_cache_dir,value);
+	  printf("Parameter %s set to '%s'\n",param,value);
+	} else {
+	  printf("WARNING - drs4_cache_dir name too long (%zu characters): %s\n",strlen(value),value);
+	}
+      } else if ( strcmp(param,"readout_mode")==0 ) {
+	if ( strcmp(value,"POLL")==0 || strcmp(value,"IRQ")==0 ) {
+	  strcpy(Config->readout_mode,value);
+	  printf("Parameter %s set to '%s'\n",param,value);
+	} else {
+	  printf("WARNING - Unknown readout mode '%s' selected: ignoring\n",value);
+	}
+      } else if ( strcmp(param,"readout_control")==0 ) {
+	if ( strcmp(value,"FIXED")==0 || strcmp(value,"ADAPTIVE")==0 ) {
+	  strcpy(Config->readout_control,value);
+	  printf("Parameter %s set to '%s'\n",param,value);
+	} else {
+	  printf("WARNING - Unknown readout control '%s' selected: ignoring\n",value);
+	}
+      } else if ( strcmp(param,"adaptive_occupancy")==0 ) {
+	if ( sscanf(value,"%u",&vu) ) {
+	  if (vu>0 && vu<=100) {
+	    Config->adaptive_occupancy = vu;
+	    printf("Parameter %s set to %u\n",param,vu);
+	  } else {
+	    printf("WARNING - Value %u not valid for parameter %s: must be in [1,100]\n",vu,param);
+	  }
+	} else {
+	  printf("WARNING - Could not parse value %s to number in line:\n%s\n",value,line);
+	}
+      } else if ( strcmp(param,"adaptive_min_delay")==0 ) {
+	if ( sscanf(value,"%d",&v) ) {
+	  Config->adaptive_min_delay = v;
+	  printf("Parameter %s set to %d\n",param,v);
+	} else {
+	  printf("WARNING - Could not parse value %s to number in line:\n%s\n",value,line);
+	}
+      } else if ( strcmp(param,"overload_policy")==0 ) {
+	if ( strcmp(value,"DROP")==0 || strcmp(value,"MISSING")==0 ) {
+	  strcpy(Config->overload_policy,value);
+	  printf("Parameter %s set to '%s'\n",param,value);
+	} else {
+	  printf("WARNING - Unknown overload policy '%s' selected: ignoring\n",value);
+	}
+      } else if ( strcmp(param,"overload_level")==0 ) {
+	if ( sscanf(value,"%u",&vu) ) {
+	  if (vu>0 && vu<=100) {
+	    Config->overload_level = vu;
+	    printf("Parameter %s set to %u\n",param,vu);
+	  } else {
+	    printf("WARNING - Value %u not valid for parameter %s: must be in [1,100]\n",vu,param);
+	  }
+	} else {
+	  printf("WARNING - Could not parse value %s to number in line:\n%s\n",value,line);
+	}
+      } else if ( strcmp(param,"irq_num_events")==0 ) {
+	if ( sscanf(value,"%u",&vu) ) {
+	  Config->irq_num_events = vu;
+	  printf("Parameter %s set to %u\n",param,vu);
+	} else {
+	  printf("WARNING - Could not parse value %s to number in line:\n%s\n",value,line);
+	}
+      } else if ( strcmp(param,"irq_timeout")==0 ) {
+	if ( sscanf(value,"%u",&vu) ) {
+	  Config->irq_timeout = vu;
+	  printf("Parameter %s set to %u\n",param,vu);
+	} else {
+	  printf("WARNING - Could not parse value %s to number in line:\n%s\n",value,line);
+	}
+      } else if ( strcmp(param,"encode_threads")==0 ) {
+	if ( sscanf(value,"%u",&vu) ) {
+	  Config->encode_threads = vu;
+	  printf("Parameter %s set to %u\n",param,vu);
+	} else {
+	  printf("WARNING - Could not parse value %s to number in line:\n%s\n",value,line);
+	}
+      } else if ( strcmp(param,"encode_pin_cpus")==0 ) {
+	if ( sscanf(value,"%d",&v) ) {
+	  Config->encode_pin_cpus = v;
+	  printf("Parameter %s set to %d\n",param,v);
+	} else {
+	  printf("WARNING - Could not parse value %s to number in line:\n%s\n",value,line);
+	}
+      } else if ( strcmp(param,"readout_cpu")==0 ) {
+	if ( sscanf(value,"%d",&v) ) {
+	  Config->readout_cpu = v;
+	  printf("Parameter %s set to %d\n",param,v);
+	} else {
+	  printf("WARNING - Could not parse value %s to number in line:\n%s\n",value,line);
+	}
+      } else if ( strcmp(param,"writer_cpu")==0 ) {
+	if ( sscanf(value,"%d",&v) ) {
+	  Config->writer_cpu = v;
+	  printf("Parameter %s set to %d\n",param,v);
+	} else {
+	  printf("WARNING - Could not parse value %s to number in line:\n%s\n",value,line);
+	}
+      } else if ( strcmp(param,"readout_rt_priority")==0 ) {
+	if ( sscanf(value,"%d",&v) ) {
+	  if (v>=0 && v<=99) {
+	    Config->readout_rt_priority = v;
+	    printf("Parameter %s set to %d\n",param,v);
+	  } else {
+	    printf("WARNING - Value %d not valid for parameter %s: must be in [0,99]\n",v,param);
+	  }
+	} else {
+	  printf("WARNING - Could not parse value %s to number in line:\n%s\n",value,line);
+	}
+      } else if ( strcmp(param,"lock_memory")==0 ) {
+	if ( sscanf(value,"%d",&v) ) {
+	  Config->lock_memory = v;
+	  printf("Parameter %s set to %d\n",param,v);
+	} else {
+	  printf("WARNING - Could not parse value %s to number in line:\n%s\n",value,line);
+	}
+      } else if ( strcmp(param,"daq_ring_size")==0 ) {
+	if ( sscanf(value,"%u",&vu) ) {
+	  Config->daq_ring_size = vu;
+	  printf("Parameter %s set to %u\n",param,vu);
+	} else {
+	  printf("WARNING - Could not parse value %s to number in line:\n%s\n",value,line);
+	}
       } else if ( strcmp(param,"zero_suppression")==0 ) {
 	if ( sscanf(value,"%d",&v) ) {
 	  Config->zero_suppression = v;
@@ -446,6 +682,27 @@ int read_config(char *cfgfile)
 	} else {
 	  printf("WARNING - Could not parse value %s to number in line:\n%s\n",value,line);
 	}
+      } else if ( strcmp(param,"daq_zero_suppression")==0 ) {
+	if ( sscanf(value,"%d",&v) ) {
+	  Config->daq_zero_suppression = v;
+	  printf("Parameter %s set to %d\n",param,v);
+	} else {
+	  printf("WARNING - Could not parse value %s to number in line:\n%s\n",value,line);
+	}
+      } else if ( strcmp(param,"zsup_threads")==0 ) {
+	if ( sscanf(value,"%u",&vu) ) {
+	  Config->zsup_threads = vu;
+	  printf("Parameter %s set to %u\n",param,vu);
+	} else {
+	  printf("WARNING - Could not parse value %s to number in line:\n%s\n",value,line);
+	}
+      } else if ( strcmp(param,"zsup_pin_cpus")==0 ) {
+	if ( sscanf(value,"%d",&v) ) {
+	  Config->zsup_pin_cpus = v;
+	  printf("Parameter %s set to %d\n",param,v);
+	} else {
+	  printf("WARNING - Could not parse value %s to number in line:\n%s\n",value,line);
+	}
       } else if ( strcmp(param,"zs1_head")==0 ) {
 	if ( sscanf(value,"%d",&v) ) {
 	  Config->zs1_head = v;
@@ -531,6 +788,125 @@ int read_config(char *cfgfile)
 	} else {
 	  printf("WARNING - Could not parse value %s to number in line:\n%s\n",value,line);
 	}
+      } else if ( strcmp(param,"file_preopen")==0 ) {
+	if ( sscanf(value,"%d",&v) ) {
+	  if (v==0 || v==1) {
+	    Config->file_preopen = v;
+	    printf("Parameter %s set to %d\n",param,v);
+	  } else {
+	    printf("WARNING - Value of file_preopen must be 0 or 1: %d - ignoring\n",v);
+	  }
+	} else {
+	  printf("WARNING - Could not parse value %s to number in line:\n%s\n",value,line);
+	}
+      } else if ( strcmp(param,"file_sync_close")==0 ) {
+	if ( sscanf(value,"%d",&v) ) {
+	  if (v==0 || v==1) {
+	    Config->file_sync_close = v;
+	    printf("Parameter %s set to %d\n",param,v);
+	  } else {
+	    printf("WARNING - Value of file_sync_close must be 0 or 1: %d - ignoring\n",v);
+	  }
+	} else {
+	  printf("WARNING - Could not parse value %s to number in line:\n%s\n",value,line);
+	}
+      } else if ( strcmp(param,"file_prealloc")==0 ) {
+	if ( sscanf(value,"%d",&v) ) {
+	  if (v==0 || v==1) {
+	    Config->file_prealloc = v;
+	    printf("Parameter %s set to %d\n",param,v);
+	  } else {
+	    printf("WARNING - Value of file_prealloc must be 0 or 1: %d - ignoring\n",v);
+	  }
+	} else {
+	  printf("WARNING - Could not parse value %s to number in line:\n%s\n",value,line);
+	}
+      } else if ( strcmp(param,"file_flush_size")==0 ) {
+	if ( sscanf(value,"%u",&vu) ) {
+	  Config->file_flush_size = vu;
+	  printf("Parameter %s set to %u\n",param,vu);
+	} else {
+	  printf("WARNING - Could not parse value %s to number in line:\n%s\n",value,line);
+	}
+      } else if ( strcmp(param,"file_index")==0 ) {
+	if ( sscanf(value,"%d",&v) ) {
+	  if (v==0 || v==1) {
+	    Config->file_index = v;
+	    printf("Parameter %s set to %d\n",param,v);
+	  } else {
+	    printf("WARNING - Value of file_index must be 0 or 1: %d - ignoring\n",v);
+	  }
+	} else {
+	  printf("WARNING - Could not parse value %s to number in line:\n%s\n",value,line);
+	}
+      } else if ( strcmp(param,"output_buffer_size")==0 ) {
+	if ( sscanf(value,"%u",&vu) ) {
+	  Config->output_buffer_size = vu;
+	  printf("Parameter %s set to %u\n",param,vu);
+	} else {
+	  printf("WARNING - Could not parse value %s to number in line:\n%s\n",value,line);
+	}
+      } else if ( strcmp(param,"output_buffer_events")==0 ) {
+	if ( sscanf(value,"%u",&vu) ) {
+	  Config->output_buffer_events = vu;
+	  printf("Parameter %s set to %u\n",param,vu);
+	} else {
+	  printf("WARNING - Could not parse value %s to number in line:\n%s\n",value,line);
+	}
+      } else if ( strcmp(param,"output_buffer_delay")==0 ) {
+	if ( sscanf(value,"%u",&vu) ) {
+	  Config->output_buffer_delay = vu;
+	  printf("Parameter %s set to %u\n",param,vu);
+	} else {
+	  printf("WARNING - Could not parse value %s to number in line:\n%s\n",value,line);
+	}
+      } else if ( strcmp(param,"output_writer")==0 ) {
+	if ( strcmp(value,"SYNC")==0 || strcmp(value,"ASYNC")==0 || strcmp(value,"URING")==0 || strcmp(value,"THREADS")==0 ) {
+	  strcpy(Config->output_writer,value);
+	  printf("Parameter %s set to '%s'\n",param,value);
+	} else {
+	  printf("WARNING - Unknown output writer '%s' selected: ignoring\n",value);
+	}
+      } else if ( strcmp(param,"output_writer_buffers")==0 ) {
+	if ( sscanf(value,"%u",&vu) ) {
+	  if (vu>=2 && vu<=ASYNC_WRITER_MAX_BUFFERS) {
+	    Config->output_writer_buffers = vu;
+	    printf("Parameter %s set to %u\n",param,vu);
+	  } else {
+	    printf("WARNING - Value of output_writer_buffers must be between 2 and %d: %u - ignoring\n",ASYNC_WRITER_MAX_BUFFERS,vu);
+	  }
+	} else {
+	  printf("WARNING - Could not parse value %s to number in line:\n%s\n",value,line);
+	}
+      } else if ( strcmp(param,"output_writer_threads")==0 ) {
+	if ( sscanf(value,"%u",&vu) ) {
+	  if (vu>=1 && vu<=ASYNC_WRITER_MAX_THREADS) {
+	    Config->output_writer_threads = vu;
+	    printf("Parameter %s set to %u\n",param,vu);
+	  } else {
+	    printf("WARNING - Value of output_writer_threads must be between 1 and %d: %u - ignoring\n",ASYNC_WRITER_MAX_THREADS,vu);
+	  }
+	} else {
+	  printf("WARNING - Could not parse value %s to number in line:\n%s\n",value,line);
+	}
+      } else if ( strcmp(param,"output_writer_test_delay")==0 ) {
+	if ( sscanf(value,"%u",&vu) ) {
+	  Config->output_writer_test_delay = vu;
+	  printf("Parameter %s set to %u\n",param,vu);
+	} else {
+	  printf("WARNING - Could not parse value %s to number in line:\n%s\n",value,line);
+	}
+      } else if ( strcmp(param,"output_writer_direct")==0 ) {
+	if ( sscanf(value,"%d",&v) ) {
+	  if (v==0 || v==1) {
+	    Config->output_writer_direct = v;
+	    printf("Parameter %s set to %d\n",param,v);
+	  } else {
+	    printf("WARNING - Value of output_writer_direct must be 0 or 1: %d - ignoring\n",v);
+	  }
+	} else {
+	  printf("WARNING - Could not parse value %s to number in line:\n%s\n",value,line);
+	}
       } else if ( strcmp(param,"debug_scale")==0 ) {
         if ( sscanf(value,"%u",&vu) ) {
           Config->debug_scale = vu;
@@ -538,6 +914,13 @@ int read_config(char *cfgfile)
         } else {
           printf("WARNING - Could not parse value %s to number in line:\n%s\n",value,line);
         }
+      } else if ( strcmp(param,"latency_report_time")==0 ) {
+	if ( sscanf(value,"%u",&vu) ) {
+	  Config->latency_report_time = vu;
+	  printf("Parameter %s set to %u\n",param,vu);
+	} else {
+	  printf("WARNING - Could not parse value %s to number in line:\n%s\n",value,line);
+	}
       } else {
 	printf("WARNING - Unknown parameter %s from line:\n%s\n",param,line);
       }
@@ -548,7 +931,7 @@ int read_config(char *cfgfile)
       // Extract parameter name
       plen = rcm[1].rm_eo-rcm[1].rm_so;
       if (plen>=MAX_PARAM_NAME_LEN) {
-	printf("WARNING - Parameter too long (%u characters) in line:\n%s\n",plen,line);
+	printf("WARNING - Parameter too long (%zu characters) in line:\n%s\n",plen,line);
       } else {
 	strncpy(param,line+rcm[1].rm_so,plen);
 	param[plen] = '\0';
@@ -558,7 +941,7 @@ int read_config(char *cfgfile)
       ch = -1;
       vlen = rcm[2].rm_eo-rcm[2].rm_so;
       if (vlen>=3) {
-	printf("WARNING - Character number too long (%u characters) in line:\n%s\n",vlen,line);
+	printf("WARNING - Character number too long (%zu characters) in line:\n%s\n",vlen,line);
       } else {
 	strncpy(value,line+rcm[2].rm_so,vlen);
 	value[vlen] = '\0';
@@ -576,7 +959,7 @@ int read_config(char *cfgfile)
       // Extract parameter value
       vlen = rcm[3].rm_eo-rcm[3].rm_so;
       if (vlen>=MAX_PARAM_VALUE_LEN) {
-	printf("WARNING - Value too long (%u characters) in line:\n%s\n",vlen,line);
+	printf("WARNING - Value too long (%zu characters) in line:\n%s\n",vlen,line);
       } else {
 	strncpy(value,line+rcm[3].rm_so,vlen);
 	value[vlen] = '\0';
@@ -626,11 +1009,11 @@ int print_config(){
 
   printf("\n=== Configuration parameters for this run ===\n");
   printf("process_id\t\t%d\t\tDB id for this process\n",Config->process_id);
-  printf("process_mode\t\t'%s'\t\tfunctioning mode for this PadmeDAQ process (DAQ, ZSUP, or FAKE)\n",Config->process_mode);
+  printf("process_mode\t\t'%s'\t\tfunctioning mode for this PadmeDAQ process (DAQ, DAQRAW, ZSUP, or FAKE)\n",Config->process_mode);
   printf("config_file\t\t'%s'\tname of configuration file (can be empty)\n",Config->config_file);
 
   // Control files are only used by DAQ. Will disappear when HW run control signals will be in place
-  if (strcmp(Config->process_mode,"DAQ")==0) {
+  if (strcmp(Config->process_mode,"DAQ")==0 || strcmp(Config->process_mode,"DAQRAW")==0) {
     printf("start_file\t\t'%s'\tname of start file. DAQ will start when this file is created\n",Config->start_file);
     printf("quit_file\t\t'%s'\tname of quit file. DAQ will exit when this file is created\n",Config->quit_file);
   }
@@ -646,9 +1029,12 @@ int print_config(){
     printf("input_stream\t\t'%s'\tname of virtual file used as input stream\n",Config->input_stream);
   }
 
-  printf("output_mode\t\t%s\t\toutput mode (FILE or STREAM)\n",Config->output_mode);
+  printf("output_mode\t\t%s\t\toutput mode (FILE, STREAM, or SHM)\n",Config->output_mode);
   if (strcmp(Config->output_mode,"STREAM")==0) {
     printf("output_stream\t\t%s\t\tname of virtual file used as output stream\n",Config->output_stream);
+  } else if (strcmp(Config->output_mode,"SHM")==0) {
+    printf("output_stream\t\t%s\t\tname of file mapped as shared memory ring\n",Config->output_stream);
+    printf("shm_ring_size\t\t%u\tsize of shared memory ring in bytes\n",Config->shm_ring_size);
   } else {
     printf("data_dir\t\t'%s'\t\tdirectory where output files will be stored\n",Config->data_dir);
     printf("data_file\t\t'%s'\ttemplate name for data files: <date/time> string will be appended\n",Config->data_file);
@@ -659,9 +1045,12 @@ int print_config(){
   printf("conect_mode\t\t%s\t\tADC module connection mode (USB or OPTICAL)\n",Config->connect_mode);
   printf("conet2_link\t\t%d\t\tCONET2 link\n",Config->conet2_link);
   printf("conet2_slot\t\t%d\t\tCONET2 slot\n",Config->conet2_slot);
+  for(i=0;i<(int)Config->n_boards;i++) {
+    printf("add_board\t\t%d:%d:%d\t\tboard:link:slot read by this process\n",Config->board_list_id[i],Config->board_list_link[i],Config->board_list_slot[i]);
+  }
 
   // Show parameters which are relevant for DAQ or FAKE (N.B. FAKE only uses a subset of them)
-  if (strcmp(Config->process_mode,"DAQ")==0 || strcmp(Config->process_mode,"FAKE")==0) {
+  if (strcmp(Config->process_mode,"DAQ")==0 || strcmp(Config->process_mode,"DAQRAW")==0 || strcmp(Config->process_mode,"FAKE")==0) {
     printf("total_daq_time\t\t%d\t\ttime (secs) after which daq will stop. 0=run forever\n",Config->total_daq_time);
     printf("startdaq_mode\t\t%d\t\tstart/stop daq mode (0:SW, 1:S_IN, 2:trg)\n",Config->startdaq_mode);
     printf("drs4_sampfreq\t\t%d\t\tDRS4 sampling frequency (0:5GHz, 1:2.5GHz, 2:1GHz)\n",Config->drs4_sampfreq);
@@ -676,14 +1065,44 @@ int print_config(){
     printf("post_trigger_size\t%d\t\tpost trigger size\n",Config->post_trigger_size);
     printf("max_num_events_blt\t%d\t\tmax number of events to transfer in a single readout\n",Config->max_num_events_blt);
     printf("drs4corr_enable\t\t%d\t\tenable (1) or disable (0) DRS4 corrections to sampled data\n",Config->drs4corr_enable);
+    printf("decode_mode\t\t%s\t\tevent decoding mode (CAEN or NATIVE)\n",Config->decode_mode);
+    if (strcmp(Config->decode_mode,"NATIVE")==0) {
+      printf("drs4_cache_dir\t\t'%s'\t\tdirectory where DRS4 correction tables are cached\n",Config->drs4_cache_dir);
+    }
     printf("daq_loop_delay\t\t%d\t\twait time inside daq loop in usecs\n",Config->daq_loop_delay);
+    printf("readout_mode\t\t%s\t\treadout mode (POLL or IRQ)\n",Config->readout_mode);
+    if (strcmp(Config->readout_mode,"IRQ")==0) {
+      printf("irq_num_events\t\t%u\t\tnumber of events ready which raise an interrupt\n",Config->irq_num_events);
+      printf("irq_timeout\t\t%u\t\tmax time to wait for an interrupt in msecs\n",Config->irq_timeout);
+    }
+    printf("readout_control\t\t%s\t\treadout control (FIXED or ADAPTIVE)\n",Config->readout_control);
+    if (strcmp(Config->readout_control,"ADAPTIVE")==0) {
+      printf("adaptive_occupancy\t%u\t\ttarget events in board memory at readout (%% of max_num_events_blt)\n",Config->adaptive_occupancy);
+      printf("adaptive_min_delay\t%d\t\tshortest delay between board polls in usecs\n",Config->adaptive_min_delay);
+    }
+    printf("encode_threads\t\t%u\t\tnumber of threads used to decode and format events\n",Config->encode_threads);
+    printf("encode_pin_cpus\t\t%d\t\tpin event encoding threads to cpus (0:no, 1:yes)\n",Config->encode_pin_cpus);
+    printf("readout_cpu\t\t%d\t\tcpu where the readout loop runs (-1: no pinning)\n",Config->readout_cpu);
+    printf("writer_cpu\t\t%d\t\tcpu where the writer thread runs (-1: no pinning)\n",Config->writer_cpu);
+    printf("readout_rt_priority\t%d\t\tSCHED_FIFO priority of the readout loop (0: normal scheduling)\n",Config->readout_rt_priority);
+    printf("lock_memory\t\t%d\t\tprefault buffers and lock memory in RAM (0:no, 1:yes)\n",Config->lock_memory);
+    printf("daq_ring_size\t\t%u\t\tnumber of BLT buffers in readout ring, rounded up to a power of 2 (0: no ring, single thread)\n",Config->daq_ring_size);
+    printf("overload_policy\t\t%s\t\tpolicy when output falls behind (DROP or MISSING)\n",Config->overload_policy);
+    if (strcmp(Config->overload_policy,"MISSING")==0) {
+      printf("overload_level\t\t%u\t\treadout ring occupancy (%%) above which events are written without data\n",Config->overload_level);
+    }
+    printf("daq_zero_suppression\t%d\t\tapply zero-suppression while formatting events (0:no, done by ZSUP - 1:yes)\n",Config->daq_zero_suppression);
     printf("auto_threshold\t\t0x%04x\t\tautopass: threshold below which trigger is considered ON\n",Config->auto_threshold);
     printf("auto_duration\t\t%d\t\tautopass: number of ns of trigger ON above which autopass is enabled\n",Config->auto_duration);
   }
 
-  // Show parameters which are relevant for ZSUP
-  if (strcmp(Config->process_mode,"ZSUP")==0) {
+  // Show parameters which are relevant for ZSUP (or for DAQ if it applies zero-suppression)
+  if (strcmp(Config->process_mode,"ZSUP")==0 || (strcmp(Config->process_mode,"DAQ")==0 && Config->daq_zero_suppression)) {
     printf("zero_suppression\t%d\t\tzero-suppression - 100*mode+algorithm (mode:0=reject,1=flag - algorithm:0=OFF,1-15=algorithm id)\n",Config->zero_suppression);
+    if (strcmp(Config->process_mode,"ZSUP")==0) {
+      printf("zsup_threads\t\t%u\t\tnumber of threads used to apply zero-suppression\n",Config->zsup_threads);
+      printf("zsup_pin_cpus\t\t%d\t\tpin zero-suppression threads to cpus (0:no, 1:yes)\n",Config->zsup_pin_cpus);
+    }
 
     // Only show parameters which are relevant for the selected zero suppression algorithm
     if (Config->zero_suppression%100 == 1) {
@@ -706,10 +1125,30 @@ int print_config(){
     printf("file_max_duration\t%d\t\tmax time to write data before changing output file\n",Config->file_max_duration);
     printf("file_max_size\t\t%llu\tmax size of output file before changing it\n",Config->file_max_size);
     printf("file_max_events\t\t%u\t\tmax number of events to write before changing output file\n",Config->file_max_events);
+    printf("file_preopen\t\t%d\t\tprepare next output file in a helper thread (0:no, 1:yes)\n",Config->file_preopen);
+    printf("file_sync_close\t\t%d\t\tsync output file before closing it in the helper thread (0:no, 1:yes)\n",Config->file_sync_close);
+    printf("file_prealloc\t\t%d\t\tpreallocate file_max_size bytes for each output file (0:no, 1:yes)\n",Config->file_prealloc);
+    printf("file_flush_size\t\t%u\tbytes written to disk and dropped from page cache at a time (0: left to kernel)\n",Config->file_flush_size);
+    printf("file_index\t\t%d\t\twrite event index of each output file to '<file>.idx' (0:no, 1:yes)\n",Config->file_index);
+  }
+
+  if (strcmp(Config->output_mode,"SHM")!=0) {
+    printf("output_buffer_size\t%u\t\tsize of output buffer in bytes (0: write each event on its own)\n",Config->output_buffer_size);
+    printf("output_buffer_events\t%u\t\tmax number of events in output buffer (0: no limit)\n",Config->output_buffer_events);
+    printf("output_buffer_delay\t%u\t\tmax time in msecs an event waits in output buffer (0: no limit)\n",Config->output_buffer_delay);
+    printf("output_writer\t\t%s\t\toutput writer (SYNC, ASYNC, URING, or THREADS)\n",Config->output_writer);
+    if (strcmp(Config->output_writer,"SYNC")!=0) {
+      printf("output_writer_buffers\t%u\t\tnumber of output buffers in flight in the asynchronous writer\n",Config->output_writer_buffers);
+      printf("output_writer_threads\t%u\t\tnumber of I/O threads of the asynchronous writer (THREADS backend)\n",Config->output_writer_threads);
+      printf("output_writer_test_delay\t%u\tminimum time in usecs of each write (slow disk simulation, 0: none)\n",Config->output_writer_test_delay);
+      printf("output_writer_direct\t%d\t\twrite output files with O_DIRECT (0:no, 1:yes)\n",Config->output_writer_direct);
+    }
   }
 
   printf("debug_scale\t\t%u\t\tDebug output downscale factor\n",Config->debug_scale);
 
+  printf("latency_report_time\t%u\t\ttime between reports of processing latency histograms in secs (0: end of run only)\n",Config->latency_report_time);
+
   printf("=== End of configuration parameters ===\n\n");
 
   return 0;
@@ -0,0 +1,209 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "Convert.h"
+
+// Vector kernels use GCC vector extensions on vectors of 8 samples. The same code is compiled for the
+// default target (SSE2 on x86_64, NEON on ARM if enabled with SIMDFLAGS in the Makefile) and, on x86,
+// also for AVX2: the AVX2 version is used only if the cpu supports it.
+#if defined(__SSE2__)
+#define CONVERT_VECTOR_NAME "sse2"
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#define CONVERT_VECTOR_NAME "neon"
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#define CONVERT_USE_AVX2 1
+#endif
+
+typedef void (*convert_samples_t)(const float*,int16_t*,unsigned int);
+typedef unsigned int (*convert_trigger_t)(const float*,int16_t*,unsigned int,uint32_t);
+
+// Scalar kernels: reference for the vector ones
+static void convert_samples_scalar(const float* in, int16_t* out, unsigned int n)
+{
+  unsigned int i;
+  for(i=0;i<n;i++) out[i] = roundf(in[i]);
+}
+
+static unsigned int convert_trigger_scalar(const float* in, int16_t* out, unsigned int n, uint32_t thr)
+{
+  unsigned int i,on = 0;
+  for(i=0;i<n;i++) {
+    out[i] = roundf(in[i]);
+    if (out[i] < thr) on++;
+  }
+  return on;
+}
+
+#ifdef CONVERT_VECTOR_NAME
+
+typedef float    v8f32 __attribute__ ((vector_size (32)));
+typedef int32_t  v8i32 __attribute__ ((vector_size (32)));
+typedef uint32_t v8u32 __attribute__ ((vector_size (32)));
+typedef int16_t  v8i16 __attribute__ ((vector_size (16)));
+
+// Round 8 samples as roundf does: truncate, then move away from zero if the dropped fraction is at least 1/2
+// (x-trunc(x) is exact in float). Narrowing keeps the low 16 bits, as the scalar conversion does.
+static inline __attribute__ ((always_inline)) v8i16 convert_round8(const float* in)
+{
+  v8f32 x,d;
+  v8i32 t;
+  memcpy(&x,in,32);
+  t = __builtin_convertvector(x,v8i32);
+  d = x-__builtin_convertvector(t,v8f32);
+  t += (d <= -0.5f);
+  t -= (d >= 0.5f);
+  return __builtin_convertvector(t,v8i16);
+}
+
+static inline __attribute__ ((always_inline)) void convert_samples_body(const float* in, int16_t* out, unsigned int n)
+{
+  unsigned int i;
+  v8i16 s;
+  for(i=0;i+8<=n;i+=8) {
+    s = convert_round8(in+i);
+    memcpy(out+i,&s,16);
+  }
+  for(;i<n;i++) out[i] = roundf(in[i]);
+}
+
+// Samples are compared with the threshold as in the scalar code, i.e. as unsigned 32 bits values
+static inline __attribute__ ((always_inline)) unsigned int convert_trigger_body(const float* in, int16_t* out, unsigned int n, uint32_t thr)
+{
+  unsigned int i,on = 0;
+  v8i16 s;
+  v8i32 cnt = { 0 };
+  for(i=0;i+8<=n;i+=8) {
+    s = convert_round8(in+i);
+    memcpy(out+i,&s,16);
+    cnt -= ( (v8u32)__builtin_convertvector(s,v8i32) < thr );
+  }
+  on = cnt[0]+cnt[1]+cnt[2]+cnt[3]+cnt[4]+cnt[5]+cnt[6]+cnt[7];
+  for(;i<n;i++) {
+    out[i] = roundf(in[i]);
+    if (out[i] < thr) on++;
+  }
+  return on;
+}
+
+static void convert_samples_vector(const float* in, int16_t* out, unsigned int n)
+{
+  convert_samples_body(in,out,n);
+}
+
+static unsigned int convert_trigger_vector(const float* in, int16_t* out, unsigned int n, uint32_t thr)
+{
+  return convert_trigger_body(in,out,n,thr);
+}
+
+#ifdef CONVERT_USE_AVX2
+
+__attribute__ ((target ("avx2"))) static void convert_samples_avx2(const float* in, int16_t* out, unsigned int n)
+{
+  convert_samples_body(in,out,n);
+}
+
+__attribute__ ((target ("avx2"))) static unsigned int convert_trigger_avx2(const float* in, int16_t* out, unsigned int n, uint32_t thr)
+{
+  return convert_trigger_body(in,out,n,thr);
+}
+
+#endif
+
+#endif
+
+// Kernels in use
+static const char* ConvertName = "scalar";
+static convert_samples_t ConvertSamples = convert_samples_scalar;
+static convert_trigger_t ConvertTrigger = convert_trigger_scalar;
+
+// Check kernels against the scalar ones using all halfway cases and random samples in the ADC range
+static int convert_check(convert_samples_t fs, convert_trigger_t ft)
+{
+
+  float in[1024];
+  int16_t out[1024],ref[1024];
+  unsigned int i,on,onRef;
+  int ok = 1;
+
+  for(i=0;i<1024;i++) in[i] = (i%2) ? (float)i/2.f-256.f : (float)((i*2654435761U)%40960)/10.f-200.f;
+  in[1] = nextafterf(0.5f,0.f);
+  in[3] = -nextafterf(0.5f,0.f);
+  in[5] = nextafterf(-0.5f,-1.f);
+  in[7] = 32767.f;
+  in[9] = -32768.f;
+
+  // Use all lengths up to 64 to exercise the scalar tails
+  for(i=0;i<64 && ok;i++) {
+    fs(in,out,i);
+    convert_samples_scalar(in,ref,i);
+    if ( memcmp(out,ref,i*2) ) ok = 0;
+  }
+  fs(in,out,1024);
+  convert_samples_scalar(in,ref,1024);
+  if ( memcmp(out,ref,sizeof(out)) ) ok = 0;
+  on = ft(in,out,1023,1000);
+  onRef = convert_trigger_scalar(in,ref,1023,1000);
+  if ( on != onRef || memcmp(out,ref,1023*2) ) ok = 0;
+
+  return ok ? 0 : 1;
+
+}
+
+int convert_select(const char* name)
+{
+
+  convert_samples_t fs = NULL;
+  convert_trigger_t ft = NULL;
+
+  if ( strcmp(name,"scalar")==0 ) {
+    fs = convert_samples_scalar;
+    ft = convert_trigger_scalar;
+#ifdef CONVERT_VECTOR_NAME
+  } else if ( strcmp(name,CONVERT_VECTOR_NAME)==0 ) {
+    fs = convert_samples_vector;
+    ft = convert_trigger_vector;
+#ifdef CONVERT_USE_AVX2
+  } else if ( strcmp(name,"avx2")==0 && __builtin_cpu_supports("avx2") ) {
+    fs = convert_samples_avx2;
+    ft = convert_trigger_avx2;
+#endif
+#endif
+  }
+  if (fs == NULL) return 1;
+
+  if ( convert_check(fs,ft) ) {
+    printf("convert_select - WARNING - Sample conversion kernels '%s' do not match scalar code: not using them\n",name);
+    return 1;
+  }
+  ConvertName = name;
+  ConvertSamples = fs;
+  ConvertTrigger = ft;
+  return 0;
+
+}
+
+void convert_init()
+{
+  if ( convert_select("avx2")==0 ) return;
+#ifdef CONVERT_VECTOR_NAME
+  if ( convert_select(CONVERT_VECTOR_NAME)==0 ) return;
+#endif
+  convert_select("scalar");
+}
+
+const char* convert_name()
+{
+  return ConvertName;
+}
+
+void convert_samples(const float* in, int16_t* out, unsigned int n)
+{
+  ConvertSamples(in,out,n);
+}
+
+unsigned int convert_trigger(const float* in, int16_t* out, unsigned int n, uint32_t thr)
+{
+  return ConvertTrigger(in,out,n,thr);
+}
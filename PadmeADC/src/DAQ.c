@@ -8,6 +8,11 @@
 #include <fcntl.h>
 #include <signal.h>
 #include <errno.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <math.h>
 
 #include "CAENDigitizer.h"
 
@@ -15,44 +20,239 @@
 #include "Tools.h"
 #include "PEvent.h"
 #include "Signal.h"
+#include "RingBuffer.h"
+#include "V1742.h"
+#include "DRS4.h"
+#include "RawBLT.h"
+#include "WorkerPool.h"
+#include "Histo.h"
+#include "ShmRing.h"
+#include "RealTime.h"
+#include "Convert.h"
+#include "OutputBuffer.h"
+#include "AsyncWriter.h"
+#include "FileRotator.h"
+#include "EventIndex.h"
 
 #include "DAQ.h"
 
+// Sleep time (usecs) of writer thread when readout ring is empty
+#define DAQ_WRITER_IDLE_DELAY 100
+
+// Interval (secs) between reports on readout ring occupancy
+#define DAQ_RING_REPORT_TIME 60
+
+// Max number of event encoding workers and number of events given to each of them in a batch
+#define DAQ_MAX_ENCODE_THREADS 16
+#define DAQ_ENCODE_EVENTS_PER_THREAD 4
+
+// Interrupt level and status id used in IRQ readout mode (same as CAEN WaveDump)
+#define DAQ_IRQ_LEVEL     1
+#define DAQ_IRQ_STATUS_ID 0xAAAA
+
+// Default size of the readout ring when several boards are read by this process or when it is needed by the overload policy
+#define DAQ_MULTI_BOARD_RING_SIZE 16
+
+// Time constant (secs) with which the estimated trigger rate follows a decreasing rate (ADAPTIVE readout control)
+// Rate increases are followed immediately. A long time constant keeps the poll delay short between trigger bursts
+#define DAQ_CONTROL_RATE_TIME 1.
+
+// Min interval (secs) between two logs of the decisions of the adaptive readout control
+#define DAQ_CONTROL_LOG_TIME 1
+
+// Max time (msecs) to wait for space in the shared memory ring before checking for interrupts (SHM mode)
+#define DAQ_SHM_WAIT_TIMEOUT 100
+
+// Output file information
+typedef struct outfile_s {
+  char* name;      // File name (FILE mode)
+  char* path;      // Full path of file or stream
+  uint64_t size;   // Bytes written
+  uint32_t events; // Events written
+  time_t t_open;
+  time_t t_close;
+} outfile_t;
+
+// Information about each board read by this process
+typedef struct board_s {
+  int id;        // Board id
+  int link;      // CONET2 link (or USB channel) of the board
+  int slot;      // Position of the board on the CONET2 optical chain
+  int handle;    // Handle for CAEN ADC module (-1: not connected)
+  uint32_t sn;   // Board serial number
+  int use_irq;   // Set if board is read in IRQ mode
+  char* buffer;  // Readout buffer (spare buffer used to drain the board when the readout ring is full)
+  ring_t* ring;  // Readout ring (only used if daq_ring_size>0)
+  outfile_t* file; // Output files (MAX_N_OUTPUT_FILES)
+  unsigned int file_index;
+  int file_handle;
+  shm_ring_t* shm; // Shared memory ring used as output stream (SHM mode)
+  output_buffer_t* out; // Buffer collecting events written to output file or stream (not used in SHM mode)
+  async_writer_t* writer; // Asynchronous writer of output files (NULL: output buffer written by the DAQ thread)
+  file_rotator_t* rotator; // Helper preparing and closing output files (NULL: files opened and closed by the DAQ thread)
+  event_index_t* index; // Index of the events of the current output file (NULL: not written)
+  const drs4_table_t* drs4; // DRS4 correction tables used by the native decoder (NULL: no corrections)
+  // Counters for input and output data
+  uint64_t read_size;
+  uint32_t read_events;
+  uint64_t write_size;
+  uint32_t write_events;
+  uint32_t missing_events; // Events written without data (MISSING overload policy)
+  // Readout loop counters (used to compare POLL and IRQ readout modes)
+  uint64_t n_loops, n_status_reads, n_irqs, n_irq_timeouts, n_readouts, n_empty_readouts;
+  uint64_t n_memory_full; // Readouts which found a group memory full
+  uint64_t t_last_loop;   // Time of previous readout loop iteration (ns)
+  // Adaptive readout control
+  uint32_t blt_events;    // Max number of events transferred in one readout
+  useconds_t loop_delay;  // Delay between two polls (POLL mode)
+  double trig_rate;       // Estimated trigger rate (Hz)
+  uint64_t t_last_read;   // Time of previous readout (ns)
+  int drained;            // Set if previous readout left the board memory empty
+  uint64_t n_blt_changes; // Number of changes of the BLT size
+  useconds_t log_delay;   // Poll delay at time of last log
+  uint32_t log_blt;       // BLT size at time of last log
+  time_t t_control_log;   // Time of last log
+} board_t;
+
+// Readout thread used for all the boards on one CONET2 link (multi-board mode)
+typedef struct link_s {
+  pthread_t thread;
+  int link;
+  unsigned int n_boards;
+  board_t* board[MAX_N_CONET2_SLOTS];
+} link_t;
+
 // Global variables
 
-int Handle; // Handle for CAEN ADC module
+static board_t Board[MAX_N_BOARDS]; // Boards read by this process
+static unsigned int NBoards = 0;
+static link_t Link[MAX_N_CONET2_LINKS]; // Readout threads (multi-board mode)
+static unsigned int NLinks = 0;
+
+// Buffers used to decode and format events
+static CAEN_DGTZ_X742_EVENT_t *event[DAQ_MAX_ENCODE_THREADS]; // One decoded event for each encoding worker
+static char *outEvtBuffer = NULL; // Holds encodeBatch formatted events of maxPEvtSize bytes each
+static int maxPEvtSize;
+
+// Events of the current encoding batch (context of the encoding pool workers)
+typedef struct encode_batch_s {
+  board_t* board;                   // Board which produced the events
+  CAEN_DGTZ_EventInfo_t* info;      // Info of each event
+  char** ptr;                       // Pointer to each event
+  int* size;                        // Size of each formatted event (0: event rejected)
+} encode_batch_t;
+
+// Event encoding pool: events of each readout buffer are decoded and formatted in batches of encodeBatch events
+static pool_t* EncodePool = NULL;
+static unsigned int encodeBatch;
+static encode_batch_t EncBatch;
+static int DecodeNative; // Set if events are decoded with the native V1742 decoder
+static char fileBuffer[PEVT_FHEAD_LEN*4+PEVT_FTAIL_LEN*4]; // Used for file head and tail
+static char bltHeader[RAW_BLT_HEADER_LEN*4]; // Used for BLT header in DAQRAW mode
+
+// In DAQRAW process mode readout buffers are written as they are, without decoding events
+static int RawMode = 0;
+
+// Set if poll delay and BLT size follow the observed trigger rate (ADAPTIVE readout control)
+static int AdaptiveReadout = 0;
+
+// Set if events are written without data when the output falls behind (MISSING overload policy)
+static int OverloadMissing = 0;
+
+// Set when one of the boards reached the maximum number of output files (set by the writer, read by all threads)
+static atomic_int tooManyOutputFiles;
+static char tmpName[MAX_FILENAME_LEN+5]; // Board id tag "_bNNN" is added in multi-board mode
+
+// Readout ring and writer thread control (only used if daq_ring_size>0)
+static atomic_int ReadoutDone; // Set by readout loop when no more data will be queued
+static atomic_int WriterDone;  // Set by writer thread when it exits
+static atomic_int WriterStatus; // 0: OK, 1: data handling error, 2: output error
+
+// Readout threads control (multi-board mode)
+static atomic_int ReadoutStop;   // Set by main thread to stop readout threads
+static atomic_int ReadoutStatus; // 0: OK, 1: ADC access error
+
+// Latency (ns) and size histograms of the readout and processing stages
+static histo_t HLoop, HIRQWait, HStatus, HReadData, HBLTSize, HBLTEvents, HDecode, HFormat, HWrite, HRotate;
 
 extern int InBurst;
 extern int BreakSignal;
 
-// Handle initial connection to digitizer. Return 0 if OK, >0 if error
-int DAQ_connect ()
+// Fill the list of boards read by this process from the configuration
+// If no add_board parameter was given, only the board defined by board_id/conet2_link/conet2_slot is read
+static void DAQ_setup_boards()
+{
+
+  unsigned int i,l;
+  board_t* b;
+
+  NBoards = Config->n_boards;
+  if (NBoards == 0) {
+    NBoards = 1;
+    Board[0].id = Config->board_id;
+    Board[0].link = Config->conet2_link;
+    Board[0].slot = Config->conet2_slot;
+  } else {
+    for(i=0;i<NBoards;i++) {
+      Board[i].id = Config->board_list_id[i];
+      Board[i].link = Config->board_list_link[i];
+      Board[i].slot = Config->board_list_slot[i];
+    }
+  }
+
+  // Group boards by link: each link will be read by its own thread
+  NLinks = 0;
+  for(i=0;i<NBoards;i++) {
+    b = &Board[i];
+    b->handle = -1;
+    b->sn = 0;
+    for(l=0;l<NLinks;l++) if (Link[l].link == b->link) break;
+    if (l == NLinks) {
+      Link[l].link = b->link;
+      Link[l].n_boards = 0;
+      NLinks++;
+    }
+    Link[l].board[Link[l].n_boards++] = b;
+  }
+
+  // Interrupts cannot be waited for on more than one board of the same link
+  for(l=0;l<NLinks;l++) {
+    for(i=0;i<Link[l].n_boards;i++) {
+      Link[l].board[i]->use_irq = ( strcmp(Config->readout_mode,"IRQ")==0 && Link[l].n_boards == 1 );
+    }
+    if ( strcmp(Config->readout_mode,"IRQ")==0 && Link[l].n_boards > 1 ) {
+      printf("WARNING - %u boards on link %d: using POLL readout mode for them\n",Link[l].n_boards,Link[l].link);
+    }
+  }
+
+}
+
+// Handle initial connection to one digitizer. Return 0 if OK, >0 if error
+static int DAQ_connect_board(board_t* b)
 {
 
   CAEN_DGTZ_ErrorCode ret;
   CAEN_DGTZ_BoardInfo_t boardInfo;
   
-  // Open connection to digitizer and initialize Handle global variable
+  // Open connection to digitizer and initialize board handle
   ret = 0;
   if ( strcmp(Config->connect_mode,"USB")==0 ) {
     // Connect to first device on USB link (use Conet2 link as USB address, ignore conet2_node)
-    printf("- Connecting to CAEN digitizer board %d via USB channel %d\n",Config->board_id,Config->conet2_link);
-    ret = CAEN_DGTZ_OpenDigitizer(CAEN_DGTZ_USB,Config->conet2_link,0,0,&Handle);
+    printf("- Connecting to CAEN digitizer board %d via USB channel %d\n",b->id,b->link);
+    ret = CAEN_DGTZ_OpenDigitizer(CAEN_DGTZ_USB,b->link,0,0,&b->handle);
   } else if ( strcmp(Config->connect_mode,"OPTICAL")==0 ) {
     // Connect to required link/slot of A3818 optical board
-    printf("- Connecting to CAEN digitizer board %d via A3818 optical board on link %d slot %d\n",Config->board_id,Config->conet2_link,Config->conet2_slot);
-    ret = CAEN_DGTZ_OpenDigitizer(CAEN_DGTZ_OpticalLink,Config->conet2_link,Config->conet2_slot,0,&Handle);
+    printf("- Connecting to CAEN digitizer board %d via A3818 optical board on link %d slot %d\n",b->id,b->link,b->slot);
+    ret = CAEN_DGTZ_OpenDigitizer(CAEN_DGTZ_OpticalLink,b->link,b->slot,0,&b->handle);
   }
   if (ret != CAEN_DGTZ_Success) {
     printf("Unable to connect to digitizer. Error code: %d\n",ret);
+    b->handle = -1;
     return 1;
   }
 
-  // Set signal handlers to make sure digitizer is reset before exiting
-  set_signal_handlers();
-
   // Show information on connected digitizer
-  ret = CAEN_DGTZ_GetInfo(Handle, &boardInfo);
+  ret = CAEN_DGTZ_GetInfo(b->handle, &boardInfo);
   if (ret != CAEN_DGTZ_Success) {
     printf("Unable to retrieve information about the digitizer. Error code: %d\n",ret);
     return 1;
@@ -65,15 +265,38 @@ int DAQ_connect ()
   printf("- AMC FPGA Release: %s\n", boardInfo.AMC_FirmwareRel);
   printf("- PCB revision number: %u\n", boardInfo.PCB_Revision);
 
-  // Get board serial number and save it to DB
-  Config->board_sn = boardInfo.SerialNumber;
+  // Get board serial number
+  b->sn = boardInfo.SerialNumber;
   
   return 0;
 
 }
 
-// Handle initialization of the digitizer. Return 0 if OK, >0 if error
-int DAQ_init ()
+// Handle initial connection to all digitizers. Return 0 if OK, >0 if error
+int DAQ_connect ()
+{
+
+  unsigned int i;
+
+  DAQ_setup_boards();
+  if (NBoards > 1) printf("- Reading %u boards on %u links\n",NBoards,NLinks);
+
+  // Set signal handlers to make sure digitizers are reset before exiting
+  set_signal_handlers();
+
+  for(i=0;i<NBoards;i++) {
+    if ( DAQ_connect_board(&Board[i]) ) return 1;
+  }
+
+  // Save serial number of (first) board to DB
+  Config->board_sn = Board[0].sn;
+
+  return 0;
+
+}
+
+// Handle initialization of one digitizer. Return 0 if OK, >0 if error
+static int DAQ_init_board(board_t* b)
 {
   CAEN_DGTZ_ErrorCode ret;
   CAEN_DGTZ_AcqMode_t mode;
@@ -84,11 +307,11 @@ int DAQ_init ()
 
   uint32_t kk;
 
-  InBurst = 0;
+  if (NBoards > 1) printf("- Initializing board %d\n",b->id);
 
   // Reset digitizer to its default values
   printf("- Resetting digitizer\n");
-  ret = CAEN_DGTZ_Reset(Handle);
+  ret = CAEN_DGTZ_Reset(b->handle);
   if (ret != CAEN_DGTZ_Success) {
     printf("ERROR - Unable to reset digitizer. Error code: %d\n",ret);
     return 1;
@@ -108,12 +331,12 @@ int DAQ_init ()
     printf("\nERROR - DRS4 sampling frequency configuration parameter set to %d\n",Config->drs4_sampfreq);
     return 1;
   }
-  ret = CAEN_DGTZ_SetDRS4SamplingFrequency(Handle,sampfreq);
+  ret = CAEN_DGTZ_SetDRS4SamplingFrequency(b->handle,sampfreq);
   if (ret != CAEN_DGTZ_Success) {
     printf("\nERROR - Unable to set sampling frequency. Error code: %d\n",ret);
     return 1;
   }
-  ret = CAEN_DGTZ_GetDRS4SamplingFrequency(Handle,&sampfreq);
+  ret = CAEN_DGTZ_GetDRS4SamplingFrequency(b->handle,&sampfreq);
   if (ret != CAEN_DGTZ_Success) {
     printf("\nERROR - Unable to read DRS4 sampling frequency. Error code: %d\n",ret);
     return 1;
@@ -121,7 +344,7 @@ int DAQ_init ()
   printf(" read %d\n",sampfreq);
 
   // Set record length (i.e. number of samples). Can be 1024, 520, 256, or 136
-  ret = CAEN_DGTZ_GetRecordLength(Handle,&data);
+  ret = CAEN_DGTZ_GetRecordLength(b->handle,&data);
   if (ret != CAEN_DGTZ_Success) {
     printf("\nERROR - Unable to read record length. Error code: %d\n",ret);
     return 1;
@@ -129,12 +352,12 @@ int DAQ_init ()
   printf("- Setting record length (number of samples). def %d",data);
   data = 1024;
   printf(" write %d",data);
-  ret = CAEN_DGTZ_SetRecordLength(Handle,data);
+  ret = CAEN_DGTZ_SetRecordLength(b->handle,data);
   if (ret != CAEN_DGTZ_Success) {
     printf("\nERROR - Unable to set record length. Error code: %d\n",ret);
     return 1;
   }
-  ret = CAEN_DGTZ_GetRecordLength(Handle,&data);
+  ret = CAEN_DGTZ_GetRecordLength(b->handle,&data);
   if (ret != CAEN_DGTZ_Success) {
     printf("\nERROR - Unable to read record length. Error code: %d\n",ret);
     return 1;
@@ -149,12 +372,12 @@ int DAQ_init ()
 
   reg = 0x8120;
   printf("- Setting group enable mask (reg 0x%04x) write 0x%01x",reg,Config->group_enable_mask);
-  ret = CAEN_DGTZ_WriteRegister(Handle,reg,Config->group_enable_mask);
+  ret = CAEN_DGTZ_WriteRegister(b->handle,reg,Config->group_enable_mask);
   if (ret != CAEN_DGTZ_Success) {
     printf("\nERROR - Unable to set group enable mask. Error code: %d\n",ret);
     return 1;
   }
-  ret = CAEN_DGTZ_ReadRegister(Handle,reg,&data);
+  ret = CAEN_DGTZ_ReadRegister(b->handle,reg,&data);
   if (ret != CAEN_DGTZ_Success) {
     printf("\nERROR - Unable to read group enable maskd. Error code: %d\n",ret);
     return 1;
@@ -162,12 +385,12 @@ int DAQ_init ()
   printf(" read 0x%01x\n",data);
   /*
   printf("- Setting group enable mask. Write 0x%01x",Config->group_enable_mask);
-  ret = CAEN_DGTZ_SetGroupEnableMask(Handle,Config->group_enable_mask);
+  ret = CAEN_DGTZ_SetGroupEnableMask(b->handle,Config->group_enable_mask);
   if (ret != CAEN_DGTZ_Success) {
     printf("\nERROR - Unable to set group enable mask. Error code: %d\n",ret);
     return 1;
   }
-  ret = CAEN_DGTZ_GetGroupEnableMask(Handle,&data);
+  ret = CAEN_DGTZ_GetGroupEnableMask(b->handle,&data);
   if (ret != CAEN_DGTZ_Success) {
     printf("\nERROR - Unable to read group enable maskd. Error code: %d\n",ret);
     return 1;
@@ -176,7 +399,7 @@ int DAQ_init ()
   */
 
   // Uncomment to enable ADC test mode
-  // CAEN_DGTZ_WriteRegister(Handle,0x8004,8);
+  // CAEN_DGTZ_WriteRegister(b->handle,0x8004,8);
   // printf("WARNING SAWTHOOTH ACTIVE!!\n");
   // printf("WARNING SAWTHOOTH ACTIVE!!\n"); 
   // printf("WARNING SAWTHOOTH ACTIVE!!\n");  
@@ -186,19 +409,19 @@ int DAQ_init ()
   for(kk=0;kk<32;kk++){
     if (Config->group_enable_mask & (0x1 << (kk/8))) {
       printf("- Channel %2d offset -",kk);
-      ret = CAEN_DGTZ_GetChannelDCOffset(Handle,kk,&data); 
+      ret = CAEN_DGTZ_GetChannelDCOffset(b->handle,kk,&data); 
       if (ret != CAEN_DGTZ_Success) {
 	printf("\nERROR - Unable to read default offset for channel %d. Error code: %d\n",kk,ret);
 	return 1;
       }
       printf(" default 0x%04x",data);
       printf(" write 0x%04x",Config->offset_ch[kk]);
-      ret = CAEN_DGTZ_SetChannelDCOffset(Handle,kk,Config->offset_ch[kk]); 
+      ret = CAEN_DGTZ_SetChannelDCOffset(b->handle,kk,Config->offset_ch[kk]); 
       if (ret != CAEN_DGTZ_Success) {
 	printf("\nERROR - Unable to set offset for channel %d. Error code: %d\n",kk,ret);
 	return 1;
       }
-      ret = CAEN_DGTZ_GetChannelDCOffset(Handle,kk,&data); 
+      ret = CAEN_DGTZ_GetChannelDCOffset(b->handle,kk,&data); 
       if (ret != CAEN_DGTZ_Success) {
 	printf("\nERROR - Unable to read offset for channel %d. Error code: %d\n",kk,ret);
 	return 1;
@@ -208,7 +431,7 @@ int DAQ_init ()
   }
 
   // Set post trigger size (0% - 100%)
-  ret = CAEN_DGTZ_GetPostTriggerSize(Handle,&data);
+  ret = CAEN_DGTZ_GetPostTriggerSize(b->handle,&data);
   if (ret != CAEN_DGTZ_Success) {
     printf("\nERROR - Unable to read post trigger size. Error code: %d\n",ret);
     return 1;
@@ -216,12 +439,12 @@ int DAQ_init ()
   printf("- Setting post trigger size. def %d",data);
   data = Config->post_trigger_size;
   printf(" write %d",data);
-  ret = CAEN_DGTZ_SetPostTriggerSize(Handle,data);
+  ret = CAEN_DGTZ_SetPostTriggerSize(b->handle,data);
   if (ret != CAEN_DGTZ_Success) {
     printf("\nERROR - Unable to set post trigger size. Error code: %d\n",ret);
     return 1;
   }
-  ret = CAEN_DGTZ_GetPostTriggerSize(Handle,&data);
+  ret = CAEN_DGTZ_GetPostTriggerSize(b->handle,&data);
   if (ret != CAEN_DGTZ_Success) {
     printf("\nERROR - Unable to read post trigger size. Error code: %d\n",ret);
     return 1;
@@ -233,7 +456,7 @@ int DAQ_init ()
 
     // Disable software triggers
     printf("- Disabling software triggers\n");
-    ret = CAEN_DGTZ_SetSWTriggerMode(Handle,CAEN_DGTZ_TRGMODE_DISABLED);
+    ret = CAEN_DGTZ_SetSWTriggerMode(b->handle,CAEN_DGTZ_TRGMODE_DISABLED);
     if (ret != CAEN_DGTZ_Success) {
       printf("ERROR - Unable to disable software triggers. Error code: %d\n",ret);
       return 1;
@@ -241,7 +464,7 @@ int DAQ_init ()
 
     // Disable fast trigger
     printf("- Disabling fast triggers\n");
-    ret = CAEN_DGTZ_SetFastTriggerMode(Handle,CAEN_DGTZ_TRGMODE_DISABLED);
+    ret = CAEN_DGTZ_SetFastTriggerMode(b->handle,CAEN_DGTZ_TRGMODE_DISABLED);
     if (ret != CAEN_DGTZ_Success) {
       printf("ERROR - Unable to disable fast trigger. Error code: %d\n",ret);
       return 1;
@@ -249,7 +472,7 @@ int DAQ_init ()
 
     // Enable external trigger and transmit it to trigger output
     printf("- Enabling external triggers\n");
-    ret = CAEN_DGTZ_SetExtTriggerInputMode(Handle,CAEN_DGTZ_TRGMODE_ACQ_AND_EXTOUT);
+    ret = CAEN_DGTZ_SetExtTriggerInputMode(b->handle,CAEN_DGTZ_TRGMODE_ACQ_AND_EXTOUT);
     if (ret != CAEN_DGTZ_Success) {
       printf("ERROR - Unable to enable external trigger. Error code: %d\n",ret);
       return 1;
@@ -258,9 +481,9 @@ int DAQ_init ()
     // Set external trigger signals to NIM or TTL standard according to configuration
     printf("- Setting trigger IO level to %s\n",Config->trigger_iolevel);
     if ( strcmp(Config->trigger_iolevel,"NIM") == 0 ) {
-      ret = CAEN_DGTZ_SetIOLevel(Handle,CAEN_DGTZ_IOLevel_NIM);
+      ret = CAEN_DGTZ_SetIOLevel(b->handle,CAEN_DGTZ_IOLevel_NIM);
     } else if ( strcmp(Config->trigger_iolevel,"TTL") == 0 ) {
-      ret = CAEN_DGTZ_SetIOLevel(Handle,CAEN_DGTZ_IOLevel_TTL);
+      ret = CAEN_DGTZ_SetIOLevel(b->handle,CAEN_DGTZ_IOLevel_TTL);
     } else {
       printf("ERROR - trigger_iolevel is set to %s (this should not happen!)",Config->trigger_iolevel);
       return 1;
@@ -274,7 +497,7 @@ int DAQ_init ()
 
     // Disable software triggers
     printf("- Disabling software triggers\n");
-    ret = CAEN_DGTZ_SetSWTriggerMode(Handle,CAEN_DGTZ_TRGMODE_DISABLED);
+    ret = CAEN_DGTZ_SetSWTriggerMode(b->handle,CAEN_DGTZ_TRGMODE_DISABLED);
     if (ret != CAEN_DGTZ_Success) {
       printf("ERROR - Unable to disable software triggers. Error code: %d\n",ret);
       return 1;
@@ -282,7 +505,7 @@ int DAQ_init ()
 
     // Disable external triggers
     printf("- Disabling external triggers\n");
-    ret = CAEN_DGTZ_SetExtTriggerInputMode(Handle,CAEN_DGTZ_TRGMODE_DISABLED);
+    ret = CAEN_DGTZ_SetExtTriggerInputMode(b->handle,CAEN_DGTZ_TRGMODE_DISABLED);
     if (ret != CAEN_DGTZ_Success) {
       printf("ERROR - Unable to disable external trigger. Error code: %d\n",ret);
       return 1;
@@ -290,7 +513,7 @@ int DAQ_init ()
 
     // Enable fast trigger
     printf("- Enabling fast triggers\n");
-    ret = CAEN_DGTZ_SetFastTriggerMode(Handle,CAEN_DGTZ_TRGMODE_ACQ_ONLY);
+    ret = CAEN_DGTZ_SetFastTriggerMode(b->handle,CAEN_DGTZ_TRGMODE_ACQ_ONLY);
     if (ret != CAEN_DGTZ_Success) {
       printf("ERROR - Unable to enable fast trigger. Error code: %d\n",ret);
       return 1;
@@ -298,7 +521,7 @@ int DAQ_init ()
 
     // Enable fast trigger readout
     printf("- Enabling fast triggers readout\n");
-    ret = CAEN_DGTZ_SetFastTriggerDigitizing(Handle,CAEN_DGTZ_ENABLE);
+    ret = CAEN_DGTZ_SetFastTriggerDigitizing(b->handle,CAEN_DGTZ_ENABLE);
     if (ret != CAEN_DGTZ_Success) {
       printf("ERROR - Unable to enable fast trigger readout. Error code: %d\n",ret);
       return 1;
@@ -316,12 +539,12 @@ int DAQ_init ()
     }
 
     printf("- Setting fast trigger polarization for TR0 & TR1, write 0x%04x", tr_polarity);
-    ret = CAEN_DGTZ_SetTriggerPolarity(Handle,0,tr_polarity);
+    ret = CAEN_DGTZ_SetTriggerPolarity(b->handle,0,tr_polarity);
     if (ret != CAEN_DGTZ_Success) {
       printf("\nERROR - Unable to set fast trigger polarity for TR0 & TR1. Error code: %d\n",ret);
       return 1;
     }
-    ret = CAEN_DGTZ_GetTriggerPolarity(Handle,0,&tr_polarity);
+    ret = CAEN_DGTZ_GetTriggerPolarity(b->handle,0,&tr_polarity);
     if (ret != CAEN_DGTZ_Success) {
       printf("\nERROR - Unable to read fast trigger polarity for TR0 & TR1. Error code: %d\n",ret);
       return 1;
@@ -342,12 +565,12 @@ int DAQ_init ()
     }
 
     printf("- Setting fast trigger DC offset for TR0, write 0x%04x", tr_offset);
-    ret = CAEN_DGTZ_SetGroupFastTriggerDCOffset(Handle,0,tr_offset);
+    ret = CAEN_DGTZ_SetGroupFastTriggerDCOffset(b->handle,0,tr_offset);
     if (ret != CAEN_DGTZ_Success) {
       printf("\nERROR - Unable to set fast trigger DC offset for TR0. Error code: %d\n",ret);
       return 1;
     }
-    ret = CAEN_DGTZ_GetGroupFastTriggerDCOffset(Handle,0,&data);
+    ret = CAEN_DGTZ_GetGroupFastTriggerDCOffset(b->handle,0,&data);
     if (ret != CAEN_DGTZ_Success) {
       printf("\nERROR - Unable to read fast trigger DC offset for TR0. Error code: %d\n",ret);
       return 1;
@@ -355,12 +578,12 @@ int DAQ_init ()
     printf(" read 0x%04x\n",data);
 
     printf("- Setting fast trigger DC offset for TR1, write 0x%04x", tr_offset);
-    ret = CAEN_DGTZ_SetGroupFastTriggerDCOffset(Handle,2,tr_offset);
+    ret = CAEN_DGTZ_SetGroupFastTriggerDCOffset(b->handle,2,tr_offset);
     if (ret != CAEN_DGTZ_Success) {
       printf("\nERROR - Unable to set fast trigger DC offset for TR1. Error code: %d\n",ret);
       return 1;
     }
-    ret = CAEN_DGTZ_GetGroupFastTriggerDCOffset(Handle,2,&data);
+    ret = CAEN_DGTZ_GetGroupFastTriggerDCOffset(b->handle,2,&data);
     if (ret != CAEN_DGTZ_Success) {
       printf("\nERROR - Unable to read fast trigger DC offset for TR1. Error code: %d\n",ret);
       return 1;
@@ -370,12 +593,12 @@ int DAQ_init ()
     // Set fast trigger threshold for TR0 and TR1 (see V1742 manual for details)
 
     printf("- Setting fast trigger threshold for TR0, write 0x%04x",tr_threshold);
-    ret = CAEN_DGTZ_SetGroupFastTriggerThreshold(Handle,0,tr_threshold);
+    ret = CAEN_DGTZ_SetGroupFastTriggerThreshold(b->handle,0,tr_threshold);
     if (ret != CAEN_DGTZ_Success) {
       printf("ERROR - Unable to set fast trigger threshold for TR0. Error code: %d\n",ret);
       return 1;
     }
-    ret = CAEN_DGTZ_GetGroupFastTriggerThreshold(Handle,0,&data);
+    ret = CAEN_DGTZ_GetGroupFastTriggerThreshold(b->handle,0,&data);
     if (ret != CAEN_DGTZ_Success) {
       printf("ERROR - Unable to read fast trigger threshold for TR0. Error code: %d\n",ret);
       return 1;
@@ -383,12 +606,12 @@ int DAQ_init ()
     printf(" read 0x%04x\n",data);
 
     printf("- Setting fast trigger threshold for TR1, write 0x%04x",tr_threshold);
-    ret = CAEN_DGTZ_SetGroupFastTriggerThreshold(Handle,2,tr_threshold);
+    ret = CAEN_DGTZ_SetGroupFastTriggerThreshold(b->handle,2,tr_threshold);
     if (ret != CAEN_DGTZ_Success) {
       printf("ERROR - Unable to set fast trigger threshold for TR1. Error code: %d\n",ret);
       return 1;
     }
-    ret = CAEN_DGTZ_GetGroupFastTriggerThreshold(Handle,2,&data);
+    ret = CAEN_DGTZ_GetGroupFastTriggerThreshold(b->handle,2,&data);
     if (ret != CAEN_DGTZ_Success) {
       printf("ERROR - Unable to read fast trigger threshold for TR1. Error code: %d\n",ret);
       return 1;
@@ -403,7 +626,7 @@ int DAQ_init ()
   }
 
   // Set max number of events to transfer in a single readout
-  ret = CAEN_DGTZ_GetMaxNumEventsBLT(Handle,&data);
+  ret = CAEN_DGTZ_GetMaxNumEventsBLT(b->handle,&data);
   if (ret != CAEN_DGTZ_Success) {
     printf("ERROR - Unable to read max number of events BLT. Error code: %d\n",ret);
     return 1;
@@ -411,27 +634,54 @@ int DAQ_init ()
   printf("- Setting max number of events BLT. def %d",data);
   data = Config->max_num_events_blt;
   printf(" write %d",data);
-  ret = CAEN_DGTZ_SetMaxNumEventsBLT(Handle,data);
+  ret = CAEN_DGTZ_SetMaxNumEventsBLT(b->handle,data);
   if (ret != CAEN_DGTZ_Success) {
     printf("\nERROR - Unable to set max number of events BLT. Error code: %d\n",ret);
     return 1;
   }
-  ret = CAEN_DGTZ_GetMaxNumEventsBLT(Handle,&data);
+  ret = CAEN_DGTZ_GetMaxNumEventsBLT(b->handle,&data);
   if (ret != CAEN_DGTZ_Success) {
     printf("\nERROR - Unable to read max number of events BLT. Error code: %d\n",ret);
     return 1;
   }
   printf(" read %d\n",data);
 
-  if ( Config->drs4corr_enable ) {
+  if ( strcmp(Config->process_mode,"DAQRAW")==0 ) {
+
+    // Raw data are written uncorrected: cache the correction tables for the offline converter
+    if ( Config->drs4corr_enable ) {
+      if ( DRS4_init(b->handle,b->id,b->sn,Config->drs4_sampfreq) ) {
+	printf("Unable to load correction tables for DRS4 chip\n");
+	return 1;
+      }
+      printf("- DRS4 corrections will be applied when converting raw data\n");
+    }
+
+  } else if ( strcmp(Config->decode_mode,"NATIVE")==0 ) {
+
+    printf("- Decoding events with native decoder (%s kernel)\n",V1742_unpack_kernel());
+
+    // Native decoder applies DRS4 corrections itself: get correction tables for this board
+    if ( Config->drs4corr_enable ) {
+      if ( DRS4_init(b->handle,b->id,b->sn,Config->drs4_sampfreq) ) {
+	printf("Unable to load correction tables for DRS4 chip\n");
+	return 1;
+      }
+      b->drs4 = DRS4_table(b->id);
+      printf("- Enabled integer DRS4 corrections to sampled data\n");
+    } else {
+      printf("WARNING: DRS4 corrections to sampled data are disabled!\n");
+    }
+
+  } else if ( Config->drs4corr_enable ) {
 
     // Load DRS4 correction tables used to decode the X742 event
     if (Config->drs4_sampfreq == 0) {
-      ret = CAEN_DGTZ_LoadDRS4CorrectionData(Handle,CAEN_DGTZ_DRS4_5GHz);
+      ret = CAEN_DGTZ_LoadDRS4CorrectionData(b->handle,CAEN_DGTZ_DRS4_5GHz);
     } else if (Config->drs4_sampfreq == 1) {
-      ret = CAEN_DGTZ_LoadDRS4CorrectionData(Handle,CAEN_DGTZ_DRS4_2_5GHz);
+      ret = CAEN_DGTZ_LoadDRS4CorrectionData(b->handle,CAEN_DGTZ_DRS4_2_5GHz);
     } else if (Config->drs4_sampfreq == 2) {
-      ret = CAEN_DGTZ_LoadDRS4CorrectionData(Handle,CAEN_DGTZ_DRS4_1GHz);
+      ret = CAEN_DGTZ_LoadDRS4CorrectionData(b->handle,CAEN_DGTZ_DRS4_1GHz);
     }
     if (ret != CAEN_DGTZ_Success) {
       printf("Unable to load correction tables for DRS4 chip. Error code: %d\n",ret);
@@ -440,7 +690,7 @@ int DAQ_init ()
     printf("- Loaded DRS4 correction tables from X742 flash memory\n");
 
     // Enable DRS4 corrections to sampled data
-    ret = CAEN_DGTZ_EnableDRS4Correction(Handle);
+    ret = CAEN_DGTZ_EnableDRS4Correction(b->handle);
     if (ret != CAEN_DGTZ_Success) {
       printf("Unable to enable DRS4 corrections to sampled data. Error code: %d\n",ret);
       return 1;
@@ -450,7 +700,7 @@ int DAQ_init ()
   } else {
 
     // Disable DRS4 corrections to sampled data
-    ret = CAEN_DGTZ_DisableDRS4Correction(Handle);
+    ret = CAEN_DGTZ_DisableDRS4Correction(b->handle);
     if (ret != CAEN_DGTZ_Success) {
       printf("Unable to disable DRS4 corrections to sampled data. Error code: %d\n",ret);
       return 1;
@@ -459,6 +709,35 @@ int DAQ_init ()
 
   }
 
+  // Configure interrupts if required: board will raise an IRQ when irq_num_events events are ready
+  if ( b->use_irq ) {
+
+    if ( strcmp(Config->connect_mode,"OPTICAL")!=0 ) {
+      printf("ERROR - readout_mode IRQ requires an OPTICAL connection (connect_mode is %s)\n",Config->connect_mode);
+      return 1;
+    }
+
+    // The IRQ threshold cannot exceed the number of events read in a single BLT
+    if (Config->irq_num_events == 0 || Config->irq_num_events > Config->max_num_events_blt) {
+      printf("WARNING - irq_num_events %u not in [1,%u]: setting it to %u\n",
+	     Config->irq_num_events,Config->max_num_events_blt,Config->max_num_events_blt);
+      Config->irq_num_events = Config->max_num_events_blt;
+    }
+
+    printf("- Enabling interrupts on %u events ready (timeout %u ms)\n",Config->irq_num_events,Config->irq_timeout);
+    ret = CAEN_DGTZ_SetInterruptConfig(b->handle,CAEN_DGTZ_ENABLE,DAQ_IRQ_LEVEL,DAQ_IRQ_STATUS_ID,
+				       (uint16_t)Config->irq_num_events,CAEN_DGTZ_IRQ_MODE_ROAK);
+    if (ret != CAEN_DGTZ_Success) {
+      printf("ERROR - Unable to configure interrupts. Error code: %d\n",ret);
+      return 1;
+    }
+
+  } else {
+
+    printf("- Readout mode is POLL: loop delay %u usecs\n",Config->daq_loop_delay);
+
+  }
+
   // Set method used to start and stop data acquisition
   if (Config->startdaq_mode == 0) {
     mode = CAEN_DGTZ_SW_CONTROLLED; // Start and stop from software commands
@@ -472,7 +751,7 @@ int DAQ_init ()
     printf("ERROR - startdaq_mode parameter set to %d (valid: 0,1,2)\n",Config->startdaq_mode);
     return 1;
   }
-  ret = CAEN_DGTZ_SetAcquisitionMode(Handle,mode);
+  ret = CAEN_DGTZ_SetAcquisitionMode(b->handle,mode);
   if (ret != CAEN_DGTZ_Success) {
     printf("ERROR - Unable to set acquisition mode. Error code: %d\n",ret);
     return 1;
@@ -484,515 +763,1456 @@ int DAQ_init ()
 
 }
 
-// Handle data acquisition
-int DAQ_readdata ()
+// Handle initialization of all digitizers. Return 0 if OK, >0 if error
+int DAQ_init ()
 {
 
-  CAEN_DGTZ_ErrorCode ret;
-  uint32_t status,grstatus;
+  unsigned int i;
 
-  // Input data information
-  char *buffer = NULL;
-  uint32_t bufferSize,readSize,writeSize;
-  uint32_t numEvents;
-  CAEN_DGTZ_EventInfo_t eventInfo;
-  char *eventPtr = NULL;
+  InBurst = 0;
 
-  // Decoded event information
-  CAEN_DGTZ_X742_EVENT_t *event = NULL;
-  uint32_t iEv, iGr;
+  // Select the kernels of the native decoder before it is used by the boards
+  if ( strcmp(Config->decode_mode,"NATIVE")==0 ) V1742_init();
 
-  // Output event information
-  char *outEvtBuffer = NULL;
-  int maxPEvtSize, pEvtSize;
-  uint32_t fHeadSize, fTailSize;
+  for(i=0;i<NBoards;i++) {
+    if ( DAQ_init_board(&Board[i]) ) return 1;
+  }
 
-  // Global counters for input data
-  uint64_t totalReadSize;
-  uint32_t totalReadEvents;
-  float evtReadPerSec, sizeReadPerSec;
+  return 0;
 
-  // Global counters for output data
-  uint64_t totalWriteSize;
-  uint32_t totalWriteEvents;
-  float evtWritePerSec, sizeWritePerSec;
+}
 
-  // Information about output files
-  unsigned int fileIndex = 0;
-  int tooManyOutputFiles;
-  char tmpName[MAX_FILENAME_LEN];
-  char* fileName[MAX_N_OUTPUT_FILES];
-  char* pathName[MAX_N_OUTPUT_FILES];
-  uint64_t fileSize[MAX_N_OUTPUT_FILES];
-  uint32_t fileEvents[MAX_N_OUTPUT_FILES];
-  time_t fileTOpen[MAX_N_OUTPUT_FILES];
-  time_t fileTClose[MAX_N_OUTPUT_FILES];
-  int fileHandle = 0;
-  //int rc;
+// Write data to the output file or stream of a board. Data are collected in the output buffer of the board
+// and written when it is full or too old. In SHM mode data are copied to the shared memory ring as a single
+// record, waiting for the consumer to free some space if needed
+// Return number of bytes written, -1 if error
+static ssize_t DAQ_output(board_t* b, const char* data, uint32_t size, uint32_t nEvents)
+{
+  if (b->shm == NULL) return output_buffer_write(b->out,data,size,nEvents) ? -1 : size;
+  while ( shm_ring_write(b->shm,data,size,DAQ_SHM_WAIT_TIMEOUT) ) {
+    if (BreakSignal) return -1;
+  }
+  return size;
+}
 
-  // Flag to end run on ADC read error
-  int adcError;
+// Open a new output file (FILE mode) for a board and write the file header to it. Return 0 if OK, 2 if error
+static int DAQ_open_file(board_t* b, time_t t_open)
+{
 
-  time_t t_daqstart, t_daqstop, t_daqtotal;
-  time_t t_now;
+  uint32_t fHeadSize,writeSize;
+  int n;
+  outfile_t* f = &b->file[b->file_index];
 
-  unsigned int i;
+  if ( strcmp(Config->output_mode,"FILE")==0 ) {
+
+    // Generate name for output file and verify it does not exist
+    // When several boards are read, board id is added to the file name template
+    if (NBoards > 1) {
+      generate_board_filename(tmpName,b->id,t_open);
+    } else {
+      generate_filename(tmpName,t_open);
+    }
+    f->name = (char*)malloc(strlen(tmpName)+1);
+    strcpy(f->name,tmpName);
+    f->path = (char*)malloc(strlen(Config->data_dir)+strlen(f->name)+1);
+    strcpy(f->path,Config->data_dir);
+    strcat(f->path,f->name);
+
+    printf("- Opening output file %d with path '%s'\n",b->file_index,f->path);
+    if (b->writer == NULL) {
+      if (b->rotator) {
+	b->file_handle = file_rotator_open(b->rotator,f->path);
+      } else {
+	b->file_handle = open(f->path,O_WRONLY | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+      }
+      if (b->file_handle == -1) {
+	printf("ERROR - Unable to open file '%s' for writing.\n",f->path);
+	return 2;
+      }
+    }
 
-  // If quit file is already there, assume this is a test run and do nothing
-  if ( access(Config->quit_file,F_OK) != -1 ) {
-    printf("DAQ_readdata - Quit file '%s' found: will not run acquisition\n",Config->quit_file);
-    return 3;
   }
+  if (b->out) output_buffer_set_fd(b->out,b->file_handle);
+  f->t_open = t_open;
+  f->size = 0;
+  f->events = 0;
 
-  // Allocate buffer to hold retrieved data
-  ret = CAEN_DGTZ_MallocReadoutBuffer(Handle,&buffer,&bufferSize);
-  if (ret != CAEN_DGTZ_Success) {
-    printf("Unable to allocate data readout buffer. Error code: %d\n",ret);
-    return 1;
+  if ( b->index && event_index_open(b->index,f->path) ) {
+    printf("ERROR - Unable to create index of output file '%s'.\n",f->path);
+    return 2;
   }
-  printf("- Allocated data readout buffer with size %d\n",bufferSize);
 
-  // Allocate buffer to hold decoded event
-  ret = CAEN_DGTZ_AllocateEvent(Handle,(void**)&event);
-  if (ret != CAEN_DGTZ_Success) {
-    printf("Unable to allocate decoded event buffer. Error code: %d\n",ret);
-    return 1;
+  // The asynchronous writer creates the file (or takes the stream) and writes its header
+  if (b->writer) {
+    n = async_writer_open(b->writer,strcmp(Config->output_mode,"FILE")==0 ? f->path : NULL,b->file_handle,
+			  RawMode,b->file_index,Config->run_number,b->id,b->sn,f->t_open);
+    if (n < 0) {
+      printf("ERROR - Asynchronous writer failed: unable to open output file '%s'.\n",f->path);
+      return 2;
+    }
+    f->size += n;
+    return 0;
   }
-  printf("- Allocated decoded event buffer\n");
 
-  // Allocate buffer to hold output event structure
-  maxPEvtSize = (PEVT_HEADER_LEN + 4*(PEVT_GRPHEAD_LEN + 512 + PEVT_GRPTTT_LEN) + 32*512)*4;
-  outEvtBuffer = (char *)malloc(maxPEvtSize);
-  if (outEvtBuffer == NULL) {
-    printf("Unable to allocate output event buffer of size %d\n",maxPEvtSize);
-    return 1;
+  // Write header to file
+  if (RawMode) {
+    fHeadSize = create_raw_file_head(b->file_index,Config->run_number,b->id,b->sn,f->t_open,(void *)fileBuffer);
+  } else {
+    fHeadSize = create_file_head(b->file_index,Config->run_number,b->id,b->sn,f->t_open,(void *)fileBuffer);
+  }
+  writeSize = DAQ_output(b,fileBuffer,fHeadSize,0);
+  if (writeSize != fHeadSize) {
+    printf("ERROR - Unable to write file header to file. Header size: %d, Write result: %d\n",
+	   fHeadSize,writeSize);
+    return 2;
   }
-  printf("- Allocated output event buffer with size %d\n",maxPEvtSize);
+  f->size += fHeadSize;
+
+  return 0;
+
+}
+
+// Write tail to current output file of a board and close it. Return 0 if OK, 2 if error
+static int DAQ_close_file(board_t* b, time_t t_close)
+{
 
-  // If we use STREAM output, the output stream must be initialized here
-  if ( strcmp(Config->output_mode,"STREAM")==0 ) {
+  uint32_t fTailSize,writeSize;
+  int n;
+  outfile_t* f = &b->file[b->file_index];
 
-    pathName[fileIndex] = (char*)malloc(strlen(Config->output_stream)+1);
-    strcpy(pathName[fileIndex],Config->output_stream);
+  // Register file closing time
+  f->t_close = t_close;
 
-    printf("- Opening output stream '%s'\n",pathName[fileIndex]);
-    fileHandle = open(pathName[fileIndex],O_WRONLY);
-    if (fileHandle == -1) {
-      printf("ERROR - Unable to open file '%s' for writing.\n",pathName[fileIndex]);
+  if ( b->index && event_index_close(b->index) ) {
+    printf("ERROR - Unable to write index of output file '%s'.\n",f->path);
+    return 2;
+  }
+
+  // The asynchronous writer writes the tail and closes the file after all buffered data
+  if (b->writer) {
+    if ( output_buffer_flush(b->out) || (n = async_writer_close(b->writer,t_close)) < 0 ) {
+      printf("ERROR - Asynchronous writer failed: unable to write output file '%s'.\n",f->path);
       return 2;
     }
-    
+    f->size += n;
+    printf("%s - Queued closing of output %s '%s' after %d secs with %u events and size %llu bytes\n",
+	   format_time(f->t_close),strcmp(Config->output_mode,"FILE")==0 ? "file" : "stream",f->path,
+	   (int)(f->t_close-f->t_open),f->events,(unsigned long long)f->size);
+    b->file_index++;
+    return 0;
   }
 
-  // DAQ is now ready to start. Create InitOK file and set status to INITIALIZED
-  if ( create_initok_file() ) return 1;
+  // Write tail to file
+  fTailSize = create_file_tail(f->events,f->size,f->t_close,(void *)fileBuffer);
+  writeSize = DAQ_output(b,fileBuffer,fTailSize,0);
+  if (writeSize != fTailSize) {
+    printf("ERROR - Unable to write file tail to file. Tail size: %d, Write result: %d\n",
+	   fTailSize,writeSize);
+    return 2;
+  }
+  f->size += fTailSize;
 
-  if (Config->startdaq_mode == 0) {
+  // All data must be written before closing the file
+  if ( b->out && output_buffer_end_file(b->out) ) {
+    printf("ERROR - Unable to write buffered data to file '%s'.\n",f->path);
+    return 2;
+  }
 
-    // If SW controlled DAQ is selected, we need to wait for the appearance of
-    // the start file and then give the SWStartAcquisition command
+  // Close output file and show some info about counters
+  if (b->shm) {
+    printf("- Shared memory ring '%s': %llu records written - ring full %llu times\n",f->path,(unsigned long long)b->shm->n_records,(unsigned long long)b->shm->n_waits);
+    shm_ring_close(b->shm);
+    b->shm = NULL;
+  } else if ( b->rotator ? file_rotator_close(b->rotator,b->file_handle) : close(b->file_handle) ) {
+    printf("ERROR - Unable to close output file '%s'.\n",f->path);
+    return 2;
+  };
+  if ( strcmp(Config->output_mode,"FILE")==0 ) {
+    printf("%s - Closed output file '%s' after %d secs with %u events and size %llu bytes\n",
+	   format_time(f->t_close),f->path,(int)(f->t_close-f->t_open),f->events,(unsigned long long)f->size);
+  } else {
+    printf("%s - Closed output stream '%s' after %d secs with %u events and size %llu bytes\n",
+	   format_time(f->t_close),f->path,(int)(f->t_close-f->t_open),f->events,(unsigned long long)f->size);
+  }
 
-    // Wait either for Start DAQ file or for Quit file
-    while(1){
-      if ( access(Config->start_file,F_OK) != -1 ) {
-	printf("- Start file '%s' found: starting DAQ\n",Config->start_file);
-	break;
-      }
-      if ( access(Config->quit_file,F_OK) != -1 ) {
-	printf("- Quit file '%s' found: exiting\n",Config->quit_file);
-	return 3;
-      }
-      // Sleep for ~1ms before checking again
-      usleep(1000);
-    }
+  // Update file counter
+  b->file_index++;
 
-    // Start digitizer acquisition
-    ret = CAEN_DGTZ_SWStartAcquisition(Handle);
-    if (ret != CAEN_DGTZ_Success) {
-      printf("Unable to start acquisition. Error code: %d\n",ret);
-      return 2;
-    }
+  return 0;
 
-  } else if (Config->startdaq_mode == 1) {
+}
 
-    // If S_IN controlled DAQ is selected, everything is automatic
-    printf("- Actual DAQ will start on S_IN signal\n");
+// Write buffered data of a board which waited too long, then, if we are running in FILE output mode,
+// check if the board needs a new data file i.e. required time elapsed or file size/events threshold exceeded
+// Return 0 if OK, 2 if error
+static int DAQ_check_file(board_t* b, time_t t_now)
+{
 
-  }
+  outfile_t* f = &b->file[b->file_index];
+  uint64_t t0;
 
-  InBurst = 1;
-  time(&t_daqstart);
-  printf("%s - Acquisition started\n",format_time(t_daqstart));
+  if ( b->out && output_buffer_poll(b->out) ) return 2;
 
-  // Zero counters
-  totalReadSize = 0;
-  totalReadEvents = 0;
-  totalWriteSize = 0;
-  totalWriteEvents = 0;
+  if ( strcmp(Config->output_mode,"FILE")!=0 ) return 0;
 
-  if ( strcmp(Config->output_mode,"FILE")==0 ) {
+  if (
+      (t_now-f->t_open >= Config->file_max_duration) ||
+      (f->size         >= Config->file_max_size    ) ||
+      (f->events       >= Config->file_max_events  )
+      ) {
 
-    // Generate name for initial output file and verify it does not exist
-    generate_filename(tmpName,t_daqstart);
-    fileName[fileIndex] = (char*)malloc(strlen(tmpName)+1);
-    strcpy(fileName[fileIndex],tmpName);
-    pathName[fileIndex] = (char*)malloc(strlen(Config->data_dir)+strlen(fileName[fileIndex])+1);
-    strcpy(pathName[fileIndex],Config->data_dir);
-    strcat(pathName[fileIndex],fileName[fileIndex]);
-
-    printf("- Opening output file %d with path '%s'\n",fileIndex,pathName[fileIndex]);
-    fileHandle = open(pathName[fileIndex],O_WRONLY | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
-    if (fileHandle == -1) {
-      printf("ERROR - Unable to open file '%s' for writing.\n",pathName[fileIndex]);
-      return 2;
+    // Close old output file
+    t0 = histo_time();
+    if ( DAQ_close_file(b,t_now) ) return 2;
+
+    if ( b->file_index<MAX_N_OUTPUT_FILES ) {
+      // Open new output file and reset all counters
+      if ( DAQ_open_file(b,t_now) ) return 2; // No output file currently open: no point in sending file tail
+    } else {
+      atomic_store(&tooManyOutputFiles,1);
     }
+    histo_fill(&HRotate,histo_time()-t0);
+
   }
-  fileTOpen[fileIndex] = t_daqstart;
-  fileSize[fileIndex] = 0;
-  fileEvents[fileIndex] = 0;
-  
-  // Write header to file
-  fHeadSize = create_file_head(fileIndex,Config->run_number,Config->board_id,Config->board_sn,fileTOpen[fileIndex],(void *)outEvtBuffer);
-  writeSize = write(fileHandle,outEvtBuffer,fHeadSize);
-  if (writeSize != fHeadSize) {
-    printf("ERROR - Unable to write file header to file. Header size: %d, Write result: %d\n",
-	   fHeadSize,writeSize);
-    return 2;
-  }
-  fileSize[fileIndex] += fHeadSize;
 
-  // Main DAQ loop: wait for some data to be present and copy it to output file
-  //old_TT =0;
-  //old_TTT=0;
-  adcError = 0;
-  tooManyOutputFiles = 0;
-  while(1){
+  return 0;
 
-    // Read Acquisition Status register
-    ret = CAEN_DGTZ_ReadRegister(Handle,CAEN_DGTZ_ACQ_STATUS_ADD,&status);
+}
+
+// Decode and format one event of the current encoding batch (called by the encoding pool workers)
+// Return 0 if OK, 1 if error while handling ADC data
+static int DAQ_encode_event(void *ctx, unsigned int worker, unsigned int item)
+{
+
+  CAEN_DGTZ_ErrorCode ret;
+  encode_batch_t* batch = (encode_batch_t*)ctx;
+  board_t* b = batch->board;
+  CAEN_DGTZ_EventInfo_t *eventInfo = &batch->info[item];
+  char *eventPtr = batch->ptr[item];
+  char *pEvt = outEvtBuffer+item*maxPEvtSize;
+  uint32_t iGr;
+  int pEvtSize;
+  uint64_t t0;
+
+  // *** EventInfo data structure (from CAENDigitizerType.h) ***
+  //
+  //typedef struct 
+  //{
+  //    uint32_t EventSize;
+  //    uint32_t BoardId;
+  //    uint32_t Pattern;
+  //    uint32_t ChannelMask;
+  //    uint32_t EventCounter;
+  //    uint32_t TriggerTimeTag;
+  //} CAEN_DGTZ_EventInfo_t;
+  //
+  // ***********************************************************
+
+  // Decode (and apply DRS4 corrections to) event. Native decoder works on the raw event
+  if (! DecodeNative) {
+    t0 = histo_time();
+    ret = CAEN_DGTZ_DecodeEvent(b->handle,eventPtr,(void**)&event[worker]);
+    histo_fill(&HDecode,histo_time()-t0);
     if (ret != CAEN_DGTZ_Success) {
-      printf("Cannot read acquisition status. Error code: %d\n",ret);
-      adcError = 1;
-      break; // Exit from main DAQ loop
+      printf("Unable to decode event. Error code: %d\n",ret);
+      return 1;
     }
+  }
 
-    //printf("Register 0x%04X Status 0x%04X\n",CAEN_DGTZ_ACQ_STATUS_ADD,status);
-    // Check if at least one event is available
-    if (status & 0x8) { // Bit 3: EVENT READY
-
-      // Check if group data buffers are full (bit 0 of register 0x1n88)
+  // *** Event data structures (from CAENDigitizerType.h) ***
+  //
+  //typedef struct 
+  //{
+  //    uint8_t                GrPresent[MAX_X742_GROUP_SIZE]; // If the group has data the value is 1 otherwise is 0  
+  //    CAEN_DGTZ_X742_GROUP_t DataGroup[MAX_X742_GROUP_SIZE]; // the array of ChSize samples (meaning "Groups" :)
+  //} CAEN_DGTZ_X742_EVENT_t;
+  //
+  //typedef struct 
+  //{
+  //    uint32_t ChSize[MAX_X742_CHANNEL_SIZE];      // the number of samples stored in DataChannel array  
+  //    float   *DataChannel[MAX_X742_CHANNEL_SIZE]; // the array of ChSize samples
+  //    uint32_t TriggerTimeTag;
+  //    uint16_t StartIndexCell;
+  //} CAEN_DGTZ_X742_GROUP_t;
+  //
+  // *********************************************************
+
+  // Print output once in a while (can become a run-time monitor)
+  if ( (eventInfo->EventCounter % Config->debug_scale) == 0 ) {
+
+    // Print event header
+    printf("- Evt# %u time %u size %u board 0x%02x pattern 0x%08x chmsk 0x%08x\n",
+	   eventInfo->EventCounter   & 0x003FFFFF,
+	   eventInfo->TriggerTimeTag & 0x7FFFFFFF,
+	   eventInfo->EventSize      & 0x0FFFFFFF,
+	   eventInfo->BoardId        & 0x0000001F,
+	   eventInfo->Pattern        & 0x00003FFF,
+	   eventInfo->ChannelMask
+	   );
+
+    // Print some group info
+    if (! DecodeNative) {
+      printf("  Group(TTT,SIC)");
       for(iGr=0;iGr<MAX_X742_GROUP_SIZE;iGr++){
-	if ( Config->group_enable_mask & (1 << iGr) ) {
-	  //printf("Checking buffer for group %d on register 0x%04X\n",iGr,CAEN_DGTZ_CHANNEL_STATUS_BASE_ADDRESS+(iGr<<8));
-	  //if (CAEN_DGTZ_ReadRegister(Handle,CAEN_DGTZ_CHANNEL_STATUS_BASE_ADDRESS+(iGr<<8),&grstatus) != CAEN_DGTZ_Success) {
-	  ret = CAEN_DGTZ_ReadRegister(Handle,CAEN_DGTZ_CHANNEL_STATUS_BASE_ADDRESS+(iGr<<8),&grstatus);
-	  if (ret != CAEN_DGTZ_Success) {
-	    printf("Cannot read group %d status. Error code: %d\n",iGr,ret);
-	    //return 2;
-	    adcError = 1;
-	    break; // Exit from loop over groups
-	  } else if (grstatus & 1) { // Bit 0: Memory full
-	    printf("*** WARNING *** Group %d data buffer is full (!!!)\n",iGr);
-	  }
+	if (event[worker]->GrPresent[iGr]) {
+	  printf(" %1d(%04x,%4d)",iGr,event[worker]->DataGroup[iGr].TriggerTimeTag,event[worker]->DataGroup[iGr].StartIndexCell);
 	}
       }
-      if (adcError) break; // Exit from main DAQ loop
-
-      // Read the data from digitizer
-      ret = CAEN_DGTZ_ReadData(Handle,CAEN_DGTZ_SLAVE_TERMINATED_READOUT_MBLT,buffer,&readSize);
-      if (ret != CAEN_DGTZ_Success) {
-	printf("Unable to read data from digitizer. Error code: %d\n",ret);
-	//return 2;
-	adcError = 1;
-	break; // Exit from main DAQ loop
-      }
-      ret = CAEN_DGTZ_GetNumEvents(Handle,buffer,readSize,&numEvents);
-      if (ret != CAEN_DGTZ_Success) {
-	printf("Unable to get number of events from read buffer. Error code: %d\n",ret);
-	//return 2;
-	adcError = 1;
-	break; // Exit from main DAQ loop
-      }
-      //printf("Read %d event(s) with total size %d bytes\n",numEvents,readSize);
-
-      // Update global counters
-      totalReadSize += readSize;
-      totalReadEvents += numEvents;
-
-      // Loop over all events in data buffer
-      for(iEv=0;iEv<numEvents;iEv++) {
-
-	// Retrieve info and pointer for current event
-	ret = CAEN_DGTZ_GetEventInfo(Handle,buffer,readSize,iEv,&eventInfo,&eventPtr);
-	if (ret != CAEN_DGTZ_Success) {
-	  printf("Unable to get event info from read buffer. Error code: %d\n",ret);
-	  //return 2;
-	  adcError = 1;
-	  break; // Exit from loop over events
-	}
-
-	// *** EventInfo data structure (from CAENDigitizerType.h) ***
-	//
-	//typedef struct 
-	//{
-	//    uint32_t EventSize;
-	//    uint32_t BoardId;
-	//    uint32_t Pattern;
-	//    uint32_t ChannelMask;
-	//    uint32_t EventCounter;
-	//    uint32_t TriggerTimeTag;
-	//} CAEN_DGTZ_EventInfo_t;
-	//
-	// ***********************************************************
-
-	/*
-	// Debug code for event timing
-	TT = ((int*)eventPtr)[3]; // Event time tag
-	TTT = ( ((int*)eventPtr)[4+1+3456] & 0x3FFFFFFF ); // Group 0 trigger time tag
-	dtr = ((float)(TTT-old_TTT))*0.0085; // 8.5ns per count in us
-	ftr = 1000000./dtr; // Frequency in Hz
-	printf("Evt# %6u t %10u 0x%08X dt %10u 0x%08X tt %10u dtt %10u %10.3fus %8.3fHz\n",
-	       eventInfo.EventCounter,
-	       TT,TT,TT-old_TT,TT-old_TT,TTT,TTT-old_TTT,dtr,ftr
-	      );
-	old_TT = TT;
-	old_TTT = TTT;
-	*/
-
-	// Decode (and apply DRS4 corrections to) event
-	ret = CAEN_DGTZ_DecodeEvent(Handle,eventPtr,(void**)&event);
-	if (ret != CAEN_DGTZ_Success) {
-	  printf("Unable to decode event. Error code: %d\n",ret);
-	  //return 2;
-	  adcError = 1;
-	  break; // Exit from loop over events
-	}
+      printf("\n");
+    }
 
-	// *** Event data structures (from CAENDigitizerType.h) ***
-	//
-	//typedef struct 
-	//{
-	//    uint8_t                GrPresent[MAX_X742_GROUP_SIZE]; // If the group has data the value is 1 otherwise is 0  
-	//    CAEN_DGTZ_X742_GROUP_t DataGroup[MAX_X742_GROUP_SIZE]; // the array of ChSize samples (meaning "Groups" :)
-	//} CAEN_DGTZ_X742_EVENT_t;
-	//
-	//typedef struct 
-	//{
-	//    uint32_t ChSize[MAX_X742_CHANNEL_SIZE];      // the number of samples stored in DataChannel array  
-	//    float   *DataChannel[MAX_X742_CHANNEL_SIZE]; // the array of ChSize samples
-	//    uint32_t TriggerTimeTag;
-	//    uint16_t StartIndexCell;
-	//} CAEN_DGTZ_X742_GROUP_t;
-	//
-	// *********************************************************
-
-	// Print output once in a while (can become a run-time monitor)
-	//if ( (eventInfo.EventCounter % 100) == 0 ) {
-	if ( (eventInfo.EventCounter % Config->debug_scale) == 0 ) {
-
-	  // Print event header
-	  printf("- Evt# %u time %u size %u board 0x%02x pattern 0x%08x chmsk 0x%08x\n",
-		 eventInfo.EventCounter   & 0x003FFFFF,
-		 eventInfo.TriggerTimeTag & 0x7FFFFFFF,
-		 eventInfo.EventSize      & 0x0FFFFFFF,
-		 eventInfo.BoardId        & 0x0000001F,
-		 eventInfo.Pattern        & 0x00003FFF,
-		 eventInfo.ChannelMask
-		);
-
-	  // Print some group info
-	  printf("  Group(TTT,SIC)");
-	  for(iGr=0;iGr<MAX_X742_GROUP_SIZE;iGr++){
-	    if (event->GrPresent[iGr]) {
-	      printf(" %1d(%04x,%4d)",iGr,event->DataGroup[iGr].TriggerTimeTag,event->DataGroup[iGr].StartIndexCell);
-	    }
-	  }
-	  printf("\n");
+  }
 
-	}
+  // Copy decoded event to output event buffer applying zero-suppression
+  // Return event size in bytes (0: event rejected, <0: error)
+  t0 = histo_time();
+  if (DecodeNative) {
+    pEvtSize = create_pevent_native((void *)eventPtr,(void *)pEvt,b->id,b->drs4);
+  } else {
+    pEvtSize = create_pevent((void *)eventPtr,event[worker],(void *)pEvt,b->id);
+  }
+  histo_fill(&HFormat,histo_time()-t0);
+  if (pEvtSize<0){
+    printf("ERROR - Unable to copy decoded event to output event buffer. RC %d\n",pEvtSize);
+    return 1;
+  }
+  batch->size[item] = pEvtSize;
+
+  // Write event header to debug info once in a while
+  if ( pEvtSize > 0 && (eventInfo->EventCounter % Config->debug_scale) == 0 ) {
+    unsigned char i,j;
+    printf("  Header");
+    for (i=0;i<6;i++) {
+      printf(" %1d(",i);
+      for (j=0;j<4;j++) { printf("%02x",(unsigned char)(pEvt[i*4+3-j])); }
+      printf(")");
+    }
+    printf("\n");
+  }
 
-	// Copy decoded event to output event buffer applying zero-suppression
-	// Return event size in bytes (0: event rejected, <0: error)
-	pEvtSize = create_pevent((void *)eventPtr,event,(void *)outEvtBuffer);
-	if (pEvtSize<0){
-	  printf("ERROR - Unable to copy decoded event to output event buffer. RC %d\n",pEvtSize);
-	  //return 2;
-	  adcError = 1;
-	  break; // Exit from loop over events
-	}
-	
-	// If event is accepted, write it to file and update counters
-	if (pEvtSize > 0) {
-	  
-	  // Write event header to debug info once in a while
-	  //if ( (eventInfo.EventCounter % 100) == 0 ) {
-	  if ( (eventInfo.EventCounter % Config->debug_scale) == 0 ) {
-	    unsigned char i,j;
-	    printf("  Header");
-	    for (i=0;i<6;i++) {
-	      printf(" %1d(",i);
-	      for (j=0;j<4;j++) { printf("%02x",(unsigned char)(outEvtBuffer[i*4+3-j])); }
-	      printf(")");
-	    }
-	    printf("\n");
-	  }
-
-	  // Write data to output file
-	  writeSize = write(fileHandle,outEvtBuffer,pEvtSize);
-	  if (writeSize != pEvtSize) {
-	    printf("ERROR - Unable to write read data to file. Event size: %d, Write result: %d\n",
-		   pEvtSize,writeSize);
-	    return 2; // As this is an error while writing data to output file, no point in sending file tail
-	  }
-	  
-	  // Update file counters
-	  fileSize[fileIndex] += pEvtSize;
-	  fileEvents[fileIndex]++;
-	  
-	  // Update global counters
-	  totalWriteSize += pEvtSize;
-	  totalWriteEvents++;
-	  
-	}
+  return 0;
 
-      }
-      if (adcError) break; // Exit from main DAQ loop
+}
 
-    }
+// Decode all events contained in a readout buffer of a board, format them, and write them to output
+// Events are formatted in batches by the encoding pool and written in their original order
+// Return 0 if OK, 1 if error while handling ADC data, 2 if error while writing to output file
+static int DAQ_write_events(board_t* b, char *buffer, uint32_t readSize, uint32_t numEvents)
+{
 
-    // Save current time
-    time(&t_now);
+  CAEN_DGTZ_ErrorCode ret;
+  uint32_t iEv, nEv, first;
+  uint32_t writeSize;
+  int pEvtSize;
+  uint64_t t0;
+  outfile_t* f = &b->file[b->file_index];
 
-    // If we are running in FILE output mode, check if we need a new data file
-    // i.e. required time elapsed or file size/events threshold exceeded
-    if ( strcmp(Config->output_mode,"FILE")==0 ) {
+  // Events are formatted with the board id and DRS4 correction tables of this board
+  EncBatch.board = b;
 
-      if (
-	  (t_now-fileTOpen[fileIndex] >= Config->file_max_duration) ||
-	  (fileSize[fileIndex]        >= Config->file_max_size    ) ||
-	  (fileEvents[fileIndex]      >= Config->file_max_events  )
-	  ) {
-
-	// Register file closing time
-	fileTClose[fileIndex] = t_now;
-
-	// Write tail to file
-	fTailSize = create_file_tail(fileEvents[fileIndex],fileSize[fileIndex],fileTClose[fileIndex],(void *)outEvtBuffer);
-	writeSize = write(fileHandle,outEvtBuffer,fTailSize);
-	if (writeSize != fTailSize) {
-	  printf("ERROR - Unable to write file header to file. Tail size: %d, Write result: %d\n",
-		 fTailSize,writeSize);
-	  return 2; // As this is an error while writing data to output file, no point in sending file tail
-	}
-	fileSize[fileIndex] += fTailSize;
-
-	// Close old output file and show some info about counters
-	if (close(fileHandle) == -1) {
-	  printf("ERROR - Unable to close output file '%s'.\n",fileName[fileIndex]);
-	  return 2; // As this is an error while writing data to output file, no point in sending file tail
-	};
-	printf("%s - Closed output file '%s' after %d secs with %u events and size %llu bytes\n",
-	       format_time(fileTClose[fileIndex]),pathName[fileIndex],
-	       (int)(fileTClose[fileIndex]-fileTOpen[fileIndex]),
-	       fileEvents[fileIndex],fileSize[fileIndex]);
-
-	// Update file counter
-	fileIndex++;
-
-	if ( fileIndex<MAX_N_OUTPUT_FILES ) {
-
-	  // Open new output file and reset all counters
-	  generate_filename(tmpName,t_now);
-	  fileName[fileIndex] = (char*)malloc(strlen(tmpName)+1);
-	  strcpy(fileName[fileIndex],tmpName);
-	  pathName[fileIndex] = (char*)malloc(strlen(Config->data_dir)+strlen(fileName[fileIndex])+1);
-	  strcpy(pathName[fileIndex],Config->data_dir);
-	  strcat(pathName[fileIndex],fileName[fileIndex]);
-	  printf("- Opening output file %d with path '%s'\n",fileIndex,pathName[fileIndex]);
-	  fileHandle = open(pathName[fileIndex],O_WRONLY | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
-	  if (fileHandle == -1) {
-	    printf("ERROR - Unable to open file '%s' for writing.\n",pathName[fileIndex]);
-	    return 2; // No output file currently open: no point in sending file tail
-	  }
-	  fileTOpen[fileIndex] = t_now;
-	  fileSize[fileIndex] = 0;
-	  fileEvents[fileIndex] = 0;
-
-	  // Write header to file
-	  fHeadSize = create_file_head(fileIndex,Config->run_number,Config->board_id,Config->board_sn,fileTOpen[fileIndex],(void *)outEvtBuffer);
-	  writeSize = write(fileHandle,outEvtBuffer,fHeadSize);
-	  if (writeSize != fHeadSize) {
-	    printf("ERROR - Unable to write file header to file. Header size: %d, Write result: %d\n",
-		   fHeadSize,writeSize);
-	    return 2; // As this is an error while writing data to output file, no point in sending file tail
-	  }
-	  fileSize[fileIndex] += fHeadSize;
-
-	} else {
-
-	  tooManyOutputFiles = 1;
+  // Loop over all events in data buffer, one batch at a time
+  for(first=0;first<numEvents;first+=nEv) {
 
-	}
+    nEv = numEvents-first;
+    if (nEv > encodeBatch) nEv = encodeBatch;
 
+    // Retrieve info and pointer for all events in batch
+    for(iEv=0;iEv<nEv;iEv++) {
+      ret = CAEN_DGTZ_GetEventInfo(b->handle,buffer,readSize,first+iEv,&EncBatch.info[iEv],&EncBatch.ptr[iEv]);
+      if (ret != CAEN_DGTZ_Success) {
+	printf("Unable to get event info from read buffer. Error code: %d\n",ret);
+	return 1;
       }
-
     }
 
-    // Check if it is time to stop DAQ (user interrupt, quit file, time elapsed, too many output files)
-    if (
-	 BreakSignal || tooManyOutputFiles ||
-	 (access(Config->quit_file,F_OK) != -1) ||
-	 ( Config->total_daq_time && ( t_now-t_daqstart >= Config->total_daq_time ) )
-       ) break;
+    // Decode and format all events in batch
+    if ( pool_run(EncodePool,nEv) ) return 1;
 
-    // Sleep for a while before continuing
-    usleep(Config->daq_loop_delay);
+    // Write accepted events to file and update counters
+    for(iEv=0;iEv<nEv;iEv++) {
 
-  }
+      pEvtSize = EncBatch.size[iEv];
+      if (pEvtSize == 0) continue;
 
-  // Tell user what stopped DAQ
-  if ( adcError ) printf("=== Stopping DAQ on ADC access or data handling ERROR ===\n");
-  if ( BreakSignal ) printf("=== Stopping DAQ on interrupt %d ===\n",BreakSignal);
-  if ( tooManyOutputFiles ) printf("=== Stopping DAQ after writing %d data files ===\n",fileIndex);
-  if ( access(Config->quit_file,F_OK) != -1 )
-    printf("=== Stopping DAQ on quit file '%s' ===\n",Config->quit_file);
-  if ( Config->total_daq_time && ( t_now-t_daqstart >= Config->total_daq_time ) )
-    printf("=== Stopping DAQ after %d secs of run (requested %d) ===\n",(int)(t_now-t_daqstart),Config->total_daq_time);
+      // Write data to output file
+      t0 = histo_time();
+      writeSize = DAQ_output(b,outEvtBuffer+iEv*maxPEvtSize,pEvtSize,1);
+      histo_fill(&HWrite,histo_time()-t0);
+      if (writeSize != pEvtSize) {
+	printf("ERROR - Unable to write read data to file. Event size: %d, Write result: %d\n",
+	       pEvtSize,writeSize);
+	return 2; // As this is an error while writing data to output file, no point in sending file tail
+      }
 
-  // If DAQ was stopped for writing too many output files, we do not have to close the last file
-  if ( ! tooManyOutputFiles ) {
+      // Update file counters
+      if ( b->index && event_index_add(b->index,outEvtBuffer+iEv*maxPEvtSize,f->size) ) return 2;
+      f->size += pEvtSize;
+      f->events++;
 
-    // Register file closing time
-    fileTClose[fileIndex] = t_now;
+      // Update board counters
+      b->write_size += pEvtSize;
+      b->write_events++;
 
-    // Write tail to file
-    fTailSize = create_file_tail(fileEvents[fileIndex],fileSize[fileIndex],fileTClose[fileIndex],(void *)outEvtBuffer);
-    writeSize = write(fileHandle,outEvtBuffer,fTailSize);
-    if (writeSize != fTailSize) {
-      printf("ERROR - Unable to write file tail to file. Tail size: %d, Write result: %d\n",
-	     fTailSize,writeSize);
-      return 2;
     }
-    fileSize[fileIndex] += fTailSize;
 
-    // Close output file and show some info about counters
-    if (close(fileHandle) == -1) {
-      printf("ERROR - Unable to close output file '%s'.\n",fileName[fileIndex]);
-      return 2;
-    };
-    if ( strcmp(Config->output_mode,"FILE")==0 ) {
-      printf("%s - Closed output file '%s' after %d secs with %u events and size %llu bytes\n",
-	     format_time(t_now),pathName[fileIndex],(int)(fileTClose[fileIndex]-fileTOpen[fileIndex]),
-	     fileEvents[fileIndex],fileSize[fileIndex]);
+  }
+
+  return 0;
+
+}
+
+// Write all events contained in a readout buffer of a board as header-only events with the MISSING status bit set
+// Event counter and time tag of each event are preserved. Events are collected in the output event buffer and
+// written with a single call (in SHM mode each event must be a separate record)
+// Return 0 if OK, 1 if error while handling ADC data, 2 if error while writing to output file
+static int DAQ_write_missing(board_t* b, char *buffer, uint32_t readSize, uint32_t numEvents)
+{
+
+  CAEN_DGTZ_ErrorCode ret;
+  CAEN_DGTZ_EventInfo_t eventInfo;
+  char *eventPtr;
+  uint32_t iEv,nEv;
+  uint32_t writeSize,pSize;
+  uint32_t maxSize = encodeBatch*maxPEvtSize;
+  uint64_t t0;
+  outfile_t* f = &b->file[b->file_index];
+
+  pSize = 0;
+  nEv = 0;
+  for(iEv=0;iEv<numEvents;iEv++) {
+
+    ret = CAEN_DGTZ_GetEventInfo(b->handle,buffer,readSize,iEv,&eventInfo,&eventPtr);
+    if (ret != CAEN_DGTZ_Success) {
+      printf("Unable to get event info from read buffer. Error code: %d\n",ret);
+      return 1;
+    }
+    pSize += create_pevent_missing((void *)eventPtr,(void *)(outEvtBuffer+pSize),b->id);
+    nEv++;
+
+    // Write collected events when buffer is full or all events were handled
+    if ( b->shm || iEv == numEvents-1 || pSize+PEVT_HEADER_LEN*4 > maxSize ) {
+
+      t0 = histo_time();
+      writeSize = DAQ_output(b,outEvtBuffer,pSize,nEv);
+      histo_fill(&HWrite,histo_time()-t0);
+      if (writeSize != pSize) {
+	printf("ERROR - Unable to write missing events to file. Data size: %u, Write result: %d\n",pSize,writeSize);
+	return 2;
+      }
+
+      // Update file and board counters
+      if ( b->index && event_index_add_events(b->index,outEvtBuffer,pSize,f->size) ) return 2;
+      f->size += pSize;
+      f->events += nEv;
+      b->write_size += pSize;
+      b->write_events += nEv;
+      b->missing_events += nEv;
+
+      pSize = 0;
+      nEv = 0;
+
+    }
+
+  }
+
+  return 0;
+
+}
+
+// Write a readout buffer of a board to output as it is, preceded by a BLT header (DAQRAW mode)
+// Return 0 if OK, 2 if error while writing to output file
+static int DAQ_write_raw(board_t* b, char *buffer, uint32_t readSize, uint32_t numEvents, uint64_t tRead)
+{
+
+  uint32_t bHeadSize,writeSize;
+  struct iovec iov[2];
+  uint64_t t0;
+
+  // Do not write empty readouts
+  if (numEvents == 0) return 0;
+
+  bHeadSize = create_raw_blt_header(readSize,numEvents,b->id,b->sn,tRead,(void *)bltHeader);
+
+  // Write BLT header and data with a single system call (large buffers are not copied to the output buffer)
+  iov[0].iov_base = bltHeader;
+  iov[0].iov_len = bHeadSize;
+  iov[1].iov_base = buffer;
+  iov[1].iov_len = readSize;
+  writeSize = bHeadSize+readSize;
+  t0 = histo_time();
+  if ( output_buffer_writev(b->out,iov,2,numEvents) ) {
+    printf("ERROR - Unable to write raw data to file. Data size: %u\n",writeSize);
+    return 2;
+  }
+  histo_fill(&HWrite,histo_time()-t0);
+
+  // Update file counters
+  b->file[b->file_index].size += writeSize;
+  b->file[b->file_index].events += numEvents;
+
+  // Update board counters
+  b->write_size += writeSize;
+  b->write_events += numEvents;
+
+  return 0;
+
+}
+
+// Send readout buffer to the raw writer (DAQRAW mode) or to the event decoder (DAQ mode)
+// Return 0 if OK, 1 if error while handling ADC data, 2 if error while writing to output file
+static int DAQ_write_buffer(board_t* b, char *buffer, uint32_t readSize, uint32_t numEvents, uint64_t tRead)
+{
+  if (RawMode) return DAQ_write_raw(b,buffer,readSize,numEvents,tRead);
+  return DAQ_write_events(b,buffer,readSize,numEvents);
+}
+
+// Return current host time in usecs since the epoch
+static uint64_t DAQ_time_usec()
+{
+  struct timeval tv;
+  gettimeofday(&tv,NULL);
+  return (uint64_t)tv.tv_sec*1000000+tv.tv_usec;
+}
+
+// Check if the output of a board is falling behind its readout (MISSING overload policy)
+// The readout ring is overloaded when filled above overload_level (see ring_check_overload)
+// Return 1 if events must be written without data, 0 otherwise
+static int DAQ_check_overload(board_t* b)
+{
+  int wasOverload = b->ring->overload;
+  if ( ring_check_overload(b->ring) ) {
+    if ( ! wasOverload && b->ring->n_overloads == 1 )
+      printf("*** WARNING *** Output of board %d is falling behind: writing events without data (!!!)\n",b->id);
+    return 1;
+  }
+  return 0;
+}
+
+// Return total number of filled slots in the readout rings of all boards
+static unsigned int DAQ_ring_used()
+{
+  unsigned int i,n = 0;
+  for(i=0;i<NBoards;i++) n += ring_used(Board[i].ring);
+  return n;
+}
+
+// Writer thread: decode, format, and write the BLT buffers queued in the readout rings
+// When several boards are read, one buffer of each board is handled in turn
+static void* DAQ_writer_thread(void* arg)
+{
+
+  ring_slot_t* slot;
+  board_t* b;
+  time_t t_now;
+  unsigned int i,nWritten;
+  int rc = 0;
+
+  rt_set_thread("Writer",Config->writer_cpu,0);
+
+  while(1) {
+
+    nWritten = 0;
+    for(i=0;i<NBoards;i++) {
+      b = &Board[i];
+      slot = ring_read_slot(b->ring);
+      if (slot == NULL) continue;
+      if ( DAQ_check_overload(b) ) {
+	rc = DAQ_write_missing(b,slot->data,slot->size,slot->nevents);
+      } else {
+	rc = DAQ_write_buffer(b,slot->data,slot->size,slot->nevents,slot->time);
+      }
+      ring_pop(b->ring);
+      nWritten++;
+      if (rc) break;
+    }
+    if (rc) {
+      atomic_store(&WriterStatus,rc);
+      break;
+    }
+
+    if (nWritten == 0) {
+
+      // All rings are empty: exit if readout has finished, otherwise wait for more data
+      if ( atomic_load(&ReadoutDone) ) {
+	if ( DAQ_ring_used() == 0 ) break;
+	continue;
+      }
+      usleep(DAQ_WRITER_IDLE_DELAY);
+
+    }
+
+    // Output files are handled here as the readout loop never writes to them
+    time(&t_now);
+    for(i=0;i<NBoards;i++) {
+      if ( DAQ_check_file(&Board[i],t_now) ) {
+	rc = 2;
+	break;
+      }
+    }
+    if (rc) {
+      atomic_store(&WriterStatus,rc);
+      break;
+    }
+    if ( atomic_load(&tooManyOutputFiles) ) break;
+
+  }
+
+  atomic_store(&WriterDone,1);
+  return NULL;
+
+}
+
+// Adjust poll delay and BLT size of a board after each readout (ADAPTIVE readout control)
+// The trigger rate is estimated from the events found since the previous readout. The board is then polled when
+// about adaptive_occupancy% of max_num_events_blt events are expected in its memory, with a BLT size large enough
+// for twice that number. If the memory was found full, or more events than the BLT size were waiting, the board
+// is polled again as soon as possible with the largest BLT size.
+static void DAQ_control_readout(board_t* b, uint32_t numEvents, uint64_t tRead, uint64_t tReadout, int memFull)
+{
+
+  CAEN_DGTZ_ErrorCode ret;
+  double dt,rate,delay,expected;
+  uint32_t blt,target;
+  int saturated;
+  time_t t_now;
+
+  if (memFull) b->n_memory_full++;
+  if ( ! AdaptiveReadout ) return;
+
+  // Update estimate of trigger rate. This is only possible if the previous readout left the board memory empty
+  // If this readout did not empty the board memory, the measured rate is only a lower limit
+  saturated = ( numEvents >= b->blt_events || memFull );
+  dt = (tRead-b->t_last_read)*1e-9;
+  if ( b->t_last_read && b->drained && dt > 0. ) {
+    rate = numEvents/dt;
+    if (rate > b->trig_rate) {
+      b->trig_rate = rate;
+    } else if ( ! saturated ) {
+      b->trig_rate += (1.-exp(-dt/DAQ_CONTROL_RATE_TIME))*(rate-b->trig_rate);
+    }
+  }
+  b->t_last_read = tRead;
+  b->drained = ! saturated;
+
+  if ( saturated || b->trig_rate == 0. ) {
+
+    // Board memory is filling up faster than it is read (or trigger rate is still unknown)
+    delay = Config->adaptive_min_delay;
+    blt = Config->max_num_events_blt;
+
+  } else {
+
+    // Poll when target events are expected in board memory, taking into account the time spent in the readout
+    target = Config->adaptive_occupancy*Config->max_num_events_blt/100;
+    if (target == 0) target = 1;
+    delay = Config->daq_loop_delay;
+    if (b->trig_rate > 0. && 1e6*target/b->trig_rate-tReadout*1e-3 < delay) delay = 1e6*target/b->trig_rate-tReadout*1e-3;
+    if (delay < Config->adaptive_min_delay) delay = Config->adaptive_min_delay;
+
+    // BLT size must hold at least twice the expected events. To avoid changing it at each readout,
+    // it is reduced only when it exceeds four times the expected events
+    expected = b->trig_rate*(delay*1e-6+tReadout*1e-9);
+    blt = b->blt_events;
+    if (blt < 2*expected) {
+      while (blt < 2*expected && blt < Config->max_num_events_blt) blt <<= 1;
+    } else if (blt > 4*expected) {
+      blt = 1;
+      while (blt < 4*expected) blt <<= 1;
+    }
+    if (blt > Config->max_num_events_blt) blt = Config->max_num_events_blt;
+
+  }
+  b->loop_delay = (useconds_t)delay;
+
+  // BLT size is only changed when needed as this requires a register write
+  if (blt != b->blt_events) {
+    ret = CAEN_DGTZ_SetMaxNumEventsBLT(b->handle,blt);
+    if (ret != CAEN_DGTZ_Success) {
+      printf("WARNING - Unable to set max number of events per BLT of board %d to %u. Error code: %d\n",b->id,blt,ret);
+    } else {
+      b->blt_events = blt;
+      b->n_blt_changes++;
+    }
+  }
+
+  // Log decisions once in a while, when they changed significantly
+  if ( b->loop_delay > 2*b->log_delay || 2*b->loop_delay < b->log_delay || b->blt_events != b->log_blt ) {
+    time(&t_now);
+    if ( t_now-b->t_control_log >= DAQ_CONTROL_LOG_TIME ) {
+      printf("%s - Board %d readout control: rate %.1f Hz - read %u events%s - poll delay %u usecs - BLT size %u events\n",
+	     format_time(t_now),b->id,b->trig_rate,numEvents,memFull ? " (memory full)" : "",b->loop_delay,b->blt_events);
+      b->log_delay = b->loop_delay;
+      b->log_blt = b->blt_events;
+      b->t_control_log = t_now;
+    }
+  }
+
+}
+
+// Check if a board has data ready and read them to the readout ring (or write them directly to output)
+// Return 0 if OK, 1 if error while handling ADC data, 2 if error while writing to output file
+static int DAQ_read_board(board_t* b)
+{
+
+  CAEN_DGTZ_ErrorCode ret;
+  uint32_t status,grstatus;
+  char *readBuffer;
+  uint32_t readSize;
+  uint32_t numEvents;
+  uint32_t iGr;
+  uint64_t tRead = 0; // Host time of readout (DAQRAW mode)
+  ring_slot_t* slot = NULL;
+  int pollStatus;
+  int memFull = 0;
+  uint64_t t0,tReadout;
+
+  // Time between loop iterations shows the scheduling jitter of the readout
+  t0 = histo_time();
+  if (b->t_last_loop) histo_fill(&HLoop,t0-b->t_last_loop);
+  b->t_last_loop = t0;
+  b->n_loops++;
+
+  // In IRQ mode wait for the board to signal that enough events are ready.
+  // On timeout fall back to a status register poll so that events below the IRQ
+  // threshold are still read and stop conditions are checked regularly.
+  pollStatus = 1;
+  if ( b->use_irq ) {
+    t0 = histo_time();
+    ret = CAEN_DGTZ_IRQWait(b->handle,Config->irq_timeout);
+    histo_fill(&HIRQWait,histo_time()-t0);
+    if (ret == CAEN_DGTZ_Success) {
+      b->n_irqs++;
+      status = 0x8; // IRQ implies EVENT READY: no need to read the status register
+      pollStatus = 0;
+    } else if (ret == CAEN_DGTZ_Timeout) {
+      b->n_irq_timeouts++;
+    } else {
+      printf("Error while waiting for interrupt from board %d. Error code: %d\n",b->id,ret);
+      return 1;
+    }
+  }
+
+  // Read Acquisition Status register
+  if ( pollStatus ) {
+    t0 = histo_time();
+    ret = CAEN_DGTZ_ReadRegister(b->handle,CAEN_DGTZ_ACQ_STATUS_ADD,&status);
+    histo_fill(&HStatus,histo_time()-t0);
+    if (ret != CAEN_DGTZ_Success) {
+      printf("Cannot read acquisition status of board %d. Error code: %d\n",b->id,ret);
+      return 1;
+    }
+    b->n_status_reads++;
+  }
+
+  //printf("Register 0x%04X Status 0x%04X\n",CAEN_DGTZ_ACQ_STATUS_ADD,status);
+  // Check if at least one event is available
+  if ( ! (status & 0x8) ) return 0; // Bit 3: EVENT READY
+
+  // Check if group data buffers are full (bit 0 of register 0x1n88)
+  for(iGr=0;iGr<MAX_X742_GROUP_SIZE;iGr++){
+    if ( Config->group_enable_mask & (1 << iGr) ) {
+      ret = CAEN_DGTZ_ReadRegister(b->handle,CAEN_DGTZ_CHANNEL_STATUS_BASE_ADDRESS+(iGr<<8),&grstatus);
+      if (ret != CAEN_DGTZ_Success) {
+	printf("Cannot read group %d status of board %d. Error code: %d\n",iGr,b->id,ret);
+	return 1;
+      } else if (grstatus & 1) { // Bit 0: Memory full
+	printf("*** WARNING *** Board %d group %d data buffer is full (!!!)\n",b->id,iGr);
+	memFull = 1;
+      }
+    }
+  }
+
+  // When using the ring, read data directly into the next free slot.
+  // If the ring is full, data are read into the spare buffer and dropped
+  // so that the board memory is drained anyway.
+  readBuffer = b->buffer;
+  if ( b->ring ) {
+    slot = ring_write_slot(b->ring);
+    if (slot) readBuffer = slot->data;
+  }
+
+  // Read the data from digitizer
+  t0 = histo_time();
+  ret = CAEN_DGTZ_ReadData(b->handle,CAEN_DGTZ_SLAVE_TERMINATED_READOUT_MBLT,readBuffer,&readSize);
+  tReadout = histo_time()-t0;
+  histo_fill(&HReadData,tReadout);
+  if (ret != CAEN_DGTZ_Success) {
+    printf("Unable to read data from board %d. Error code: %d\n",b->id,ret);
+    return 1;
+  }
+  if (RawMode) tRead = DAQ_time_usec();
+  ret = CAEN_DGTZ_GetNumEvents(b->handle,readBuffer,readSize,&numEvents);
+  if (ret != CAEN_DGTZ_Success) {
+    printf("Unable to get number of events from read buffer of board %d. Error code: %d\n",b->id,ret);
+    return 1;
+  }
+  //printf("Read %d event(s) with total size %d bytes\n",numEvents,readSize);
+
+  // Update board counters
+  b->read_size += readSize;
+  b->read_events += numEvents;
+  b->n_readouts++;
+  if (numEvents == 0) b->n_empty_readouts++;
+  histo_fill(&HBLTSize,readSize);
+  histo_fill(&HBLTEvents,numEvents);
+
+  // Adapt poll delay and BLT size to the trigger rate
+  DAQ_control_readout(b,numEvents,t0,tReadout,memFull);
+
+  // Without readout ring decode, format, and write all events in data buffer
+  if ( b->ring == NULL ) return DAQ_write_buffer(b,b->buffer,readSize,numEvents,tRead);
+
+  // Hand buffer to writer thread or count it as dropped
+  if (slot) {
+    slot->size = readSize;
+    slot->nevents = numEvents;
+    slot->time = tRead;
+    ring_push(b->ring);
+  } else {
+    if (b->ring->n_dropped_blt == 0) printf("*** WARNING *** Readout ring of board %d is full: dropping data (!!!)\n",b->id);
+    b->ring->n_dropped_blt++;
+    b->ring->n_dropped_events += numEvents;
+  }
+
+  return 0;
+
+}
+
+// Readout thread: read all boards connected to one link (multi-board mode)
+static void* DAQ_readout_thread(void* arg)
+{
+
+  link_t* l = (link_t*)arg;
+  unsigned int i;
+  useconds_t delay;
+  char name[32];
+
+  sprintf(name,"Readout (link %d)",l->link);
+  rt_set_thread(name,Config->readout_cpu,Config->readout_rt_priority);
+
+  while ( ! atomic_load(&ReadoutStop) ) {
+
+    for(i=0;i<l->n_boards;i++) {
+      if ( DAQ_read_board(l->board[i]) ) {
+	atomic_store(&ReadoutStatus,1);
+	return NULL;
+      }
+    }
+
+    // Sleep for a while before continuing (in IRQ mode IRQWait already did the waiting)
+    // Boards on the same link are polled together: use the shortest delay required by one of them
+    if ( ! l->board[0]->use_irq ) {
+      delay = l->board[0]->loop_delay;
+      for(i=1;i<l->n_boards;i++) if (l->board[i]->loop_delay < delay) delay = l->board[i]->loop_delay;
+      usleep(delay);
+    }
+
+  }
+
+  return NULL;
+
+}
+
+// Report occupancy of the readout ring of each board
+static void DAQ_ring_report(time_t t_now)
+{
+  unsigned int i;
+  ring_t* r;
+  for(i=0;i<NBoards;i++) {
+    r = Board[i].ring;
+    printf("%s - Board %d readout ring: used %u/%u max %u - dropped %llu BLTs with %llu events - %u events without data\n",
+	   format_time(t_now),Board[i].id,ring_used(r),r->n_slots,r->max_used,
+	   (unsigned long long)r->n_dropped_blt,(unsigned long long)r->n_dropped_events,Board[i].missing_events);
+  }
+}
+
+// Report latency and size histograms of the readout and processing stages
+// At the end of the run the content of all non-empty bins is also shown
+static void DAQ_latency_report(time_t t_now, int bins)
+{
+  printf("%s - Latency report\n",format_time(t_now));
+  histo_print(&HLoop,bins);
+  if ( Board[0].use_irq ) histo_print(&HIRQWait,bins);
+  histo_print(&HStatus,bins);
+  histo_print(&HReadData,bins);
+  histo_print(&HBLTSize,bins);
+  histo_print(&HBLTEvents,bins);
+  if ( ! RawMode ) {
+    if ( ! DecodeNative ) histo_print(&HDecode,bins);
+    histo_print(&HFormat,bins);
+  }
+  histo_print(&HWrite,bins);
+  if ( strcmp(Config->output_mode,"FILE")==0 ) histo_print(&HRotate,bins);
+}
+
+// Choose the number of slots of the readout rings (0: no ring) and the overload policy
+static unsigned int DAQ_ring_size()
+{
+
+  unsigned int ringSize = Config->daq_ring_size;
+
+  // When several boards are read, readout threads always hand their data to the writer thread
+  if (NBoards > 1 && ringSize == 0) {
+    printf("WARNING - daq_ring_size is 0 but %u boards are read: setting it to %d\n",NBoards,DAQ_MULTI_BOARD_RING_SIZE);
+    ringSize = DAQ_MULTI_BOARD_RING_SIZE;
+  }
+
+  // With MISSING overload policy the readout ring occupancy tells when the output falls behind
+  OverloadMissing = ( strcmp(Config->overload_policy,"MISSING")==0 );
+  if ( OverloadMissing && RawMode ) {
+    printf("WARNING - overload_policy MISSING cannot be used in DAQRAW mode: using DROP\n");
+    OverloadMissing = 0;
+  }
+  if ( OverloadMissing && ringSize == 0 ) {
+    printf("WARNING - overload_policy MISSING requires a readout ring: setting daq_ring_size to %d\n",DAQ_MULTI_BOARD_RING_SIZE);
+    ringSize = DAQ_MULTI_BOARD_RING_SIZE;
+  }
+
+  return ringSize;
+
+}
+
+// Create the readout ring of a board with n_slots slots and allocate one readout buffer for each slot
+// Return 0 if OK, 1 if error
+static int DAQ_setup_ring(board_t* b, unsigned int n_slots)
+{
+
+  CAEN_DGTZ_ErrorCode ret;
+  uint32_t bufferSize;
+  unsigned int j;
+
+  b->ring = ring_create(n_slots);
+  if (b->ring == NULL) {
+    printf("Unable to create readout ring with %u slots for board %d\n",n_slots,b->id);
+    return 1;
+  }
+  for(j=0;j<b->ring->n_slots;j++) {
+    ret = CAEN_DGTZ_MallocReadoutBuffer(b->handle,&b->ring->slot[j].data,&bufferSize);
+    if (ret != CAEN_DGTZ_Success) {
+      printf("Unable to allocate data readout buffer for ring slot %u of board %d. Error code: %d\n",j,b->id,ret);
+      return 1;
+    }
+  }
+
+  // With MISSING overload policy events are written without data while the ring is overloaded
+  if (OverloadMissing) ring_set_overload_level(b->ring,Config->overload_level);
+
+  return 0;
+
+}
+
+// Open the output stream (STREAM or SHM mode) of a board and create its output buffer, asynchronous writer,
+// file helper, and event index as requested by the configuration
+// Return 0 if OK, 1 if configuration error, 2 if output error
+static int DAQ_setup_output(board_t* b)
+{
+
+  // If we use STREAM (or SHM) output, the output stream must be initialized here
+  // When several boards are read, board id is added to the output stream name
+  if ( strcmp(Config->output_mode,"STREAM")==0 || strcmp(Config->output_mode,"SHM")==0 ) {
+
+    b->file[0].path = (char*)malloc(strlen(Config->output_stream)+6);
+    if (NBoards > 1) {
+      sprintf(b->file[0].path,"%s_b%.2d",Config->output_stream,b->id);
+    } else {
+      strcpy(b->file[0].path,Config->output_stream);
+    }
+
+    if ( strcmp(Config->output_mode,"SHM")==0 ) {
+
+      // Shared memory ring must hold at least a few events of max size
+      if (Config->shm_ring_size < 8*maxPEvtSize) {
+	printf("ERROR - shm_ring_size %u too small: must be at least %d\n",Config->shm_ring_size,8*maxPEvtSize);
+	return 1;
+      }
+      printf("- Creating shared memory ring '%s' with size %u\n",b->file[0].path,Config->shm_ring_size);
+      b->shm = shm_ring_create(b->file[0].path,Config->shm_ring_size);
+      if (b->shm == NULL) {
+	printf("ERROR - Unable to create shared memory ring '%s'.\n",b->file[0].path);
+	return 2;
+      }
+
+      // Events are written to the shared memory ring without output buffer
+      return 0;
+
+    }
+
+    printf("- Opening output stream '%s'\n",b->file[0].path);
+    b->file_handle = open(b->file[0].path,O_WRONLY);
+    if (b->file_handle == -1) {
+      printf("ERROR - Unable to open file '%s' for writing.\n",b->file[0].path);
+      return 2;
+    }
+
+  }
+
+  // Events are collected in an output buffer and written in large blocks
+  if ( strcmp(Config->output_writer,"SYNC")!=0 ) {
+    b->writer = async_writer_create(Config->output_writer,Config->output_writer_buffers,Config->output_buffer_size,
+				    Config->output_writer_threads,Config->output_writer_test_delay);
+    if (b->writer == NULL) {
+      printf("ERROR - Unable to create asynchronous output writer for board %d.\n",b->id);
+      return 2;
+    }
+    b->out = output_buffer_create_async(b->writer,Config->output_buffer_events,Config->output_buffer_delay);
+  } else {
+    b->out = output_buffer_create(Config->output_buffer_size,Config->output_buffer_events,Config->output_buffer_delay);
+  }
+  if (b->out == NULL) {
+    printf("ERROR - Unable to create output buffer for board %d.\n",b->id);
+    return 2;
+  }
+
+  if ( strcmp(Config->output_mode,"FILE")!=0 ) return 0;
+
+  // Next output file is prepared by a helper thread
+  if ( b->writer == NULL && Config->file_preopen ) {
+    if (NBoards > 1) {
+      sprintf(tmpName,"%s_b%.2d",Config->data_file,b->id);
+    } else {
+      strcpy(tmpName,Config->data_file);
+    }
+    b->rotator = file_rotator_create(Config->data_dir,tmpName,Config->file_sync_close,
+				     Config->file_prealloc ? Config->file_max_size : 0);
+    if (b->rotator == NULL) {
+      printf("ERROR - Unable to create output file helper for board %d.\n",b->id);
+      return 2;
+    }
+  }
+
+  // Output files are preallocated (by the helper thread if used) and written back in chunks
+  if (b->writer) {
+    async_writer_set_write_back(b->writer,Config->file_prealloc ? Config->file_max_size : 0,
+				Config->file_flush_size,Config->file_sync_close);
+    if ( async_writer_set_direct(b->writer,Config->output_writer_direct) ) return 2;
+  } else {
+    output_buffer_set_write_back(b->out,( Config->file_prealloc && b->rotator == NULL ) ? Config->file_max_size : 0,
+				 Config->file_flush_size);
+  }
+
+  // Events of each output file are indexed in a sidecar file
+  if ( Config->file_index && ! RawMode ) {
+    b->index = event_index_create(EVENT_INDEX_BUFFER);
+    if (b->index == NULL) {
+      printf("ERROR - Unable to create event index for board %d.\n",b->id);
+      return 2;
+    }
+  }
+
+  return 0;
+
+}
+
+// Handle data acquisition
+int DAQ_readdata ()
+{
+
+  CAEN_DGTZ_ErrorCode ret;
+
+  // Input data information
+  uint32_t bufferSize;
+  board_t* b;
+
+  // Output event information
+  unsigned int nEncodeThreads;
+  unsigned int ringSize;
+
+  // Global counters for input data
+  uint64_t totalReadSize;
+  uint32_t totalReadEvents;
+  float evtReadPerSec, sizeReadPerSec;
+
+  // Global counters for output data
+  uint64_t totalWriteSize;
+  uint32_t totalWriteEvents;
+  float evtWritePerSec, sizeWritePerSec;
+
+  // Readout ring and writer thread (only used if daq_ring_size>0)
+  pthread_t writerThread;
+  int writerStatus = 0;
+  time_t t_ringreport;
+  time_t t_latencyreport;
+
+  char outName[32];
+
+  // Readout loop counters (used to compare POLL and IRQ readout modes)
+  uint64_t nLoops, nStatusReads, nIRQs, nIRQTimeouts, nReadouts, nEmptyReadouts;
+  uint64_t nMemoryFull, nBLTChanges;
+
+  // Flag to end run on ADC read error
+  int adcError;
+  int rc;
+
+  time_t t_daqstart, t_daqstop, t_daqtotal;
+  time_t t_now;
+
+  unsigned int i,j;
+
+  // If quit file is already there, assume this is a test run and do nothing
+  if ( access(Config->quit_file,F_OK) != -1 ) {
+    printf("DAQ_readdata - Quit file '%s' found: will not run acquisition\n",Config->quit_file);
+    return 3;
+  }
+
+  // In DAQRAW mode events are not decoded: readout buffers are written to output as they are
+  RawMode = ( strcmp(Config->process_mode,"DAQRAW")==0 );
+  if (RawMode) printf("- Process mode is DAQRAW: writing raw readout buffers to output\n");
+  if ( RawMode && strcmp(Config->output_mode,"SHM")==0 ) {
+    printf("ERROR - Output mode SHM can only be used in DAQ process mode\n");
+    return 1;
+  }
+
+  // Allocate buffer to hold retrieved data and output files information for each board
+  for(i=0;i<NBoards;i++) {
+    b = &Board[i];
+    ret = CAEN_DGTZ_MallocReadoutBuffer(b->handle,&b->buffer,&bufferSize);
+    if (ret != CAEN_DGTZ_Success) {
+      printf("Unable to allocate data readout buffer for board %d. Error code: %d\n",b->id,ret);
+      return 1;
+    }
+    b->file = (outfile_t*)calloc(MAX_N_OUTPUT_FILES,sizeof(outfile_t));
+    if (b->file == NULL) {
+      printf("Unable to allocate output files information for board %d\n",b->id);
+      return 1;
+    }
+  }
+  printf("- Allocated data readout buffer with size %d for %u board(s)\n",bufferSize,NBoards);
+
+  // Define number of event encoding workers
+  DecodeNative = ( strcmp(Config->decode_mode,"NATIVE")==0 );
+  nEncodeThreads = Config->encode_threads;
+  if (nEncodeThreads == 0 || nEncodeThreads > DAQ_MAX_ENCODE_THREADS) {
+    printf("WARNING - encode_threads %u not in [1,%d]: setting it to 1\n",nEncodeThreads,DAQ_MAX_ENCODE_THREADS);
+    nEncodeThreads = 1;
+  }
+  if (nEncodeThreads > 1 && ! DecodeNative) {
+    // CAEN library does not document CAEN_DGTZ_DecodeEvent as thread safe
+    printf("WARNING - encode_threads %u requires decode_mode NATIVE: setting it to 1\n",nEncodeThreads);
+    nEncodeThreads = 1;
+  }
+
+  // Select the kernels used to round the float samples returned by CAEN_DGTZ_DecodeEvent
+  if (! DecodeNative && ! RawMode) {
+    convert_init();
+    printf("- Converting decoded samples with %s kernels\n",convert_name());
+  }
+
+  // Allocate buffers to hold decoded events (one for each encoding worker)
+  for(i=0;i<nEncodeThreads;i++) {
+    ret = CAEN_DGTZ_AllocateEvent(Board[0].handle,(void**)&event[i]);
+    if (ret != CAEN_DGTZ_Success) {
+      printf("Unable to allocate decoded event buffer. Error code: %d\n",ret);
+      return 1;
+    }
+  }
+  printf("- Allocated %u decoded event buffer(s)\n",nEncodeThreads);
+
+  // Allocate buffer to hold output event structures for a full encoding batch
+  encodeBatch = nEncodeThreads*DAQ_ENCODE_EVENTS_PER_THREAD;
+  maxPEvtSize = (PEVT_HEADER_LEN + 4*(PEVT_GRPHEAD_LEN + 512 + PEVT_GRPTTT_LEN) + 32*512)*4;
+  outEvtBuffer = (char *)malloc(encodeBatch*maxPEvtSize);
+  EncBatch.info = (CAEN_DGTZ_EventInfo_t *)malloc(encodeBatch*sizeof(CAEN_DGTZ_EventInfo_t));
+  EncBatch.ptr = (char **)malloc(encodeBatch*sizeof(char*));
+  EncBatch.size = (int *)malloc(encodeBatch*sizeof(int));
+  if (outEvtBuffer == NULL || EncBatch.info == NULL || EncBatch.ptr == NULL || EncBatch.size == NULL) {
+    printf("Unable to allocate output event buffer for %u events of size %d\n",encodeBatch,maxPEvtSize);
+    return 1;
+  }
+  printf("- Allocated output event buffer for %u events with size %d\n",encodeBatch,maxPEvtSize);
+
+  // Start event encoding workers
+  EncodePool = pool_create(nEncodeThreads,Config->encode_pin_cpus,DAQ_encode_event,&EncBatch);
+  if (EncodePool == NULL) {
+    printf("Unable to create event encoding pool with %u workers\n",nEncodeThreads);
+    return 1;
+  }
+  printf("- Started event encoding pool with %u worker(s)%s\n",nEncodeThreads,Config->encode_pin_cpus ? " pinned to cpus" : "");
+
+  // With ADAPTIVE readout control poll delay and BLT size follow the trigger rate
+  AdaptiveReadout = ( strcmp(Config->readout_control,"ADAPTIVE")==0 );
+  if (AdaptiveReadout) {
+    printf("- Readout control is ADAPTIVE: poll delay in [%u,%u] usecs - BLT size up to %u events\n",
+	   Config->adaptive_min_delay,Config->daq_loop_delay,Config->max_num_events_blt);
+  }
+
+  // Create readout ring and allocate one readout buffer for each of its slots
+  ringSize = DAQ_ring_size();
+  if ( ringSize ) {
+    for(i=0;i<NBoards;i++) {
+      if ( DAQ_setup_ring(&Board[i],ringSize) ) return 1;
+    }
+    printf("- Allocated readout ring with %u slots of size %d for %u board(s)\n",Board[0].ring->n_slots,bufferSize,NBoards);
+  }
+
+  // Zero output file counters
+  atomic_store(&tooManyOutputFiles,0);
+  for(i=0;i<NBoards;i++) Board[i].file_index = 0;
+
+  // Open output streams and create output buffers, writers, and helpers of each board
+  for(i=0;i<NBoards;i++) {
+    rc = DAQ_setup_output(&Board[i]);
+    if (rc) return rc;
+  }
+  if ( strcmp(Config->output_mode,"SHM")!=0 ) {
+    printf("- Output buffer of %u bytes - max events %u - max delay %u msecs (0: no limit)\n",
+	   Config->output_buffer_size,Config->output_buffer_events,Config->output_buffer_delay);
+    if (Board[0].rotator) {
+      printf("- Output files prepared and closed by a helper thread - sync on close %d\n",Config->file_sync_close);
+    }
+    if ( strcmp(Config->output_mode,"FILE")==0 ) {
+      printf("- Output files preallocation %d - written back every %u bytes (0: by the kernel)\n",
+	     Config->file_prealloc,Config->file_flush_size);
+    }
+    if (Board[0].writer) {
+      printf("- Asynchronous writer with %s: %u buffers in flight - simulated write time %u usecs (0: none) - O_DIRECT %d\n",
+	     async_writer_backend(Board[0].writer),Config->output_writer_buffers,Config->output_writer_test_delay,Board[0].writer->direct);
+    }
+  }
+
+  // Map all pages of the readout and output buffers now and keep them in RAM
+  // so that no page fault slows down the readout loop
+  if ( Config->lock_memory ) {
+    for(i=0;i<NBoards;i++) {
+      b = &Board[i];
+      rt_prefault(b->buffer,bufferSize);
+      if ( b->ring ) for(j=0;j<b->ring->n_slots;j++) rt_prefault(b->ring->slot[j].data,bufferSize);
+      if ( b->out && b->out->size ) rt_prefault(b->out->data,b->out->size);
+      if ( b->writer ) for(j=0;j<b->writer->n_blocks;j++) rt_prefault(b->writer->block[j].data,b->writer->block[j].size);
+    }
+    rt_prefault(outEvtBuffer,encodeBatch*maxPEvtSize);
+    printf("- Prefaulted readout and output buffers\n");
+    rt_lock_memory();
+  }
+
+  // DAQ is now ready to start. Create InitOK file and set status to INITIALIZED
+  if ( create_initok_file() ) return 1;
+
+  if (Config->startdaq_mode == 0) {
+
+    // If SW controlled DAQ is selected, we need to wait for the appearance of
+    // the start file and then give the SWStartAcquisition command
+
+    // Wait either for Start DAQ file or for Quit file
+    while(1){
+      if ( access(Config->start_file,F_OK) != -1 ) {
+	printf("- Start file '%s' found: starting DAQ\n",Config->start_file);
+	break;
+      }
+      if ( access(Config->quit_file,F_OK) != -1 ) {
+	printf("- Quit file '%s' found: exiting\n",Config->quit_file);
+	return 3;
+      }
+      // Sleep for ~1ms before checking again
+      usleep(1000);
+    }
+
+    // Start digitizer acquisition
+    for(i=0;i<NBoards;i++) {
+      ret = CAEN_DGTZ_SWStartAcquisition(Board[i].handle);
+      if (ret != CAEN_DGTZ_Success) {
+	printf("Unable to start acquisition of board %d. Error code: %d\n",Board[i].id,ret);
+	return 2;
+      }
+    }
+
+  } else if (Config->startdaq_mode == 1) {
+
+    // If S_IN controlled DAQ is selected, everything is automatic
+    printf("- Actual DAQ will start on S_IN signal\n");
+
+  }
+
+  InBurst = 1;
+  time(&t_daqstart);
+  printf("%s - Acquisition started\n",format_time(t_daqstart));
+
+  // Clear latency histograms
+  histo_init(&HLoop,"Loop period","ns");
+  histo_init(&HIRQWait,"IRQ wait","ns");
+  histo_init(&HStatus,"Status poll","ns");
+  histo_init(&HReadData,"ReadData","ns");
+  histo_init(&HBLTSize,"BLT size","B");
+  histo_init(&HBLTEvents,"BLT events","evts");
+  histo_init(&HDecode,"DecodeEvent","ns");
+  histo_init(&HFormat,"create_pevent","ns");
+  histo_init(&HWrite,"write","ns");
+  histo_init(&HRotate,"file change","ns");
+  t_latencyreport = t_daqstart;
+
+  // Zero counters
+  for(i=0;i<NBoards;i++) {
+    b = &Board[i];
+    b->read_size = 0;
+    b->read_events = 0;
+    b->write_size = 0;
+    b->write_events = 0;
+    b->missing_events = 0;
+    b->n_loops = 0;
+    b->n_status_reads = 0;
+    b->n_irqs = 0;
+    b->n_irq_timeouts = 0;
+    b->n_readouts = 0;
+    b->n_empty_readouts = 0;
+    b->n_memory_full = 0;
+    b->t_last_loop = 0;
+    b->blt_events = Config->max_num_events_blt;
+    b->loop_delay = Config->daq_loop_delay;
+    b->trig_rate = 0.;
+    b->t_last_read = 0;
+    b->drained = 0;
+    b->n_blt_changes = 0;
+    b->log_delay = b->loop_delay;
+    b->log_blt = b->blt_events;
+    b->t_control_log = 0;
+  }
+
+  // Open initial output files and write header to them
+  for(i=0;i<NBoards;i++) {
+    if ( DAQ_open_file(&Board[i],t_daqstart) ) return 2;
+  }
+
+  // Start writer thread: from now on only the writer thread will access the output files
+  if ( ringSize ) {
+    atomic_store(&ReadoutDone,0);
+    atomic_store(&WriterDone,0);
+    atomic_store(&WriterStatus,0);
+    if ( pthread_create(&writerThread,NULL,DAQ_writer_thread,NULL) ) {
+      printf("ERROR - Unable to start writer thread.\n");
+      return 2;
+    }
+    printf("- Writer thread started\n");
+  }
+  t_ringreport = t_daqstart;
+
+  // When several boards are read, each link is read by its own thread
+  if (NBoards > 1) {
+    atomic_store(&ReadoutStop,0);
+    atomic_store(&ReadoutStatus,0);
+    for(i=0;i<NLinks;i++) {
+      if ( pthread_create(&Link[i].thread,NULL,DAQ_readout_thread,&Link[i]) ) {
+	printf("ERROR - Unable to start readout thread for link %d.\n",Link[i].link);
+	return 2;
+      }
+    }
+    printf("- Started %u readout thread(s)\n",NLinks);
+  }
+
+  // In single-board mode the readout loop runs in this thread (after all other threads were started, so that they do not inherit its settings)
+  if (NBoards == 1) rt_set_thread("Readout",Config->readout_cpu,Config->readout_rt_priority);
+
+  // Main DAQ loop: wait for some data to be present and copy it to output file
+  // In multi-board mode data are read by the readout threads and this loop only checks stop conditions
+  adcError = 0;
+  while(1){
+
+    if (NBoards == 1) {
+
+      rc = DAQ_read_board(&Board[0]);
+      if (rc == 1) {
+	adcError = 1;
+	break; // Exit from main DAQ loop
+      } else if (rc == 2) {
+	return 2; // As this is an error while writing data to output file, no point in sending file tail
+      }
+
+    } else if ( atomic_load(&ReadoutStatus) ) {
+
+      adcError = 1;
+      break; // Exit from main DAQ loop
+
+    }
+
+    // Save current time
+    time(&t_now);
+
+    if ( ringSize ) {
+
+      // Writer thread stopped on its own: stop acquisition
+      if ( atomic_load(&WriterDone) ) break;
+
+      // Report ring status once in a while
+      if ( t_now-t_ringreport >= DAQ_RING_REPORT_TIME ) {
+	DAQ_ring_report(t_now);
+	t_ringreport = t_now;
+      }
+
     } else {
-      printf("%s - Closed output stream '%s' after %d secs with %u events and size %llu bytes\n",
-	     format_time(t_now),pathName[fileIndex],(int)(fileTClose[fileIndex]-fileTOpen[fileIndex]),
-	     fileEvents[fileIndex],fileSize[fileIndex]);
+
+      // Change output file if needed
+      if ( DAQ_check_file(&Board[0],t_now) ) return 2; // As this is an error while writing data to output file, no point in sending file tail
+
     }
 
-    // Update file counter
-    fileIndex++;
+    // Report latency histograms once in a while
+    if ( Config->latency_report_time && t_now-t_latencyreport >= Config->latency_report_time ) {
+      DAQ_latency_report(t_now,0);
+      t_latencyreport = t_now;
+    }
 
+    // Check if it is time to stop DAQ (user interrupt, quit file, time elapsed, too many output files)
+    if (
+	 BreakSignal || atomic_load(&tooManyOutputFiles) ||
+	 (access(Config->quit_file,F_OK) != -1) ||
+	 ( Config->total_daq_time && ( t_now-t_daqstart >= Config->total_daq_time ) )
+       ) break;
+
+    // Sleep for a while before continuing (in IRQ mode IRQWait already did the waiting)
+    if (NBoards > 1) {
+      usleep(Config->daq_loop_delay);
+    } else if ( ! Board[0].use_irq ) {
+      usleep(Board[0].loop_delay);
+    }
+
+  }
+
+  // Stop readout threads
+  if (NBoards > 1) {
+    atomic_store(&ReadoutStop,1);
+    for(i=0;i<NLinks;i++) pthread_join(Link[i].thread,NULL);
+    if ( atomic_load(&ReadoutStatus) ) adcError = 1;
+  }
+
+  // Let writer thread process all pending data and wait for it to finish
+  if ( ringSize ) {
+    atomic_store(&ReadoutDone,1);
+    printf("- Waiting for writer thread to process %u pending readout buffers\n",DAQ_ring_used());
+    pthread_join(writerThread,NULL);
+    writerStatus = atomic_load(&WriterStatus);
+    if (writerStatus == 1) {
+      adcError = 1;
+    } else if (writerStatus == 2) {
+      return 2; // As this is an error while writing data to output file, no point in sending file tail
+    }
+    time(&t_now);
+  }
+
+  // Tell user what stopped DAQ
+  if ( adcError ) printf("=== Stopping DAQ on ADC access or data handling ERROR ===\n");
+  if ( BreakSignal ) printf("=== Stopping DAQ on interrupt %d ===\n",BreakSignal);
+  if ( atomic_load(&tooManyOutputFiles) ) printf("=== Stopping DAQ after writing %d data files ===\n",MAX_N_OUTPUT_FILES);
+  if ( access(Config->quit_file,F_OK) != -1 )
+    printf("=== Stopping DAQ on quit file '%s' ===\n",Config->quit_file);
+  if ( Config->total_daq_time && ( t_now-t_daqstart >= Config->total_daq_time ) )
+    printf("=== Stopping DAQ after %d secs of run (requested %d) ===\n",(int)(t_now-t_daqstart),Config->total_daq_time);
+
+  // Close last output file of each board (if DAQ was stopped for writing too many output files,
+  // the board which reached the limit has no open file)
+  for(i=0;i<NBoards;i++) {
+    if ( Board[i].file_index<MAX_N_OUTPUT_FILES ) {
+      if ( DAQ_close_file(&Board[i],t_now) ) return 2;
+    }
+  }
+
+  // Wait for the asynchronous writers and the file helpers to complete all files
+  for(i=0;i<NBoards;i++) {
+    if ( Board[i].writer && async_writer_sync(Board[i].writer) ) {
+      printf("ERROR - Asynchronous writer of board %d failed: output files are incomplete\n",Board[i].id);
+      return 2;
+    }
+    if ( Board[i].rotator && file_rotator_sync(Board[i].rotator) ) {
+      printf("ERROR - Output file helper of board %d failed: output files are incomplete\n",Board[i].id);
+      return 2;
+    }
   }
 
   if (adcError) {
@@ -1001,33 +2221,75 @@ int DAQ_readdata ()
   }
 
   // Stop digitizer acquisition
-  ret = CAEN_DGTZ_SWStopAcquisition(Handle);
-  if (ret != CAEN_DGTZ_Success) {
-    printf("Unable to stop acquisition. Error code: %d\n",ret);
-    return 2;
+  for(i=0;i<NBoards;i++) {
+    ret = CAEN_DGTZ_SWStopAcquisition(Board[i].handle);
+    if (ret != CAEN_DGTZ_Success) {
+      printf("Unable to stop acquisition of board %d. Error code: %d\n",Board[i].id,ret);
+      return 2;
+    }
   }
   InBurst = 0; // Signal DAQ has stopped
   time(&t_daqstop);
   printf("%s - Acquisition stopped\n",format_time(t_daqstop));
 
-  // Deallocate data buffer
-  ret = CAEN_DGTZ_FreeReadoutBuffer(&buffer);
-  if (ret != CAEN_DGTZ_Success) {
-    printf("Unable to free allocated data readout buffer. Error code: %d\n",ret);
-    return 2;
+  // Deallocate data buffers
+  for(i=0;i<NBoards;i++) {
+    ret = CAEN_DGTZ_FreeReadoutBuffer(&Board[i].buffer);
+    if (ret != CAEN_DGTZ_Success) {
+      printf("Unable to free allocated data readout buffer. Error code: %d\n",ret);
+      return 2;
+    }
   }
   printf("- Deallocated data readout buffer\n");
 
-  // Deallocate event buffer
-  ret = CAEN_DGTZ_FreeEvent(Handle,(void**)&event);
-  if (ret != CAEN_DGTZ_Success) {
-    printf("Unable to free allocated event buffer. Error code: %d\n",ret);
-    return 2;
+  // Stop event encoding workers
+  pool_destroy(EncodePool);
+  EncodePool = NULL;
+
+  // Deallocate event buffers
+  for(i=0;i<nEncodeThreads;i++) {
+    ret = CAEN_DGTZ_FreeEvent(Board[0].handle,(void**)&event[i]);
+    if (ret != CAEN_DGTZ_Success) {
+      printf("Unable to free allocated event buffer. Error code: %d\n",ret);
+      return 2;
+    }
   }
-  printf("- Deallocated event buffer\n");
+  printf("- Deallocated event buffers\n");
 
-  // Deallocate output event buffer
+  // Deallocate output event buffers
   free(outEvtBuffer);
+  free(EncBatch.info);
+  free(EncBatch.ptr);
+  free(EncBatch.size);
+
+  // Sum counters of all boards
+  totalReadSize = 0;
+  totalReadEvents = 0;
+  totalWriteSize = 0;
+  totalWriteEvents = 0;
+  nLoops = 0;
+  nStatusReads = 0;
+  nIRQs = 0;
+  nIRQTimeouts = 0;
+  nReadouts = 0;
+  nEmptyReadouts = 0;
+  nMemoryFull = 0;
+  nBLTChanges = 0;
+  for(i=0;i<NBoards;i++) {
+    b = &Board[i];
+    totalReadSize += b->read_size;
+    totalReadEvents += b->read_events;
+    totalWriteSize += b->write_size;
+    totalWriteEvents += b->write_events;
+    nLoops += b->n_loops;
+    nStatusReads += b->n_status_reads;
+    nIRQs += b->n_irqs;
+    nIRQTimeouts += b->n_irq_timeouts;
+    nReadouts += b->n_readouts;
+    nEmptyReadouts += b->n_empty_readouts;
+    nMemoryFull += b->n_memory_full;
+    nBLTChanges += b->n_blt_changes;
+  }
 
   // Give some final report
   evtReadPerSec = 0.;
@@ -1047,25 +2309,106 @@ int DAQ_readdata ()
   printf("Total size of data acquired: %llu B - %6.2f KB/s\n",totalReadSize,sizeReadPerSec);
   printf("Total number of events written: %u - %6.2f events/s\n",totalWriteEvents,evtWritePerSec);
   printf("Total size of data written: %llu B - %6.2f KB/s\n",totalWriteSize,sizeWritePerSec);
+  printf("Readout mode %s: loops %llu - status reads %llu - IRQs %llu - IRQ timeouts %llu\n",
+	 Config->readout_mode,(unsigned long long)nLoops,(unsigned long long)nStatusReads,(unsigned long long)nIRQs,(unsigned long long)nIRQTimeouts);
+  printf("Readouts %llu - empty readouts %llu - %6.2f events/readout\n",
+	 (unsigned long long)nReadouts,(unsigned long long)nEmptyReadouts,nReadouts ? 1.*totalReadEvents/nReadouts : 0.);
+  printf("Readout control %s: memory full %llu times - BLT size changes %llu\n",Config->readout_control,(unsigned long long)nMemoryFull,(unsigned long long)nBLTChanges);
+  if (NBoards > 1) {
+    for(i=0;i<NBoards;i++) {
+      b = &Board[i];
+      printf("Board %d link %d slot %d: acquired %u events %llu B - written %u events %llu B - readouts %llu\n",
+	     b->id,b->link,b->slot,b->read_events,(unsigned long long)b->read_size,b->write_events,(unsigned long long)b->write_size,(unsigned long long)b->n_readouts);
+    }
+  }
+  if ( ringSize ) {
+    for(i=0;i<NBoards;i++) {
+      b = &Board[i];
+      printf("Board %d readout ring: %u slots - max used %u - BLTs to writer %llu - BLTs dropped %llu with %llu events\n",
+	     b->id,b->ring->n_slots,b->ring->max_used,(unsigned long long)b->ring->n_pushed_blt,(unsigned long long)b->ring->n_dropped_blt,(unsigned long long)b->ring->n_dropped_events);
+      if ( OverloadMissing ) {
+	printf("Board %d overload: output fell behind %llu times - %u events written without data\n",
+	       b->id,(unsigned long long)b->ring->n_overloads,b->missing_events);
+      }
+    }
+  }
+  for(i=0;i<NBoards;i++) {
+    b = &Board[i];
+    if (b->out) {
+      sprintf(outName,"of board %d",b->id);
+      output_buffer_report(b->out,outName);
+    }
+    if (b->writer) {
+      sprintf(outName,"of board %d",b->id);
+      async_writer_report(b->writer,outName);
+    }
+    if (b->rotator) {
+      sprintf(outName,"of board %d",b->id);
+      file_rotator_report(b->rotator,outName);
+    }
+    if (b->index) {
+      sprintf(outName,"of board %d",b->id);
+      event_index_report(b->index,outName);
+    }
+  }
   if ( strcmp(Config->output_mode,"FILE")==0 ) {
     printf("=== Files created =======================================\n");
-    for(i=0;i<fileIndex;i++) {
-      printf("'%s' %u %llu",fileName[i],fileEvents[i],fileSize[i]);
-      printf(" %s",format_time(fileTOpen[i])); // Optimizer effect! :)
-      printf(" %s\n",format_time(fileTClose[i]));
+    for(i=0;i<NBoards;i++) {
+      b = &Board[i];
+      for(j=0;j<b->file_index;j++) {
+	printf("'%s' %u %llu",b->file[j].name,b->file[j].events,(unsigned long long)b->file[j].size);
+	printf(" %s",format_time(b->file[j].t_open)); // Optimizer effect! :)
+	printf(" %s\n",format_time(b->file[j].t_close));
+      }
     }
   }
   printf("=========================================================\n");
+  DAQ_latency_report(t_daqstop,1);
+  printf("=========================================================\n");
 
-  // Free space allocated for file names
-  for(i=0;i<fileIndex;i++) free(fileName[i]);
+  // Free space allocated for file names and output buffers
+  for(i=0;i<NBoards;i++) {
+    b = &Board[i];
+    if (b->out) {
+      output_buffer_destroy(b->out);
+      b->out = NULL;
+    }
+    if (b->writer) {
+      async_writer_destroy(b->writer);
+      b->writer = NULL;
+    }
+    if (b->rotator) {
+      file_rotator_destroy(b->rotator);
+      b->rotator = NULL;
+    }
+    if (b->index) {
+      event_index_destroy(b->index);
+      b->index = NULL;
+    }
+    for(j=0;j<MAX_N_OUTPUT_FILES;j++) {
+      free(b->file[j].name);
+      free(b->file[j].path);
+    }
+    free(b->file);
+    b->file = NULL;
+  }
+
+  // Free readout rings and their buffers
+  if ( ringSize ) {
+    for(i=0;i<NBoards;i++) {
+      b = &Board[i];
+      for(j=0;j<b->ring->n_slots;j++) CAEN_DGTZ_FreeReadoutBuffer(&b->ring->slot[j].data);
+      ring_destroy(b->ring);
+      b->ring = NULL;
+    }
+  }
 
   return 0;
 
 }
 
-// Function to handle final reset of the digitizer
-int DAQ_close ()
+// Function to handle final reset of one digitizer
+static int DAQ_close_board(board_t* b)
 {
 
   CAEN_DGTZ_ErrorCode ret;
@@ -1073,20 +2416,20 @@ int DAQ_close ()
 
   // Check if DAQ is running and stop it (should never happen!)
   reg = 0x8104; // Acquisition Status
-  ret = CAEN_DGTZ_ReadRegister(Handle,reg,&data);
+  ret = CAEN_DGTZ_ReadRegister(b->handle,reg,&data);
   if (ret != CAEN_DGTZ_Success) {
     printf("*** ERROR *** Unable to read Acquisition Status register 0x%04x. Error code: %d\n",reg,ret);
     return 1;
   }
   if ( (data >> 2) & 0x1 ) { // bit 2: RUN on/off
     printf ("WARNING!!! DAQ is active (should not happen): stopping... ");
-    ret = CAEN_DGTZ_SWStopAcquisition(Handle);
+    ret = CAEN_DGTZ_SWStopAcquisition(b->handle);
     if (ret != CAEN_DGTZ_Success) {
       printf("\n*** ERROR *** Unable to stop data acquisition. Error code: %d\n",ret);
       return 1;
     }
     printf(" done\n");
-    ret = CAEN_DGTZ_ClearData(Handle); // Clear digitizer buffers
+    ret = CAEN_DGTZ_ClearData(b->handle); // Clear digitizer buffers
     if (ret != CAEN_DGTZ_Success) {
       printf("*** ERROR *** Unable to clear data after stopping data acquisition. Error code: %d\n",ret);
       return 1;
@@ -1095,19 +2438,15 @@ int DAQ_close ()
 
   // Reset
   printf ("- Resetting digitizer... ");
-  ret = CAEN_DGTZ_Reset (Handle);
+  ret = CAEN_DGTZ_Reset (b->handle);
   if (ret != CAEN_DGTZ_Success) {
     printf("*** ERROR *** Unable to reset digitizer. Error code: %d\n",ret);
     return 1;
   }
   printf ("done!\n");
 
-  printf ("- Flushing all output files... ");
-  fflush (NULL);
-  printf ("done!\n");
-
   printf ("- Closing connection to digitizer... ");
-  ret = CAEN_DGTZ_CloseDigitizer (Handle);
+  ret = CAEN_DGTZ_CloseDigitizer (b->handle);
   if (ret != CAEN_DGTZ_Success) {
     printf("*** ERROR *** Unable to close digitizer connection. Error code: %d\n",ret);
     return 1;
@@ -1117,3 +2456,25 @@ int DAQ_close ()
   return 0;
 
 }
+
+// Function to handle final reset of all digitizers
+int DAQ_close ()
+{
+
+  unsigned int i;
+  int rc = 0;
+
+  for(i=0;i<NBoards;i++) {
+    if (Board[i].handle < 0) continue; // Board was not connected
+    if (NBoards > 1) printf("- Closing board %d\n",Board[i].id);
+    if ( DAQ_close_board(&Board[i]) ) rc = 1;
+    Board[i].handle = -1;
+  }
+
+  printf ("- Flushing all output files... ");
+  fflush (NULL);
+  printf ("done!\n");
+
+  return rc;
+
+}
@@ -0,0 +1,269 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+
+#include "CAENDigitizer.h"
+
+#include "Config.h"
+
+#include "DRS4.h"
+
+#define DRS4_N_CELLS 1024
+
+// Correction tables for the 9 channels (8 + trigger) of each group of a board.
+// Cell corrections are stored twice in a row so that they can be read
+// starting from the start index cell without wrapping around.
+struct drs4_table_s {
+  int16_t cell[MAX_X742_GROUP_SIZE][MAX_X742_CHANNEL_SIZE][2*DRS4_N_CELLS];
+  int16_t nsample[MAX_X742_GROUP_SIZE][MAX_X742_CHANNEL_SIZE][DRS4_N_CELLS];
+};
+
+// Tables of each board (indexed by board id)
+static drs4_table_t* DRS4Table[MAX_N_BOARDS];
+
+// Vector of 8 int16 (GCC vector extensions: SIMD instructions are used if enabled with SIMDFLAGS)
+typedef int16_t v8i16 __attribute__ ((vector_size (16)));
+
+// Read correction tables from cache file. Return 0 if OK, 1 if file is missing or not valid
+static int DRS4_read_cache(char* fileName, uint32_t board_sn, int freq, CAEN_DGTZ_DRS4Correction_t* table)
+{
+
+  FILE* cf;
+  uint32_t head[4];
+  size_t n;
+
+  if ( (cf = fopen(fileName,"rb")) == NULL ) return 1;
+  n = fread(head,sizeof(uint32_t),4,cf);
+  if ( n != 4 || head[0] != DRS4_CACHE_TAG || head[1] != board_sn || head[2] != (uint32_t)freq ||
+       head[3] != MAX_X742_GROUP_SIZE*sizeof(CAEN_DGTZ_DRS4Correction_t) ) {
+    printf("DRS4_read_cache - WARNING - File %s does not match board %u at frequency %d: ignoring it\n",fileName,board_sn,freq);
+    fclose(cf);
+    return 1;
+  }
+  n = fread(table,sizeof(CAEN_DGTZ_DRS4Correction_t),MAX_X742_GROUP_SIZE,cf);
+  fclose(cf);
+  if ( n != MAX_X742_GROUP_SIZE ) {
+    printf("DRS4_read_cache - WARNING - File %s is truncated: ignoring it\n",fileName);
+    return 1;
+  }
+  return 0;
+
+}
+
+// Write correction tables to cache file. Return 0 if OK, 1 if error
+static int DRS4_write_cache(char* fileName, uint32_t board_sn, int freq, CAEN_DGTZ_DRS4Correction_t* table)
+{
+
+  FILE* cf;
+  uint32_t head[4];
+
+  if ( (cf = fopen(fileName,"wb")) == NULL ) {
+    printf("DRS4_write_cache - WARNING - Unable to open file %s for writing: %s\n",fileName,strerror(errno));
+    return 1;
+  }
+  head[0] = DRS4_CACHE_TAG;
+  head[1] = board_sn;
+  head[2] = freq;
+  head[3] = MAX_X742_GROUP_SIZE*sizeof(CAEN_DGTZ_DRS4Correction_t);
+  if ( fwrite(head,sizeof(uint32_t),4,cf) != 4 ||
+       fwrite(table,sizeof(CAEN_DGTZ_DRS4Correction_t),MAX_X742_GROUP_SIZE,cf) != MAX_X742_GROUP_SIZE ) {
+    printf("DRS4_write_cache - WARNING - Unable to write file %s\n",fileName);
+    fclose(cf);
+    remove(fileName);
+    return 1;
+  }
+  fclose(cf);
+  return 0;
+
+}
+
+// Get DRS4 correction tables for the board at the given sampling frequency
+// Tables are read from the cache file if available, otherwise from the board flash memory
+// (and then saved to the cache file). Use handle -1 to only read the cache.
+// Tables of this board are then used by the correction routines. Return 0 if OK, 1 if error
+int DRS4_init(int handle, int board_id, uint32_t board_sn, int freq)
+{
+
+  CAEN_DGTZ_ErrorCode ret;
+  CAEN_DGTZ_DRS4Correction_t* table;
+  drs4_table_t* t;
+  char fileName[MAX_FILE_LEN];
+  int useCache;
+  unsigned int iGr,iCh,iCl;
+
+  if (board_id < 0 || board_id >= MAX_N_BOARDS) {
+    printf("DRS4_init - ERROR - Board id %d not valid\n",board_id);
+    return 1;
+  }
+  if (DRS4Table[board_id] == NULL) {
+    DRS4Table[board_id] = (drs4_table_t*)malloc(sizeof(drs4_table_t));
+    if (DRS4Table[board_id] == NULL) {
+      printf("DRS4_init - ERROR - Unable to allocate memory for DRS4 correction tables of board %d\n",board_id);
+      return 1;
+    }
+  }
+  t = DRS4Table[board_id];
+
+  table = (CAEN_DGTZ_DRS4Correction_t*)malloc(MAX_X742_GROUP_SIZE*sizeof(CAEN_DGTZ_DRS4Correction_t));
+  if (table == NULL) {
+    printf("DRS4_init - ERROR - Unable to allocate memory for DRS4 correction tables\n");
+    return 1;
+  }
+
+  // Cache file is <drs4_cache_dir>drs4corr_<board_sn>_<freq>.dat (as for data_dir, drs4_cache_dir must end with "/")
+  useCache = ( strcmp(Config->drs4_cache_dir,"")!=0 && strcmp(Config->drs4_cache_dir,"none")!=0 );
+  if ( useCache && snprintf(fileName,MAX_FILE_LEN,"%sdrs4corr_%u_%d.dat",Config->drs4_cache_dir,board_sn,freq) >= MAX_FILE_LEN ) {
+    printf("DRS4_init - WARNING - Name of cache file in %s is too long: cache not used\n",Config->drs4_cache_dir);
+    useCache = 0;
+  }
+
+  if ( useCache && DRS4_read_cache(fileName,board_sn,freq,table)==0 ) {
+
+    printf("- Loaded DRS4 correction tables from cache file %s\n",fileName);
+
+  } else {
+
+    // A negative handle means that no board is connected (offline use): only the cache can be used
+    if (handle < 0) {
+      printf("DRS4_init - ERROR - No valid DRS4 correction tables cache found for board %u at frequency %d\n",board_sn,freq);
+      free(table);
+      return 1;
+    }
+
+    ret = CAEN_DGTZ_GetCorrectionTables(handle,freq,(void*)table);
+    if (ret != CAEN_DGTZ_Success) {
+      printf("DRS4_init - ERROR - Unable to read DRS4 correction tables from board. Error code: %d\n",ret);
+      free(table);
+      return 1;
+    }
+    printf("- Loaded DRS4 correction tables from X742 flash memory\n");
+
+    if ( useCache && DRS4_write_cache(fileName,board_sn,freq,table)==0 ) {
+      printf("- Saved DRS4 correction tables to cache file %s\n",fileName);
+    }
+
+  }
+
+  // Convert tables to the format used by the correction routines
+  for (iGr=0;iGr<MAX_X742_GROUP_SIZE;iGr++) {
+    for (iCh=0;iCh<MAX_X742_CHANNEL_SIZE;iCh++) {
+      for (iCl=0;iCl<DRS4_N_CELLS;iCl++) {
+	t->cell[iGr][iCh][iCl] = table[iGr].cell[iCh][iCl];
+	t->cell[iGr][iCh][iCl+DRS4_N_CELLS] = table[iGr].cell[iCh][iCl];
+	t->nsample[iGr][iCh][iCl] = table[iGr].nsample[iCh][iCl];
+      }
+    }
+  }
+
+  free(table);
+  return 0;
+
+}
+
+// Correction tables of the given board (loaded with DRS4_init). Return NULL if not loaded
+const drs4_table_t* DRS4_table(int board_id)
+{
+  if (board_id < 0 || board_id >= MAX_N_BOARDS) return NULL;
+  return DRS4Table[board_id];
+}
+
+// Subtract cell and index corrections from nSm samples of one channel
+static void DRS4_offset_correction(int16_t* data, const int16_t* cell, const int16_t* nsample, unsigned int nSm)
+{
+
+  unsigned int iSm = 0;
+  v8i16 d,c,n;
+
+  for (;iSm+8<=nSm;iSm+=8) {
+    memcpy(&d,data+iSm,16);
+    memcpy(&c,cell+iSm,16);
+    memcpy(&n,nsample+iSm,16);
+    d = d - c - n;
+    memcpy(data+iSm,&d,16);
+  }
+  for (;iSm<nSm;iSm++) data[iSm] -= cell[iSm] + nsample[iSm];
+
+}
+
+// Return 1 if sample iSm of a channel looks like a spike, with the conditions used by the CAEN library:
+// a drop of more than 30 counts from the previous sample which recovers at the next or second next sample
+static inline int DRS4_is_spike(const int16_t* d, unsigned int iSm, unsigned int nSm)
+{
+  if (iSm == 1) return ( d[2]-d[1] > 30 ) || ( (d[3]-d[1] > 30) && (d[3]-d[2] > 30) );
+  if (iSm == nSm-1) return ( d[nSm-2]-d[iSm] > 30 );
+  if ( ! (d[iSm-1]-d[iSm] > 30) ) return 0;
+  return ( d[iSm+1]-d[iSm] > 30 ) || ( iSm == nSm-2 ) || ( d[iSm+2]-d[iSm] > 30 );
+}
+
+// Mean of two samples, rounded half away from zero as done by the conversion of the CAEN float samples
+static inline int16_t DRS4_mean(int16_t a, int16_t b)
+{
+  int32_t sum = a+b;
+  return (sum >= 0) ? (sum+1)/2 : (sum-1)/2;
+}
+
+// Replace a spike at sample iSm of a channel as done by the CAEN library
+static inline void DRS4_remove_spike(int16_t* d, unsigned int iSm, unsigned int nSm)
+{
+  if (iSm == 1) {
+    if (d[2]-d[1] > 30) {
+      d[0] = d[1] = d[2];
+    } else {
+      d[0] = d[1] = d[2] = d[3];
+    }
+  } else if (iSm == nSm-1) {
+    d[iSm] = d[iSm-1];
+  } else if (d[iSm+1]-d[iSm] > 30) {
+    d[iSm] = DRS4_mean(d[iSm-1],d[iSm+1]);
+  } else if (iSm == nSm-2) {
+    d[iSm] = d[iSm+1] = d[iSm-1];
+  } else {
+    d[iSm] = d[iSm+1] = DRS4_mean(d[iSm-1],d[iSm+2]);
+  }
+}
+
+// Remove spikes appearing at the same sample in all 8 channels of a group, also from the trigger samples (if not NULL).
+// Same algorithm used by the CAEN library (PeakCorrection) but interpolated samples are rounded to integer
+static void DRS4_peak_correction(int16_t** ch, int16_t* tr, unsigned int nSm)
+{
+
+  unsigned int iSm,iCh;
+
+  if (nSm < 4) return;
+
+  for (iCh=0;iCh<8;iCh++) ch[iCh][0] = ch[iCh][1];
+  if (tr) tr[0] = tr[1];
+
+  for (iSm=1;iSm<nSm;iSm++) {
+
+    // Spike must be present in all channels (the trigger is not checked)
+    for (iCh=0;iCh<8;iCh++) {
+      if ( ! DRS4_is_spike(ch[iCh],iSm,nSm) ) break;
+    }
+    if (iCh<8) continue;
+
+    for (iCh=0;iCh<8;iCh++) DRS4_remove_spike(ch[iCh],iSm,nSm);
+    if (tr) DRS4_remove_spike(tr,iSm,nSm);
+
+  }
+
+}
+
+// Apply DRS4 corrections of tables t to nSm samples of the 8 channels of a group and to its nTr trigger samples (tr NULL if none)
+void DRS4_correct_group(const drs4_table_t* t, unsigned int iGr, unsigned int sic, unsigned int nSm, int16_t** ch, int16_t* tr, unsigned int nTr)
+{
+
+  unsigned int iCh;
+
+  for (iCh=0;iCh<8;iCh++) {
+    DRS4_offset_correction(ch[iCh],&t->cell[iGr][iCh][sic%DRS4_N_CELLS],t->nsample[iGr][iCh],nSm);
+  }
+  if (tr) DRS4_offset_correction(tr,&t->cell[iGr][8][sic%DRS4_N_CELLS],t->nsample[iGr][8],nTr);
+
+  // As in the CAEN library, trigger spikes are removed where all channels have one (trigger and channels
+  // of V1742 groups always have the same number of samples)
+  DRS4_peak_correction(ch,(nTr == nSm) ? tr : NULL,nSm);
+
+}
@@ -0,0 +1,307 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "CAENDigitizer.h"
+
+#include "PEvent.h"
+
+#include "EventIndex.h"
+
+event_index_t* event_index_create(unsigned int maxEntries)
+{
+
+  event_index_t* idx;
+
+  if (maxEntries == 0) maxEntries = 1;
+  idx = (event_index_t*)malloc(sizeof(event_index_t));
+  if (idx == NULL) {
+    printf("event_index_create - ERROR - Unable to allocate index structure\n");
+    return NULL;
+  }
+  memset(idx,0,sizeof(event_index_t));
+  idx->fd = -1;
+  idx->max_entries = maxEntries;
+  idx->entry = (event_index_entry_t*)malloc(maxEntries*sizeof(event_index_entry_t));
+  if (idx->entry == NULL) {
+    printf("event_index_create - ERROR - Unable to allocate buffer of %u index entries\n",maxEntries);
+    free(idx);
+    return NULL;
+  }
+  return idx;
+
+}
+
+void event_index_destroy(event_index_t* idx)
+{
+  if (idx->fd != -1) event_index_close(idx);
+  free(idx->entry);
+  free(idx);
+}
+
+// Write data to the sidecar, continuing after interrupted or partial writes. Return 0 if OK, -1 if error
+static int event_index_write(event_index_t* idx, const void* data, size_t len)
+{
+  ssize_t n;
+  while (len) {
+    n = write(idx->fd,data,len);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      printf("event_index - ERROR - Unable to write index file: %s\n",strerror(errno));
+      return -1;
+    }
+    data = (const char*)data+n;
+    len -= n;
+  }
+  idx->n_writes++;
+  return 0;
+}
+
+// Append waiting entries to the sidecar
+static int event_index_flush(event_index_t* idx)
+{
+  if (idx->n_entries == 0) return 0;
+  if ( event_index_write(idx,idx->entry,idx->n_entries*sizeof(event_index_entry_t)) ) return -1;
+  idx->n_entries = 0;
+  return 0;
+}
+
+int event_index_open(event_index_t* idx, const char* dataPath)
+{
+
+  char* path;
+  uint32_t head[EVENT_INDEX_HEAD_LEN];
+
+  if (idx->fd != -1 && event_index_close(idx)) return -1;
+
+  path = (char*)malloc(strlen(dataPath)+strlen(EVENT_INDEX_SUFFIX)+1);
+  if (path == NULL) {
+    printf("event_index_open - ERROR - Unable to allocate file name\n");
+    return -1;
+  }
+  strcpy(path,dataPath);
+  strcat(path,EVENT_INDEX_SUFFIX);
+  idx->fd = open(path,O_WRONLY | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+  if (idx->fd == -1) {
+    printf("event_index_open - ERROR - Unable to create index file '%s': %s\n",path,strerror(errno));
+    free(path);
+    return -1;
+  }
+  free(path);
+
+  idx->n_entries = 0;
+  idx->file_entries = 0;
+  idx->n_files++;
+
+  head[0] = EVENT_INDEX_MAGIC;
+  head[1] = EVENT_INDEX_VERSION;
+  head[2] = sizeof(event_index_entry_t);
+  head[3] = 0;
+  return event_index_write(idx,head,sizeof(head));
+
+}
+
+int event_index_add(event_index_t* idx, const void* pEvt, uint64_t offset)
+{
+
+  uint32_t line[PEVT_HEADER_LEN];
+  event_index_entry_t* e;
+
+  if (idx->fd == -1) return 0;
+
+  memcpy(line,pEvt,PEVT_HEADER_LEN*4);
+  if ( (line[0] >> 28) != PEVT_EVENT_TAG ) {
+    printf("event_index_add - ERROR - Event at offset %llu has tag 0x%x instead of 0x%x\n",
+	   (unsigned long long)offset,line[0] >> 28,PEVT_EVENT_TAG);
+    return -1;
+  }
+
+  // Extend counter and time tag with the wraps since the first event of the file
+  if (idx->file_entries == 0) {
+    idx->counter = line[2] & 0x003FFFFF;
+    idx->time = line[3];
+  } else {
+    idx->counter += ((line[2] & 0x003FFFFF)-idx->last_counter) & 0x003FFFFF;
+    idx->time += (uint32_t)(line[3]-idx->last_time);
+  }
+  idx->last_counter = line[2] & 0x003FFFFF;
+  idx->last_time = line[3];
+
+  e = &idx->entry[idx->n_entries];
+  e->offset = offset;
+  e->time = idx->time;
+  e->counter = idx->counter;
+  e->mask = line[PEVT_CHMASK_ACCEPTED_LINE];
+  e->size = (line[0] & 0x0FFFFFFF)*4;
+  e->status = (line[2] >> 22) & 0x03FF;
+  idx->file_entries++;
+  idx->n_entries_total++;
+  if (++idx->n_entries == idx->max_entries) return event_index_flush(idx);
+  return 0;
+
+}
+
+int event_index_add_events(event_index_t* idx, const void* data, size_t len, uint64_t offset)
+{
+
+  const char* evt = (const char*)data;
+  uint32_t line,size;
+
+  while (len >= PEVT_HEADER_LEN*4) {
+    memcpy(&line,evt,4);
+    size = (line & 0x0FFFFFFF)*4;
+    if (size < PEVT_HEADER_LEN*4 || size > len) {
+      printf("event_index_add_events - ERROR - Invalid event size %u at offset %llu\n",size,(unsigned long long)offset);
+      return -1;
+    }
+    if ( event_index_add(idx,evt,offset) ) return -1;
+    evt += size;
+    offset += size;
+    len -= size;
+  }
+  return 0;
+
+}
+
+int event_index_close(event_index_t* idx)
+{
+  int rc = 0;
+  if (idx->fd == -1) return 0;
+  if ( event_index_flush(idx) ) rc = -1;
+  if ( close(idx->fd) == -1 ) {
+    printf("event_index_close - ERROR - Unable to close index file: %s\n",strerror(errno));
+    rc = -1;
+  }
+  idx->fd = -1;
+  return rc;
+}
+
+void event_index_report(event_index_t* idx, const char* name)
+{
+  printf("- Event index %s: %llu events in %llu files - %llu writes (%u entries of %u bytes buffered)\n",
+	 name,(unsigned long long)idx->n_entries_total,(unsigned long long)idx->n_files,(unsigned long long)idx->n_writes,
+	 idx->max_entries,(unsigned int)sizeof(event_index_entry_t));
+}
+
+event_index_map_t* event_index_load(const char* dataPath)
+{
+
+  event_index_map_t* m;
+  char* path;
+  int fd;
+  struct stat st;
+  uint32_t* head;
+
+  path = (char*)malloc(strlen(dataPath)+strlen(EVENT_INDEX_SUFFIX)+1);
+  if (path == NULL) return NULL;
+  strcpy(path,dataPath);
+  strcat(path,EVENT_INDEX_SUFFIX);
+  fd = open(path,O_RDONLY);
+  if (fd == -1) {
+    printf("event_index_load - ERROR - Unable to open index file '%s': %s\n",path,strerror(errno));
+    free(path);
+    return NULL;
+  }
+  if ( fstat(fd,&st) == -1 || st.st_size < EVENT_INDEX_HEAD_LEN*4 ) {
+    printf("event_index_load - ERROR - Index file '%s' is too short\n",path);
+    free(path);
+    close(fd);
+    return NULL;
+  }
+
+  m = (event_index_map_t*)malloc(sizeof(event_index_map_t));
+  if (m == NULL) {
+    free(path);
+    close(fd);
+    return NULL;
+  }
+  m->map_len = st.st_size;
+  m->map = mmap(NULL,m->map_len,PROT_READ,MAP_SHARED,fd,0);
+  close(fd);
+  if (m->map == MAP_FAILED) {
+    printf("event_index_load - ERROR - Unable to map index file '%s': %s\n",path,strerror(errno));
+    free(path);
+    free(m);
+    return NULL;
+  }
+
+  head = (uint32_t*)m->map;
+  if ( head[0] != EVENT_INDEX_MAGIC || head[1] != EVENT_INDEX_VERSION || head[2] != sizeof(event_index_entry_t) ) {
+    printf("event_index_load - ERROR - File '%s' is not an index of version %d (magic 0x%08x version %u entry size %u)\n",
+	   path,EVENT_INDEX_VERSION,head[0],head[1],head[2]);
+    munmap(m->map,m->map_len);
+    free(path);
+    free(m);
+    return NULL;
+  }
+  free(path);
+
+  // Entries are searched in random order: no readahead
+  madvise(m->map,m->map_len,MADV_RANDOM);
+  m->entry = (const event_index_entry_t*)(head+EVENT_INDEX_HEAD_LEN);
+  m->n_entries = (m->map_len-EVENT_INDEX_HEAD_LEN*4)/sizeof(event_index_entry_t);
+  return m;
+
+}
+
+void event_index_unload(event_index_map_t* m)
+{
+  munmap(m->map,m->map_len);
+  free(m);
+}
+
+ssize_t event_index_find_event(event_index_map_t* m, uint32_t counter)
+{
+  size_t lo = 0, hi = m->n_entries, mid;
+  while (lo < hi) {
+    mid = lo+(hi-lo)/2;
+    if (m->entry[mid].counter < counter) {
+      lo = mid+1;
+    } else {
+      hi = mid;
+    }
+  }
+  return (lo < m->n_entries) ? (ssize_t)lo : -1;
+}
+
+// Return entry of the first event at time t or later (n_entries if none)
+static size_t event_index_lower_time(event_index_map_t* m, uint64_t t)
+{
+  size_t lo = 0, hi = m->n_entries, mid;
+  while (lo < hi) {
+    mid = lo+(hi-lo)/2;
+    if (m->entry[mid].time < t) {
+      lo = mid+1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+ssize_t event_index_find_time(event_index_map_t* m, uint64_t t)
+{
+  size_t i = event_index_lower_time(m,t);
+  return (i < m->n_entries) ? (ssize_t)i : -1;
+}
+
+size_t event_index_time_range(event_index_map_t* m, uint64_t tStart, uint64_t tEnd, size_t* first)
+{
+  size_t last;
+  *first = event_index_lower_time(m,tStart);
+  if (tEnd <= tStart) return 0;
+  last = event_index_lower_time(m,tEnd);
+  return last-*first;
+}
+
+off_t event_index_seek(event_index_map_t* m, int fd, size_t i)
+{
+  if (i >= m->n_entries) return -1;
+  return lseek(fd,m->entry[i].offset,SEEK_SET);
+}
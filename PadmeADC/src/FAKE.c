@@ -14,6 +14,9 @@
 #include "Tools.h"
 #include "PEvent.h"
 #include "Signal.h"
+#include "OutputBuffer.h"
+#include "FileRotator.h"
+#include "EventIndex.h"
 
 #include "FAKE.h"
 
@@ -39,9 +42,11 @@ int FAKE_readdata ()
   // Size in bytes of file head and tail
   unsigned int fHeadSize, fTailSize;
 
-  // Output file handle
+  // Output file handle and buffer
   int outFileHandle;
-  unsigned int writeSize;
+  output_buffer_t* outBuffer = NULL;
+  file_rotator_t* outRotator = NULL; // Prepares and closes output files (NULL: done by this thread)
+  event_index_t* outIndex = NULL; // Indexes the events of each output file (NULL: no index)
 
   // Global counters for output data
   unsigned long int totalWriteSize;
@@ -85,6 +90,37 @@ int FAKE_readdata ()
   }
   printf("- Allocated output event buffer with size %d\n",maxPEvtSize);
 
+  // Events are collected in the output buffer and written in large blocks
+  outBuffer = output_buffer_create(Config->output_buffer_size,Config->output_buffer_events,Config->output_buffer_delay);
+  if (outBuffer == NULL) {
+    printf("Unable to create output buffer of size %u\n",Config->output_buffer_size);
+    return 1;
+  }
+  printf("- Created output buffer with size %u\n",Config->output_buffer_size);
+
+  // Output files are prepared by a helper thread, which also closes the old ones
+  if ( strcmp(Config->output_mode,"FILE")==0 && Config->file_preopen ) {
+    outRotator = file_rotator_create(Config->data_dir,Config->data_file,Config->file_sync_close,
+				     Config->file_prealloc ? Config->file_max_size : 0);
+    if (outRotator == NULL) {
+      printf("Unable to create output file helper\n");
+      return 1;
+    }
+  }
+
+  // Output files are preallocated (by the helper thread if used) and written back in chunks
+  if ( strcmp(Config->output_mode,"FILE")==0 ) {
+    output_buffer_set_write_back(outBuffer,( Config->file_prealloc && outRotator == NULL ) ? Config->file_max_size : 0,
+				 Config->file_flush_size);
+    if (Config->file_index) {
+      outIndex = event_index_create(EVENT_INDEX_BUFFER);
+      if (outIndex == NULL) {
+	printf("Unable to create event index\n");
+	return 1;
+      }
+    }
+  }
+
   // FAKE is now ready to start. Create InitOK file
   printf("- Creating InitOK file '%s'\n",Config->initok_file);
   if ( access(Config->initok_file,F_OK) == -1 ) {
@@ -158,7 +194,11 @@ int FAKE_readdata ()
   // Open output file
   if ( strcmp(Config->output_mode,"FILE")==0 ) {
     printf("- Opening output file %d with path '%s'\n",fileIndex,pathName[fileIndex]);
-    outFileHandle = open(pathName[fileIndex],O_WRONLY | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+    if (outRotator) {
+      outFileHandle = file_rotator_open(outRotator,pathName[fileIndex]);
+    } else {
+      outFileHandle = open(pathName[fileIndex],O_WRONLY | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+    }
   } else {
     printf("- Opening output stream '%s'\n",pathName[fileIndex]);
     outFileHandle = open(pathName[fileIndex],O_WRONLY);
@@ -167,19 +207,22 @@ int FAKE_readdata ()
     printf("ERROR - Unable to open file '%s' for writing.\n",pathName[fileIndex]);
     return 2;
   }
+  output_buffer_set_fd(outBuffer,outFileHandle);
+  if ( outIndex && event_index_open(outIndex,pathName[fileIndex]) ) {
+    printf("ERROR - Unable to create index of output file '%s'.\n",pathName[fileIndex]);
+    return 2;
+  }
   fileTOpen[fileIndex] = t_daqstart;
   fileSize[fileIndex] = 0;
   fileEvents[fileIndex] = 0;
 
   // Write header to file
   fHeadSize = create_file_head(fileIndex,Config->run_number,Config->board_id,boardSN,fileTOpen[fileIndex],(void *)outEvtBuffer);
-  writeSize = write(outFileHandle,outEvtBuffer,fHeadSize);
-  if (writeSize != fHeadSize) {
-    printf("ERROR - Unable to write file header to file. Header size: %u, Write result: %u\n",
-	   fHeadSize,writeSize);
+  if ( output_buffer_write(outBuffer,outEvtBuffer,fHeadSize,0) ) {
+    printf("ERROR - Unable to write file header to file. Header size: %u\n",fHeadSize);
     return 2;
   }
-  totalWriteSize += writeSize;
+  totalWriteSize += fHeadSize;
   fileSize[fileIndex] += fHeadSize;
 
   unsigned int triggerTimeTag = 0;
@@ -193,14 +236,13 @@ int FAKE_readdata ()
     outputEventSize = create_fake_event(eventNumber,triggerTimeTag,(void *)outEvtBuffer);
 
     // Write data to output file
-    writeSize = write(outFileHandle,outEvtBuffer,outputEventSize);
-    if (writeSize != outputEventSize) {
-      printf("ERROR - Unable to write event data to output file. Event size: %u, Write result: %u\n",
-	     outputEventSize,writeSize);
+    if ( output_buffer_write(outBuffer,outEvtBuffer,outputEventSize,1) ) {
+      printf("ERROR - Unable to write event data to output file. Event size: %u\n",outputEventSize);
       return 2;
     }
-    fileSize[fileIndex] += writeSize;
-    totalWriteSize += writeSize;
+    if ( outIndex && event_index_add(outIndex,outEvtBuffer,fileSize[fileIndex]) ) return 2;
+    fileSize[fileIndex] += outputEventSize;
+    totalWriteSize += outputEventSize;
     fileEvents[fileIndex]++;
     totalWriteEvents++;
 
@@ -223,20 +265,22 @@ int FAKE_readdata ()
 
 	// Register file closing time
 	fileTClose[fileIndex] = t_now;
+	if ( outIndex && event_index_close(outIndex) ) {
+	  printf("ERROR - Unable to write index of output file '%s'.\n",pathName[fileIndex]);
+	  return 2;
+	}
 
 	// Write tail to file
 	fTailSize = create_file_tail(fileEvents[fileIndex],fileSize[fileIndex],fileTClose[fileIndex],(void *)outEvtBuffer);
-	writeSize = write(outFileHandle,outEvtBuffer,fTailSize);
-	if (writeSize != fTailSize) {
-	  printf("ERROR - Unable to write file header to output file. Tail size: %u, Write result: %u\n",
-		 fTailSize,writeSize);
+	if ( output_buffer_write(outBuffer,outEvtBuffer,fTailSize,0) || output_buffer_end_file(outBuffer) ) {
+	  printf("ERROR - Unable to write file tail to output file. Tail size: %u\n",fTailSize);
 	  return 2;
 	}
-	fileSize[fileIndex] += writeSize;
-	totalWriteSize += writeSize;
+	fileSize[fileIndex] += fTailSize;
+	totalWriteSize += fTailSize;
 
 	// Close old output file and show some info about counters
-	if (close(outFileHandle) == -1) {
+	if ( outRotator ? file_rotator_close(outRotator,outFileHandle) : close(outFileHandle) ) {
 	  printf("ERROR - Unable to close output file '%s'.\n",fileName[fileIndex]);
 	  return 2;
 	};
@@ -258,24 +302,31 @@ int FAKE_readdata ()
 	  strcpy(pathName[fileIndex],Config->data_dir);
 	  strcat(pathName[fileIndex],fileName[fileIndex]);
 	  printf("- Opening output file %d with path '%s'\n",fileIndex,pathName[fileIndex]);
-	  outFileHandle = open(pathName[fileIndex],O_WRONLY | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+	  if (outRotator) {
+	    outFileHandle = file_rotator_open(outRotator,pathName[fileIndex]);
+	  } else {
+	    outFileHandle = open(pathName[fileIndex],O_WRONLY | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+	  }
 	  if (outFileHandle == -1) {
 	    printf("ERROR - Unable to open file '%s' for writing.\n",pathName[fileIndex]);
 	    return 2;
 	  }
+	  output_buffer_set_fd(outBuffer,outFileHandle);
+	  if ( outIndex && event_index_open(outIndex,pathName[fileIndex]) ) {
+	    printf("ERROR - Unable to create index of output file '%s'.\n",pathName[fileIndex]);
+	    return 2;
+	  }
 	  fileTOpen[fileIndex] = t_now;
 	  fileSize[fileIndex] = 0;
 	  fileEvents[fileIndex] = 0;
 
 	  // Write header to file
 	  fHeadSize = create_file_head(fileIndex,Config->run_number,Config->board_id,boardSN,fileTOpen[fileIndex],(void *)outEvtBuffer);
-	  writeSize = write(outFileHandle,outEvtBuffer,fHeadSize);
-	  if (writeSize != fHeadSize) {
-	    printf("ERROR - Unable to write file header to file. Header size: %u, Write result: %u\n",
-		   fHeadSize,writeSize);
+	  if ( output_buffer_write(outBuffer,outEvtBuffer,fHeadSize,0) ) {
+	    printf("ERROR - Unable to write file header to file. Header size: %u\n",fHeadSize);
 	    return 2;
 	  }
-	  fileSize[fileIndex] += writeSize;
+	  fileSize[fileIndex] += fHeadSize;
 
 	} else {
 
@@ -315,22 +366,28 @@ int FAKE_readdata ()
 
     // Register file closing time
     fileTClose[fileIndex] = t_now;
+    if ( outIndex && event_index_close(outIndex) ) {
+      printf("ERROR - Unable to write index of output file '%s'.\n",pathName[fileIndex]);
+      return 2;
+    }
 
     // Write tail to file
     fTailSize = create_file_tail(fileEvents[fileIndex],fileSize[fileIndex],fileTClose[fileIndex],(void *)outEvtBuffer);
-    writeSize = write(outFileHandle,outEvtBuffer,fTailSize);
-    if (writeSize != fTailSize) {
-      printf("ERROR - Unable to write file tail to file. Tail size: %u, Write result: %u\n",
-    	     fTailSize,(unsigned int)writeSize);
+    if ( output_buffer_write(outBuffer,outEvtBuffer,fTailSize,0) || output_buffer_end_file(outBuffer) ) {
+      printf("ERROR - Unable to write file tail to file. Tail size: %u\n",fTailSize);
       return 2;
     }
-    fileSize[fileIndex] += writeSize;
+    fileSize[fileIndex] += fTailSize;
 
     // Close output file and show some info about counters
-    if (close(outFileHandle) == -1) {
+    if ( outRotator ? file_rotator_close(outRotator,outFileHandle) : close(outFileHandle) ) {
       printf("ERROR - Unable to close output file '%s'.\n",fileName[fileIndex]);
       return 2;
     };
+    if ( outRotator && file_rotator_sync(outRotator) ) {
+      printf("ERROR - Output file helper failed: output files are incomplete\n");
+      return 2;
+    }
     if ( strcmp(Config->output_mode,"FILE")==0 ) {
       printf("%s - Closed output file '%s' after %d secs with %u events and size %lu bytes\n",
 	     format_time(t_now),pathName[fileIndex],(int)(fileTClose[fileIndex]-fileTOpen[fileIndex]),
@@ -352,6 +409,16 @@ int FAKE_readdata ()
 
   // Deallocate input/output event buffer
   free(outEvtBuffer);
+  output_buffer_report(outBuffer,"stream");
+  output_buffer_destroy(outBuffer);
+  if (outRotator) {
+    file_rotator_report(outRotator,"stream");
+    file_rotator_destroy(outRotator);
+  }
+  if (outIndex) {
+    event_index_report(outIndex,"stream");
+    event_index_destroy(outIndex);
+  }
 
   // Give some final report
   evtWritePerSec = 0.;
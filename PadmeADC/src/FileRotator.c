@@ -0,0 +1,278 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "FileRotator.h"
+
+// Give a name to an unnamed file or rename a file, without replacing an existing one. Return 0 if OK, errno if error
+static int file_rotator_rename(const char* from, int fd, int anon, const char* to)
+{
+  char proc[32];
+  if (anon) {
+    sprintf(proc,"/proc/self/fd/%d",fd);
+    if ( linkat(AT_FDCWD,proc,AT_FDCWD,to,AT_SYMLINK_FOLLOW) == -1 ) return errno;
+    return 0;
+  }
+#ifdef RENAME_NOREPLACE
+  if ( renameat2(AT_FDCWD,from,AT_FDCWD,to,RENAME_NOREPLACE) == 0 ) return 0;
+  if ( errno != EINVAL && errno != ENOSYS ) return errno;
+#endif
+  // Filesystem cannot rename without replacing: link fails if the name exists
+  if ( link(from,to) == -1 ) return errno;
+  if ( unlink(from) == -1 ) return errno;
+  return 0;
+}
+
+// Record and report first error
+static void file_rotator_fail(file_rotator_t* r, int err, const char* what, const char* path)
+{
+  if (r->error == 0) {
+    r->error = err;
+    if (path) {
+      printf("file_rotator - ERROR - %s '%s': %s\n",what,path,strerror(err));
+    } else {
+      printf("file_rotator - ERROR - %s: %s\n",what,strerror(err));
+    }
+  }
+}
+
+// Helper thread. Called with the lock held between operations
+static void* file_rotator_thread(void* arg)
+{
+
+  file_rotator_t* r = (file_rotator_t*)arg;
+  int fd,err,anon;
+  uint64_t t0;
+  sigset_t set;
+  struct sched_param sp;
+
+  // Signals are handled by the main thread
+  sigfillset(&set);
+  pthread_sigmask(SIG_BLOCK,&set,NULL);
+
+  // Waking up the helper must not preempt the processing thread
+  memset(&sp,0,sizeof(sp));
+  pthread_setschedparam(pthread_self(),SCHED_BATCH,&sp);
+
+  pthread_mutex_lock(&r->lock);
+  while(1) {
+
+    // Prepare the next file
+    if ( r->want_next && ! r->quit && ! r->error ) {
+      r->want_next = 0;
+      pthread_mutex_unlock(&r->lock);
+      t0 = histo_time();
+      fd = -1;
+      err = 0;
+#ifdef O_TMPFILE
+      fd = open(r->dir,O_WRONLY | O_TMPFILE, S_IRUSR | S_IWUSR);
+#endif
+      anon = (fd != -1);
+      if (fd == -1) {
+	fd = open(r->tmp_path,O_WRONLY | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+	err = errno;
+      }
+      // Blocks are allocated without changing the file size
+      if ( fd != -1 && r->prealloc && fallocate(fd,FALLOC_FL_KEEP_SIZE,0,r->prealloc) == -1 ) {
+	if (r->n_prealloc_fail == 0) printf("file_rotator - WARNING - Unable to preallocate %llu bytes: %s\n",
+					    (unsigned long long)r->prealloc,strerror(errno));
+	r->n_prealloc_fail++;
+      }
+      histo_fill(&r->h_open,histo_time()-t0);
+      pthread_mutex_lock(&r->lock);
+      if (fd == -1) {
+	file_rotator_fail(r,err,"Unable to prepare output file",r->tmp_path);
+      } else {
+	r->next_fd = fd;
+	r->next_anon = anon;
+      }
+      pthread_cond_broadcast(&r->cond);
+      continue;
+    }
+
+    // Sync and close old files
+    if (r->n_close) {
+      fd = r->close_fd[0];
+      r->n_close--;
+      memmove(r->close_fd,r->close_fd+1,r->n_close*sizeof(int));
+      pthread_mutex_unlock(&r->lock);
+      t0 = histo_time();
+      err = 0;
+      if ( r->prealloc && ftruncate(fd,lseek(fd,0,SEEK_CUR)) == -1 ) err = errno;
+      if ( r->sync && fsync(fd) == -1 && errno != EINVAL && err == 0 ) err = errno;
+      posix_fadvise(fd,0,0,POSIX_FADV_DONTNEED);
+      if ( close(fd) == -1 && err == 0 ) err = errno;
+      histo_fill(&r->h_close,histo_time()-t0);
+      pthread_mutex_lock(&r->lock);
+      if (err) file_rotator_fail(r,err,"Unable to complete output file",NULL);
+      pthread_cond_broadcast(&r->cond);
+      continue;
+    }
+
+    if (r->quit) break;
+    pthread_cond_wait(&r->cond,&r->lock);
+
+  }
+  pthread_mutex_unlock(&r->lock);
+
+  return NULL;
+
+}
+
+file_rotator_t* file_rotator_create(const char* dir, const char* tag, int sync, uint64_t prealloc)
+{
+
+  file_rotator_t* r;
+
+  r = (file_rotator_t*)malloc(sizeof(file_rotator_t));
+  if (r == NULL) {
+    printf("file_rotator_create - ERROR - Unable to allocate rotator structure\n");
+    return NULL;
+  }
+  memset(r,0,sizeof(file_rotator_t));
+  r->next_fd = -1;
+  r->want_next = 1;
+  r->sync = sync;
+  r->prealloc = prealloc;
+
+  // Hidden file in the data directory (same filesystem as the final name)
+  r->dir = strdup(dir[0] ? dir : ".");
+  r->tmp_path = (char*)malloc(strlen(dir)+strlen(tag)+32);
+  if (r->dir == NULL || r->tmp_path == NULL) {
+    printf("file_rotator_create - ERROR - Unable to allocate file name\n");
+    free(r->dir);
+    free(r->tmp_path);
+    free(r);
+    return NULL;
+  }
+  sprintf(r->tmp_path,"%s.%s.%d.next",dir,tag,(int)getpid());
+
+  pthread_mutex_init(&r->lock,NULL);
+  pthread_cond_init(&r->cond,NULL);
+  histo_init(&r->h_open,"file prepare","ns");
+  histo_init(&r->h_close,"file close","ns");
+  histo_init(&r->h_wait,"wait for file","ns");
+  histo_init(&r->h_name,"file naming","ns");
+
+  if ( pthread_create(&r->thread,NULL,file_rotator_thread,r) ) {
+    printf("file_rotator_create - ERROR - Unable to start helper thread\n");
+    free(r->dir);
+    free(r->tmp_path);
+    free(r);
+    return NULL;
+  }
+  return r;
+
+}
+
+int file_rotator_destroy(file_rotator_t* r)
+{
+
+  int rc;
+
+  pthread_mutex_lock(&r->lock);
+  r->quit = 1;
+  pthread_cond_broadcast(&r->cond);
+  pthread_mutex_unlock(&r->lock);
+  pthread_join(r->thread,NULL);
+
+  // Remove the prepared file which was not used
+  if (r->next_fd != -1) {
+    close(r->next_fd);
+    if (! r->next_anon) unlink(r->tmp_path);
+  }
+
+  rc = r->error ? -1 : 0;
+  free(r->dir);
+  free(r->tmp_path);
+  free(r);
+  return rc;
+
+}
+
+int file_rotator_open(file_rotator_t* r, const char* path)
+{
+
+  int fd,anon,err;
+  uint64_t t0;
+
+  t0 = histo_time();
+  pthread_mutex_lock(&r->lock);
+  if (r->next_fd == -1 && ! r->error) {
+    r->n_waits++;
+    while (r->next_fd == -1 && ! r->error) pthread_cond_wait(&r->cond,&r->lock);
+  }
+  if (r->error) {
+    pthread_mutex_unlock(&r->lock);
+    return -1;
+  }
+  fd = r->next_fd;
+  anon = r->next_anon;
+  r->next_fd = -1;
+  pthread_mutex_unlock(&r->lock);
+  histo_fill(&r->h_wait,histo_time()-t0);
+
+  // The file must have its final name before it is written. The helper cannot prepare the next file meanwhile,
+  // as it would use the same temporary name
+  t0 = histo_time();
+  err = file_rotator_rename(r->tmp_path,fd,anon,path);
+  histo_fill(&r->h_name,histo_time()-t0);
+
+  pthread_mutex_lock(&r->lock);
+  if (err) {
+    // Keep the prepared file for the next attempt
+    r->next_fd = fd;
+    pthread_mutex_unlock(&r->lock);
+    printf("file_rotator_open - ERROR - Unable to create output file '%s': %s\n",path,strerror(err));
+    return -1;
+  }
+  r->want_next = 1;
+  r->n_files++;
+  pthread_cond_broadcast(&r->cond);
+  pthread_mutex_unlock(&r->lock);
+  return fd;
+
+}
+
+int file_rotator_close(file_rotator_t* r, int fd)
+{
+
+  int rc;
+
+  pthread_mutex_lock(&r->lock);
+  while (r->n_close == FILE_ROTATOR_MAX_CLOSE) pthread_cond_wait(&r->cond,&r->lock);
+  r->close_fd[r->n_close++] = fd;
+  rc = r->error ? -1 : 0;
+  pthread_cond_broadcast(&r->cond);
+  pthread_mutex_unlock(&r->lock);
+  return rc;
+
+}
+
+int file_rotator_sync(file_rotator_t* r)
+{
+  int rc;
+  pthread_mutex_lock(&r->lock);
+  while (r->n_close) pthread_cond_wait(&r->cond,&r->lock);
+  rc = r->error ? -1 : 0;
+  pthread_mutex_unlock(&r->lock);
+  return rc;
+}
+
+void file_rotator_report(file_rotator_t* r, const char* name)
+{
+  printf("- File rotation %s: %llu files prepared in background - waited for the prepared file %llu times - sync on close %s - preallocation %llu bytes (failed %llu times)\n",
+	 name,(unsigned long long)r->n_files,(unsigned long long)r->n_waits,r->sync ? "yes" : "no",(unsigned long long)r->prealloc,(unsigned long long)r->n_prealloc_fail);
+  histo_print(&r->h_wait,0);
+  histo_print(&r->h_name,0);
+  histo_print(&r->h_open,0);
+  histo_print(&r->h_close,0);
+}
@@ -0,0 +1,107 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "Histo.h"
+
+// Return bin holding a value
+static unsigned int histo_bin(uint64_t value)
+{
+  unsigned int exp;
+  if (value < HISTO_N_SUB) return value;
+  exp = 63-__builtin_clzll(value); // Position of most significant bit (>= HISTO_SUB_BITS)
+  return (exp-HISTO_SUB_BITS+1)*HISTO_N_SUB + ((value >> (exp-HISTO_SUB_BITS)) & (HISTO_N_SUB-1));
+}
+
+// Return lower edge of a bin
+static uint64_t histo_low(unsigned int bin)
+{
+  unsigned int exp;
+  if (bin < HISTO_N_SUB) return bin;
+  exp = bin/HISTO_N_SUB+HISTO_SUB_BITS-1;
+  return (uint64_t)(HISTO_N_SUB + bin%HISTO_N_SUB) << (exp-HISTO_SUB_BITS);
+}
+
+// Return upper edge of a bin (largest value contained in the bin)
+static uint64_t histo_high(unsigned int bin)
+{
+  if (bin == HISTO_N_BINS-1) return UINT64_MAX;
+  return histo_low(bin+1)-1;
+}
+
+void histo_init(histo_t* h, const char* name, const char* unit)
+{
+  unsigned int i;
+  h->name = name;
+  h->unit = unit;
+  atomic_store(&h->n,0);
+  atomic_store(&h->sum,0);
+  atomic_store(&h->max,0);
+  for(i=0;i<HISTO_N_BINS;i++) atomic_store(&h->bin[i],0);
+}
+
+void histo_fill(histo_t* h, uint64_t value)
+{
+  unsigned long long max = atomic_load_explicit(&h->max,memory_order_relaxed);
+  atomic_fetch_add_explicit(&h->bin[histo_bin(value)],1,memory_order_relaxed);
+  atomic_fetch_add_explicit(&h->sum,value,memory_order_relaxed);
+  atomic_fetch_add_explicit(&h->n,1,memory_order_relaxed);
+  while ( value > max && ! atomic_compare_exchange_weak_explicit(&h->max,&max,value,memory_order_relaxed,memory_order_relaxed) );
+}
+
+uint64_t histo_quantile(histo_t* h, double fraction)
+{
+  unsigned int i;
+  unsigned long long n,max,count,target;
+  n = atomic_load_explicit(&h->n,memory_order_relaxed);
+  max = atomic_load_explicit(&h->max,memory_order_relaxed);
+  if (n == 0) return 0;
+  target = (unsigned long long)(fraction*n);
+  if (target >= n) target = n-1;
+  count = 0;
+  for(i=0;i<HISTO_N_BINS;i++) {
+    count += atomic_load_explicit(&h->bin[i],memory_order_relaxed);
+    if (count > target) return (histo_high(i) < max) ? histo_high(i) : max;
+  }
+  return max;
+}
+
+// Print a summary line with the main quantiles of the histogram and, if requested, the content of all non-empty bins
+// Latencies are measured in ns but reported in usecs
+void histo_print(histo_t* h, int bins)
+{
+
+  unsigned int i;
+  unsigned long long n,sum,max,count;
+  double scale = 1.;
+  const char* unit = h->unit;
+
+  if ( strcmp(h->unit,"ns")==0 ) {
+    scale = 1e-3;
+    unit = "us";
+  }
+
+  n = atomic_load_explicit(&h->n,memory_order_relaxed);
+  sum = atomic_load_explicit(&h->sum,memory_order_relaxed);
+  max = atomic_load_explicit(&h->max,memory_order_relaxed);
+  printf("- %-14s n %10llu - mean %10.1f - p50 %10.1f - p90 %10.1f - p99 %10.1f - p99.9 %10.1f - max %10.1f %s\n",
+	 h->name,n,n ? scale*sum/n : 0.,
+	 scale*histo_quantile(h,0.5),scale*histo_quantile(h,0.9),scale*histo_quantile(h,0.99),scale*histo_quantile(h,0.999),
+	 scale*max,unit);
+
+  if ( ! bins || n == 0 ) return;
+  for(i=0;i<HISTO_N_BINS;i++) {
+    count = atomic_load_explicit(&h->bin[i],memory_order_relaxed);
+    if (count == 0) continue;
+    printf("    [%12.3f,%12.3f] %s %10llu %6.2f%%\n",scale*histo_low(i),scale*histo_high(i),unit,count,100.*count/n);
+  }
+
+}
+
+uint64_t histo_time()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return (uint64_t)ts.tv_sec*1000000000+ts.tv_nsec;
+}
@@ -0,0 +1,297 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "OutputBuffer.h"
+
+#define OUTPUT_BUFFER_ALIGN 4096
+
+static uint64_t output_buffer_time()
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC,&t);
+  return (uint64_t)t.tv_sec*1000000000+t.tv_nsec;
+}
+
+output_buffer_t* output_buffer_create(size_t size, uint32_t maxEvents, uint32_t maxDelay)
+{
+
+  output_buffer_t* ob;
+
+  ob = (output_buffer_t*)malloc(sizeof(output_buffer_t));
+  if (ob == NULL) {
+    printf("output_buffer_create - ERROR - Unable to allocate buffer structure\n");
+    return NULL;
+  }
+  memset(ob,0,sizeof(output_buffer_t));
+  ob->fd = -1;
+  ob->size = size;
+  ob->max_events = maxEvents;
+  ob->max_delay = (uint64_t)maxDelay*1000000;
+  write_back_init(&ob->wb,0,0);
+
+  if ( size && posix_memalign((void**)&ob->data,OUTPUT_BUFFER_ALIGN,size) ) {
+    printf("output_buffer_create - ERROR - Unable to allocate output buffer of %lu bytes\n",(unsigned long)size);
+    free(ob);
+    return NULL;
+  }
+  return ob;
+
+}
+
+output_buffer_t* output_buffer_create_async(async_writer_t* w, uint32_t maxEvents, uint32_t maxDelay)
+{
+
+  output_buffer_t* ob;
+
+  ob = (output_buffer_t*)malloc(sizeof(output_buffer_t));
+  if (ob == NULL) {
+    printf("output_buffer_create_async - ERROR - Unable to allocate buffer structure\n");
+    return NULL;
+  }
+  memset(ob,0,sizeof(output_buffer_t));
+  ob->fd = -1;
+  ob->max_events = maxEvents;
+  ob->max_delay = (uint64_t)maxDelay*1000000;
+  ob->writer = w;
+  write_back_init(&ob->wb,0,0);
+  ob->block = async_writer_get_block(w);
+  if (ob->block == NULL) {
+    free(ob);
+    return NULL;
+  }
+  ob->data = ob->block->data;
+  ob->size = ob->block->size;
+  return ob;
+
+}
+
+void output_buffer_destroy(output_buffer_t* ob)
+{
+  if (ob->writer) {
+    // Give the (empty) block back to the writer
+    if (ob->block == NULL) { free(ob); return; }
+    ob->block->used = 0;
+    ob->block->events = 0;
+    async_writer_submit(ob->writer,ob->block);
+  } else {
+    free(ob->data);
+  }
+  free(ob);
+}
+
+void output_buffer_set_fd(output_buffer_t* ob, int fd)
+{
+  ob->fd = fd;
+  if (ob->writer == NULL) write_back_start(&ob->wb,fd);
+}
+
+void output_buffer_set_write_back(output_buffer_t* ob, uint64_t prealloc, uint64_t chunk)
+{
+  write_back_init(&ob->wb,prealloc,chunk);
+}
+
+// Write a full vector, continuing after interrupted or partial writes. The vector is modified
+static int output_buffer_sync(output_buffer_t* ob, struct iovec* iov, int iovcnt)
+{
+
+  ssize_t n;
+
+  while (iovcnt) {
+    n = writev(ob->fd,iov,iovcnt);
+    ob->n_syscalls++;
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      printf("output_buffer - ERROR - Unable to write to output: %s\n",strerror(errno));
+      return -1;
+    }
+    ob->n_bytes += n;
+    if ( write_back_written(&ob->wb,n) ) return -1;
+    while ( iovcnt && (size_t)n >= iov->iov_len ) {
+      n -= iov->iov_len;
+      iov++;
+      iovcnt--;
+    }
+    if (iovcnt) {
+      iov->iov_base = (char*)iov->iov_base+n;
+      iov->iov_len -= n;
+    }
+  }
+  return 0;
+
+}
+
+// Queue the buffer to the asynchronous writer and continue with a new block
+// With O_DIRECT only whole pages are queued before the end of a file: the rest is moved to the new block
+static int output_buffer_queue(output_buffer_t* ob, int end)
+{
+  char* data = ob->data;
+  size_t sent,keep = 0;
+  if ( ob->writer->direct && ! end ) {
+    keep = ob->used % ASYNC_WRITER_ALIGN;
+    if (keep == ob->used) {
+      ob->t_first = output_buffer_time();
+      return 0;
+    }
+  }
+  sent = ob->used-keep;
+  ob->block->used = sent;
+  ob->block->events = ob->events;
+  ob->n_syscalls++;
+  ob->n_bytes += sent;
+  ob->n_events += ob->events;
+  ob->used = keep;
+  ob->events = 0;
+  if ( async_writer_submit(ob->writer,ob->block) ) {
+    ob->block = NULL;
+    printf("output_buffer - ERROR - Asynchronous writer failed\n");
+    return -1;
+  }
+  ob->block = async_writer_get_block(ob->writer);
+  if (ob->block == NULL) {
+    printf("output_buffer - ERROR - Asynchronous writer failed\n");
+    return -1;
+  }
+  ob->data = ob->block->data;
+  // The old block may have been written and given back already: it is then the new one
+  if (keep) {
+    memmove(ob->data,data+sent,keep);
+    ob->t_first = output_buffer_time();
+  }
+  return 0;
+}
+
+// Write all data waiting in the buffer (only whole pages with O_DIRECT unless the file ends)
+static int output_buffer_drain(output_buffer_t* ob, int end)
+{
+
+  struct iovec iov;
+
+  if (ob->writer) return output_buffer_queue(ob,end);
+
+  iov.iov_base = ob->data;
+  iov.iov_len = ob->used;
+  if ( output_buffer_sync(ob,&iov,1) ) return -1;
+  ob->n_events += ob->events;
+  ob->used = 0;
+  ob->events = 0;
+  return 0;
+
+}
+
+int output_buffer_writev(output_buffer_t* ob, const struct iovec* iov, int iovcnt, uint32_t nEvents)
+{
+
+  struct iovec v[OUTPUT_BUFFER_MAX_IOVEC];
+  size_t len = 0;
+  int i,n;
+
+  for(i=0;i<iovcnt;i++) len += iov[i].iov_len;
+
+  // A new file written with O_DIRECT starts with its head (not counted as written by the buffer)
+  if ( ob->used == 0 && ob->writer && ob->writer->prefix_len ) {
+    ob->t_first = output_buffer_time();
+    ob->used = async_writer_prefix(ob->writer,ob->data);
+    ob->n_bytes -= ob->used;
+  }
+
+  if (len <= ob->size-ob->used) {
+
+    // Data fit in the buffer: copy them and check if the buffer must be written
+    if (ob->used == 0) ob->t_first = output_buffer_time();
+    for(i=0;i<iovcnt;i++) {
+      memcpy(ob->data+ob->used,iov[i].iov_base,iov[i].iov_len);
+      ob->used += iov[i].iov_len;
+    }
+    ob->events += nEvents;
+    if ( ob->max_events && ob->events >= ob->max_events ) {
+      ob->n_flush_events++;
+      return output_buffer_drain(ob,0);
+    }
+    return output_buffer_poll(ob);
+
+  }
+
+  // Data do not fit in the buffer: with the asynchronous writer they are copied to as many blocks as needed
+  if (ob->writer) {
+    if (ob->used == 0) ob->t_first = output_buffer_time();
+    ob->events += nEvents;
+    for(i=0;i<iovcnt;i++) {
+      size_t done = 0,len;
+      while (done < iov[i].iov_len) {
+	len = iov[i].iov_len-done;
+	if (len > ob->size-ob->used) len = ob->size-ob->used;
+	memcpy(ob->data+ob->used,(char*)iov[i].iov_base+done,len);
+	ob->used += len;
+	done += len;
+	if (ob->used == ob->size) {
+	  ob->n_flush_size++;
+	  if ( output_buffer_queue(ob,0) ) return -1;
+	  ob->t_first = output_buffer_time();
+	}
+      }
+    }
+    return 0;
+  }
+
+  // Data do not fit in the buffer: write them in place after the waiting data with a single system call
+  if (iovcnt >= OUTPUT_BUFFER_MAX_IOVEC) {
+    printf("output_buffer_writev - ERROR - Too many sections in vector: %d (max %d)\n",iovcnt,OUTPUT_BUFFER_MAX_IOVEC-1);
+    return -1;
+  }
+  n = 0;
+  if (ob->used) {
+    v[n].iov_base = ob->data;
+    v[n].iov_len = ob->used;
+    n++;
+  }
+  memcpy(v+n,iov,iovcnt*sizeof(struct iovec));
+  n += iovcnt;
+  if (ob->size) ob->n_flush_size++;
+  if ( output_buffer_sync(ob,v,n) ) return -1;
+  ob->n_events += ob->events+nEvents;
+  ob->used = 0;
+  ob->events = 0;
+  return 0;
+
+}
+
+int output_buffer_write(output_buffer_t* ob, const void* data, size_t len, uint32_t nEvents)
+{
+  struct iovec iov;
+  iov.iov_base = (void*)data;
+  iov.iov_len = len;
+  return output_buffer_writev(ob,&iov,1,nEvents);
+}
+
+int output_buffer_flush(output_buffer_t* ob)
+{
+  if (ob->used == 0) return 0;
+  ob->n_flush_sync++;
+  return output_buffer_drain(ob,1);
+}
+
+int output_buffer_end_file(output_buffer_t* ob)
+{
+  if ( output_buffer_flush(ob) ) return -1;
+  return write_back_end(&ob->wb);
+}
+
+int output_buffer_poll(output_buffer_t* ob)
+{
+  if ( ob->used == 0 || ob->max_delay == 0 ) return 0;
+  if ( output_buffer_time()-ob->t_first < ob->max_delay ) return 0;
+  ob->n_flush_time++;
+  return output_buffer_drain(ob,0);
+}
+
+void output_buffer_report(output_buffer_t* ob, const char* name)
+{
+  printf("- Output %s: %llu bytes and %llu events with %llu writes (%.1f events/write) - flushes: buffer full %llu, %u events %llu, timeout %llu, sync %llu\n",
+	 name,(unsigned long long)ob->n_bytes,(unsigned long long)ob->n_events,(unsigned long long)ob->n_syscalls,ob->n_syscalls ? 1.*ob->n_events/ob->n_syscalls : 0.,
+	 (unsigned long long)ob->n_flush_size,ob->max_events,(unsigned long long)ob->n_flush_events,(unsigned long long)ob->n_flush_time,(unsigned long long)ob->n_flush_sync);
+  if (ob->wb.n_files) write_back_report(&ob->wb,name);
+}
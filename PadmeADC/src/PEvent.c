@@ -14,12 +14,191 @@
 #include "Config.h"
 
 #include "PEvent.h"
+#include "V1742.h"
+#include "DRS4.h"
+#include "Convert.h"
 
-int create_pevent(void *evtPtr, CAEN_DGTZ_X742_EVENT_t *event, void *pEvt)
+// Create the pEvent header from the raw V1742 event header and the results of the event formatting
+static void create_pevent_header(void *evtPtr, void *pEvt, int boardId, int pEvtSize, uint32_t pEvtChMaskActive, uint32_t pEvtChMaskAccepted, int pEvtAutoPass, int pEvtMissing)
 {
 
-  int pEvtSize = 0;
   int pEvtStatus;
+  uint32_t line;
+
+  // Extract 0-suppression configuration
+  int pEvt0SupMode = Config->zero_suppression / 100; // 0=rejction, 1=flagging
+  int pEvt0SupAlgr = Config->zero_suppression % 100; // 0=off, 1-15=algorithm code
+
+  // When zero-suppression is applied by DAQ, autopass events are always in flagging mode (as in ZSUP)
+  if (Config->daq_zero_suppression && pEvtAutoPass) pEvt0SupMode = 1;
+
+  // Line 0 of pEvent header: event tag (bit 28-31) + event size in 4bytes words (bit 0-27)
+  //  printf("Final - pEvtSize %d\n",pEvtSize);
+  line = (PEVT_EVENT_TAG << 28) + (pEvtSize & 0x0FFFFFFF);
+  memcpy(pEvt,&line,4);
+
+  // Prepare events status mask for this event
+  pEvtStatus = 0; // Zero event status
+
+  if (pEvtChMaskAccepted) { // Check if at least one channel was accepted
+    pEvtStatus += (0x1 << PEVT_STATUS_HASDATA_BIT); // Event has data
+  } else {
+    pEvtStatus += (0x0 << PEVT_STATUS_HASDATA_BIT); // Event has no data
+  }
+
+  if (Config->drs4corr_enable) { // Check if DRS4 corrections were applied
+    pEvtStatus += (0x1 << PEVT_STATUS_DRS4CORR_BIT); // Corrections applied
+  } else {
+    pEvtStatus += (0x0 << PEVT_STATUS_DRS4CORR_BIT); // Corrections not applied
+  }
+
+  if (pEvt0SupMode == 0) { // Save 0-suppression mode
+    pEvtStatus += (0x0 << PEVT_STATUS_ZEROSUPP_BIT); // 0-suppression in rejection mode
+  } else {
+    pEvtStatus += (0x1 << PEVT_STATUS_ZEROSUPP_BIT); // 0-suppression in flagging mode
+  }
+
+  if (pEvtAutoPass == 0) {
+    pEvtStatus += (0x0 << PEVT_STATUS_AUTOPASS_BIT); // No autopass
+  } else {
+    pEvtStatus += (0x1 << PEVT_STATUS_AUTOPASS_BIT); // Enable autopass for this even
+  }
+
+  if (pEvtMissing == 0) {
+    pEvtStatus += (0x0 << PEVT_STATUS_MISSING_BIT); // Event data are present
+  } else {
+    pEvtStatus += (0x1 << PEVT_STATUS_MISSING_BIT); // Event data are missing
+  }
+
+  // 1) Get line 1 of V1742 event header
+  memcpy(&line,evtPtr+4,4);
+  //printf("First line of header 0x%08x\n",line);
+  // 2) Save Board Fail flag (bit 26) to event status. *** NOT USED ANYMORE: replaced by "missing event" bit ***
+  //if (line & 0x04000000) pEvtStatus += (0x1 << PEVT_STATUS_BRDFAIL_BIT);
+  // 3) Extract LVDS pattern (bit 8-23) and group mask (bit 0-3).
+  // 4) Add our board id (bit 24-31) and 0-suppression algorithm code (bit 4-7).
+  //    If event data are missing, no group is present in the event.
+  line = (line & 0x00FFFF0F) + ((boardId & 0xFF) << 24) + ((pEvt0SupAlgr & 0xF) << 4);
+  if (pEvtMissing) line &= 0xFFFFFFF0;
+  // 5) Copy result to line 1 of pEvent header
+  memcpy(pEvt+4,&line,4);
+
+  // 1) Get line 2 of V1742 event header
+  memcpy(&line,evtPtr+8,4);
+  // 2) Extract event counter (bit 0-21)
+  // 3) Add event status pattern (bit 22-31)
+  line = (line & 0x003FFFFF) + ((pEvtStatus & 0x03FF) << 22);
+  // 4) Copy result to line 2 of pEvent header
+  memcpy(pEvt+8,&line,4);
+
+  // Copy line 3 of V1742 event header to line 3 of pEvent header (event time tag)
+  memcpy(pEvt+12,evtPtr+12,4);
+
+  // Copy channel masks to lines 4 and 5 of pEvent header
+  memcpy(pEvt+PEVT_CHMASK_ACTIVE_LINE*4,  &pEvtChMaskActive,  4);
+  memcpy(pEvt+PEVT_CHMASK_ACCEPTED_LINE*4,&pEvtChMaskAccepted,4);
+
+  // Dump event header
+  //for(i=0;i<PEVT_HEADER_LEN;i++){
+  //  printf("%d\t%08x\n",i,((int*)pEvt)[i]);
+  //}
+
+}
+
+// Define autopass trig ON duration (in samples) taking into account sampling frequency
+// Return 0 if OK, 1 if sampling frequency is not valid
+static int autopass_duration(unsigned int *autopass_trig_duration)
+{
+  if (Config->drs4_sampfreq == 0) {
+    *autopass_trig_duration = 5*Config->auto_duration; // 1ns = 5 samples
+  } else if (Config->drs4_sampfreq == 1) {
+    *autopass_trig_duration = 2.5*Config->auto_duration; // 1ns = 2.5 samples
+  } else if (Config->drs4_sampfreq == 2) {
+    *autopass_trig_duration = Config->auto_duration; // 1ns = 1 sample
+  } else {
+    printf("PEvent ERROR - drs4_sampfreq set to %d\n",Config->drs4_sampfreq);
+    return 1;
+  }
+  return 0;
+}
+
+// Zero suppression state of one channel. Statistics are accumulated one sample at a time while
+// the channel is formatted, using the same algorithms as the ZSUP process (see ZSUP.c)
+typedef struct zsup_state_s {
+  int n;        // Number of samples seen
+  int head;     // Samples used to compute mean and rms
+  int end;      // Samples from here on are not used for threshold crossings (algorithm 1 only)
+  int64_t sum;  // Algorithm 2: sum of samples
+  int64_t sum2; // Algorithm 2: sum of squares of samples
+  float fsum;   // Algorithm 1: sum of samples (float as in ZSUP, to take the same decisions)
+  float fsum2;  // Algorithm 1: sum of squares of samples
+  float rms;    // Algorithm 1: rms of the first samples
+  float thrLo;  // Algorithm 1: threshold below pedestal
+  unsigned int nOverThr;
+  unsigned int nMaxOverThr;
+} zsup_state_t;
+
+// As in ZSUP, the final samples are counted from sample 1024 and the threshold stays below any sample until the
+// pedestal is computed
+static inline void zsup_start(zsup_state_t *zs, int algr)
+{
+  memset(zs,0,sizeof(zsup_state_t));
+  zs->thrLo = -8192.;
+  if (algr == 1) {
+    zs->head = Config->zs1_head;
+    zs->end = 1024-Config->zs1_tail;
+  } else if (algr == 2) {
+    zs->head = 1024-Config->zs2_tail;
+  }
+}
+
+static inline void zsup_sample(zsup_state_t *zs, int algr, int16_t s)
+{
+  float fs,mean;
+  if (zs->n < zs->head) {
+    if (algr == 1) {
+      fs = (float)s;
+      zs->fsum += fs;
+      zs->fsum2 += fs*fs;
+      if (zs->n == zs->head-1) {
+	mean = zs->fsum/zs->head;
+	zs->rms = sqrt((zs->fsum2-zs->fsum*mean)/(zs->head-1));
+	zs->thrLo = mean-Config->zs1_nsigma*zs->rms;
+      }
+    } else {
+      zs->sum += s;
+      zs->sum2 += (int32_t)s*s;
+    }
+  } else if (zs->n < zs->end) {
+    // Get longest set of consecutive samples above threshold
+    if (s < zs->thrLo) {
+      if (++zs->nOverThr > zs->nMaxOverThr) zs->nMaxOverThr = zs->nOverThr;
+    } else {
+      zs->nOverThr = 0;
+    }
+  }
+  zs->n++;
+}
+
+// Return 1 if channel ch is accepted, 0 if it is rejected. If algorithm is unknown, channel is accepted
+static int zsup_accept(zsup_state_t *zs, int algr, int ch)
+{
+  double rms;
+  if (algr == 1) {
+    // Channel is accepted if rms is bad or if at least zs1_nabovethr samples are above threshold
+    return (zs->rms > Config->zs1_badrmsthr || zs->nMaxOverThr >= Config->zs1_nabovethr);
+  } else if (algr == 2) {
+    // Channel is accepted if rms is above threshold for this channel
+    rms = sqrt(((double)zs->sum2-(double)zs->sum*zs->sum/zs->head)/(zs->head-1));
+    return (rms >= Config->zs2_minrms_ch[ch]);
+  }
+  return 1;
+}
+
+int create_pevent(void *evtPtr, CAEN_DGTZ_X742_EVENT_t *event, void *pEvt, int boardId)
+{
+
+  int pEvtSize = 0;
   int pEvtGroupSize;
 
   uint32_t pEvtChMaskActive = 0;
@@ -27,7 +206,6 @@ int create_pevent(void *evtPtr, CAEN_DGTZ_X742_EVENT_t *event, void *pEvt)
 
   int nSm;
   int freq,tr;
-  int16_t myshort; // Used to store rounded samples (can be negative)
   unsigned int n_samples_on; // Counter for trigger length evaluation (autopass)
   uint32_t line;
 
@@ -36,26 +214,19 @@ int create_pevent(void *evtPtr, CAEN_DGTZ_X742_EVENT_t *event, void *pEvt)
 
   // Pointer to move over the pEvt structure one byte at a time
   void *cursor = pEvt;
+  void *chStart;
 
-  // Extract 0-suppression configuration
-  int pEvt0SupMode = Config->zero_suppression / 100; // 0=rejction, 1=flagging
-  int pEvt0SupAlgr = Config->zero_suppression % 100; // 0=off, 1-15=algorithm code
+  // Zero-suppression is applied here only if requested, otherwise it is left to the ZSUP process
+  int zsupMode = Config->zero_suppression / 100; // 0=rejection, 1=flagging
+  int zsupAlgr = Config->daq_zero_suppression ? Config->zero_suppression % 100 : 0; // 0=off
+  zsup_state_t zs;
 
   // Set autopass bit to 0. Will be set to 1 if trigger signal is long.
   int pEvtAutoPass = 0;
 
   // Define autopass trig ON duration taking into account sampling frequency
   unsigned int autopass_trig_duration;
-  if (Config->drs4_sampfreq == 0) {
-    autopass_trig_duration = 5*Config->auto_duration; // 1ns = 5 samples
-  } else if (Config->drs4_sampfreq == 1) {
-    autopass_trig_duration = 2.5*Config->auto_duration; // 1ns = 2.5 samples
-  } else if (Config->drs4_sampfreq == 2) {
-    autopass_trig_duration = Config->auto_duration; // 1ns = 1 sample
-  } else {
-    printf("PEvent ERROR - drs4_sampfreq set to %d\n",Config->drs4_sampfreq);
-    return 0;
-  }
+  if ( autopass_duration(&autopass_trig_duration) ) return 0;
   //printf("Autopass trigger ON duration set to %u samples\n",autopass_trig_duration);
 
   // Event header will be created at the end
@@ -94,15 +265,8 @@ int create_pevent(void *evtPtr, CAEN_DGTZ_X742_EVENT_t *event, void *pEvt)
 
       // Copy trigger samples (if present)
       if (nSm) {
-	n_samples_on = 0;
-	for (iSm=0;iSm<nSm;iSm++) {
-	  myshort = roundf(event->DataGroup[iGr].DataChannel[8][iSm]);
-	  if (myshort < Config->auto_threshold) n_samples_on++;
-	  memcpy(cursor,&myshort,2);
-	  cursor += 2;
-	  //printf("Tr %d Sm %d %f %d\n",iGr,iSm,event->DataGroup[iGr].DataChannel[8][iSm],myshort);
-	  //printf("Tr %d Sm %d 0x%04x\n",iGr,iSm,myshort);
-	}
+	n_samples_on = convert_trigger(event->DataGroup[iGr].DataChannel[8],(int16_t*)cursor,nSm,Config->auto_threshold);
+	cursor += 2*nSm;
 	//printf("Trigger ON for %u samples\n",n_samples_on);
 	if (n_samples_on > autopass_trig_duration) {
 	  //printf("Autopass enabled: %u > %u\n",n_samples_on,autopass_trig_duration);
@@ -122,6 +286,9 @@ int create_pevent(void *evtPtr, CAEN_DGTZ_X742_EVENT_t *event, void *pEvt)
 
   }
 
+  // Autopass events are never zero-suppressed in rejection mode
+  if (pEvtAutoPass) zsupMode = 1;
+
   // Loop over 32 channels
   for (Ch=0;Ch<32;Ch++) {
 
@@ -134,18 +301,27 @@ int create_pevent(void *evtPtr, CAEN_DGTZ_X742_EVENT_t *event, void *pEvt)
 
       // Tag channel as active
       pEvtChMaskActive |= bCh;
-      pEvtChMaskAccepted |= bCh;
 
-      // Copy the samples to output structure
-      for (iSm=0;iSm<nSm;iSm++) {
-	myshort = roundf(event->DataGroup[iGr].DataChannel[iCh][iSm]);
-	memcpy(cursor,&myshort,2);
-	cursor += 2;
+      // Copy the samples to output structure while collecting zero-suppression statistics
+      chStart = cursor;
+      if (zsupAlgr) zsup_start(&zs,zsupAlgr);
+      convert_samples(event->DataGroup[iGr].DataChannel[iCh],(int16_t*)cursor,nSm);
+      if (zsupAlgr) {
+	for (iSm=0;iSm<nSm;iSm++) zsup_sample(&zs,zsupAlgr,((int16_t*)cursor)[iSm]);
       }
+      cursor += 2*nSm;
 
       // If number of samples is odd, pad last sample to full word (probably never used)
       if (nSm%2) cursor += 2;
 
+      // Tag channel as accepted. In rejection mode, rejected channels are dropped from output structure
+      if ( zsupAlgr == 0 || zsup_accept(&zs,zsupAlgr,Ch) ) {
+	pEvtChMaskAccepted |= bCh;
+      } else if (zsupMode == 0) {
+	cursor = chStart;
+	continue;
+      }
+
       pEvtSize += (nSm/2 + nSm%2);
 
     }
@@ -154,74 +330,224 @@ int create_pevent(void *evtPtr, CAEN_DGTZ_X742_EVENT_t *event, void *pEvt)
   //  printf("Final masks 0x%08X 0x%08X\n",pEvtChMaskActive,pEvtChMaskAccepted);
 
   // Create the event header
+  create_pevent_header(evtPtr,pEvt,boardId,pEvtSize,pEvtChMaskActive,pEvtChMaskAccepted,pEvtAutoPass,0);
 
-  // Line 0 of pEvent header: event tag (bit 28-31) + event size in 4bytes words (bit 0-27)
-  //  printf("Final - pEvtSize %d\n",pEvtSize);
-  line = (PEVT_EVENT_TAG << 28) + (pEvtSize & 0x0FFFFFFF);
-  memcpy(pEvt,&line,4);
+  return pEvtSize*4; // Return total size of event in bytes
 
-  // Prepare events status mask for this event
-  pEvtStatus = 0; // Zero event status
+}
 
-  if (pEvtChMaskAccepted) { // Check if at least one channel was accepted
-    pEvtStatus += (0x1 << PEVT_STATUS_HASDATA_BIT); // Event has data
-  } else {
-    pEvtStatus += (0x0 << PEVT_STATUS_HASDATA_BIT); // Event has no data
-  }
+// Same as create_pevent but samples are unpacked directly from the raw V1742 event,
+// without going through CAEN_DGTZ_DecodeEvent. DRS4 corrections of tables drs4 are applied in the integer domain.
+int create_pevent_native(void *evtPtr, void *pEvt, int boardId, const drs4_table_t* drs4)
+{
+
+  int pEvtSize = 0;
+  int pEvtGroupSize;
+
+  uint32_t pEvtChMaskActive = 0;
+  uint32_t pEvtChMaskAccepted = 0;
+
+  unsigned int nSm;
+  int freq,tr;
+  unsigned int n_samples_on; // Counter for trigger length evaluation (autopass)
+  uint32_t line;
+  uint32_t grMask;
+  uint32_t grHead;
+  uint32_t grTTT;
+  unsigned int size1,size2;
+
+  int iGr,iCh,iSm;
+  uint32_t bCh; // bit mask for channel
+  int16_t* chOut;
+
+  // Zero-suppression is applied here only if requested, otherwise it is left to the ZSUP process
+  int zsupMode = Config->zero_suppression / 100; // 0=rejection, 1=flagging
+  int zsupAlgr = Config->daq_zero_suppression ? Config->zero_suppression % 100 : 0; // 0=off
+  zsup_state_t zs;
+
+  // Position of channel data of each group in the raw event
+  const uint32_t* grData[MAX_X742_GROUP_SIZE];
+  unsigned int grNSm[MAX_X742_GROUP_SIZE];
+  unsigned int grSIC[MAX_X742_GROUP_SIZE];
+
+  // Trigger samples of each group in the output structure (NULL if not recorded)
+  int16_t* grTr[MAX_X742_GROUP_SIZE];
+  unsigned int grTrNSm[MAX_X742_GROUP_SIZE];
+
+  // Output pointers for the 8 channels of each group (NULL if channel is disabled). Disabled channels are
+  // unpacked to scratch as DRS4 corrections need all the channels of the group.
+  int16_t* grCh[MAX_X742_GROUP_SIZE][8];
+  int16_t* chPtr[8];
+  int16_t scratch[8][1024];
+
+  // Pointer to move over the raw V1742 event one word at a time
+  const uint32_t* raw = (const uint32_t*)evtPtr;
+
+  // Pointer to move over the pEvt structure one byte at a time
+  void *cursor = pEvt;
+
+  // Set autopass bit to 0. Will be set to 1 if trigger signal is long.
+  int pEvtAutoPass = 0;
+
+  // Define autopass trig ON duration taking into account sampling frequency
+  unsigned int autopass_trig_duration;
+  if ( autopass_duration(&autopass_trig_duration) ) return 0;
+
+  // Get group mask from line 1 of V1742 event header
+  grMask = raw[1] & 0xF;
+
+  // Jump at beginning of first group in V1742 event
+  raw += V1742_EVT_HEADER_LEN;
+
+  // Event header will be created at the end
+
+  // Jump at beginning of group trigger section
+  cursor += PEVT_HEADER_LEN*4;
+
+  // Update total size of event
+  pEvtSize += PEVT_HEADER_LEN;
+
+  // Write group header and group trigger info
+  for (iGr=0;iGr<MAX_X742_GROUP_SIZE;iGr++) {
+
+    grData[iGr] = NULL;
+    grNSm[iGr] = 0;
+    grTr[iGr] = NULL;
+    grTrNSm[iGr] = 0;
+
+    if (grMask & (1 << iGr)) {
+
+      // Decode V1742 group header
+      grHead = raw[0];
+      size1 = V1742_GRP_SIZE(grHead);
+      size2 = V1742_GRP_TR(grHead) ? size1/8 : 0;
+      grData[iGr] = raw+1;
+      grNSm[iGr] = size1/3;
+      grSIC[iGr] = V1742_GRP_SIC(grHead);
+      grTTT = raw[1+size1+size2] & 0x3FFFFFFF;
+
+      // Group header: start index cell|freq|tr|size
+      pEvtGroupSize = PEVT_GRPHEAD_LEN+PEVT_GRPTTT_LEN;
+      freq = Config->drs4_sampfreq; // 0=5GHz, 1=2.5GHz, 2=1GHz, 3=0.7GHz(new)
+      tr = 0; // trigger data - 0:no, 1:yes
+      nSm = size2*8/3;
+      if (nSm > 1024) {
+	printf("PEvent ERROR - Group %d has %u trigger samples\n",iGr,nSm);
+	return 0;
+      }
+      if (nSm) {
+	tr = 1;
+	pEvtGroupSize += (nSm/2 + nSm%2);
+      }
+
+      line = ((grSIC[iGr] & 0x3FF)<<22)
+	+ ((freq & 0x3)<<20) + ((tr & 0x1)<<19) + (pEvtGroupSize & 0xFFF);
+      memcpy(cursor,&line,4);
+      cursor += 4;
+
+      // Unpack trigger samples (if present) directly to output structure. They are corrected with the channels
+      if (nSm) {
+	V1742_unpack_trigger(raw+1+size1,nSm,(int16_t*)cursor);
+	grTr[iGr] = (int16_t*)cursor;
+	grTrNSm[iGr] = nSm;
+	cursor += 4*(nSm/2 + nSm%2);
+      }
+
+      // Copy trigger time tag
+      memcpy(cursor,&grTTT,4);
+      cursor += 4;
+
+      // Update total size of event
+      pEvtSize += pEvtGroupSize;
+
+      // Jump to next group in V1742 event
+      raw += 1+size1+size2+1;
+
+    }
 
-  if (Config->drs4corr_enable) { // Check if DRS4 corrections were applied
-    pEvtStatus += (0x1 << PEVT_STATUS_DRS4CORR_BIT); // Corrections applied
-  } else {
-    pEvtStatus += (0x0 << PEVT_STATUS_DRS4CORR_BIT); // Corrections not applied
   }
 
-  if (pEvt0SupMode == 0) { // Save 0-suppression mode
-    pEvtStatus += (0x0 << PEVT_STATUS_ZEROSUPP_BIT); // 0-suppression in rejection mode
-  } else {
-    pEvtStatus += (0x1 << PEVT_STATUS_ZEROSUPP_BIT); // 0-suppression in flagging mode
+  // Unpack channels group by group, writing enabled channels directly to output structure, and apply DRS4
+  // corrections to channels and trigger (spikes are removed from the trigger where all channels have one)
+  chOut = (int16_t*)cursor;
+  for (iGr=0;iGr<MAX_X742_GROUP_SIZE;iGr++) {
+
+    if (grData[iGr] == NULL) continue;
+    if ((nSm = grNSm[iGr]) > 1024) {
+      printf("PEvent ERROR - Group %d has %u samples\n",iGr,nSm);
+      return 0;
+    }
+
+    for (iCh=0;iCh<8;iCh++) {
+      bCh = (1 << (iGr*8+iCh));
+      if ( nSm && (Config->channel_enable_mask & bCh) ) {
+	pEvtChMaskActive |= bCh;
+	chPtr[iCh] = grCh[iGr][iCh] = (int16_t*)cursor;
+	cursor += 4*(nSm/2 + nSm%2);
+      } else {
+	chPtr[iCh] = scratch[iCh];
+	grCh[iGr][iCh] = NULL;
+      }
+    }
+
+    if (nSm) V1742_unpack_channels(grData[iGr],nSm,chPtr);
+    if (drs4) DRS4_correct_group(drs4,iGr,grSIC[iGr],nSm,chPtr,grTr[iGr],grTrNSm[iGr]);
+
   }
 
-  if (pEvtAutoPass == 0) {
-    pEvtStatus += (0x0 << PEVT_STATUS_AUTOPASS_BIT); // No autopass
-  } else {
-    pEvtStatus += (0x1 << PEVT_STATUS_AUTOPASS_BIT); // Enable autopass for this even
+  // Check the trigger signals of the groups for autopass
+  for (iGr=0;iGr<MAX_X742_GROUP_SIZE;iGr++) {
+    if (grTr[iGr] == NULL) continue;
+    n_samples_on = 0;
+    for (iSm=0;iSm<grTrNSm[iGr];iSm++) {
+      if (grTr[iGr][iSm] < Config->auto_threshold) n_samples_on++;
+    }
+    if (n_samples_on > autopass_trig_duration) pEvtAutoPass = 1;
   }
 
-  // 1) Get line 1 of V1742 event header
-  memcpy(&line,evtPtr+4,4);
-  //printf("First line of header 0x%08x\n",line);
-  // 2) Save Board Fail flag (bit 26) to event status. *** NOT USED ANYMORE: replaced by "missing event" bit ***
-  //if (line & 0x04000000) pEvtStatus += (0x1 << PEVT_STATUS_BRDFAIL_BIT);
-  // 3) Extract LVDS pattern (bit 8-23) and group mask (bit 0-3).
-  // 4) Add our board id (bit 24-31) and 0-suppression algorithm code (bit 4-7).
-  line = (line & 0x00FFFF0F) + ((Config->board_id & 0xFF) << 24) + ((pEvt0SupAlgr & 0xF) << 4);
-  // 5) Copy result to line 1 of pEvent header
-  memcpy(pEvt+4,&line,4);
+  // Autopass events are never zero-suppressed in rejection mode
+  if (pEvtAutoPass) zsupMode = 1;
 
-  // 1) Get line 2 of V1742 event header
-  memcpy(&line,evtPtr+8,4);
-  // 2) Extract event counter (bit 0-21)
-  // 3) Add event status pattern (bit 22-31)
-  line = (line & 0x003FFFFF) + ((pEvtStatus & 0x03FF) << 22);
-  // 4) Copy result to line 2 of pEvent header
-  memcpy(pEvt+8,&line,4);
+  // Apply zero-suppression to the enabled channels. In rejection mode, accepted channels are moved down
+  // over the space left by rejected ones.
+  for (iGr=0;iGr<MAX_X742_GROUP_SIZE;iGr++) {
 
-  // Copy line 3 of V1742 event header to line 3 of pEvent header (event time tag)
-  memcpy(pEvt+12,evtPtr+12,4);
+    if (grData[iGr] == NULL) continue;
+    nSm = grNSm[iGr];
 
-  // Copy channel masks to lines 4 and 5 of pEvent header
-  memcpy(pEvt+PEVT_CHMASK_ACTIVE_LINE*4,  &pEvtChMaskActive,  4);
-  memcpy(pEvt+PEVT_CHMASK_ACCEPTED_LINE*4,&pEvtChMaskAccepted,4);
+    for (iCh=0;iCh<8;iCh++) {
+      if (grCh[iGr][iCh] == NULL) continue;
+      if (zsupAlgr) {
+	zsup_start(&zs,zsupAlgr);
+	for (iSm=0;iSm<nSm;iSm++) zsup_sample(&zs,zsupAlgr,grCh[iGr][iCh][iSm]);
+      }
+      if ( zsupAlgr == 0 || zsup_accept(&zs,zsupAlgr,iGr*8+iCh) ) {
+	pEvtChMaskAccepted |= (1 << (iGr*8+iCh));
+      } else if (zsupMode == 0) {
+	continue;
+      }
+      if (chOut != grCh[iGr][iCh]) memmove(chOut,grCh[iGr][iCh],4*(nSm/2 + nSm%2));
+      chOut += 2*(nSm/2 + nSm%2);
+      pEvtSize += (nSm/2 + nSm%2);
+    }
 
-  // Dump event header
-  //for(i=0;i<PEVT_HEADER_LEN;i++){
-  //  printf("%d\t%08x\n",i,((int*)pEvt)[i]);
-  //}
+  }
+
+  // Create the event header
+  create_pevent_header(evtPtr,pEvt,boardId,pEvtSize,pEvtChMaskActive,pEvtChMaskAccepted,pEvtAutoPass,0);
 
   return pEvtSize*4; // Return total size of event in bytes
 
 }
 
+// Create a header-only pEvent with the MISSING status bit set from the raw V1742 event
+// Event counter and time tag are preserved but no group or channel data are written
+int create_pevent_missing(void *evtPtr, void *pEvt, int boardId)
+{
+  create_pevent_header(evtPtr,pEvt,boardId,PEVT_HEADER_LEN,0,0,0,1);
+  return PEVT_HEADER_LEN*4; // Return total size of event in bytes
+}
+
 unsigned int create_file_head(unsigned int fIndex, int runNr, int boardId, uint32_t boardSN, time_t timeTag, void *fHead)
 {
 
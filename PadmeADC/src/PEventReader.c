@@ -0,0 +1,266 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "CAENDigitizer.h"
+
+#include "PEvent.h"
+
+#include "PEventReader.h"
+
+pevent_reader_t* pevent_reader_open(const char* path, size_t bufSize, size_t readahead)
+{
+
+  pevent_reader_t* r;
+
+  r = (pevent_reader_t*)malloc(sizeof(pevent_reader_t));
+  if (r == NULL) {
+    printf("pevent_reader_open - ERROR - Unable to allocate reader structure\n");
+    return NULL;
+  }
+  memset(r,0,sizeof(pevent_reader_t));
+  r->in = stream_reader_open(path,bufSize ? bufSize : PEVENT_READER_BUFFER,0);
+  if (r->in == NULL) {
+    free(r);
+    return NULL;
+  }
+  if (r->in->mapped) r->readahead = readahead;
+  return r;
+
+}
+
+void pevent_reader_close(pevent_reader_t* r)
+{
+  stream_reader_close(r->in);
+  free(r);
+}
+
+int pevent_reader_mapped(pevent_reader_t* r)
+{
+  return r->in->mapped;
+}
+
+// Ask the kernel for the pages of the next readahead window when half of the current one was used
+static void pevent_reader_readahead(pevent_reader_t* r)
+{
+  size_t start,len;
+  if (r->offset < r->ra_next) return;
+  start = r->offset & ~((size_t)sysconf(_SC_PAGESIZE)-1);
+  if (start >= r->in->size) return;
+  len = r->in->size-start;
+  if (len > r->readahead) len = r->readahead;
+  madvise(r->in->data+start,len,MADV_WILLNEED);
+  r->ra_next = r->offset+r->readahead/2;
+  r->n_readahead++;
+}
+
+// Return pointer to the next len bytes, after reporting why they are not available
+static const uint32_t* pevent_reader_peek(pevent_reader_t* r, size_t len, const char* what)
+{
+  const char* p = stream_reader_peek(r->in,len);
+  if (p) return (const uint32_t*)p;
+  if ( ! r->in->mapped && len > r->in->size ) {
+    printf("pevent_reader - ERROR - Size of %s at byte %llu (%lu bytes) exceeds the refill buffer (%lu bytes)\n",
+	   what,(unsigned long long)r->offset,(unsigned long)len,(unsigned long)r->in->size);
+  } else if (r->in->error) {
+    printf("pevent_reader - ERROR - Unable to read %s at byte %llu: %s\n",what,(unsigned long long)r->offset,strerror(r->in->error));
+  } else {
+    printf("pevent_reader - ERROR - Data end inside %s at byte %llu\n",what,(unsigned long long)r->offset);
+  }
+  return NULL;
+}
+
+static void pevent_reader_consume(pevent_reader_t* r, size_t len)
+{
+  stream_reader_skip(r->in,len);
+  r->offset += len;
+  r->n_bytes += len;
+}
+
+// Decode a file head. Return 0 if OK, -1 if error
+static int pevent_reader_head(pevent_reader_t* r)
+{
+  const uint32_t* line;
+  if ( (line = pevent_reader_peek(r,PEVT_FHEAD_LEN*4,"file head")) == NULL ) return -1;
+  if (r->in_file) {
+    printf("pevent_reader - ERROR - File head at byte %llu while file started at byte %llu has no tail\n",
+	   (unsigned long long)r->offset,(unsigned long long)r->file_start);
+    return -1;
+  }
+  r->head.version = (line[0] >> 16) & 0x0FFF;
+  r->head.index = line[0] & 0xFFFF;
+  r->head.run_number = (int)line[1];
+  r->head.board_id = line[2] >> 24;
+  r->head.board_sn = line[2] & 0x00FFFFFF;
+  r->head.time = line[3];
+  if (r->head.version != PEVT_CURRENT_VERSION) {
+    printf("pevent_reader - WARNING - File at byte %llu has format version %u: decoded as version %d\n",
+	   (unsigned long long)r->offset,r->head.version,PEVT_CURRENT_VERSION);
+  }
+  r->in_file = 1;
+  r->file_start = r->offset;
+  r->file_events = 0;
+  pevent_reader_consume(r,PEVT_FHEAD_LEN*4);
+  return 0;
+}
+
+// Check a file tail against the data read after the head. Return 0 if OK, -1 if error
+static int pevent_reader_tail(pevent_reader_t* r)
+{
+  const uint32_t* line;
+  uint64_t size;
+  if ( (line = pevent_reader_peek(r,PEVT_FTAIL_LEN*4,"file tail")) == NULL ) return -1;
+  if (! r->in_file) {
+    printf("pevent_reader - ERROR - File tail at byte %llu without file head\n",(unsigned long long)r->offset);
+    return -1;
+  }
+  memcpy(&size,line+1,8);
+  if ( (line[0] & 0x0FFFFFFF) != (r->file_events & 0x0FFFFFFF) || size != r->offset+PEVT_FTAIL_LEN*4-r->file_start ) {
+    printf("pevent_reader - ERROR - File tail at byte %llu reports %u events and %llu bytes, %llu events and %llu bytes found\n",
+	   (unsigned long long)r->offset,line[0] & 0x0FFFFFFF,(unsigned long long)size,
+	   (unsigned long long)r->file_events,(unsigned long long)(r->offset+PEVT_FTAIL_LEN*4-r->file_start));
+    return -1;
+  }
+  r->in_file = 0;
+  r->n_files++;
+  pevent_reader_consume(r,PEVT_FTAIL_LEN*4);
+  return 0;
+}
+
+// Decode the header, groups and channels of an event in place. Return 0 if OK, -1 if structure is not consistent
+static int pevent_reader_decode(pevent_reader_t* r, const uint32_t* evt, uint32_t nWords, pevent_view_t* v)
+{
+
+  unsigned int iGr,iCh,nCh,gSize;
+  uint32_t pos = PEVT_HEADER_LEN;
+  uint32_t chWords;
+
+  v->data = evt;
+  v->size = nWords*4;
+  v->offset = r->offset;
+  v->board_id = evt[1] >> 24;
+  v->lvds = (evt[1] >> 8) & 0xFFFF;
+  v->zsup_algr = (evt[1] >> 4) & 0xF;
+  v->group_mask = evt[1] & 0xF;
+  v->counter = evt[2] & 0x003FFFFF;
+  v->status = (evt[2] >> 22) & 0x03FF;
+  v->time_tag = evt[3];
+  v->active_mask = evt[PEVT_CHMASK_ACTIVE_LINE];
+  v->accepted_mask = evt[PEVT_CHMASK_ACCEPTED_LINE];
+  v->present_mask = ( v->status & (1 << PEVT_STATUS_ZEROSUPP_BIT) ) ? v->active_mask : v->accepted_mask;
+
+  // Group trigger blocks: header, trigger samples (if recorded) and trigger time tag
+  v->n_groups = 0;
+  for (iGr=0;iGr<PEVENT_READER_MAX_GROUPS;iGr++) {
+    if ( ! (v->group_mask & (1 << iGr)) ) continue;
+    if (pos >= nWords) {
+      printf("pevent_reader - ERROR - Event at byte %llu ends before group %u\n",(unsigned long long)r->offset,iGr);
+      return -1;
+    }
+    gSize = evt[pos] & 0xFFF;
+    if ( gSize < PEVT_GRPHEAD_LEN+PEVT_GRPTTT_LEN || pos+gSize > nWords ||
+	 ( ! (evt[pos] & (1 << 19)) && gSize != PEVT_GRPHEAD_LEN+PEVT_GRPTTT_LEN ) ) {
+      printf("pevent_reader - ERROR - Event at byte %llu has group %u with invalid size %u\n",(unsigned long long)r->offset,iGr,gSize);
+      return -1;
+    }
+    v->group[v->n_groups].head = evt+pos;
+    if (evt[pos] & (1 << 19)) {
+      v->group[v->n_groups].trigger = (const int16_t*)(evt+pos+PEVT_GRPHEAD_LEN);
+      v->group[v->n_groups].n_trigger = (gSize-PEVT_GRPHEAD_LEN-PEVT_GRPTTT_LEN)*2;
+    } else {
+      v->group[v->n_groups].trigger = NULL;
+      v->group[v->n_groups].n_trigger = 0;
+    }
+    v->group[v->n_groups].time_tag = evt[pos+gSize-1];
+    v->n_groups++;
+    pos += gSize;
+  }
+
+  // Channel samples: all present channels have the same number of samples
+  nCh = __builtin_popcount(v->present_mask);
+  chWords = nCh ? (nWords-pos)/nCh : 0;
+  if ( nCh ? ( (nWords-pos)%nCh != 0 ) : ( pos != nWords ) ) {
+    printf("pevent_reader - ERROR - Event at byte %llu has %u words of channel data for %u channels\n",
+	   (unsigned long long)r->offset,nWords-pos,nCh);
+    return -1;
+  }
+  v->n_samples = chWords*2;
+  for (iCh=0;iCh<PEVENT_READER_MAX_CHANNELS;iCh++) {
+    if (v->present_mask & (1u << iCh)) {
+      v->channel[iCh] = (const int16_t*)(evt+pos);
+      pos += chWords;
+    } else {
+      v->channel[iCh] = NULL;
+    }
+  }
+  return 0;
+
+}
+
+int pevent_reader_next(pevent_reader_t* r, pevent_view_t* v)
+{
+
+  const uint32_t* line;
+  uint32_t nWords;
+
+  // The previous event is released only now, so that its view stays valid until this call
+  if (r->pending) {
+    pevent_reader_consume(r,r->pending);
+    r->pending = 0;
+  }
+
+  while (1) {
+
+    if (r->readahead) pevent_reader_readahead(r);
+
+    line = (const uint32_t*)stream_reader_peek(r->in,4);
+    if (line == NULL) {
+      if (r->in->error) {
+	printf("pevent_reader - ERROR - Unable to read at byte %llu: %s\n",(unsigned long long)r->offset,strerror(r->in->error));
+	return -1;
+      }
+      if (r->in->tail != r->in->head) {
+	printf("pevent_reader - ERROR - Data end inside a word at byte %llu\n",(unsigned long long)r->offset);
+	return -1;
+      }
+      if (r->in_file) {
+	printf("pevent_reader - WARNING - File started at byte %llu has no tail (%llu events)\n",
+	       (unsigned long long)r->file_start,(unsigned long long)r->file_events);
+      }
+      return 0;
+    }
+
+    switch (line[0] >> 28) {
+
+    case PEVT_FHEAD_TAG:
+      if ( pevent_reader_head(r) ) return -1;
+      break;
+
+    case PEVT_FTAIL_TAG:
+      if ( pevent_reader_tail(r) ) return -1;
+      break;
+
+    case PEVT_EVENT_TAG:
+      nWords = line[0] & 0x0FFFFFFF;
+      if (nWords < PEVT_HEADER_LEN) {
+	printf("pevent_reader - ERROR - Event at byte %llu has invalid size %u words\n",(unsigned long long)r->offset,nWords);
+	return -1;
+      }
+      if ( (line = pevent_reader_peek(r,nWords*4,"event")) == NULL ) return -1;
+      if ( pevent_reader_decode(r,line,nWords,v) ) return -1;
+      r->pending = nWords*4;
+      r->file_events++;
+      r->n_events++;
+      return 1;
+
+    default:
+      printf("pevent_reader - ERROR - Unknown record 0x%08x at byte %llu\n",line[0],(unsigned long long)r->offset);
+      return -1;
+
+    }
+
+  }
+
+}
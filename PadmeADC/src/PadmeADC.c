@@ -98,9 +98,9 @@ int main(int argc, char*argv[])
     exit(1);
   }
 
-  // Check current running mode (DAQ, ZSUP, FAKE)
+  // Check current running mode (DAQ, DAQRAW, ZSUP, FAKE)
 
-  if ( strcmp(Config->process_mode,"DAQ")==0 ) {
+  if ( strcmp(Config->process_mode,"DAQ")==0 || strcmp(Config->process_mode,"DAQRAW")==0 ) {
 
     // Show some startup message
     if (Config->run_number == 0) {
@@ -187,7 +187,6 @@ int main(int argc, char*argv[])
 
   } else if ( strcmp(Config->process_mode,"ZSUP")==0 ) {
 
-    /*
     // Show some startup message
     if (Config->run_number == 0) {
       printf("\n=== Starting PadmeDAQ zero suppression for dummy run ===\n");
@@ -214,8 +213,6 @@ int main(int argc, char*argv[])
     } else {
       printf("=== ZSUP reported unknown return code %d ===\n",rc);
     }
-    */
-    printf("\n=== ZSUP zero suppression currently not supported ===\n");
 
   }
 
@@ -0,0 +1,56 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "RawBLT.h"
+
+unsigned int create_raw_file_head(unsigned int fIndex, int runNr, int boardId, uint32_t boardSN, time_t timeTag, void *fHead)
+{
+
+  uint32_t line;
+
+  // First line: raw file head tag (4) + version (12) + file index (16)
+  line = (RAW_FHEAD_TAG << 28) + (RAW_CURRENT_VERSION << 16) + (fIndex & 0xFFFF);
+  memcpy(fHead,&line,4);
+
+  // Second line: run number (32, signed int)
+  memcpy(fHead+4,&runNr,4);
+
+  // Third line: board id (8) + board serial number (24)
+  line = ( (boardId & 0xff) << 24 ) + (boardSN & 0xffffff);
+  memcpy(fHead+8,&line,4);
+
+  // Fourth line: start of file time tag (32)
+  line = (timeTag & 0xffffffff); // Avoid problems with 8Bytes time_t structure
+  memcpy(fHead+12,&line,4);
+
+  return RAW_FHEAD_LEN*4;     // Return total size of file header in bytes
+
+}
+
+unsigned int create_raw_blt_header(uint32_t readSize, uint32_t nEvts, int boardId, uint32_t boardSN, uint64_t timeUsec, void *bHead)
+{
+
+  uint32_t line;
+
+  // First line: BLT tag (4) + total size of BLT record in words (28)
+  line = (RAW_BLT_TAG << 28) + ((RAW_BLT_HEADER_LEN + readSize/4) & 0x0FFFFFFF);
+  memcpy(bHead,&line,4);
+
+  // Second line: board id (8) + board serial number (24)
+  line = ( (boardId & 0xff) << 24 ) + (boardSN & 0xffffff);
+  memcpy(bHead+4,&line,4);
+
+  // Third line: size of raw data in bytes (32)
+  memcpy(bHead+8,&readSize,4);
+
+  // Fourth line: number of events in raw data (32)
+  memcpy(bHead+12,&nEvts,4);
+
+  // Fifth + sixth line: host time of readout in usecs (64)
+  memcpy(bHead+16,&timeUsec,8);
+
+  return RAW_BLT_HEADER_LEN*4;     // Return total size of BLT header in bytes
+
+}
@@ -0,0 +1,89 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+#include "RealTime.h"
+
+// Pin calling thread to a cpu and/or run it with SCHED_FIFO at the given priority
+int rt_set_thread(const char* name, int cpu, int priority)
+{
+
+  int rc;
+  int errors = 0;
+  long n_cpus;
+  cpu_set_t cpus;
+  struct sched_param sp;
+  struct rlimit rl;
+
+  if (cpu >= 0) {
+    n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpu >= n_cpus) {
+      printf("rt_set_thread - WARNING - Cannot pin %s thread to cpu %d: only %ld cpu(s) online\n",name,cpu,n_cpus);
+      errors++;
+    } else {
+      CPU_ZERO(&cpus);
+      CPU_SET(cpu,&cpus);
+      rc = pthread_setaffinity_np(pthread_self(),sizeof(cpu_set_t),&cpus);
+      if (rc) {
+	printf("rt_set_thread - WARNING - Unable to pin %s thread to cpu %d: %s\n",name,cpu,strerror(rc));
+	errors++;
+      } else {
+	printf("- %s thread pinned to cpu %d\n",name,cpu);
+      }
+    }
+  }
+
+  if (priority > 0) {
+    memset(&sp,0,sizeof(sp));
+    sp.sched_priority = priority;
+    rc = pthread_setschedparam(pthread_self(),SCHED_FIFO,&sp);
+    if (rc) {
+      printf("rt_set_thread - WARNING - Unable to run %s thread with SCHED_FIFO priority %d: %s\n",name,priority,strerror(rc));
+      if ( getrlimit(RLIMIT_RTPRIO,&rl) == 0 && rl.rlim_cur < (rlim_t)priority ) {
+	printf("rt_set_thread - WARNING - RLIMIT_RTPRIO is %lu: run as root, with CAP_SYS_NICE, or raise rtprio limit to %d\n",
+	       (unsigned long)rl.rlim_cur,priority);
+      }
+      errors++;
+    } else {
+      printf("- %s thread running with SCHED_FIFO priority %d\n",name,priority);
+    }
+  }
+
+  return errors;
+
+}
+
+// Write to each page of buffer: pages get mapped now instead of at first use during the run
+void rt_prefault(void* buf, size_t size)
+{
+  long page;
+  size_t i;
+  if (buf == NULL) return;
+  page = sysconf(_SC_PAGESIZE);
+  if (page <= 0) page = 4096;
+  for(i=0;i<size;i+=page) ((volatile char*)buf)[i] = 0;
+  if (size) ((volatile char*)buf)[size-1] = 0;
+}
+
+// Lock current pages in RAM. Buffers should be allocated (and prefaulted) before calling this
+int rt_lock_memory()
+{
+  struct rlimit rl;
+  if ( mlockall(MCL_CURRENT) ) {
+    printf("rt_lock_memory - WARNING - Unable to lock process memory: %s\n",strerror(errno));
+    if ( getrlimit(RLIMIT_MEMLOCK,&rl) == 0 && rl.rlim_cur != RLIM_INFINITY ) {
+      printf("rt_lock_memory - WARNING - RLIMIT_MEMLOCK is %lu bytes: run as root, with CAP_IPC_LOCK, or raise memlock limit\n",
+	     (unsigned long)rl.rlim_cur);
+    }
+    return 1;
+  }
+  printf("- Process memory locked in RAM\n");
+  return 0;
+}
@@ -0,0 +1,125 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "RingBuffer.h"
+
+// Largest power of 2 which can be used as number of slots
+#define RING_MAX_SLOTS 0x80000000U
+
+// Create ring with at least n_slots empty slots (rounded up to a power of 2). Return NULL if error
+ring_t* ring_create(unsigned int n_slots)
+{
+
+  ring_t* ring;
+  unsigned int n;
+
+  if (n_slots == 0) {
+    printf("ring_create - ERROR - Cannot create a ring with no slots\n");
+    return NULL;
+  }
+  if (n_slots > RING_MAX_SLOTS) {
+    printf("ring_create - ERROR - Cannot create a ring with more than %u slots\n",RING_MAX_SLOTS);
+    return NULL;
+  }
+  for(n=1;n<n_slots;n<<=1);
+  n_slots = n;
+
+  ring = (ring_t*)malloc(sizeof(ring_t));
+  if (ring == NULL) {
+    printf("ring_create - ERROR - Unable to allocate ring structure\n");
+    return NULL;
+  }
+  memset(ring,0,sizeof(ring_t));
+
+  ring->slot = (ring_slot_t*)malloc(n_slots*sizeof(ring_slot_t));
+  if (ring->slot == NULL) {
+    printf("ring_create - ERROR - Unable to allocate %u ring slots\n",n_slots);
+    free(ring);
+    return NULL;
+  }
+  memset(ring->slot,0,n_slots*sizeof(ring_slot_t));
+
+  ring->n_slots = n_slots;
+  ring->mask = n_slots-1;
+  atomic_init(&ring->head,0);
+  atomic_init(&ring->tail,0);
+
+  return ring;
+
+}
+
+// Release ring structure. Slot buffers must be released by the caller
+void ring_destroy(ring_t* ring)
+{
+  if (ring == NULL) return;
+  free(ring->slot);
+  free(ring);
+}
+
+// Producer side: get next free slot
+ring_slot_t* ring_write_slot(ring_t* ring)
+{
+  unsigned int head = atomic_load_explicit(&ring->head,memory_order_relaxed);
+  unsigned int tail = atomic_load_explicit(&ring->tail,memory_order_acquire);
+  if (head-tail >= ring->n_slots) return NULL; // Ring is full
+  return &ring->slot[head & ring->mask];
+}
+
+// Producer side: make filled slot visible to consumer
+void ring_push(ring_t* ring)
+{
+  unsigned int head = atomic_load_explicit(&ring->head,memory_order_relaxed);
+  unsigned int tail = atomic_load_explicit(&ring->tail,memory_order_relaxed);
+  atomic_store_explicit(&ring->head,head+1,memory_order_release);
+  if (head+1-tail > ring->max_used) ring->max_used = head+1-tail;
+  ring->n_pushed_blt++;
+}
+
+// Consumer side: get oldest filled slot
+ring_slot_t* ring_read_slot(ring_t* ring)
+{
+  unsigned int tail = atomic_load_explicit(&ring->tail,memory_order_relaxed);
+  unsigned int head = atomic_load_explicit(&ring->head,memory_order_acquire);
+  if (head == tail) return NULL; // Ring is empty
+  return &ring->slot[tail & ring->mask];
+}
+
+// Consumer side: give processed slot back to producer
+void ring_pop(ring_t* ring)
+{
+  unsigned int tail = atomic_load_explicit(&ring->tail,memory_order_relaxed);
+  atomic_store_explicit(&ring->tail,tail+1,memory_order_release);
+}
+
+// Number of slots currently waiting to be processed
+unsigned int ring_used(ring_t* ring)
+{
+  return atomic_load(&ring->head)-atomic_load(&ring->tail);
+}
+
+// Set occupancy level (percent of slots) used to detect overloads
+void ring_set_overload_level(ring_t* ring, unsigned int level)
+{
+  ring->overload_level = level;
+}
+
+// Consumer side: overload starts when the ring is filled above the overload level
+// and ends when it is back below half that level
+int ring_check_overload(ring_t* ring)
+{
+
+  unsigned int used;
+
+  if (ring->overload_level == 0) return 0;
+
+  used = ring_used(ring);
+  if ( ! ring->overload && 100*used >= ring->overload_level*ring->n_slots ) {
+    ring->overload = 1;
+    ring->n_overloads++;
+  } else if ( ring->overload && 200*used < ring->overload_level*ring->n_slots ) {
+    ring->overload = 0;
+  }
+  return ring->overload;
+
+}
@@ -0,0 +1,301 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "ShmRing.h"
+
+// Size of the page holding the control block
+#define SHM_RING_CTRL_SIZE 4096
+
+// Length written in place of a record when the following one does not fit before the end of the ring
+#define SHM_RING_WRAP 0xFFFFFFFF
+
+// Space used in the ring by a record of len bytes (length word included, 8 bytes aligned)
+#define SHM_RING_SPACE(len) (((uint32_t)(len)+4+7) & ~7U)
+
+static uint64_t shm_ring_msec()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return (uint64_t)ts.tv_sec*1000+ts.tv_nsec/1000000;
+}
+
+// Sleep until futex word changes from value or timeout (ms, -1: forever) expires
+static void shm_ring_sleep(atomic_uint* word, unsigned int value, int timeout)
+{
+  struct timespec ts;
+  if (timeout >= 0) {
+    ts.tv_sec = timeout/1000;
+    ts.tv_nsec = (timeout%1000)*1000000;
+  }
+  syscall(SYS_futex,word,FUTEX_WAIT,value,(timeout >= 0) ? &ts : NULL,NULL,0);
+}
+
+static void shm_ring_wake(atomic_uint* word)
+{
+  syscall(SYS_futex,word,FUTEX_WAKE,1,NULL,NULL,0);
+}
+
+static shm_ring_t* shm_ring_map(int fd, size_t map_size, int producer)
+{
+
+  shm_ring_t* r;
+  void* map;
+
+  map = mmap(NULL,map_size,PROT_READ|PROT_WRITE,MAP_SHARED,fd,0);
+  if (map == MAP_FAILED) {
+    printf("shm_ring_map - ERROR - Unable to map ring in memory: %s\n",strerror(errno));
+    return NULL;
+  }
+
+  r = (shm_ring_t*)malloc(sizeof(shm_ring_t));
+  if (r == NULL) {
+    printf("shm_ring_map - ERROR - Unable to allocate ring structure\n");
+    munmap(map,map_size);
+    return NULL;
+  }
+  memset(r,0,sizeof(shm_ring_t));
+  r->ctrl = (shm_ring_ctrl_t*)map;
+  r->data = (char*)map+SHM_RING_CTRL_SIZE;
+  r->map_size = map_size;
+  r->fd = fd;
+  r->producer = producer;
+  return r;
+
+}
+
+// Producer side: create ring in file path with a data area of size bytes (rounded to 8 bytes)
+shm_ring_t* shm_ring_create(const char* path, uint32_t size)
+{
+
+  int fd;
+  struct stat st;
+  shm_ring_t* r;
+
+  size &= ~7U;
+  if (size < 4096) {
+    printf("shm_ring_create - ERROR - Ring size %u is too small\n",size);
+    return NULL;
+  }
+
+  fd = open(path,O_RDWR | O_CREAT,S_IRUSR | S_IWUSR);
+  if (fd == -1) {
+    printf("shm_ring_create - ERROR - Unable to open file '%s': %s\n",path,strerror(errno));
+    return NULL;
+  }
+  if (fstat(fd,&st) == -1 || ! S_ISREG(st.st_mode)) {
+    printf("shm_ring_create - ERROR - File '%s' is not a regular file\n",path);
+    close(fd);
+    return NULL;
+  }
+
+  // Clear any ring left over by a previous process
+  if (ftruncate(fd,0) == -1 || ftruncate(fd,SHM_RING_CTRL_SIZE+(off_t)size) == -1) {
+    printf("shm_ring_create - ERROR - Unable to set size of file '%s': %s\n",path,strerror(errno));
+    close(fd);
+    return NULL;
+  }
+
+  r = shm_ring_map(fd,SHM_RING_CTRL_SIZE+(size_t)size,1);
+  if (r == NULL) {
+    close(fd);
+    return NULL;
+  }
+  r->size = size;
+
+  r->ctrl->version = SHM_RING_VERSION;
+  r->ctrl->size = size;
+  atomic_store(&r->ctrl->closed,0);
+  atomic_store(&r->ctrl->head,0);
+  atomic_store(&r->ctrl->head_seq,0);
+  atomic_store(&r->ctrl->prod_wait,0);
+  atomic_store(&r->ctrl->tail,0);
+  atomic_store(&r->ctrl->tail_seq,0);
+  atomic_store(&r->ctrl->cons_wait,0);
+
+  // Ring is now ready for the consumer
+  atomic_thread_fence(memory_order_release);
+  r->ctrl->magic = SHM_RING_MAGIC;
+
+  return r;
+
+}
+
+// Consumer side: attach to ring created by producer in file path
+// Once attached, the file is removed so that it cannot be attached again by mistake
+shm_ring_t* shm_ring_open(const char* path)
+{
+
+  int fd;
+  struct stat st;
+  shm_ring_t* r;
+
+  fd = open(path,O_RDWR);
+  if (fd == -1) return NULL;
+  if (fstat(fd,&st) == -1 || ! S_ISREG(st.st_mode) || st.st_size <= SHM_RING_CTRL_SIZE) {
+    close(fd);
+    return NULL;
+  }
+
+  r = shm_ring_map(fd,st.st_size,0);
+  if (r == NULL) {
+    close(fd);
+    return NULL;
+  }
+  if (r->ctrl->magic != SHM_RING_MAGIC || r->ctrl->size+SHM_RING_CTRL_SIZE != (uint64_t)st.st_size) {
+    munmap(r->ctrl,r->map_size);
+    close(fd);
+    free(r);
+    return NULL;
+  }
+  atomic_thread_fence(memory_order_acquire);
+  if (r->ctrl->version != SHM_RING_VERSION) {
+    printf("shm_ring_open - ERROR - Ring '%s' has version %u (expected %u)\n",path,r->ctrl->version,SHM_RING_VERSION);
+    munmap(r->ctrl,r->map_size);
+    close(fd);
+    free(r);
+    return NULL;
+  }
+  r->size = r->ctrl->size;
+  r->pos = atomic_load(&r->ctrl->tail);
+
+  unlink(path);
+  return r;
+
+}
+
+// Detach from ring. The producer also marks the ring as closed and wakes up the consumer
+void shm_ring_close(shm_ring_t* r)
+{
+  if (r == NULL) return;
+  if (r->producer) {
+    atomic_store(&r->ctrl->closed,1);
+    atomic_fetch_add(&r->ctrl->head_seq,1);
+    shm_ring_wake(&r->ctrl->head_seq);
+  }
+  munmap(r->ctrl,r->map_size);
+  close(r->fd);
+  free(r);
+}
+
+// Producer side: reserve contiguous space for a record of len bytes
+char* shm_ring_reserve(shm_ring_t* r, uint32_t len, int timeout)
+{
+
+  uint32_t off,need,skip;
+  unsigned int seq;
+  uint64_t deadline = 0;
+
+  need = SHM_RING_SPACE(len);
+  if (need > r->size/2) {
+    printf("shm_ring_reserve - ERROR - Record of %u bytes too large for ring of %u bytes\n",len,r->size);
+    return NULL;
+  }
+
+  // If record does not fit before end of ring, skip to the beginning
+  off = r->pos % r->size;
+  skip = (r->size-off < need) ? r->size-off : 0;
+
+  // Wait for consumer to release enough space
+  if (timeout > 0) deadline = shm_ring_msec()+timeout;
+  while ( r->pos+skip+need-atomic_load(&r->ctrl->tail) > r->size ) {
+    if (timeout == 0 || (timeout > 0 && shm_ring_msec() >= deadline)) return NULL;
+    r->n_waits++;
+    seq = atomic_load(&r->ctrl->tail_seq);
+    atomic_store(&r->ctrl->prod_wait,1);
+    if ( r->pos+skip+need-atomic_load(&r->ctrl->tail) > r->size ) shm_ring_sleep(&r->ctrl->tail_seq,seq,timeout);
+    atomic_store(&r->ctrl->prod_wait,0);
+  }
+
+  if (skip) {
+    *(uint32_t*)(r->data+off) = SHM_RING_WRAP;
+    off = 0;
+  }
+  *(uint32_t*)(r->data+off) = len;
+  r->rec_len = skip+need;
+  return r->data+off+4;
+
+}
+
+// Producer side: make reserved record visible to consumer
+void shm_ring_commit(shm_ring_t* r)
+{
+  r->pos += r->rec_len;
+  r->rec_len = 0;
+  r->n_records++;
+  atomic_store(&r->ctrl->head,r->pos);
+  atomic_fetch_add(&r->ctrl->head_seq,1);
+  if ( atomic_load(&r->ctrl->cons_wait) ) shm_ring_wake(&r->ctrl->head_seq);
+}
+
+// Producer side: copy a record of len bytes to the ring
+int shm_ring_write(shm_ring_t* r, const void* data, uint32_t len, int timeout)
+{
+  char* rec = shm_ring_reserve(r,len,timeout);
+  if (rec == NULL) return 1;
+  memcpy(rec,data,len);
+  shm_ring_commit(r);
+  return 0;
+}
+
+// Consumer side: get next record. Record stays valid until shm_ring_release is called
+char* shm_ring_read(shm_ring_t* r, uint32_t* len, int timeout)
+{
+
+  uint32_t off,l;
+  unsigned int seq;
+  uint64_t deadline = 0;
+
+  if (timeout > 0) deadline = shm_ring_msec()+timeout;
+  while(1) {
+
+    // Wait for producer to write a record
+    while ( atomic_load(&r->ctrl->head) == r->pos ) {
+      if ( atomic_load(&r->ctrl->closed) && atomic_load(&r->ctrl->head) == r->pos ) {
+	*len = 0;
+	return NULL;
+      }
+      if (timeout == 0 || (timeout > 0 && shm_ring_msec() >= deadline)) {
+	*len = 1; // Not closed: more records may come
+	return NULL;
+      }
+      r->n_waits++;
+      seq = atomic_load(&r->ctrl->head_seq);
+      atomic_store(&r->ctrl->cons_wait,1);
+      if ( atomic_load(&r->ctrl->head) == r->pos ) shm_ring_sleep(&r->ctrl->head_seq,seq,timeout);
+      atomic_store(&r->ctrl->cons_wait,0);
+    }
+
+    off = r->pos % r->size;
+    l = *(uint32_t*)(r->data+off);
+    if (l != SHM_RING_WRAP) break;
+
+    // Record continues at the beginning of the ring
+    r->pos += r->size-off;
+
+  }
+
+  *len = l;
+  r->rec_len = SHM_RING_SPACE(l);
+  return r->data+off+4;
+
+}
+
+// Consumer side: release record returned by shm_ring_read
+void shm_ring_release(shm_ring_t* r)
+{
+  r->pos += r->rec_len;
+  r->rec_len = 0;
+  r->n_records++;
+  atomic_store(&r->ctrl->tail,r->pos);
+  atomic_fetch_add(&r->ctrl->tail_seq,1);
+  if ( atomic_load(&r->ctrl->prod_wait) ) shm_ring_wake(&r->ctrl->tail_seq);
+}
@@ -0,0 +1,132 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "StreamReader.h"
+
+// Regular files are mapped in memory, everything else is read into the refill buffer
+stream_reader_t* stream_reader_open(const char* path, size_t bufSize, int pipeSize)
+{
+
+  int fd,ps;
+  struct stat st;
+  stream_reader_t* r;
+  void* map;
+
+  fd = open(path,O_RDONLY);
+  if (fd == -1) {
+    printf("stream_reader_open - ERROR - Unable to open file '%s': %s\n",path,strerror(errno));
+    return NULL;
+  }
+  if (fstat(fd,&st) == -1) {
+    printf("stream_reader_open - ERROR - Unable to get status of file '%s': %s\n",path,strerror(errno));
+    close(fd);
+    return NULL;
+  }
+
+  r = (stream_reader_t*)malloc(sizeof(stream_reader_t));
+  if (r == NULL) {
+    printf("stream_reader_open - ERROR - Unable to allocate reader structure\n");
+    close(fd);
+    return NULL;
+  }
+  memset(r,0,sizeof(stream_reader_t));
+  r->fd = fd;
+
+  if ( S_ISREG(st.st_mode) && st.st_size > 0 ) {
+    map = mmap(NULL,st.st_size,PROT_READ,MAP_SHARED,fd,0);
+    if (map != MAP_FAILED) {
+      madvise(map,st.st_size,MADV_SEQUENTIAL);
+      r->mapped = 1;
+      r->data = (char*)map;
+      r->size = st.st_size;
+      r->tail = st.st_size;
+      printf("stream_reader_open - File '%s' mapped in memory (%lu bytes)\n",path,(unsigned long)r->size);
+      return r;
+    }
+    // Mapping can fail for very large files on 32 bits systems: read them as a stream
+    printf("stream_reader_open - WARNING - Unable to map file '%s' in memory: %s. Reading it as a stream\n",path,strerror(errno));
+  }
+
+  // A bigger pipe lets the writer go on while the reader is busy with a large event
+  if ( S_ISFIFO(st.st_mode) && pipeSize > 0 ) {
+    if ( fcntl(fd,F_SETPIPE_SZ,pipeSize) == -1 ) {
+      printf("stream_reader_open - WARNING - Unable to set pipe size to %d: %s (see /proc/sys/fs/pipe-max-size)\n",pipeSize,strerror(errno));
+    }
+    if ( (ps = fcntl(fd,F_GETPIPE_SZ)) != -1 ) printf("stream_reader_open - Pipe size is %d bytes\n",ps);
+  }
+
+  r->data = (char*)malloc(bufSize);
+  if (r->data == NULL) {
+    printf("stream_reader_open - ERROR - Unable to allocate refill buffer of %lu bytes\n",(unsigned long)bufSize);
+    close(fd);
+    free(r);
+    return NULL;
+  }
+  r->size = bufSize;
+  return r;
+
+}
+
+void stream_reader_close(stream_reader_t* r)
+{
+  if (r->mapped) {
+    munmap(r->data,r->size);
+  } else {
+    free(r->data);
+  }
+  close(r->fd);
+  free(r);
+}
+
+char* stream_reader_peek(stream_reader_t* r, size_t len)
+{
+
+  ssize_t n;
+
+  if (r->tail-r->head >= len) return r->data+r->head;
+  if (r->mapped || r->eof || len > r->size) {
+    r->eof = 1;
+    return NULL;
+  }
+
+  // Move unused data to the beginning of the buffer if requested data would not fit after them
+  if (r->head+len > r->size) {
+    memmove(r->data,r->data+r->head,r->tail-r->head);
+    r->tail -= r->head;
+    r->head = 0;
+    r->n_compact++;
+  }
+
+  // Fill as much of the buffer as the writer allows, until requested data are available
+  while (r->tail-r->head < len) {
+    n = read(r->fd,r->data+r->tail,r->size-r->tail);
+    r->n_reads++;
+    if (n > 0) {
+      r->tail += n;
+      if (r->tail-r->head < len) r->n_short++;
+    } else if (n == 0) {
+      r->eof = 1;
+      return NULL;
+    } else if (errno != EINTR) {
+      r->error = errno;
+      return NULL;
+    }
+  }
+  return r->data+r->head;
+
+}
+
+void stream_reader_skip(stream_reader_t* r, size_t len)
+{
+  r->head += len;
+  r->n_bytes += len;
+  // Start again from the beginning of the buffer when all data were used
+  if (!r->mapped && r->head == r->tail) r->head = r->tail = 0;
+}
@@ -139,6 +139,16 @@ int generate_filename(char* name, const time_t time) {
   return 0;
 }
 
+// Return file name given the board id and the file open time (multi-board mode). Return 0 if OK, <>0 error
+int generate_board_filename(char* name, int board_id, const time_t time) {
+  struct tm* t = gmtime(&time);
+  sprintf(name,"%s_b%.2d_%.4d_%.2d_%.2d_%.2d_%.2d_%.2d",
+	  Config->data_file, board_id,
+	  1900+t->tm_year, 1+t->tm_mon, t->tm_mday,
+	  t->tm_hour,      t->tm_min,   t->tm_sec);
+  return 0;
+}
+
 // Write time (in secs) to a string with standard formatting
 char* format_time(const time_t time) {
   static char tform[20];
@@ -0,0 +1,270 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "V1742.h"
+
+// Number of samples used to check the vector kernels (multiple of 8)
+#define V1742_CHECK_SAMPLES 1024
+
+// Each group of 3 words (12 bytes) contains 8 samples of 12 bits packed little-endian.
+// Sample k starts at bit 12*k, i.e. at byte 3*k/2, and is in the low 12 bits (k even)
+// or in the high 12 bits (k odd) of the 16 bits word starting at that byte.
+
+// Vector kernels use GCC vector extensions: the byte shuffles become pshufb (SSSE3) or vtbl (NEON) instructions.
+// On x86 the vector code is compiled for SSSE3 and used only if the cpu supports it. On ARM it is compiled
+// for the default target, i.e. only if NEON is enabled with SIMDFLAGS in the Makefile.
+#if defined(__x86_64__) || defined(__i386__)
+#define V1742_VECTOR_NAME "ssse3"
+#define V1742_VECTOR_TARGET __attribute__ ((target ("ssse3")))
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#define V1742_VECTOR_NAME "neon"
+#define V1742_VECTOR_TARGET
+#endif
+
+typedef void (*V1742_channels_t)(const uint32_t*,unsigned int,int16_t**);
+typedef void (*V1742_trigger_t)(const uint32_t*,unsigned int,int16_t*);
+
+#ifdef V1742_VECTOR_NAME
+
+typedef uint8_t  v16u8 __attribute__ ((vector_size (16)));
+typedef int16_t  v8i16 __attribute__ ((vector_size (16)));
+
+// Byte shuffle moving the two bytes holding sample k to 16 bits lane k
+static const v16u8 V1742_GATHER = { 0,1, 1,2, 3,4, 4,5, 6,7, 7,8, 9,10, 10,11 };
+
+// Unpack 8 samples from 3 words. N.B. 16 bytes are loaded: caller must guarantee
+// that 4 readable bytes follow the 3 words (always true inside a V1742 event).
+static inline __attribute__ ((always_inline)) v8i16 V1742_unpack8(const uint32_t* w)
+{
+  v16u8 in;
+  v8i16 v;
+  memcpy(&in,w,16);
+  v = (v8i16)__builtin_shuffle(in,V1742_GATHER);
+  return ( (v & (v8i16){0x0FFF,0,0x0FFF,0,0x0FFF,0,0x0FFF,0}) |
+	   ((v >> 4) & (v8i16){0,0x0FFF,0,0x0FFF,0,0x0FFF,0,0x0FFF}) );
+}
+
+#endif
+
+// Scalar version: unpack 8 samples from 3 words
+static inline void V1742_unpack8_scalar(const uint32_t* w, int16_t* s)
+{
+  s[0] = (w[0]      ) & 0xFFF;
+  s[1] = (w[0] >> 12) & 0xFFF;
+  s[2] = ((w[0] >> 24) & 0x0FF) | ((w[1] & 0x00F) << 8);
+  s[3] = (w[1] >>  4) & 0xFFF;
+  s[4] = (w[1] >> 16) & 0xFFF;
+  s[5] = ((w[1] >> 28) & 0x00F) | ((w[2] & 0x0FF) << 4);
+  s[6] = (w[2] >>  8) & 0xFFF;
+  s[7] = (w[2] >> 20) & 0xFFF;
+}
+
+// Scalar loops, starting from sample iSm (data points to the words of that sample)
+static inline void V1742_channels_scalar(const uint32_t* data, unsigned int iSm, unsigned int nSm, int16_t** ch)
+{
+  unsigned int c;
+  int16_t s[8];
+  for (;iSm<nSm;iSm++) {
+    V1742_unpack8_scalar(data,s);
+    for (c=0;c<8;c++) ch[c][iSm] = s[c];
+    data += 3;
+  }
+}
+
+static inline void V1742_trigger_scalar(const uint32_t* data, unsigned int iSm, unsigned int nSm, int16_t* tr)
+{
+  unsigned int i;
+  int16_t s[8];
+  for (;iSm<nSm;iSm+=8) {
+    V1742_unpack8_scalar(data,s);
+    for (i=0;i<8 && iSm+i<nSm;i++) tr[iSm+i] = s[i];
+    data += 3;
+  }
+}
+
+#ifdef V1742_VECTOR_NAME
+
+// Vector kernel for the channels of a group
+V1742_VECTOR_TARGET static void V1742_channels_vector(const uint32_t* data, unsigned int nSm, int16_t** ch)
+{
+
+  unsigned int iSm = 0;
+
+  // Unpack blocks of 8 samples for all channels (8 x 3 words) and transpose them
+  // so that each vector holds 8 consecutive samples of the same channel
+  v8i16 r0,r1,r2,r3,r4,r5,r6,r7;
+  v8i16 t0,t1,t2,t3,t4,t5,t6,t7;
+  v8i16 u0,u1,u2,u3,u4,u5,u6,u7;
+  v8i16 o;
+  const v8i16 lo16 = {0,8,1,9,2,10,3,11};
+  const v8i16 hi16 = {4,12,5,13,6,14,7,15};
+  const v8i16 lo32 = {0,1,8,9,2,3,10,11};
+  const v8i16 hi32 = {4,5,12,13,6,7,14,15};
+  const v8i16 lo64 = {0,1,2,3,8,9,10,11};
+  const v8i16 hi64 = {4,5,6,7,12,13,14,15};
+
+  for (;iSm+8<=nSm;iSm+=8) {
+
+    r0 = V1742_unpack8(data+ 0); r1 = V1742_unpack8(data+ 3);
+    r2 = V1742_unpack8(data+ 6); r3 = V1742_unpack8(data+ 9);
+    r4 = V1742_unpack8(data+12); r5 = V1742_unpack8(data+15);
+    r6 = V1742_unpack8(data+18); r7 = V1742_unpack8(data+21);
+    data += 24;
+
+    t0 = __builtin_shuffle(r0,r1,lo16); t1 = __builtin_shuffle(r0,r1,hi16);
+    t2 = __builtin_shuffle(r2,r3,lo16); t3 = __builtin_shuffle(r2,r3,hi16);
+    t4 = __builtin_shuffle(r4,r5,lo16); t5 = __builtin_shuffle(r4,r5,hi16);
+    t6 = __builtin_shuffle(r6,r7,lo16); t7 = __builtin_shuffle(r6,r7,hi16);
+
+    u0 = __builtin_shuffle(t0,t2,lo32); u1 = __builtin_shuffle(t0,t2,hi32);
+    u2 = __builtin_shuffle(t4,t6,lo32); u3 = __builtin_shuffle(t4,t6,hi32);
+    u4 = __builtin_shuffle(t1,t3,lo32); u5 = __builtin_shuffle(t1,t3,hi32);
+    u6 = __builtin_shuffle(t5,t7,lo32); u7 = __builtin_shuffle(t5,t7,hi32);
+
+    o = __builtin_shuffle(u0,u2,lo64); memcpy(ch[0]+iSm,&o,16);
+    o = __builtin_shuffle(u0,u2,hi64); memcpy(ch[1]+iSm,&o,16);
+    o = __builtin_shuffle(u1,u3,lo64); memcpy(ch[2]+iSm,&o,16);
+    o = __builtin_shuffle(u1,u3,hi64); memcpy(ch[3]+iSm,&o,16);
+    o = __builtin_shuffle(u4,u6,lo64); memcpy(ch[4]+iSm,&o,16);
+    o = __builtin_shuffle(u4,u6,hi64); memcpy(ch[5]+iSm,&o,16);
+    o = __builtin_shuffle(u5,u7,lo64); memcpy(ch[6]+iSm,&o,16);
+    o = __builtin_shuffle(u5,u7,hi64); memcpy(ch[7]+iSm,&o,16);
+
+  }
+
+  // Scalar loop for the last samples
+  V1742_channels_scalar(data,iSm,nSm,ch);
+
+}
+
+// Vector kernel for the trigger samples of a group
+V1742_VECTOR_TARGET static void V1742_trigger_vector(const uint32_t* data, unsigned int nSm, int16_t* tr)
+{
+
+  unsigned int iSm = 0;
+  v8i16 o;
+
+  for (;iSm+8<=nSm;iSm+=8) {
+    o = V1742_unpack8(data);
+    memcpy(tr+iSm,&o,16);
+    data += 3;
+  }
+
+  V1742_trigger_scalar(data,iSm,nSm,tr);
+
+}
+
+#endif
+
+void V1742_unpack_channels_scalar(const uint32_t* data, unsigned int nSm, int16_t** ch)
+{
+  V1742_channels_scalar(data,0,nSm,ch);
+}
+
+void V1742_unpack_trigger_scalar(const uint32_t* data, unsigned int nSm, int16_t* tr)
+{
+  V1742_trigger_scalar(data,0,nSm,tr);
+}
+
+// Kernels in use
+static const char* V1742Name = "scalar";
+static V1742_channels_t V1742Channels = V1742_unpack_channels_scalar;
+static V1742_trigger_t V1742Trigger = V1742_unpack_trigger_scalar;
+
+// Compare output of kernels with the scalar ones for nSm samples. Return 0 if equal, 1 if not
+static int V1742_check_length(V1742_channels_t fc, V1742_trigger_t ft, const uint32_t* data, unsigned int nSm,
+			      int16_t** out, int16_t** ref)
+{
+  unsigned int i;
+  for(i=0;i<8;i++) {
+    memset(out[i],0,V1742_CHECK_SAMPLES*2);
+    memset(ref[i],0,V1742_CHECK_SAMPLES*2);
+  }
+  fc(data,nSm,out);
+  V1742_unpack_channels_scalar(data,nSm,ref);
+  for(i=0;i<8;i++) if ( memcmp(out[i],ref[i],V1742_CHECK_SAMPLES*2) ) return 1;
+  ft(data,nSm,out[0]);
+  V1742_unpack_trigger_scalar(data,nSm,ref[0]);
+  if ( memcmp(out[0],ref[0],V1742_CHECK_SAMPLES*2) ) return 1;
+  return 0;
+}
+
+// Check kernels against the scalar ones on pseudo-random data words, using all lengths up to 64 to exercise the scalar tails
+static int V1742_check(V1742_channels_t fc, V1742_trigger_t ft)
+{
+
+  uint32_t data[3*V1742_CHECK_SAMPLES+1];
+  int16_t out[8][V1742_CHECK_SAMPLES],ref[8][V1742_CHECK_SAMPLES];
+  int16_t* outPtr[8];
+  int16_t* refPtr[8];
+  unsigned int i,n;
+  int ok = 1;
+
+  for(i=0;i<3*V1742_CHECK_SAMPLES+1;i++) data[i] = i*2654435761U;
+  for(i=0;i<8;i++) {
+    outPtr[i] = out[i];
+    refPtr[i] = ref[i];
+  }
+
+  for(n=0;n<64 && ok;n++) ok = (V1742_check_length(fc,ft,data,n,outPtr,refPtr) == 0);
+  if (ok) ok = (V1742_check_length(fc,ft,data,V1742_CHECK_SAMPLES,outPtr,refPtr) == 0);
+
+  return ok ? 0 : 1;
+
+}
+
+int V1742_select(const char* name)
+{
+
+  V1742_channels_t fc = NULL;
+  V1742_trigger_t ft = NULL;
+
+  if ( strcmp(name,"scalar")==0 ) {
+    fc = V1742_unpack_channels_scalar;
+    ft = V1742_unpack_trigger_scalar;
+#ifdef V1742_VECTOR_NAME
+  } else if ( strcmp(name,V1742_VECTOR_NAME)==0 ) {
+#if defined(__x86_64__) || defined(__i386__)
+    if ( ! __builtin_cpu_supports("ssse3") ) return 1;
+#endif
+    fc = V1742_channels_vector;
+    ft = V1742_trigger_vector;
+#endif
+  }
+  if (fc == NULL) return 1;
+
+  if ( V1742_check(fc,ft) ) {
+    printf("V1742_select - WARNING - Unpacking kernels '%s' do not match scalar code: not using them\n",name);
+    return 1;
+  }
+  V1742Name = name;
+  V1742Channels = fc;
+  V1742Trigger = ft;
+  return 0;
+
+}
+
+void V1742_init()
+{
+#ifdef V1742_VECTOR_NAME
+  if ( V1742_select(V1742_VECTOR_NAME)==0 ) return;
+#endif
+  V1742_select("scalar");
+}
+
+const char* V1742_unpack_kernel()
+{
+  return V1742Name;
+}
+
+void V1742_unpack_channels(const uint32_t* data, unsigned int nSm, int16_t** ch)
+{
+  V1742Channels(data,nSm,ch);
+}
+
+void V1742_unpack_trigger(const uint32_t* data, unsigned int nSm, int16_t* tr)
+{
+  V1742Trigger(data,nSm,tr);
+}
@@ -0,0 +1,183 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+
+#include "WorkerPool.h"
+
+typedef struct pool_arg_s {
+  pool_t* pool;
+  unsigned int id;
+} pool_arg_t;
+
+// Process items of current batch until none is left
+static void pool_work(pool_t* pool, unsigned int id)
+{
+  unsigned int item;
+  int rc,zero;
+  while ( (item = atomic_fetch_add(&pool->next,1)) < pool->n_items ) {
+    rc = pool->func(pool->ctx,id,item);
+    if (rc) {
+      zero = 0;
+      atomic_compare_exchange_strong(&pool->rc,&zero,rc);
+    }
+  }
+}
+
+static void* pool_thread(void* arg)
+{
+
+  pool_t* pool = ((pool_arg_t*)arg)->pool;
+  unsigned int id = ((pool_arg_t*)arg)->id;
+  unsigned int generation = 0;
+  free(arg);
+
+  while(1) {
+
+    // Wait for next batch
+    pthread_mutex_lock(&pool->mutex);
+    while ( pool->generation == generation && ! pool->quit ) pthread_cond_wait(&pool->start,&pool->mutex);
+    if (pool->quit) {
+      pthread_mutex_unlock(&pool->mutex);
+      break;
+    }
+    generation = pool->generation;
+    pthread_mutex_unlock(&pool->mutex);
+
+    pool_work(pool,id);
+
+    // Tell caller that this worker is done
+    pthread_mutex_lock(&pool->mutex);
+    if (--pool->n_active == 0) pthread_cond_signal(&pool->done);
+    pthread_mutex_unlock(&pool->mutex);
+
+  }
+
+  return NULL;
+
+}
+
+// Create pool with n_workers workers. If pin is set, worker n is bound to cpu n (modulo number of cpus)
+// Return NULL if error
+pool_t* pool_create(unsigned int n_workers, int pin, pool_func_t func, void* ctx)
+{
+
+  pool_t* pool;
+  pool_arg_t* arg;
+  unsigned int i;
+  long n_cpus;
+  cpu_set_t cpus;
+
+  if (n_workers == 0) {
+    printf("pool_create - ERROR - Cannot create a pool with no workers\n");
+    return NULL;
+  }
+
+  pool = (pool_t*)malloc(sizeof(pool_t));
+  if (pool == NULL) {
+    printf("pool_create - ERROR - Unable to allocate pool structure\n");
+    return NULL;
+  }
+  memset(pool,0,sizeof(pool_t));
+  pool->n_workers = n_workers;
+  pool->func = func;
+  pool->ctx = ctx;
+  pthread_mutex_init(&pool->mutex,NULL);
+  pthread_cond_init(&pool->start,NULL);
+  pthread_cond_init(&pool->done,NULL);
+  atomic_init(&pool->next,0);
+  atomic_init(&pool->rc,0);
+
+  pool->thread = (pthread_t*)malloc(n_workers*sizeof(pthread_t));
+  if (pool->thread == NULL) {
+    printf("pool_create - ERROR - Unable to allocate %u worker threads\n",n_workers);
+    free(pool);
+    return NULL;
+  }
+
+  n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  if (n_cpus < 1) n_cpus = 1;
+
+  for (i=1;i<n_workers;i++) {
+    arg = (pool_arg_t*)malloc(sizeof(pool_arg_t));
+    if (arg == NULL) {
+      printf("pool_create - ERROR - Unable to allocate worker %u arguments\n",i);
+      pool->n_workers = i;
+      pool_destroy(pool);
+      return NULL;
+    }
+    arg->pool = pool;
+    arg->id = i;
+    if ( pthread_create(&pool->thread[i],NULL,pool_thread,(void*)arg) ) {
+      printf("pool_create - ERROR - Unable to start worker thread %u\n",i);
+      free(arg);
+      pool->n_workers = i;
+      pool_destroy(pool);
+      return NULL;
+    }
+    if (pin) {
+      CPU_ZERO(&cpus);
+      CPU_SET(i % n_cpus,&cpus);
+      if ( pthread_setaffinity_np(pool->thread[i],sizeof(cpu_set_t),&cpus) ) {
+	printf("pool_create - WARNING - Unable to pin worker %u to cpu %ld\n",i,i % n_cpus);
+      }
+    }
+  }
+
+  return pool;
+
+}
+
+// Process items 0..n_items-1 using all workers and wait for completion
+int pool_run(pool_t* pool, unsigned int n_items)
+{
+
+  if (n_items == 0) return 0;
+
+  atomic_store(&pool->next,0);
+  atomic_store(&pool->rc,0);
+
+  // Wake up worker threads only if there is something for them to do
+  if (pool->n_workers > 1 && n_items > 1) {
+    pthread_mutex_lock(&pool->mutex);
+    pool->n_items = n_items;
+    pool->n_active = pool->n_workers-1;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->mutex);
+    pool_work(pool,0);
+    pthread_mutex_lock(&pool->mutex);
+    while (pool->n_active > 0) pthread_cond_wait(&pool->done,&pool->mutex);
+    pthread_mutex_unlock(&pool->mutex);
+  } else {
+    pool->n_items = n_items;
+    pool_work(pool,0);
+  }
+
+  return atomic_load(&pool->rc);
+
+}
+
+// Stop worker threads and release pool
+void pool_destroy(pool_t* pool)
+{
+
+  unsigned int i;
+
+  if (pool == NULL) return;
+
+  pthread_mutex_lock(&pool->mutex);
+  pool->quit = 1;
+  pthread_cond_broadcast(&pool->start);
+  pthread_mutex_unlock(&pool->mutex);
+  for (i=1;i<pool->n_workers;i++) pthread_join(pool->thread[i],NULL);
+
+  pthread_mutex_destroy(&pool->mutex);
+  pthread_cond_destroy(&pool->start);
+  pthread_cond_destroy(&pool->done);
+  free(pool->thread);
+  free(pool);
+
+}
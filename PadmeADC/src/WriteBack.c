@@ -0,0 +1,126 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "WriteBack.h"
+
+void write_back_init(write_back_t* wb, uint64_t prealloc, uint64_t chunk)
+{
+  memset(wb,0,sizeof(write_back_t));
+  wb->fd = -1;
+  wb->prealloc = prealloc;
+  wb->chunk = chunk;
+  histo_init(&wb->h_wait,"writeback wait","ns");
+}
+
+void write_back_start(write_back_t* wb, int fd)
+{
+
+  struct stat st;
+
+  wb->fd = -1;
+  wb->pos = 0;
+  wb->started = 0;
+  wb->allocated = 0;
+  wb->error = 0;
+  if ( fstat(fd,&st) == -1 || ! S_ISREG(st.st_mode) ) return;
+  wb->fd = fd;
+  wb->n_files++;
+
+  // Size is left unchanged: readers of a file being written only see real data
+  if (wb->prealloc) {
+    if ( fallocate(fd,FALLOC_FL_KEEP_SIZE,0,wb->prealloc) == 0 ) {
+      wb->allocated = 1;
+    } else {
+      if (wb->n_prealloc_fail == 0) printf("write_back - WARNING - Unable to preallocate %llu bytes: %s\n",
+					   (unsigned long long)wb->prealloc,strerror(errno));
+      wb->n_prealloc_fail++;
+      // Some blocks may have been allocated before the failure
+      wb->allocated = (errno == ENOSPC);
+    }
+  }
+
+}
+
+// Record and report first error of the current file
+static int write_back_fail(write_back_t* wb, int err, const char* what, uint64_t offset)
+{
+  if (wb->error == 0) {
+    wb->error = err;
+    printf("write_back - ERROR - %s at byte %llu: %s\n",what,(unsigned long long)offset,strerror(err));
+  }
+  return -1;
+}
+
+int write_back_written(write_back_t* wb, uint64_t n)
+{
+
+  uint64_t t0;
+  int err;
+
+  if (wb->fd == -1) return 0;
+  if (wb->error) return -1;
+  wb->pos += n;
+  if (wb->chunk == 0) return 0;
+
+  while (wb->pos-wb->started >= wb->chunk) {
+
+    // Start writeback of the new chunk
+    if ( sync_file_range(wb->fd,wb->started,wb->chunk,SYNC_FILE_RANGE_WRITE) == -1 )
+      return write_back_fail(wb,errno,"Unable to start writeback",wb->started);
+
+    // Wait for the previous chunk to be on disk and drop it from the page cache
+    // Write errors of the chunk are reported here
+    if (wb->started >= wb->chunk) {
+      t0 = histo_time();
+      if ( sync_file_range(wb->fd,wb->started-wb->chunk,wb->chunk,
+			   SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER) == -1 )
+	return write_back_fail(wb,errno,"Unable to write back data",wb->started-wb->chunk);
+      if ( (err = posix_fadvise(wb->fd,wb->started-wb->chunk,wb->chunk,POSIX_FADV_DONTNEED)) != 0 )
+	return write_back_fail(wb,err,"Unable to drop data from page cache",wb->started-wb->chunk);
+      histo_fill(&wb->h_wait,histo_time()-t0);
+      wb->n_chunks++;
+    }
+    wb->started += wb->chunk;
+
+  }
+  return 0;
+
+}
+
+int write_back_end(write_back_t* wb)
+{
+
+  int rc = 0;
+
+  if (wb->fd == -1) return 0;
+
+  // Release preallocated blocks beyond the end of data
+  if ( wb->allocated && ftruncate(wb->fd,wb->pos) == -1 ) {
+    printf("write_back - ERROR - Unable to release preallocated space: %s\n",strerror(errno));
+    rc = -1;
+  }
+
+  // Start writeback of the last chunks: they can be dropped from the page cache once the file is synced
+  if ( wb->chunk && wb->pos && sync_file_range(wb->fd,0,0,SYNC_FILE_RANGE_WRITE) == -1 ) {
+    printf("write_back - ERROR - Unable to start writeback: %s\n",strerror(errno));
+    rc = -1;
+  }
+
+  wb->fd = -1;
+  return rc;
+
+}
+
+void write_back_report(write_back_t* wb, const char* name)
+{
+  printf("- Writeback %s: %llu files - preallocation %llu bytes (failed %llu times) - %llu chunks of %llu bytes dropped from page cache\n",
+	 name,(unsigned long long)wb->n_files,(unsigned long long)wb->prealloc,(unsigned long long)wb->n_prealloc_fail,(unsigned long long)wb->n_chunks,(unsigned long long)wb->chunk);
+  if (wb->chunk) histo_print(&wb->h_wait,0);
+}
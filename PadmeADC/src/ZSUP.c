@@ -9,11 +9,21 @@
 #include <signal.h>
 #include <errno.h>
 #include <math.h>
+#include <sys/uio.h>
 
 #include "Config.h"
 #include "Tools.h"
 #include "PEvent.h"
 #include "Signal.h"
+#include "Histo.h"
+#include "ShmRing.h"
+#include "ZsupAlgo.h"
+#include "StreamReader.h"
+#include "OutputBuffer.h"
+#include "AsyncWriter.h"
+#include "FileRotator.h"
+#include "EventIndex.h"
+#include "WorkerPool.h"
 
 #include "ZSUP.h"
 
@@ -22,36 +32,196 @@
 
 #define MAX_N_OUTPUT_FILES 10240
 
+// Prefix of input_stream selecting the shared memory ring created by a DAQ process in SHM output mode
+#define SHM_STREAM_PREFIX "shm:"
+
+// Max time (msecs) to wait for data in the shared memory ring before checking for interrupts
+#define ZSUP_SHM_WAIT_TIMEOUT 100
+
+// Size of the refill buffer used to read the input stream (must hold at least one event)
+#define ZSUP_INPUT_BUFFER_SIZE (4*1024*1024)
+
+// Size requested for the pipe buffer when the input stream is a FIFO (1 MiB is the default pipe-max-size)
+#define ZSUP_INPUT_PIPE_SIZE (1024*1024)
+
+// Max number of zero suppression threads and number of events handed to each of them in a batch
+#define ZSUP_MAX_THREADS 16
+#define ZSUP_EVENTS_PER_THREAD 4
+
 extern int InBurst;
 extern int BreakSignal;
 
+// Latency (ns) histograms of the processing stages
+static histo_t HRead, HZsup, HWrite, HRotate;
+
+// Event of the current zero suppression batch
+typedef struct zsup_event_s {
+  char* in;              // Input event: in place in the input stream or copied to buf
+  char* buf;             // Copy of the input event (only used when the input stream does not keep it)
+  unsigned int inSize;   // Size of input event in bytes
+  unsigned int number;   // Number of the event in the input stream
+  int zsup;              // Apply zero suppression (0: event is sent to output as it is)
+  unsigned int zsupMode; // 0=rejection, 1=flagging
+  unsigned int zsupAlgr; // Algorithm code
+  char* head;            // New event header
+  struct iovec iov[ZSUP_MAX_IOVEC]; // Sections of the output event
+  int iovCnt;
+  unsigned int outSize;  // Size of output event in bytes
+  uint64_t tZsup;        // Time spent in zero suppression (ns)
+} zsup_event_t;
+
+static pool_t* ZsupPool = NULL;
+static zsup_event_t* ZsupBatch = NULL;
+
+// Report latency histograms. At the end of the run the content of all non-empty bins is also shown
+static void ZSUP_latency_report(time_t t_now, int bins)
+{
+  printf("%s - Latency report\n",format_time(t_now));
+  histo_print(&HRead,bins);
+  if ( (Config->zero_suppression % 100) != 0 ) histo_print(&HZsup,bins);
+  histo_print(&HWrite,bins);
+  if ( strcmp(Config->output_mode,"FILE")==0 ) histo_print(&HRotate,bins);
+}
+
+// Read next PEvent structure (file head, event, or file tail) from the input stream
+// The structure is used in place in the buffer of the stream reader or in the shared memory ring
+// and stays valid until the next call. Return pointer to the structure (NULL if error) and its size in bytes
+static char* ZSUP_read_record(stream_reader_t* in, shm_ring_t* ring, unsigned int maxSize, unsigned int* size)
+{
+
+  char *buffer;
+  unsigned int *line;
+  unsigned int tag;
+  uint32_t len;
+
+  if (ring) {
+
+    // Previous structure has been fully handled: give its space back to the DAQ process
+    if (ring->rec_len) shm_ring_release(ring);
+
+    while ( (buffer = shm_ring_read(ring,&len,ZSUP_SHM_WAIT_TIMEOUT)) == NULL ) {
+      if (len == 0) {
+	printf("ERROR - Shared memory ring was closed before end of stream.\n");
+	return NULL;
+      }
+      if (BreakSignal) return NULL;
+    }
+    *size = len;
+    return buffer;
+
+  }
+
+  // Read first line of structure and get its size from the tag
+  buffer = stream_reader_peek(in,4);
+  if (buffer == NULL) {
+    printf("ERROR - Unable to read first line of structure from stream.\n");
+    if (in->error) printf("ERROR - Read error: %s\n",strerror(in->error));
+    return NULL;
+  }
+  line = (unsigned int *)buffer;
+  tag = (*line >> 28) & 0xF;
+  if (tag == 0x9) {
+    *size = PEVT_FHEAD_LEN*4;
+  } else if (tag == 0x5) {
+    *size = PEVT_FTAIL_LEN*4;
+  } else if (tag == 0xE) {
+    *size = 4*(*line & 0x0FFFFFFF);
+    if (*size < 4 || *size > maxSize) {
+      printf("ERROR - Event size %u not valid.\n",*size);
+      return NULL;
+    }
+  } else {
+    *size = 4; // Unknown tag: let the caller handle it
+    stream_reader_skip(in,4);
+    return buffer;
+  }
+
+  // Get the rest of the structure
+  buffer = stream_reader_peek(in,*size);
+  if (buffer == NULL) {
+    printf("ERROR - Unable to read final part of structure from stream.\n");
+    if (in->error) printf("ERROR - Read error: %s\n",strerror(in->error));
+    return NULL;
+  }
+  stream_reader_skip(in,*size);
+  return buffer;
+
+}
+
+// Tell if the next record of the input stream can be read without waiting for the producer
+static int ZSUP_record_ready(stream_reader_t* in, shm_ring_t* ring)
+{
+  unsigned int line;
+  if (ring) return ( atomic_load(&ring->ctrl->head) != ring->pos+ring->rec_len );
+  if (in->mapped) return 1;
+  if (in->tail-in->head < 4) return 0;
+  memcpy(&line,in->data+in->head,4);
+  return ( ((line >> 28) & 0xF) != 0xE || in->tail-in->head >= 4*(size_t)(line & 0x0FFFFFFF) );
+}
+
+// Apply zero suppression to one event of the current batch (called by the zero suppression pool workers)
+static int ZSUP_zsup_event(void *ctx, unsigned int worker, unsigned int item)
+{
+
+  zsup_event_t* e = &ZsupBatch[item];
+  uint64_t t0;
+
+  if (! e->zsup) {
+    e->outSize = e->inSize;
+    e->iov[0].iov_base = e->in;
+    e->iov[0].iov_len = e->inSize;
+    e->iovCnt = 1;
+    return 0;
+  }
+
+  t0 = histo_time();
+  e->outSize = apply_zero_suppression(e->zsupMode,e->zsupAlgr,(void *)e->in,(void *)e->head,e->iov,&e->iovCnt);
+  e->tZsup = histo_time()-t0;
+  return 0;
+
+}
+
 // Handle zero suppression
 int ZSUP_readdata ()
 {
 
   // Input/Output event buffers
   int maxPEvtSize;
-  char *inEvtBuffer = NULL;
   char *outEvtBuffer = NULL;
 
-  // This is the pointer to the buffer which will be sent to output. Can point to inEvtBuffer or outEvtBuffer
-  char *outputEventBuffer = NULL;
+  // This is the pointer to the input structure. Points to the buffer of the stream reader or to the shared memory ring
+  char *inEvt = NULL;
 
-  // Dimensions (in 4 bytes words) of input and output event structures
-  unsigned int inputEventSize, outputEventSize;
+  // Batch of events handed to the zero suppression workers. Output events are sent as sections pointing
+  // to the input event and (for the new event header) to a buffer of the batch
+  zsup_event_t *e;
+  unsigned int nZsupThreads, zsupBatch, nBatch, iEv;
+  int zsupCopy;
+  char *outputEventBuffer = NULL; // Beginning of output event (used for debug printout)
+
+  // Dimension (in 4 bytes words) of output event structure
+  unsigned int outputEventSize;
 
   // Size in bytes of file head and tail
   unsigned int fHeadSize, fTailSize;
 
   // Input/Output file handles
-  int inFileHandle;
+  stream_reader_t* inStream = NULL;
+  shm_ring_t* inRing = NULL;
   int outFileHandle;
+  output_buffer_t* outBuffer = NULL; // Collects output events (written when full or when its oldest event is too old)
+  async_writer_t* outWriter = NULL; // Asynchronous writer of output files (NULL: output buffer written by this thread)
+  file_rotator_t* outRotator = NULL; // Helper preparing and closing output files (NULL: files opened and closed by this thread)
+  event_index_t* outIndex = NULL; // Index of the events of the output file (NULL: not written)
+  int n;
   unsigned int *line; // Used to read input buffer one line at a time
-  unsigned int readSize,writeSize;
+  unsigned int readSize;
 
   // Global counters for input data
   unsigned long int totalReadSize;
   unsigned int totalReadEvents;
+  unsigned int totalMissingEvents; // Events received without data (MISSING status bit set by DAQ)
+  unsigned int missingEvent;
   float evtReadPerSec, sizeReadPerSec;
 
   // Global counters for output data
@@ -73,6 +243,8 @@ int ZSUP_readdata ()
   // Process timers
   time_t t_daqstart, t_daqstop, t_daqtotal;
   time_t t_now;
+  time_t t_latencyreport;
+  uint64_t t0;
 
   unsigned int i;
 
@@ -80,27 +252,110 @@ int ZSUP_readdata ()
   InBurst = 1;
   set_signal_handlers();
 
-  // Allocate buffers to hold input and output event structures (same max size)
+  // Allocate buffer to hold output event headers
+  // Output events are written from the input buffer: only their header is rewritten
 
   maxPEvtSize = (PEVT_HEADER_LEN + 4*(PEVT_GRPHEAD_LEN + 512 + PEVT_GRPTTT_LEN) + 32*512)*4;
 
-  inEvtBuffer = (char *)malloc(maxPEvtSize);
-  if (inEvtBuffer == NULL) {
-    printf("Unable to allocate input event buffer of size %d\n",maxPEvtSize);
+  outEvtBuffer = (char *)malloc(PEVT_HEADER_LEN*4);
+  if (outEvtBuffer == NULL) {
+    printf("Unable to allocate output header buffer of size %d\n",PEVT_HEADER_LEN*4);
+    return 1;
+  }
+  printf("- Allocated output header buffer with size %d\n",PEVT_HEADER_LEN*4);
+
+  // Output events are copied from the input buffer to the output buffer and written in large blocks
+  // The time limit of buffered events is checked when a new event arrives
+  // With an asynchronous writer, output files are rotated by the writer thread
+  if ( strcmp(Config->output_writer,"SYNC")!=0 ) {
+    outWriter = async_writer_create(Config->output_writer,Config->output_writer_buffers,Config->output_buffer_size,
+				    Config->output_writer_threads,Config->output_writer_test_delay);
+    if (outWriter == NULL) {
+      printf("Unable to create asynchronous output writer\n");
+      return 1;
+    }
+    printf("- Created asynchronous writer with %s: %u buffers in flight - simulated write time %u usecs\n",
+	   async_writer_backend(outWriter),Config->output_writer_buffers,Config->output_writer_test_delay);
+    outBuffer = output_buffer_create_async(outWriter,Config->output_buffer_events,Config->output_buffer_delay);
+  } else {
+    outBuffer = output_buffer_create(Config->output_buffer_size,Config->output_buffer_events,Config->output_buffer_delay);
+  }
+  if (outBuffer == NULL) {
+    printf("Unable to create output buffer of size %u\n",Config->output_buffer_size);
     return 1;
   }
-  printf("- Allocated input event buffer with size %d\n",maxPEvtSize);
+  printf("- Created output buffer with size %u\n",Config->output_buffer_size);
+
+  // Output files are prepared by a helper thread, which also closes the old ones
+  if ( strcmp(Config->output_mode,"FILE")==0 && outWriter == NULL && Config->file_preopen ) {
+    outRotator = file_rotator_create(Config->data_dir,Config->data_file,Config->file_sync_close,
+				     Config->file_prealloc ? Config->file_max_size : 0);
+    if (outRotator == NULL) {
+      printf("Unable to create output file helper\n");
+      return 1;
+    }
+    printf("- Output files prepared and closed by a helper thread - sync on close %d\n",Config->file_sync_close);
+  }
 
-  outEvtBuffer = (char *)malloc(maxPEvtSize);
-  if (outEvtBuffer == NULL) {
-    printf("Unable to allocate output event buffer of size %d\n",maxPEvtSize);
+  // Output files are preallocated (by the helper thread if used) and written back in chunks
+  if ( strcmp(Config->output_mode,"FILE")==0 ) {
+    if (outWriter) {
+      async_writer_set_write_back(outWriter,Config->file_prealloc ? Config->file_max_size : 0,
+				  Config->file_flush_size,Config->file_sync_close);
+      if ( async_writer_set_direct(outWriter,Config->output_writer_direct) ) return 1;
+      if (Config->output_writer_direct) printf("- Output files written with O_DIRECT\n");
+    } else {
+      output_buffer_set_write_back(outBuffer,( Config->file_prealloc && outRotator == NULL ) ? Config->file_max_size : 0,
+				   Config->file_flush_size);
+    }
+    printf("- Output files preallocation %d - written back every %u bytes (0: by the kernel)\n",
+	   Config->file_prealloc,Config->file_flush_size);
+    // Events of each output file are indexed in a sidecar file
+    if (Config->file_index) {
+      outIndex = event_index_create(EVENT_INDEX_BUFFER);
+      if (outIndex == NULL) {
+	printf("Unable to create event index\n");
+	return 1;
+      }
+      printf("- Events of each output file indexed in '<file>%s'\n",EVENT_INDEX_SUFFIX);
+    }
+  }
+
+  // Select the zero suppression kernels
+  zsup_algorithm_init();
+  printf("- Zero suppression uses %s kernels\n",zsup_algorithm_name());
+
+  // With several zero suppression threads, events are handled in batches
+  nZsupThreads = Config->zsup_threads;
+  if (nZsupThreads == 0 || nZsupThreads > ZSUP_MAX_THREADS) {
+    printf("WARNING - zsup_threads %u not in [1,%d]: setting it to 1\n",nZsupThreads,ZSUP_MAX_THREADS);
+    nZsupThreads = 1;
+  }
+  zsupBatch = (nZsupThreads > 1) ? nZsupThreads*ZSUP_EVENTS_PER_THREAD : 1;
+  ZsupBatch = (zsup_event_t*)calloc(zsupBatch,sizeof(zsup_event_t));
+  if (ZsupBatch == NULL) {
+    printf("Unable to allocate zero suppression batch of %u events\n",zsupBatch);
     return 1;
   }
-  printf("- Allocated output event buffer with size %d\n",maxPEvtSize);
+  for(iEv=0;iEv<zsupBatch;iEv++) {
+    ZsupBatch[iEv].head = (char *)malloc(PEVT_HEADER_LEN*4);
+    if (ZsupBatch[iEv].head == NULL) {
+      printf("Unable to allocate output header buffer of size %d\n",PEVT_HEADER_LEN*4);
+      return 1;
+    }
+  }
+  ZsupPool = pool_create(nZsupThreads,Config->zsup_pin_cpus,ZSUP_zsup_event,NULL);
+  if (ZsupPool == NULL) {
+    printf("Unable to create zero suppression pool with %u workers\n",nZsupThreads);
+    return 1;
+  }
+  printf("- Started zero suppression pool with %u worker(s)%s - %u events per batch\n",
+	 nZsupThreads,Config->zsup_pin_cpus ? " pinned to cpus" : "",zsupBatch);
 
   // Zero counters
   totalReadSize = 0;
   totalReadEvents = 0;
+  totalMissingEvents = 0;
   totalWriteSize = 0;
   totalWriteEvents = 0;
 
@@ -109,6 +364,7 @@ int ZSUP_readdata ()
   tooManyOutputFiles = 0;
 
   // We have to open the output file first to avoid network-related lock-ups
+  time(&t_daqstart);
 
   if ( strcmp(Config->output_mode,"FILE")==0 ) {
 
@@ -131,7 +387,11 @@ int ZSUP_readdata ()
   // Open output file
   if ( strcmp(Config->output_mode,"FILE")==0 ) {
     printf("- Opening output file %d with path '%s'\n",fileIndex,pathName[fileIndex]);
-    outFileHandle = open(pathName[fileIndex],O_WRONLY | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+    if (outRotator) {
+      outFileHandle = file_rotator_open(outRotator,pathName[fileIndex]);
+    } else {
+      outFileHandle = open(pathName[fileIndex],O_WRONLY | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+    }
   } else {
     printf("- Opening output stream '%s'\n",pathName[fileIndex]);
     outFileHandle = open(pathName[fileIndex],O_WRONLY);
@@ -140,31 +400,68 @@ int ZSUP_readdata ()
     printf("ERROR - Unable to open file '%s' for writing.\n",pathName[fileIndex]);
     return 2;
   }
+  output_buffer_set_fd(outBuffer,outFileHandle);
+  if ( outIndex && event_index_open(outIndex,pathName[fileIndex]) ) {
+    printf("ERROR - Unable to create index of output file '%s'.\n",pathName[fileIndex]);
+    return 2;
+  }
 
   // Create initok file to tell RunControl that we are ready
   if ( create_initok_file() ) return 1;
 
   // Open virtual file for input data stream (will wait for DAQ to start before proceeding)
-  printf("- Opening input stream from file '%s'\n",Config->input_stream);
-  inFileHandle = open(Config->input_stream,O_RDONLY, S_IRUSR | S_IWUSR);
-  if (inFileHandle == -1) {
-    printf("ERROR - Unable to open input stream '%s' for reading.\n",Config->input_stream);
-    return 1;
+  if ( strncmp(Config->input_stream,SHM_STREAM_PREFIX,strlen(SHM_STREAM_PREFIX))==0 ) {
+    printf("- Attaching to shared memory ring '%s'\n",Config->input_stream+strlen(SHM_STREAM_PREFIX));
+    while ( (inRing = shm_ring_open(Config->input_stream+strlen(SHM_STREAM_PREFIX))) == NULL ) {
+      if (BreakSignal) {
+	printf("ERROR - Interrupted while waiting for shared memory ring '%s'.\n",Config->input_stream);
+	return 1;
+      }
+      usleep(1000);
+    }
+  } else {
+    printf("- Opening input stream from file '%s'\n",Config->input_stream);
+    inStream = stream_reader_open(Config->input_stream,ZSUP_INPUT_BUFFER_SIZE,ZSUP_INPUT_PIPE_SIZE);
+    if (inStream == NULL) {
+      printf("ERROR - Unable to open input stream '%s' for reading.\n",Config->input_stream);
+      return 1;
+    }
+  }
+
+  // A record of the input stream is only valid until the next one is read: unless the whole input file
+  // is mapped in memory, events of a batch are copied
+  zsupCopy = ( zsupBatch > 1 && ! (inStream && inStream->mapped) );
+  if (zsupCopy) {
+    for(iEv=0;iEv<zsupBatch;iEv++) {
+      ZsupBatch[iEv].buf = (char *)malloc(maxPEvtSize);
+      if (ZsupBatch[iEv].buf == NULL) {
+	printf("Unable to allocate input event buffer of size %d\n",maxPEvtSize);
+	return 1;
+      }
+    }
+    printf("- Events of each batch copied from the input stream\n");
   }
 
   time(&t_daqstart);
   printf("%s - Zero suppression started\n",format_time(t_daqstart));
 
+  // Clear latency histograms
+  histo_init(&HRead,"read","ns");
+  histo_init(&HZsup,"zero supp.","ns");
+  histo_init(&HWrite,"write","ns");
+  histo_init(&HRotate,"file change","ns");
+  t_latencyreport = t_daqstart;
+
   // Read file header (4 words) from input stream
-  readSize = read(inFileHandle,inEvtBuffer,16);
-  if (readSize != 16) {
+  inEvt = ZSUP_read_record(inStream,inRing,maxPEvtSize,&readSize);
+  if (inEvt == NULL || readSize != 16) {
     printf("ERROR - Unable to read header from input stream\n");
     return 2;
   }
   totalReadSize += readSize;
 
   // First line: tag,version,index
-  line = (unsigned int *)(inEvtBuffer+0);
+  line = (unsigned int *)(inEvt+0);
   unsigned int tag = (*line >> 28) & 0xF;
   if (tag != 0X9) {
     printf("ERROR - File does not start with the right tag - Expected 0x9 - Found 0x%1X\n",tag);
@@ -184,14 +481,14 @@ int ZSUP_readdata ()
 
   // Second line: run number
   int run_number;
-  memcpy(&run_number,inEvtBuffer+4,4);
+  memcpy(&run_number,inEvt+4,4);
   if ( run_number != Config->run_number ) {
     printf("WARNING - Run number from stream not consistent with that from configuration: stream %d config %d\n",run_number,Config->run_number);
   }
   printf("- Run number %d\n",run_number);
 
   // Third line: board_id and board serial number (save it to DB)
-  line = (unsigned int *)(inEvtBuffer+8);
+  line = (unsigned int *)(inEvt+8);
   int board_id = ( (*line & 0xff000000) >> 24 );
   unsigned int board_sn = (*line & 0x00ffffff);
   printf("- Board id %d S/N %u\n",board_id,board_sn);
@@ -201,7 +498,7 @@ int ZSUP_readdata ()
 
   // Fourth line: start of file time tag
   unsigned int start_time;
-  memcpy(&start_time,inEvtBuffer+12,4);
+  memcpy(&start_time,inEvt+12,4);
   printf("- Start time %s\n",format_time(start_time));
 
   // Now that we have a recognized input stream we can register the output file in the DB and send it the header
@@ -251,115 +548,125 @@ int ZSUP_readdata ()
   fileSize[fileIndex] = 0;
   fileEvents[fileIndex] = 0;
   
-  // Write header to file
-  fHeadSize = create_file_head(fileIndex,run_number,board_id,board_sn,fileTOpen[fileIndex],(void *)outEvtBuffer);
-  writeSize = write(outFileHandle,outEvtBuffer,fHeadSize);
-  if (writeSize != fHeadSize) {
-    printf("ERROR - Unable to write file header to file. Header size: %u, Write result: %u\n",
-	   fHeadSize,writeSize);
-    return 2;
+  // Write header to file (the asynchronous writer takes over the output file and writes it itself)
+  if (outWriter) {
+    n = async_writer_open(outWriter,NULL,outFileHandle,0,fileIndex,run_number,board_id,board_sn,fileTOpen[fileIndex]);
+    if (n < 0) {
+      printf("ERROR - Unable to write file header to file.\n");
+      return 2;
+    }
+    fHeadSize = n;
+  } else {
+    fHeadSize = create_file_head(fileIndex,run_number,board_id,board_sn,fileTOpen[fileIndex],(void *)outEvtBuffer);
+    if ( output_buffer_write(outBuffer,outEvtBuffer,fHeadSize,0) ) {
+      printf("ERROR - Unable to write file header to file. Header size: %u\n",fHeadSize);
+      return 2;
+    }
   }
-  totalWriteSize += writeSize;
+  totalWriteSize += fHeadSize;
   fileSize[fileIndex] += fHeadSize;
 
-  // Main loop
+  // Main loop: events are read in batches, zero suppressed by the pool workers, and written in their original order
   int inputStreamEnd = 0;
-  while (inputStreamEnd == 0) {
+  nBatch = 0;
+  iEv = 0;
+  while (inputStreamEnd == 0 || iEv < nBatch) {
 
-    // Read first line of next event
-    readSize = read(inFileHandle,inEvtBuffer,4);
-    if (readSize != 4) {
-      printf("ERROR - Unable to read first line of event from stream.\n");
-      return 2;
-    }
-    totalReadSize += readSize;
-    line = (unsigned int *)(inEvtBuffer+0);
-    unsigned int tag = (*line >> 28) & 0xF;
+    // All events of the batch were written: read the next batch
+    // The batch is closed as soon as the next record is not yet available, so that events are not held back
+    if (iEv == nBatch) {
 
-    // Check if this is a file tail tag
-    if (tag == 0x5) {
+      nBatch = 0;
+      iEv = 0;
+      while ( inputStreamEnd == 0 && nBatch < zsupBatch && (nBatch == 0 || ZSUP_record_ready(inStream,inRing)) ) {
 
-      // File tail reached: read final information and exit
+	// Read next event (or file tail)
+	t0 = histo_time();
+	inEvt = ZSUP_read_record(inStream,inRing,maxPEvtSize,&readSize);
+	histo_fill(&HRead,histo_time()-t0);
+	if (inEvt == NULL) return 2;
+	totalReadSize += readSize;
+	line = (unsigned int *)(inEvt+0);
+	unsigned int tag = (*line >> 28) & 0xF;
 
-      // First line of file tail contains tag and number of events
-      unsigned int nInEvents = *line & 0x0FFFFFFF;
+	// Check if this is a file tail tag
+	if (tag == 0x5) {
 
-      // Read remaining 3 words of file tail
-      readSize = read(inFileHandle,inEvtBuffer+4,12);
-      if (readSize != 12) {
-	printf("ERROR - Unable to read final part of tail from stream.\n");
-	return 2;
-      }
-      totalReadSize += readSize;
+	  // File tail reached: read final information and exit
 
-      // Second and third lines of file tail contain the total size of the input file
-      unsigned long int eofFileSize;
-      memcpy(&eofFileSize,inEvtBuffer+4,8);
+	  // First line of file tail contains tag and number of events
+	  unsigned int nInEvents = *line & 0x0FFFFFFF;
 
-      // Fourth line of file tail contains the end of file time tag
-      unsigned int eofTimeTag;
-      memcpy(&eofTimeTag,inEvtBuffer+12,4);
+	  // Second and third lines of file tail contain the total size of the input file
+	  unsigned long int eofFileSize;
+	  memcpy(&eofFileSize,inEvt+4,8);
 
-      // Print report about input stream
-      printf("- Reached tail of stream - Events %u Size %lu Time %s\n",nInEvents,eofFileSize,format_time(eofTimeTag));
+	  // Fourth line of file tail contains the end of file time tag
+	  unsigned int eofTimeTag;
+	  memcpy(&eofTimeTag,inEvt+12,4);
 
-      inputStreamEnd = 1;
-      continue;
+	  // Print report about input stream
+	  printf("- Reached tail of stream - Events %u Size %lu Time %s\n",nInEvents,eofFileSize,format_time(eofTimeTag));
 
-    }
+	  inputStreamEnd = 1;
+	  break;
 
-    // Check if this is an event tag
-    if (tag != 0XE) {
-      printf("ERROR - Event does not start with the right tag - Expected 0xE or 0x5 - Found 0x%1X\n",tag);
-      return 2;
-    }
+	}
 
-    // Get size of event and read the full event in the input buffer
-    inputEventSize = 4*(*line & 0x0FFFFFFF);
-    readSize = read(inFileHandle,inEvtBuffer+4,inputEventSize-4); // First 4 bytes already read
-    if (readSize != inputEventSize-4) {
-      printf("ERROR - Unable to read final part of event from stream.\n");
-      return 2;
-    }
-    totalReadSize += readSize;
-    totalReadEvents++;
+	// Check if this is an event tag
+	if (tag != 0XE) {
+	  printf("ERROR - Event does not start with the right tag - Expected 0xE or 0x5 - Found 0x%1X\n",tag);
+	  return 2;
+	}
+
+	totalReadEvents++;
+	e = &ZsupBatch[nBatch++];
+	e->number = totalReadEvents;
+	e->inSize = readSize;
+	if (zsupCopy) {
+	  memcpy(e->buf,inEvt,readSize);
+	  e->in = e->buf;
+	} else {
+	  e->in = inEvt;
+	}
 
-    if ( (Config->zero_suppression % 100) == 0 ) {
+	// Check if event data are missing (bit 3 of status)
+	line = (unsigned int *)(e->in+8);
+	missingEvent = (*line >> (22+PEVT_STATUS_MISSING_BIT)) & 0x1;
+	if (missingEvent) totalMissingEvents++;
 
-      // If zero suppression is switched off, we just send input event to output
-      outputEventSize = inputEventSize;
-      outputEventBuffer = inEvtBuffer;
+	// If zero suppression is switched off or event has no data, we just send input event to output
+	e->zsup = ( (Config->zero_suppression % 100) != 0 && ! missingEvent );
+	if (e->zsup) {
 
-      //// Even if zero suppression is off, show we are alive
-      ////if (totalReadEvents % 100 == 0) {
-      //if (totalReadEvents % Config->debug_scale == 0) {
-      //	printf("Event %7d\tZero suppression OFF\n",totalReadEvents);
-      //}
+	  // Extract 0-suppression configuration
+	  e->zsupMode = (Config->zero_suppression / 100) & 0x1; // 0=rejction, 1=flagging
+	  e->zsupAlgr = (Config->zero_suppression % 100) & 0xF; // 0=off, 1-15=algorithm code
 
-    } else {
+	  // If Autopass flag (bit 4 of status) is on, force zero suppression to flagging mode
+	  unsigned short int status = (*line >> 22) & 0x03FF;
+	  if ( status & 0x0010 ) e->zsupMode = 1;
 
-      // Extract 0-suppression configuration
-      //printf("Config-zero_suppression is %u\n",Config->zero_suppression);
-      unsigned int zsupMode = (Config->zero_suppression / 100) & 0x1; // 0=rejction, 1=flagging
-      unsigned int zsupAlgr = (Config->zero_suppression % 100) & 0xF; // 0=off, 1-15=algorithm code
-      //printf("Entering zsup with mode %u algorithm %u\n",zsupMode,zsupAlgr);
+	}
 
-      // If Autopass flag (bit 4 of status) is on, force zero suppression to flagging mode
-      line = (unsigned int *)(inEvtBuffer+8);
-      unsigned short int status = (*line >> 22) & 0x03FF;
-      if ( status & 0x0010 ) zsupMode = 1;
+      }
 
-      // Apply zero suppression algorithm
-      //printf("Calling apply_zero_suppression with mode %u algorithm %u\n",zsupMode,zsupAlgr);
-      outputEventSize = apply_zero_suppression(zsupMode,zsupAlgr,(void *)inEvtBuffer,(void *)outEvtBuffer);
-      outputEventBuffer = outEvtBuffer;
+      // Apply zero suppression algorithm to all events of the batch
+      if ( nBatch && pool_run(ZsupPool,nBatch) ) return 2;
+      if (nBatch == 0) continue;
 
     }
+
+    // Get next event of the batch
+    e = &ZsupBatch[iEv++];
+    if (e->zsup) histo_fill(&HZsup,e->tZsup);
+    outputEventSize = e->outSize;
+    outputEventBuffer = (char *)e->iov[0].iov_base;
 	  
     // Write event header to debug info once in a while
-    if ( (totalReadEvents % Config->debug_scale) == 0 ) {
+    if ( (e->number % Config->debug_scale) == 0 ) {
       unsigned char i,j;
-      printf("- Event %7d - Header",totalReadEvents);
+      printf("- Event %7d - Header",e->number);
       for (i=0;i<6;i++) {
 	printf(" %1d(",i);
 	for (j=0;j<4;j++) { printf("%02x",(unsigned char)(outputEventBuffer[i*4+3-j])); }
@@ -369,14 +676,15 @@ int ZSUP_readdata ()
     }
 
     // Write data to output file
-    writeSize = write(outFileHandle,outputEventBuffer,outputEventSize);
-    if (writeSize != outputEventSize) {
-      printf("ERROR - Unable to write event data to output file. Event size: %u, Write result: %u\n",
-	     outputEventSize,writeSize);
+    t0 = histo_time();
+    if ( output_buffer_writev(outBuffer,e->iov,e->iovCnt,1) ) {
+      printf("ERROR - Unable to write event data to output file. Event size: %u\n",outputEventSize);
       return 2;
     }
-    fileSize[fileIndex] += writeSize;
-    totalWriteSize += writeSize;
+    histo_fill(&HWrite,histo_time()-t0);
+    if ( outIndex && event_index_add(outIndex,outputEventBuffer,fileSize[fileIndex]) ) return 2;
+    fileSize[fileIndex] += outputEventSize;
+    totalWriteSize += outputEventSize;
     fileEvents[fileIndex]++;
     totalWriteEvents++;
 
@@ -393,20 +701,31 @@ int ZSUP_readdata ()
 
 	// Register file closing time
 	fileTClose[fileIndex] = t_now;
+	t0 = histo_time();
+	if ( outIndex && event_index_close(outIndex) ) {
+	  printf("ERROR - Unable to write index of output file '%s'.\n",pathName[fileIndex]);
+	  return 2;
+	}
 
 	// Write tail to file
-	fTailSize = create_file_tail(fileEvents[fileIndex],fileSize[fileIndex],fileTClose[fileIndex],(void *)outEvtBuffer);
-	writeSize = write(outFileHandle,outEvtBuffer,fTailSize);
-	if (writeSize != fTailSize) {
-	  printf("ERROR - Unable to write file header to output file. Tail size: %u, Write result: %u\n",
-		 fTailSize,writeSize);
-	  return 2;
+	if (outWriter) {
+	  if ( output_buffer_flush(outBuffer) || (n = async_writer_close(outWriter,fileTClose[fileIndex])) < 0 ) {
+	    printf("ERROR - Unable to write file tail to output file.\n");
+	    return 2;
+	  }
+	  fTailSize = n;
+	} else {
+	  fTailSize = create_file_tail(fileEvents[fileIndex],fileSize[fileIndex],fileTClose[fileIndex],(void *)outEvtBuffer);
+	  if ( output_buffer_write(outBuffer,outEvtBuffer,fTailSize,0) || output_buffer_end_file(outBuffer) ) {
+	    printf("ERROR - Unable to write file tail to output file. Tail size: %u\n",fTailSize);
+	    return 2;
+	  }
 	}
-	fileSize[fileIndex] += writeSize;
-	totalWriteSize += writeSize;
+	fileSize[fileIndex] += fTailSize;
+	totalWriteSize += fTailSize;
 
 	// Close old output file and show some info about counters
-	if (close(outFileHandle) == -1) {
+	if ( outWriter == NULL && (outRotator ? file_rotator_close(outRotator,outFileHandle) : close(outFileHandle)) ) {
 	  printf("ERROR - Unable to close output file '%s'.\n",fileName[fileIndex]);
 	  return 2;
 	};
@@ -428,35 +747,67 @@ int ZSUP_readdata ()
 	  strcpy(pathName[fileIndex],Config->data_dir);
 	  strcat(pathName[fileIndex],fileName[fileIndex]);
 	  printf("- Opening output file %d with path '%s'\n",fileIndex,pathName[fileIndex]);
-	  outFileHandle = open(pathName[fileIndex],O_WRONLY | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
-	  if (outFileHandle == -1) {
-	    printf("ERROR - Unable to open file '%s' for writing.\n",pathName[fileIndex]);
-	    return 2;
-	  }
 	  fileTOpen[fileIndex] = t_now;
 	  fileSize[fileIndex] = 0;
 	  fileEvents[fileIndex] = 0;
-
-	  // Write header to file
-	  fHeadSize = create_file_head(fileIndex,run_number,board_id,board_sn,fileTOpen[fileIndex],(void *)outEvtBuffer);
-	  writeSize = write(outFileHandle,outEvtBuffer,fHeadSize);
-	  if (writeSize != fHeadSize) {
-	    printf("ERROR - Unable to write file header to file. Header size: %u, Write result: %u\n",
-		   fHeadSize,writeSize);
+	  if ( outIndex && event_index_open(outIndex,pathName[fileIndex]) ) {
+	    printf("ERROR - Unable to create index of output file '%s'.\n",pathName[fileIndex]);
 	    return 2;
 	  }
-	  fileSize[fileIndex] += writeSize;
+
+	  if (outWriter) {
+
+	    // File is created and its header written by the asynchronous writer
+	    n = async_writer_open(outWriter,pathName[fileIndex],-1,0,fileIndex,run_number,board_id,board_sn,fileTOpen[fileIndex]);
+	    if (n < 0) {
+	      printf("ERROR - Unable to open file '%s' for writing.\n",pathName[fileIndex]);
+	      return 2;
+	    }
+	    fHeadSize = n;
+
+	  } else {
+
+	    if (outRotator) {
+	      outFileHandle = file_rotator_open(outRotator,pathName[fileIndex]);
+	    } else {
+	      outFileHandle = open(pathName[fileIndex],O_WRONLY | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+	    }
+	    if (outFileHandle == -1) {
+	      printf("ERROR - Unable to open file '%s' for writing.\n",pathName[fileIndex]);
+	      return 2;
+	    }
+	    output_buffer_set_fd(outBuffer,outFileHandle);
+
+	    // Write header to file
+	    fHeadSize = create_file_head(fileIndex,run_number,board_id,board_sn,fileTOpen[fileIndex],(void *)outEvtBuffer);
+	    if ( output_buffer_write(outBuffer,outEvtBuffer,fHeadSize,0) ) {
+	      printf("ERROR - Unable to write file header to file. Header size: %u\n",fHeadSize);
+	      return 2;
+	    }
+
+	  }
+	  fileSize[fileIndex] += fHeadSize;
 
 	} else {
 
 	  tooManyOutputFiles = 1;
 
 	}
+	histo_fill(&HRotate,histo_time()-t0);
 
       }
 
     }
 
+    // Report latency histograms once in a while
+    if ( Config->latency_report_time && (e->number % Config->debug_scale) == 0 ) {
+      time(&t_now);
+      if ( t_now-t_latencyreport >= Config->latency_report_time ) {
+	ZSUP_latency_report(t_now,0);
+	t_latencyreport = t_now;
+      }
+    }
+
     // Check if it is time to stop DAQ (user interrupt, too many output files)
     if ( BreakSignal || tooManyOutputFiles ) break;
 
@@ -472,32 +823,54 @@ int ZSUP_readdata ()
 
   // Close input stream file
   printf("- Closing input stream.\n");
-  if (close(inFileHandle) == -1) {
-    printf("ERROR - Unable to close input stream '%s'.\n",Config->input_stream);
-    return 2;
-  };
+  if (inRing) {
+    printf("- Shared memory ring: %llu records read - ring empty %llu times\n",(unsigned long long)inRing->n_records,(unsigned long long)inRing->n_waits);
+    shm_ring_close(inRing);
+  } else {
+    printf("- Input stream: %llu bytes read with %llu reads - %llu short reads - buffer compacted %llu times\n",
+	   (unsigned long long)inStream->n_bytes,(unsigned long long)inStream->n_reads,(unsigned long long)inStream->n_short,(unsigned long long)inStream->n_compact);
+    stream_reader_close(inStream);
+  }
 
   // If ZSUP was stopped for writing too many output files, we do not have to close the last file
   if ( ! tooManyOutputFiles ) {
 
     // Register file closing time
     fileTClose[fileIndex] = t_now;
+    if ( outIndex && event_index_close(outIndex) ) {
+      printf("ERROR - Unable to write index of output file '%s'.\n",pathName[fileIndex]);
+      return 2;
+    }
 
     // Write tail to file
-    fTailSize = create_file_tail(fileEvents[fileIndex],fileSize[fileIndex],fileTClose[fileIndex],(void *)outEvtBuffer);
-    writeSize = write(outFileHandle,outEvtBuffer,fTailSize);
-    if (writeSize != fTailSize) {
-      printf("ERROR - Unable to write file tail to file. Tail size: %u, Write result: %u\n",
-    	     fTailSize,(unsigned int)writeSize);
-      return 2;
+    if (outWriter) {
+      if ( output_buffer_flush(outBuffer) || (n = async_writer_close(outWriter,fileTClose[fileIndex])) < 0 ) {
+	printf("ERROR - Unable to write file tail to file.\n");
+	return 2;
+      }
+      fTailSize = n;
+    } else {
+      fTailSize = create_file_tail(fileEvents[fileIndex],fileSize[fileIndex],fileTClose[fileIndex],(void *)outEvtBuffer);
+      if ( output_buffer_write(outBuffer,outEvtBuffer,fTailSize,0) || output_buffer_end_file(outBuffer) ) {
+	printf("ERROR - Unable to write file tail to file. Tail size: %u\n",fTailSize);
+	return 2;
+      }
     }
-    fileSize[fileIndex] += writeSize;
+    fileSize[fileIndex] += fTailSize;
 
-    // Close output file and show some info about counters
-    if (close(outFileHandle) == -1) {
+    // Close output file (the asynchronous writer closes it after writing all data) and show some info about counters
+    if ( outWriter && async_writer_sync(outWriter) ) {
+      printf("ERROR - Asynchronous writer failed: output files are incomplete\n");
+      return 2;
+    }
+    if ( outWriter == NULL && (outRotator ? file_rotator_close(outRotator,outFileHandle) : close(outFileHandle)) ) {
       printf("ERROR - Unable to close output file '%s'.\n",fileName[fileIndex]);
       return 2;
     };
+    if ( outRotator && file_rotator_sync(outRotator) ) {
+      printf("ERROR - Output file helper failed: output files are incomplete\n");
+      return 2;
+    }
     if ( strcmp(Config->output_mode,"FILE")==0 ) {
       printf("%s - Closed output file '%s' after %d secs with %u events and size %lu bytes\n",
 	     format_time(t_now),pathName[fileIndex],(int)(fileTClose[fileIndex]-fileTOpen[fileIndex]),
@@ -516,9 +889,28 @@ int ZSUP_readdata ()
   time(&t_daqstop);
   printf("%s - Zero suppression stopped\n",format_time(t_daqstop));
 
-  // Deallocate input/output event buffer
-  free(inEvtBuffer);
+  // Stop zero suppression workers and deallocate batch, output event and output buffers
+  pool_destroy(ZsupPool);
+  for(iEv=0;iEv<zsupBatch;iEv++) {
+    free(ZsupBatch[iEv].head);
+    free(ZsupBatch[iEv].buf);
+  }
+  free(ZsupBatch);
   free(outEvtBuffer);
+  output_buffer_report(outBuffer,"stream");
+  output_buffer_destroy(outBuffer);
+  if (outWriter) {
+    async_writer_report(outWriter,"stream");
+    async_writer_destroy(outWriter);
+  }
+  if (outRotator) {
+    file_rotator_report(outRotator,"stream");
+    file_rotator_destroy(outRotator);
+  }
+  if (outIndex) {
+    event_index_report(outIndex,"stream");
+    event_index_destroy(outIndex);
+  }
 
   // Give some final report
   evtReadPerSec = 0.;
@@ -535,6 +927,7 @@ int ZSUP_readdata ()
   printf("\n=== ZSUP ending on %s ===\n",format_time(t_daqstop));
   printf("Total running time: %d secs\n",(int)t_daqtotal);
   printf("Total number of events read: %u - %6.2f events/s\n",totalReadEvents,evtReadPerSec);
+  printf("Total number of events without data: %u\n",totalMissingEvents);
   printf("Total size of data read: %lu B - %6.2f KB/s\n",totalReadSize,sizeReadPerSec);
   printf("Total number of events written: %u - %6.2f events/s\n",totalWriteEvents,evtWritePerSec);
   printf("Total size of data written: %lu B - %6.2f KB/s\n",totalWriteSize,sizeWritePerSec);
@@ -547,12 +940,28 @@ int ZSUP_readdata ()
     }
   }
   printf("=========================================================\n");
+  ZSUP_latency_report(t_daqstop,1);
+  printf("=========================================================\n");
 
   return 0;
 
 }
 
-unsigned int apply_zero_suppression (unsigned int zsupMode, unsigned int zsupAlgr, void *inBuff,void *outBuff)
+// Add a section of the input event to the output vector, merging it with the previous one if they are contiguous
+static inline void ZSUP_add_iovec(struct iovec *iov, int *iovcnt, void *base, size_t len)
+{
+  if ( *iovcnt && iov[*iovcnt-1].iov_base+iov[*iovcnt-1].iov_len == base ) {
+    iov[*iovcnt-1].iov_len += len;
+  } else {
+    iov[*iovcnt].iov_base = base;
+    iov[*iovcnt].iov_len = len;
+    (*iovcnt)++;
+  }
+}
+
+// Only the event header is written to outBuff: trigger groups and accepted channels are not copied but
+// referenced in the output vector iov, which points to outBuff and to sections of inBuff
+unsigned int apply_zero_suppression (unsigned int zsupMode, unsigned int zsupAlgr, void *inBuff,void *outBuff, struct iovec *iov, int *iovcnt)
 {
   unsigned int *line;
   unsigned int outLine;
@@ -597,6 +1006,7 @@ unsigned int apply_zero_suppression (unsigned int zsupMode, unsigned int zsupAlg
   // Input line is copied to output after setting the zero suppression bit in the status mask
   line = (unsigned int *)(inCursor);
   //unsigned int eventNumber = *line & 0x003FFFFF;
+  unsigned int inStatusLine = *line;
   outLine = (*line & 0xFEFFFFFF) + (zsupMode << 24);
   memcpy(outCursor,&outLine,4);
 
@@ -617,9 +1027,11 @@ unsigned int apply_zero_suppression (unsigned int zsupMode, unsigned int zsupAlg
   inCursor += 4; outCursor += 4; // Move to sixth line
 
   // Sixth line contains the accepted channel mask
-  // Input accepted channel mask is ignored (should be identical to active channel mask)
+  // If zero suppression was already applied in rejection mode by DAQ, only accepted channels are present
+  // in input, otherwise the input accepted channel mask is ignored (should be identical to active channel mask)
   // Output accepted channel mask will be defined after applying zero suppression
-  // ...hence not much to do here...
+  line = (unsigned int *)(inCursor);
+  unsigned int presentChannelMask = (inStatusLine & 0x01000000) ? activeChannelMask : *line;
 
   // ...just move to beginning of trigger group section
   inCursor += 4; outCursor += 4;
@@ -627,22 +1039,26 @@ unsigned int apply_zero_suppression (unsigned int zsupMode, unsigned int zsupAlg
   // Event header is over: add size of event header to event size counters...
   inSize += 6; outSize += 6;
 
+  // ...and start output vector with the new event header
+  *iovcnt = 0;
+  ZSUP_add_iovec(iov,iovcnt,outStart,outCursor-outStart);
+
   // Get number of trigger groups from group mask
   unsigned int nGroups = ( (groupMask >> 0) && 0x1 ) + ( (groupMask >> 1) && 0x1 ) + ( (groupMask >> 2) && 0x1 ) + ( (groupMask >> 3) && 0x1 );
   
-  // Copy all triggers to output with no modifications
+  // Send all triggers to output with no modifications
   unsigned int grSize;
   for (i=0;i<nGroups;i++) {
 
     line = (unsigned int *)(inCursor);
     grSize = (*line) & 0x00000FFF;
-    memcpy(outCursor,inCursor,4*grSize);
+    ZSUP_add_iovec(iov,iovcnt,inCursor,4*grSize);
 
     // Add size of trigger group to event size counters
     inSize += grSize; outSize += grSize;
 
     // Jump to next group section
-    inCursor += 4*grSize; outCursor += 4*grSize;
+    inCursor += 4*grSize;
 
   }
 
@@ -656,31 +1072,31 @@ unsigned int apply_zero_suppression (unsigned int zsupMode, unsigned int zsupAlg
     bCh = (1 << iCh); // Bit pattern for this channel
 
     // Check if channel was acquired
-    if (activeChannelMask & bCh) {
+    if (presentChannelMask & bCh) {
 
       // Call required zero suppression algorithm for this channel
-      // The function MUST copy the 1024 16bit samples from the input buffer to the output buffer
-      // while applying its zero suppression algorithm
+      // The function reads the 1024 16bit samples in place from the input buffer
       // WARNING: if required algorithm is unknown then channel is accepted!
       accept = 1;
       if ( zsupAlgr == 1 ) {
-	accept = zsup_algorithm_1(inCursor,outCursor); // Channel number not needed
+	accept = zsup_algorithm_1(inCursor); // Channel number not needed
       } else if ( zsupAlgr == 2 ) {
-        accept = zsup_algorithm_2(iCh,inCursor,outCursor);
+        accept = zsup_algorithm_2(iCh,inCursor);
       }
       
       // Tag accepted channels in the accepted channel mask
       if ( accept ) acceptedChannelMask += bCh;
 
-      // Move to next channel
-      inCursor += 1024*2;
-      inSize += 1024/2;
-      // Note: channel is written to output only if accepted or if zero suppression is in tagging mode
+      // Note: channel is sent to output only if accepted or if zero suppression is in tagging mode
       if ( accept || zsupMode == 1 ) {
-	outCursor += 1024*2;
+	ZSUP_add_iovec(iov,iovcnt,inCursor,1024*2);
 	outSize += 1024/2;
       }
 
+      // Move to next channel
+      inCursor += 1024*2;
+      inSize += 1024/2;
+
     }
 
   }
@@ -708,134 +1124,3 @@ unsigned int apply_zero_suppression (unsigned int zsupMode, unsigned int zsupAlg
   return 4*outSize; // Return size of output event (in bytes) to caller
 
 }
-
-unsigned int zsup_algorithm_1(void *inC,void *outC)
-{
-
-  // Initialize some counters
-  float sum = 0.;
-  float sum2 = 0.;
-  float mean = 0.;
-  float rms = 0.;
-  //float thrHi = 8192.;
-  float thrLo = -8192;
-  unsigned int overThr = 0;
-  unsigned int nOverThr = 0;
-  unsigned int nMaxOverThr = 0;
-
-  short s; // Used to store sample values (can be negative due to DRS4 corrections)
-  float fs; // Used to store float version of sample values
-
-  unsigned int cursor = 0; // Point cursor to first sample
-
-  // Loop over 1024 samples
-  unsigned int i;
-  for (i=0;i<1024;i++) {
-
-    // Get value of current sample and copy it to output
-    memcpy(&s,inC+cursor,2);
-    memcpy(outC+cursor,&s,2);
-    fs = (float)s;
-    //if (s<0 || s>4095) printf("\tWARNING %d %f\n",s,fs);
-    //if (fs<0. || fs>4095.) printf("\tWARNING %d %f\n",s,fs);
-
-    // Use the first 80 samples to compute pedestal and sigma pedestal
-    if (i<Config->zs1_head) {
-
-      // Compute sum of samples and sum of squares of samples (used for RMS)
-      sum += fs;
-      sum2 += fs*fs;
-      if ( i == Config->zs1_head-1 ) {
-	mean = sum/Config->zs1_head;
-	rms = sqrt((sum2-sum*mean)/(Config->zs1_head-1));
-	//thrHi = mean+Config->zs1_nsigma*rms;
-	thrLo = mean-Config->zs1_nsigma*rms;
-	//printf("Channel %d mean %f rms %f thrHi %f thrLo %f\n",Ch,mean,rms,thrHi,thrLo);
-      }
-
-    } else if ( i < 1024-Config->zs1_tail ) { // Do not consider final set of samples
-
-      // Get longest set of consecutive samples above threshold
-      if (overThr) {
-	if (fs<thrLo) {
-	  nOverThr++;
-	  if (nOverThr>nMaxOverThr) nMaxOverThr = nOverThr;
-	} else {
-	  overThr = 0;
-	  nOverThr = 0;
-	}
-      } else {
-	if (fs<thrLo) {
-	  overThr = 1;
-	  nOverThr = 1;
-	  if (nOverThr>nMaxOverThr) nMaxOverThr = nOverThr;
-	}
-      }
-
-    }
-
-    // Move to next sample
-    cursor += 2;
-
-  }
-
-  // Channel is accepted if rms is bad or if at least zs1_nabovethr channels are above threshold
-  //if ( (rms>Config->zs1_badrmsthr) ||  (nMaxOverThr>=Config->zs1_nabovethr) ) return 1;
-  if (rms>Config->zs1_badrmsthr) {
-    printf("Accepted for bad RMS\n");
-    return 1;
-  }
-  if (nMaxOverThr>=Config->zs1_nabovethr) return 1;
-
-  printf("Rejected for lack of signal\n");
-  return 0; // Otherwise channel is rejected
-
-}
-
-unsigned int zsup_algorithm_2(unsigned int ch,void *inC,void *outC)
-{
-
-  // Initialize some counters. NB double is needed as sums can exceed 2*10^9
-  double sum  = 0.;
-  double sum2 = 0.;
-  double rms  = 0.;
-
-  short s; // Used to store sample values (can be negative due to DRS4 corrections)
-  double fs; // Used to store float version of sample values
-
-  unsigned int cursor = 0; // Point cursor to first sample
-
-  // Loop over samples skipping last section (noisy)
-  unsigned int i,imax;
-  imax = 1024-Config->zs2_tail;
-  for (i=0;i<1024;i++) {
-
-    // Get value of current sample and copy it to output
-    memcpy(&s,inC+cursor,2);
-    memcpy(outC+cursor,&s,2);
-    //if (s<0 || s>4095) printf("\tWARNING %d\n",s);
-
-    // Compute sum of samples and sum of squares of samples (used for RMS) skipping last section of event
-    if (i<imax) {
-      fs = (double)s;
-      //if (fs<0. || fs>4095.) printf("\tWARNING %d %f\n",s,fs);
-      sum += fs;
-      sum2 += fs*fs;
-    }
-
-    // Move to next sample
-    cursor += 2;
-
-  }
-
-  rms = sqrt((sum2-sum*sum/imax)/(imax-1));
-  //printf("\tch %.2d\t%8.3f\n",ch,rms);
-  if (rms < Config->zs2_minrms_ch[ch]) {
-    //printf("Rejected for low rms\n");
-    return 0;
-  }
-
-  //printf("Accepted for hi rms %8.3f\n",rms);
-  return 1;
-
-}
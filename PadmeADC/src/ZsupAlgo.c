@@ -0,0 +1,373 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "Config.h"
+
+#include "ZsupAlgo.h"
+
+// Vector kernels use GCC vector extensions on vectors of 8 samples. As for the sample conversion kernels
+// (see Convert.c) the same code is compiled for the default target (SSE2 on x86_64, NEON on ARM if enabled
+// with SIMDFLAGS in the Makefile) and, on x86, also for AVX2: the AVX2 version is used only if the cpu supports it.
+#if defined(__SSE2__)
+#define ZSUP_VECTOR_NAME "sse2"
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#define ZSUP_VECTOR_NAME "neon"
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#define ZSUP_USE_AVX2 1
+#endif
+
+#define ZSUP_N_SAMPLES 1024
+
+typedef unsigned int (*zsup_algorithm_1_t)(void*);
+typedef unsigned int (*zsup_algorithm_2_t)(unsigned int,void*);
+
+// Scalar kernels: reference for the vector ones
+
+static unsigned int zsup_algorithm_1_scalar(void *inC)
+{
+
+  // Initialize some counters
+  float sum = 0.;
+  float sum2 = 0.;
+  float mean = 0.;
+  float rms = 0.;
+  //float thrHi = 8192.;
+  float thrLo = -8192;
+  unsigned int overThr = 0;
+  unsigned int nOverThr = 0;
+  unsigned int nMaxOverThr = 0;
+
+  short s; // Used to store sample values (can be negative due to DRS4 corrections)
+  float fs; // Used to store float version of sample values
+
+  unsigned int cursor = 0; // Point cursor to first sample
+
+  // Loop over 1024 samples
+  unsigned int i;
+  for (i=0;i<1024;i++) {
+
+    // Get value of current sample
+    memcpy(&s,inC+cursor,2);
+    fs = (float)s;
+    //if (s<0 || s>4095) printf("\tWARNING %d %f\n",s,fs);
+    //if (fs<0. || fs>4095.) printf("\tWARNING %d %f\n",s,fs);
+
+    // Use the first 80 samples to compute pedestal and sigma pedestal
+    if (i<Config->zs1_head) {
+
+      // Compute sum of samples and sum of squares of samples (used for RMS)
+      sum += fs;
+      sum2 += fs*fs;
+      if ( i == Config->zs1_head-1 ) {
+	mean = sum/Config->zs1_head;
+	rms = sqrt((sum2-sum*mean)/(Config->zs1_head-1));
+	//thrHi = mean+Config->zs1_nsigma*rms;
+	thrLo = mean-Config->zs1_nsigma*rms;
+	//printf("Channel %d mean %f rms %f thrHi %f thrLo %f\n",Ch,mean,rms,thrHi,thrLo);
+      }
+
+    } else if ( i < 1024-Config->zs1_tail ) { // Do not consider final set of samples
+
+      // Get longest set of consecutive samples above threshold
+      if (overThr) {
+	if (fs<thrLo) {
+	  nOverThr++;
+	  if (nOverThr>nMaxOverThr) nMaxOverThr = nOverThr;
+	} else {
+	  overThr = 0;
+	  nOverThr = 0;
+	}
+      } else {
+	if (fs<thrLo) {
+	  overThr = 1;
+	  nOverThr = 1;
+	  if (nOverThr>nMaxOverThr) nMaxOverThr = nOverThr;
+	}
+      }
+
+    }
+
+    // Move to next sample
+    cursor += 2;
+
+  }
+
+  // Channel is accepted if rms is bad or if at least zs1_nabovethr channels are above threshold
+  //if ( (rms>Config->zs1_badrmsthr) ||  (nMaxOverThr>=Config->zs1_nabovethr) ) return 1;
+  if (rms>Config->zs1_badrmsthr) {
+    //printf("Accepted for bad RMS\n");
+    return 1;
+  }
+  if (nMaxOverThr>=Config->zs1_nabovethr) return 1;
+
+  //printf("Rejected for lack of signal\n");
+  return 0; // Otherwise channel is rejected
+
+}
+
+static unsigned int zsup_algorithm_2_scalar(unsigned int ch,void *inC)
+{
+
+  // Initialize some counters. NB double is needed as sums can exceed 2*10^9
+  double sum  = 0.;
+  double sum2 = 0.;
+  double rms  = 0.;
+
+  short s; // Used to store sample values (can be negative due to DRS4 corrections)
+  double fs; // Used to store float version of sample values
+
+  unsigned int cursor = 0; // Point cursor to first sample
+
+  // Loop over samples skipping last section (noisy)
+  unsigned int i,imax;
+  imax = 1024-Config->zs2_tail;
+  for (i=0;i<1024;i++) {
+
+    // Get value of current sample
+    memcpy(&s,inC+cursor,2);
+    //if (s<0 || s>4095) printf("\tWARNING %d\n",s);
+
+    // Compute sum of samples and sum of squares of samples (used for RMS) skipping last section of event
+    if (i<imax) {
+      fs = (double)s;
+      //if (fs<0. || fs>4095.) printf("\tWARNING %d %f\n",s,fs);
+      sum += fs;
+      sum2 += fs*fs;
+    }
+
+    // Move to next sample
+    cursor += 2;
+
+  }
+
+  rms = sqrt((sum2-sum*sum/imax)/(imax-1));
+  //printf("\tch %.2d\t%8.3f\n",ch,rms);
+  if (rms < Config->zs2_minrms_ch[ch]) {
+    //printf("Rejected for low rms\n");
+    return 0;
+  }
+
+  //printf("Accepted for hi rms %8.3f\n",rms);
+  return 1;
+
+}
+
+#ifdef ZSUP_VECTOR_NAME
+
+typedef int16_t v8i16  __attribute__ ((vector_size (16)));
+typedef int16_t v4i16  __attribute__ ((vector_size (8)));
+typedef int32_t v4i32  __attribute__ ((vector_size (16)));
+typedef int64_t v4i64  __attribute__ ((vector_size (32)));
+
+// Return 1 if len samples contain a run of at least n (>0) consecutive samples <= t
+// The run is found as a window of n samples whose maximum is <= t. Window maxima are built by doubling
+// the window width, then two overlapping windows give the maximum over exactly n samples.
+static inline __attribute__ ((always_inline)) int zsup_find_run(const void *in, unsigned int len, unsigned int n, int16_t t)
+{
+
+  int16_t w[ZSUP_N_SAMPLES];
+  v8i16 a,b,m,acc = { 0 };
+  unsigned int i,d,last;
+
+  memcpy(w,in,len*2);
+
+  // After each pass w[i] is the maximum of the 2d samples starting at i (valid for i <= len-2d)
+  // Each w[i] only depends on samples after it, so the update can be done in place going forward
+  for(d=1;2*d<=n;d*=2) {
+    last = len-2*d;
+    for(i=0;i+7<=last;i+=8) {
+      memcpy(&a,w+i,16);
+      memcpy(&b,w+i+d,16);
+      m = (a > b);
+      a = (a & m) | (b & ~m);
+      memcpy(w+i,&a,16);
+    }
+    for(;i<=last;i++) if (w[i+d] > w[i]) w[i] = w[i+d];
+  }
+
+  // Maximum of n samples starting at i from the two windows of width d starting at i and at i+n-d
+  last = len-n;
+  for(i=0;i+7<=last;i+=8) {
+    memcpy(&a,w+i,16);
+    memcpy(&b,w+i+n-d,16);
+    acc |= ( (a <= t) & (b <= t) );
+  }
+  for(;i<=last;i++) if (w[i] <= t && w[i+n-d] <= t) return 1;
+  for(i=0;i<8;i++) if (acc[i]) return 1;
+  return 0;
+
+}
+
+static inline __attribute__ ((always_inline)) unsigned int zsup_algorithm_1_body(void *inC)
+{
+
+  // Read configuration once. Sample ranges are computed in unsigned arithmetic as in the scalar code
+  unsigned int head = Config->zs1_head;
+  unsigned int stop = 1024-Config->zs1_tail;
+  int nAbove = Config->zs1_nabovethr;
+  float nsigma = Config->zs1_nsigma;
+
+  float sum = 0.;
+  float sum2 = 0.;
+  float mean = 0.;
+  float rms = 0.;
+  float thrLo = -8192;
+  float fs;
+  int16_t s;
+  int16_t t;
+  unsigned int i;
+
+  // Pedestal and rms of the first samples use the same float arithmetic as the scalar code: with float
+  // sums, rms (and thus the threshold) would change if computed with exact sums or in a different order
+  for(i=0;i<head && i<ZSUP_N_SAMPLES;i++) {
+    memcpy(&s,inC+2*i,2);
+    fs = (float)s;
+    sum += fs;
+    sum2 += fs*fs;
+    if ( i == head-1 ) {
+      mean = sum/head;
+      rms = sqrt((sum2-sum*mean)/(head-1));
+      thrLo = mean-nsigma*rms;
+    }
+  }
+
+  // Channel is accepted if rms is bad
+  if (rms>Config->zs1_badrmsthr) return 1;
+
+  // or if there are at least zs1_nabovethr consecutive samples below threshold (scalar code compares unsigned values)
+  if (nAbove == 0) return 1;
+  if (nAbove < 0) return 0;
+  if (stop > ZSUP_N_SAMPLES) stop = ZSUP_N_SAMPLES;
+  if (head >= stop || stop-head < (unsigned int)nAbove) return 0;
+
+  // For integer samples s<thrLo is the same as s<=ceil(thrLo)-1
+  if ( isnan(thrLo) || thrLo <= -32768.f ) return 0;
+  t = (thrLo > 32767.f) ? 32767 : (int)ceilf(thrLo)-1;
+  return zsup_find_run(inC+2*head,stop-head,nAbove,t);
+
+}
+
+static inline __attribute__ ((always_inline)) unsigned int zsup_algorithm_2_body(unsigned int ch,void *inC)
+{
+
+  unsigned int imax = 1024-Config->zs2_tail;
+  unsigned int n = (imax < ZSUP_N_SAMPLES) ? imax : ZSUP_N_SAMPLES;
+  v4i16 sa,sb;
+  v4i32 xa,xb, vsum = { 0 };
+  v4i64 vsum2a = { 0 }, vsum2b = { 0 };
+  int64_t sum,sum2;
+  int16_t s;
+  unsigned int i,l;
+  double rms;
+
+  // Exact sums: sums of 1024 samples fit in int32 lanes, squares are accumulated in int64 lanes
+  for(i=0;i+8<=n;i+=8) {
+    memcpy(&sa,inC+2*i,8);
+    memcpy(&sb,inC+2*i+8,8);
+    xa = __builtin_convertvector(sa,v4i32);
+    xb = __builtin_convertvector(sb,v4i32);
+    vsum += xa+xb;
+    vsum2a += __builtin_convertvector(xa*xa,v4i64);
+    vsum2b += __builtin_convertvector(xb*xb,v4i64);
+  }
+  vsum2a += vsum2b;
+  sum = 0; sum2 = 0;
+  for(l=0;l<4;l++) { sum += vsum[l]; sum2 += vsum2a[l]; }
+  for(;i<n;i++) {
+    memcpy(&s,inC+2*i,2);
+    sum += s;
+    sum2 += (int32_t)s*s;
+  }
+
+  // Sums are exact in double as well, so rms is the same as in the scalar code
+  rms = sqrt(((double)sum2-(double)sum*(double)sum/imax)/(imax-1));
+  return (rms < Config->zs2_minrms_ch[ch]) ? 0 : 1;
+
+}
+
+static unsigned int zsup_algorithm_1_vector(void *inC)
+{
+  return zsup_algorithm_1_body(inC);
+}
+
+static unsigned int zsup_algorithm_2_vector(unsigned int ch,void *inC)
+{
+  return zsup_algorithm_2_body(ch,inC);
+}
+
+#ifdef ZSUP_USE_AVX2
+
+__attribute__ ((target ("avx2"))) static unsigned int zsup_algorithm_1_avx2(void *inC)
+{
+  return zsup_algorithm_1_body(inC);
+}
+
+__attribute__ ((target ("avx2"))) static unsigned int zsup_algorithm_2_avx2(unsigned int ch,void *inC)
+{
+  return zsup_algorithm_2_body(ch,inC);
+}
+
+#endif
+
+#endif
+
+// Kernels in use
+static const char* ZsupName = "scalar";
+static zsup_algorithm_1_t ZsupAlgorithm1 = zsup_algorithm_1_scalar;
+static zsup_algorithm_2_t ZsupAlgorithm2 = zsup_algorithm_2_scalar;
+
+int zsup_algorithm_select(const char* name)
+{
+
+  zsup_algorithm_1_t f1 = NULL;
+  zsup_algorithm_2_t f2 = NULL;
+
+  if ( strcmp(name,"scalar")==0 ) {
+    f1 = zsup_algorithm_1_scalar;
+    f2 = zsup_algorithm_2_scalar;
+#ifdef ZSUP_VECTOR_NAME
+  } else if ( strcmp(name,ZSUP_VECTOR_NAME)==0 ) {
+    f1 = zsup_algorithm_1_vector;
+    f2 = zsup_algorithm_2_vector;
+#ifdef ZSUP_USE_AVX2
+  } else if ( strcmp(name,"avx2")==0 && __builtin_cpu_supports("avx2") ) {
+    f1 = zsup_algorithm_1_avx2;
+    f2 = zsup_algorithm_2_avx2;
+#endif
+#endif
+  }
+  if (f1 == NULL) return 1;
+
+  ZsupName = name;
+  ZsupAlgorithm1 = f1;
+  ZsupAlgorithm2 = f2;
+  return 0;
+
+}
+
+void zsup_algorithm_init()
+{
+  if ( zsup_algorithm_select("avx2")==0 ) return;
+#ifdef ZSUP_VECTOR_NAME
+  if ( zsup_algorithm_select(ZSUP_VECTOR_NAME)==0 ) return;
+#endif
+  zsup_algorithm_select("scalar");
+}
+
+const char* zsup_algorithm_name()
+{
+  return ZsupName;
+}
+
+unsigned int zsup_algorithm_1(void *inC)
+{
+  return ZsupAlgorithm1(inC);
+}
+
+unsigned int zsup_algorithm_2(unsigned int ch,void *inC)
+{
+  return ZsupAlgorithm2(ch,inC);
+}
@@ -0,0 +1,132 @@
+// Check and time the kernels used by create_pevent to round the float samples of CAEN_DGTZ_DecodeEvent to int16.
+// Each kernel supported by the cpu is compared bit by bit with the scalar code on all halfway cases of the
+// int16 range (and their float neighbours) and on random samples, then timed on 1024-sample channels.
+// Usage: ConvertBench.exe [number of iterations]
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <math.h>
+
+#include "Convert.h"
+
+#define BENCH_N_SAMPLES 1024
+#define BENCH_THRESHOLD 0x0400
+
+static const char* BenchKernels[] = { "scalar", "sse2", "neon", "avx2" };
+
+// Reference conversion, as originally done in create_pevent
+static unsigned int bench_reference(const float* in, int16_t* out, unsigned int n, uint32_t thr)
+{
+  unsigned int i,on = 0;
+  int16_t myshort;
+  for(i=0;i<n;i++) {
+    myshort = roundf(in[i]);
+    if (myshort < thr) on++;
+    out[i] = myshort;
+  }
+  return on;
+}
+
+static double bench_now()
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC,&t);
+  return t.tv_sec+t.tv_nsec*1.e-9;
+}
+
+// Compare current kernels with the reference code. Return number of mismatches.
+static unsigned int bench_check(float* in, int16_t* out, int16_t* ref)
+{
+
+  unsigned int i,j,n,on,onRef;
+  unsigned int bad = 0;
+  int k;
+  float h;
+
+  // Halfway cases k+0.5 of the whole int16 range with their float neighbours, one block at a time
+  n = 0;
+  for(k=-32768;k<32767;k++) {
+    h = (float)k+0.5f;
+    in[n++] = nextafterf(h,-INFINITY);
+    in[n++] = h;
+    in[n++] = nextafterf(h,INFINITY);
+    in[n++] = (float)k;
+    if (n+4 > BENCH_N_SAMPLES || k == 32766) {
+      convert_samples(in,out,n);
+      bench_reference(in,ref,n,BENCH_THRESHOLD);
+      if ( memcmp(out,ref,n*2) ) bad++;
+      n = 0;
+    }
+  }
+
+  // Random samples in the ADC range, with all lengths up to one full channel
+  for(j=0;j<BENCH_N_SAMPLES;j++) {
+    for(i=0;i<j;i++) in[i] = (float)(rand()%4096000)/1000.f-(float)(rand()%2)*0.5f;
+    on = convert_trigger(in,out,j,BENCH_THRESHOLD);
+    onRef = bench_reference(in,ref,j,BENCH_THRESHOLD);
+    if ( on != onRef || memcmp(out,ref,j*2) ) bad++;
+    convert_samples(in,out,j);
+    if ( memcmp(out,ref,j*2) ) bad++;
+  }
+
+  return bad;
+
+}
+
+int main(int argc, char* argv[])
+{
+
+  float in[BENCH_N_SAMPLES];
+  int16_t out[BENCH_N_SAMPLES],ref[BENCH_N_SAMPLES];
+  unsigned int i,k,bad,on;
+  unsigned int nIter = 200000;
+  unsigned int failed = 0;
+  double t0,tSamples,tTrigger;
+  volatile unsigned int sink = 0;
+
+  if (argc > 1) nIter = strtoul(argv[1],NULL,10);
+  if (nIter == 0) nIter = 1;
+
+  printf("%-8s %8s %14s %14s\n","kernels","errors","samples ns/ch","trigger ns/ch");
+  for(k=0;k<sizeof(BenchKernels)/sizeof(BenchKernels[0]);k++) {
+
+    if ( convert_select(BenchKernels[k]) ) {
+      printf("%-8s not supported\n",BenchKernels[k]);
+      continue;
+    }
+
+    srand(1);
+    bad = bench_check(in,out,ref);
+    if (bad) failed++;
+
+    // Typical V1742 channel: baseline around 3500 counts with noise
+    for(i=0;i<BENCH_N_SAMPLES;i++) in[i] = 3500.f+(float)(rand()%2000)/100.f;
+
+    t0 = bench_now();
+    for(i=0;i<nIter;i++) {
+      convert_samples(in,out,BENCH_N_SAMPLES);
+      sink += out[i%BENCH_N_SAMPLES];
+    }
+    tSamples = (bench_now()-t0)*1.e9/nIter;
+
+    t0 = bench_now();
+    for(i=0;i<nIter;i++) {
+      on = convert_trigger(in,out,BENCH_N_SAMPLES,BENCH_THRESHOLD);
+      sink += on;
+    }
+    tTrigger = (bench_now()-t0)*1.e9/nIter;
+
+    printf("%-8s %8u %14.1f %14.1f\n",BenchKernels[k],bad,tSamples,tTrigger);
+
+  }
+
+  if (failed) {
+    printf("*** ERROR *** %u kernel(s) do not match the scalar conversion\n",failed);
+    return 1;
+  }
+  return 0;
+
+}
@@ -0,0 +1,369 @@
+// Count system calls and measure throughput of the output stage used by the DAQ, ZSUP and FAKE processes.
+// Synthetic events with the size of a full event (32 channels), of a zero suppressed event and of an event
+// without data are written to the output, first one at a time (output_buffer_size 0) and then through the
+// output buffer. Write to /dev/null (default) to see the cost of the system calls alone (the copy to the buffer
+// then costs more than the write of a full event), or to a file on the disk used for data taking, where the
+// kernel copies and the block allocation of many small writes add up. The file is removed at the end.
+// With -w the buffered output is also written by the asynchronous writer (ASYNC, URING or THREADS backend):
+// use -d to simulate a slow disk (e.g. a file on tmpfs with -d 20000) and see the writes kept in flight.
+// With -D the asynchronous writer also writes the file with O_DIRECT, to compare with the writes through the page cache
+// on the disk used for data taking. The size of each file written by the asynchronous writer is checked.
+// With -l a single long run writes full events to the output file through the output buffer (and then through the
+// asynchronous writer with -w), with preallocation and writeback in chunks of -c bytes (see WriteBack.h): every second
+// throughput, resident memory of the process and dirty pages of the system are reported, then all the bins of the
+// histogram of the time spent waiting for the writeback of each chunk.
+// Usage: OutputBench.exe [-o output_file] [-n events] [-b buffer_size] [-e buffer_events] [-w writer] [-k buffers] [-t threads] [-d write_time] [-D] [-l MiB] [-c chunk]
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+
+#include "CAENDigitizer.h"
+
+#include "PEvent.h"
+#include "OutputBuffer.h"
+#include "AsyncWriter.h"
+
+// Asynchronous writer (NULL: not tested)
+static char* Writer = NULL;
+static unsigned int WriterBuffers = 8;
+static unsigned int WriterThreads = 2;
+static unsigned int WriterDelay = 0;
+static int WriterDirect = 0;
+
+static double bench_now()
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC,&t);
+  return t.tv_sec+t.tv_nsec*1.e-9;
+}
+
+// Return resident memory of the process in KiB
+static unsigned long bench_rss()
+{
+  unsigned long size,rss = 0;
+  FILE* f = fopen("/proc/self/statm","r");
+  if (f == NULL) return 0;
+  if ( fscanf(f,"%lu %lu",&size,&rss) != 2 ) rss = 0;
+  fclose(f);
+  return rss*(sysconf(_SC_PAGESIZE)/1024);
+}
+
+// Return a field of /proc/meminfo in KiB
+static unsigned long bench_meminfo(const char* field)
+{
+  char line[128];
+  unsigned long v = 0;
+  size_t len = strlen(field);
+  FILE* f = fopen("/proc/meminfo","r");
+  if (f == NULL) return 0;
+  while ( fgets(line,sizeof(line),f) ) {
+    if ( strncmp(line,field,len) == 0 && line[len] == ':' ) {
+      sscanf(line+len+1,"%lu",&v);
+      break;
+    }
+  }
+  fclose(f);
+  return v;
+}
+
+// Write nEvents events of evtSize bytes and report. Return 0 if OK, 1 if error
+// With an asynchronous writer the file gets a head and a tail and the time includes the wait for the last write
+static int bench_run(const char* path, unsigned int evtSize, unsigned int nEvents, unsigned int bufSize, unsigned int bufEvents, char* evt, int async, int direct)
+{
+
+  output_buffer_t* ob;
+  async_writer_t* w = NULL;
+  int fd,rc = 0;
+  unsigned int i;
+  double t0,dt;
+  struct stat st;
+  char name[32];
+
+  fd = open(path,O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+  if (fd == -1) {
+    printf("*** ERROR *** Unable to open file '%s' for writing\n",path);
+    return 1;
+  }
+  if (async) {
+    w = async_writer_create(Writer,WriterBuffers,bufSize,WriterThreads,WriterDelay);
+    if ( w && async_writer_set_direct(w,direct) ) {
+      async_writer_destroy(w);
+      w = NULL;
+    }
+    if (w == NULL) {
+      close(fd);
+      return 1;
+    }
+    ob = output_buffer_create_async(w,bufEvents,0);
+  } else {
+    ob = output_buffer_create(bufSize,bufEvents,0);
+  }
+  if (ob == NULL) {
+    if (w) async_writer_destroy(w);
+    close(fd);
+    return 1;
+  }
+  output_buffer_set_fd(ob,fd);
+
+  t0 = bench_now();
+  if ( w && async_writer_open(w,NULL,fd,0,0,0,0,0,time(NULL)) < 0 ) rc = 1;
+  for(i=0;i<nEvents && rc==0;i++) {
+    // Each event has its own event number, as it would be written by DAQ
+    memcpy(evt+12,&i,4);
+    if ( output_buffer_write(ob,evt,evtSize,1) ) rc = 1;
+  }
+  if ( rc == 0 && output_buffer_flush(ob) ) rc = 1;
+  if (w) {
+    // The writer closes the file
+    if ( rc == 0 && ( async_writer_close(w,time(NULL)) < 0 || async_writer_sync(w) ) ) rc = 1;
+  }
+  dt = bench_now()-t0;
+  if (w == NULL) close(fd);
+
+  if ( rc || ob->n_bytes != (uint64_t)evtSize*nEvents ) {
+    printf("*** ERROR *** Only %llu of %llu bytes were written\n",(unsigned long long)ob->n_bytes,(unsigned long long)evtSize*nEvents);
+    rc = 1;
+  } else if ( w && strcmp(path,"/dev/null") != 0 &&
+	      ( stat(path,&st) || (uint64_t)st.st_size != (uint64_t)evtSize*nEvents+(PEVT_FHEAD_LEN+PEVT_FTAIL_LEN)*4 ) ) {
+    printf("*** ERROR *** File '%s' has size %llu instead of %llu\n",path,(unsigned long long)st.st_size,
+	   (unsigned long long)evtSize*nEvents+(PEVT_FHEAD_LEN+PEVT_FTAIL_LEN)*4);
+    rc = 1;
+  } else {
+    sprintf(name,"%s%s",w ? async_writer_backend(w) : "sync",direct ? " O_DIRECT" : "");
+    printf("%8u %9u %9u %10llu %11.4f %10.0f %10.1f %s\n",evtSize,bufSize,bufEvents,(unsigned long long)ob->n_syscalls,
+	   1.*ob->n_syscalls/nEvents,nEvents/dt,ob->n_bytes/(dt*1024.*1024.),name);
+  }
+  output_buffer_destroy(ob);
+  if (w) {
+    if ( rc == 0 ) async_writer_report(w,"bench");
+    if ( async_writer_destroy(w) ) rc = 1;
+  }
+  return rc;
+
+}
+
+// Write full events to a file for longBytes bytes with preallocation and chunked writeback and report memory
+// and writeback waits. Return 0 if OK, 1 if error
+static int bench_long(const char* path, unsigned int evtSize, uint64_t longBytes, unsigned int bufSize, uint64_t chunk, char* evt, int async)
+{
+
+  output_buffer_t* ob;
+  async_writer_t* w = NULL;
+  write_back_t* wb;
+  int fd,rc = 0;
+  unsigned int i;
+  uint64_t nEvents = longBytes/evtSize;
+  uint64_t n = 0;
+  double t0,t_next,t;
+  struct rusage ru;
+
+  fd = open(path,O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+  if (fd == -1) {
+    printf("*** ERROR *** Unable to open file '%s' for writing\n",path);
+    return 1;
+  }
+  if (async) {
+    w = async_writer_create(Writer,WriterBuffers,bufSize,WriterThreads,WriterDelay);
+    if (w == NULL) {
+      close(fd);
+      return 1;
+    }
+    async_writer_set_write_back(w,longBytes,chunk,0);
+    ob = output_buffer_create_async(w,0,0);
+    wb = &w->wb;
+  } else {
+    ob = output_buffer_create(bufSize,0,0);
+    if (ob) output_buffer_set_write_back(ob,longBytes,chunk);
+    wb = ob ? &ob->wb : NULL;
+  }
+  if (ob == NULL) {
+    if (w) async_writer_destroy(w);
+    close(fd);
+    return 1;
+  }
+  output_buffer_set_fd(ob,fd);
+
+  printf("Long run %s: %llu events of %u bytes - preallocation %llu bytes - writeback chunk %llu bytes\n",
+	 w ? async_writer_backend(w) : "sync",(unsigned long long)nEvents,evtSize,(unsigned long long)longBytes,(unsigned long long)chunk);
+  printf("%8s %10s %10s %10s %10s %10s\n","time_s","MiB","MiB/s","rss_KiB","dirty_KiB","wback_KiB");
+  t0 = bench_now();
+  t_next = t0+1.;
+  if ( w && async_writer_open(w,NULL,fd,0,0,0,0,0,time(NULL)) < 0 ) rc = 1;
+  for(n=0;n<nEvents && rc==0;n++) {
+    i = (unsigned int)n;
+    memcpy(evt+12,&i,4);
+    if ( output_buffer_write(ob,evt,evtSize,1) ) rc = 1;
+    if ( (n & 0xFF) == 0 && (t = bench_now()) >= t_next ) {
+      printf("%8.1f %10.1f %10.1f %10lu %10lu %10lu\n",t-t0,n*evtSize/1048576.,n*evtSize/(1048576.*(t-t0)),
+	     bench_rss(),bench_meminfo("Dirty"),bench_meminfo("Writeback"));
+      t_next += 1.;
+    }
+  }
+  if (w) {
+    if ( rc == 0 && ( output_buffer_flush(ob) || async_writer_close(w,time(NULL)) < 0 || async_writer_sync(w) ) ) rc = 1;
+  } else {
+    if ( rc == 0 && output_buffer_end_file(ob) ) rc = 1;
+    close(fd);
+  }
+  t = bench_now();
+  getrusage(RUSAGE_SELF,&ru);
+  printf("%8.1f %10.1f %10.1f %10lu %10lu %10lu - max rss %ld KiB\n",t-t0,n*evtSize/1048576.,n*evtSize/(1048576.*(t-t0)),
+	 bench_rss(),bench_meminfo("Dirty"),bench_meminfo("Writeback"),ru.ru_maxrss);
+  if (rc) printf("*** ERROR *** Long run failed after %llu events\n",(unsigned long long)n);
+
+  if (w) {
+    async_writer_report(w,"long run");
+  } else {
+    output_buffer_report(ob,"long run");
+  }
+  histo_print(&wb->h_wait,1);
+  output_buffer_destroy(ob);
+  if ( w && async_writer_destroy(w) ) rc = 1;
+  return rc;
+
+}
+
+int main(int argc, char* argv[])
+{
+
+  int c;
+  unsigned int k;
+  char* path = "/dev/null";
+  unsigned int nEvents = 100000;
+  unsigned int bufSize = 1024*1024;
+  unsigned int bufEvents = 0;
+  unsigned int evtSize[3];
+  char* evt;
+  int failed = 0;
+  unsigned long long longMiB = 0;
+  unsigned long long chunk = 8*1024*1024;
+
+  while ((c = getopt (argc, argv, "o:n:b:e:w:k:t:d:Dl:c:h")) != -1)
+    switch (c)
+      {
+      case 'o':
+	path = optarg;
+	break;
+      case 'n':
+	if ( sscanf(optarg,"%u",&nEvents) != 1 || nEvents == 0 ) {
+	  printf("*** ERROR *** Invalid number of events '%s'.\n",optarg);
+	  exit(1);
+	}
+	break;
+      case 'b':
+	if ( sscanf(optarg,"%u",&bufSize) != 1 || bufSize == 0 ) {
+	  printf("*** ERROR *** Invalid buffer size '%s'.\n",optarg);
+	  exit(1);
+	}
+	break;
+      case 'e':
+	if ( sscanf(optarg,"%u",&bufEvents) != 1 ) {
+	  printf("*** ERROR *** Invalid number of buffer events '%s'.\n",optarg);
+	  exit(1);
+	}
+	break;
+      case 'w':
+	if ( strcmp(optarg,"ASYNC")!=0 && strcmp(optarg,"URING")!=0 && strcmp(optarg,"THREADS")!=0 ) {
+	  printf("*** ERROR *** Invalid writer '%s' (ASYNC, URING or THREADS).\n",optarg);
+	  exit(1);
+	}
+	Writer = optarg;
+	break;
+      case 'k':
+	if ( sscanf(optarg,"%u",&WriterBuffers) != 1 || WriterBuffers < 2 ) {
+	  printf("*** ERROR *** Invalid number of writer buffers '%s'.\n",optarg);
+	  exit(1);
+	}
+	break;
+      case 't':
+	if ( sscanf(optarg,"%u",&WriterThreads) != 1 || WriterThreads == 0 ) {
+	  printf("*** ERROR *** Invalid number of I/O threads '%s'.\n",optarg);
+	  exit(1);
+	}
+	break;
+      case 'd':
+	if ( sscanf(optarg,"%u",&WriterDelay) != 1 ) {
+	  printf("*** ERROR *** Invalid write time '%s'.\n",optarg);
+	  exit(1);
+	}
+	break;
+      case 'D':
+	WriterDirect = 1;
+	break;
+      case 'l':
+	if ( sscanf(optarg,"%llu",&longMiB) != 1 || longMiB == 0 ) {
+	  printf("*** ERROR *** Invalid size of long run '%s'.\n",optarg);
+	  exit(1);
+	}
+	break;
+      case 'c':
+	if ( sscanf(optarg,"%llu",&chunk) != 1 ) {
+	  printf("*** ERROR *** Invalid writeback chunk '%s'.\n",optarg);
+	  exit(1);
+	}
+	break;
+      case 'h':
+	fprintf(stdout,"\nOutputBench [-o output_file] [-n events] [-b buffer_size] [-e buffer_events] [-w writer] [-k buffers] [-t threads] [-d write_time] [-D] [-l MiB] [-c chunk]\n\n");
+	fprintf(stdout,"  -o: write to 'output_file' (default /dev/null). The file is removed at the end\n");
+	fprintf(stdout,"  -n: number of events written for each event size (default %u)\n",nEvents);
+	fprintf(stdout,"  -b: size of the output buffer in bytes (default %u)\n",bufSize);
+	fprintf(stdout,"  -e: max number of events in the output buffer (default 0: no limit)\n");
+	fprintf(stdout,"  -w: also test the asynchronous writer (ASYNC, URING or THREADS)\n");
+	fprintf(stdout,"  -k: number of buffers of the asynchronous writer (default %u)\n",WriterBuffers);
+	fprintf(stdout,"  -t: number of I/O threads of the asynchronous writer (default %u)\n",WriterThreads);
+	fprintf(stdout,"  -d: minimum time in usecs of each write of the asynchronous writer (default 0)\n");
+	fprintf(stdout,"  -D: also test the asynchronous writer with O_DIRECT (needs -w and -o, buffer size multiple of 4096)\n");
+	fprintf(stdout,"  -l: only write MiB of full events with preallocation and writeback in chunks, reporting memory (needs -o)\n");
+	fprintf(stdout,"  -c: writeback chunk in bytes for -l (default %llu, 0: left to the kernel)\n",chunk);
+	fprintf(stdout,"  -h: show this help message and exit\n\n");
+	exit(0);
+      default:
+	exit(1);
+      }
+
+  // Full event with 32 channels, zero suppressed event with the trigger groups and 2 channels, event without data
+  evtSize[0] = (PEVT_HEADER_LEN + 4*(PEVT_GRPHEAD_LEN + 512 + PEVT_GRPTTT_LEN) + 32*512)*4;
+  evtSize[1] = (PEVT_HEADER_LEN + 4*(PEVT_GRPHEAD_LEN + 512 + PEVT_GRPTTT_LEN) + 2*512)*4;
+  evtSize[2] = PEVT_HEADER_LEN*4;
+
+  evt = (char*)malloc(evtSize[0]);
+  memset(evt,0x5a,evtSize[0]);
+
+  if (longMiB) {
+    if ( strcmp(path,"/dev/null") == 0 ) {
+      printf("*** ERROR *** The long run needs an output file (-o)\n");
+      exit(1);
+    }
+    failed |= bench_long(path,evtSize[0],longMiB*1024*1024,bufSize,chunk,evt,0);
+    if (Writer) failed |= bench_long(path,evtSize[0],longMiB*1024*1024,bufSize,chunk,evt,1);
+    unlink(path);
+    free(evt);
+    return failed;
+  }
+
+  printf("Output to '%s' - %u events for each event size\n",path,nEvents);
+  if ( WriterDirect && ( Writer == NULL || strcmp(path,"/dev/null") == 0 ) ) {
+    printf("*** ERROR *** O_DIRECT needs an asynchronous writer (-w) and an output file (-o)\n");
+    exit(1);
+  }
+  if (Writer) printf("Asynchronous writer %s: %u buffers - %u I/O threads - write time %u usecs\n",Writer,WriterBuffers,WriterThreads,WriterDelay);
+  printf("%8s %9s %9s %10s %11s %10s %10s %s\n","evt_size","buf_size","buf_evts","syscalls","calls/event","events/s","MiB/s","writer");
+  for(k=0;k<3;k++) {
+    failed |= bench_run(path,evtSize[k],nEvents,0,0,evt,0,0);
+    failed |= bench_run(path,evtSize[k],nEvents,bufSize,bufEvents,evt,0,0);
+    if (Writer) failed |= bench_run(path,evtSize[k],nEvents,bufSize,bufEvents,evt,1,0);
+    if (WriterDirect) failed |= bench_run(path,evtSize[k],nEvents,bufSize,bufEvents,evt,1,1);
+  }
+  if ( strcmp(path,"/dev/null") != 0 ) unlink(path);
+
+  free(evt);
+  return failed;
+
+}
@@ -0,0 +1,174 @@
+// Build, check and query the event index (sidecar '<file>.idx', see EventIndex.h) of a PEvent file.
+// Without options all entries of the index are checked against the headers of the events in the data file.
+// Usage: PEventIndex.exe [-b] [-e event] [-t tstart:tend] pevent_file
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "CAENDigitizer.h"
+
+#include "PEvent.h"
+#include "EventIndex.h"
+#include "PEventReader.h"
+
+// Index all events of an existing data file. Return 0 if OK, 1 if error
+static int index_build(const char* fileName)
+{
+
+  pevent_reader_t* r;
+  pevent_view_t v;
+  event_index_t* idx;
+  int rc;
+
+  if ( (r = pevent_reader_open(fileName,0,PEVENT_READER_READAHEAD)) == NULL ) return 1;
+  idx = event_index_create(EVENT_INDEX_BUFFER);
+  if ( idx == NULL || event_index_open(idx,fileName) ) {
+    pevent_reader_close(r);
+    return 1;
+  }
+  while ( (rc = pevent_reader_next(r,&v)) == 1 ) {
+    if ( event_index_add(idx,v.data,v.offset) ) {
+      rc = -1;
+      break;
+    }
+  }
+  if ( event_index_close(idx) ) rc = -1;
+  printf("Indexed %llu events of file '%s' in '%s%s'\n",
+	 (unsigned long long)idx->n_entries_total,fileName,fileName,EVENT_INDEX_SUFFIX);
+  event_index_destroy(idx);
+  pevent_reader_close(r);
+  return rc < 0 ? 1 : 0;
+
+}
+
+// Read the header of the event of an entry from the data file. Return 0 if it matches the entry, 1 otherwise
+static int index_check_entry(event_index_map_t* m, int fd, size_t i)
+{
+  uint32_t line[PEVT_HEADER_LEN];
+  const event_index_entry_t* e = &m->entry[i];
+  if ( event_index_seek(m,fd,i) == -1 || read(fd,line,sizeof(line)) != sizeof(line) ) {
+    printf("*** ERROR *** Unable to read event %lu at byte %llu\n",(unsigned long)i,(unsigned long long)e->offset);
+    return 1;
+  }
+  if ( (line[0] >> 28) != PEVT_EVENT_TAG || (line[0] & 0x0FFFFFFF)*4 != e->size ||
+       (line[2] & 0x003FFFFF) != (e->counter & 0x003FFFFF) || line[3] != (uint32_t)e->time ||
+       line[PEVT_CHMASK_ACCEPTED_LINE] != e->mask ) {
+    printf("*** ERROR *** Entry %lu does not match the event at byte %llu\n",(unsigned long)i,(unsigned long long)e->offset);
+    return 1;
+  }
+  return 0;
+}
+
+static void index_print_entry(event_index_map_t* m, size_t i)
+{
+  const event_index_entry_t* e = &m->entry[i];
+  printf("Entry %lu: event %u time %llu at byte %llu size %u mask 0x%08x status 0x%03x\n",
+	 (unsigned long)i,e->counter,(unsigned long long)e->time,(unsigned long long)e->offset,e->size,e->mask,e->status);
+}
+
+int main(int argc, char* argv[])
+{
+
+  int c,fd;
+  int build = 0;
+  int findEvent = 0, findTime = 0;
+  unsigned int event = 0;
+  unsigned long long tStart = 0, tEnd = 0;
+  const char* fileName;
+  event_index_map_t* m;
+  ssize_t i;
+  size_t j,first,n;
+  unsigned int bad = 0;
+
+  while ((c = getopt (argc, argv, "be:t:h")) != -1)
+    switch (c)
+      {
+      case 'b':
+	build = 1;
+	break;
+      case 'e':
+	if ( sscanf(optarg,"%u",&event) != 1 ) {
+	  printf("*** ERROR *** Invalid event number '%s'.\n",optarg);
+	  exit(1);
+	}
+	findEvent = 1;
+	break;
+      case 't':
+	if ( sscanf(optarg,"%llu:%llu",&tStart,&tEnd) != 2 ) {
+	  printf("*** ERROR *** Invalid time range '%s'.\n",optarg);
+	  exit(1);
+	}
+	findTime = 1;
+	break;
+      case 'h':
+	fprintf(stdout,"\nPEventIndex [-b] [-e event] [-t tstart:tend] pevent_file\n\n");
+	fprintf(stdout,"  -b: create the index of a file written without it\n");
+	fprintf(stdout,"  -e: show the first event with counter 'event' or higher\n");
+	fprintf(stdout,"  -t: show the events with time tag in [tstart,tend) (ticks, extended to 64 bits)\n");
+	fprintf(stdout,"  -h: show this help message and exit\n");
+	fprintf(stdout,"  Without -e and -t all entries are checked against the data file\n\n");
+	exit(0);
+      default:
+	exit(1);
+      }
+
+  if (optind != argc-1) {
+    printf("*** ERROR *** One PEvent file must be given. Use -h for help.\n");
+    exit(1);
+  }
+  fileName = argv[optind];
+
+  if ( build && index_build(fileName) ) exit(1);
+
+  if ( (m = event_index_load(fileName)) == NULL ) exit(1);
+  if ( (fd = open(fileName,O_RDONLY)) == -1 ) {
+    printf("*** ERROR *** Unable to open file '%s'\n",fileName);
+    exit(1);
+  }
+  printf("Index of '%s': %lu events",fileName,(unsigned long)m->n_entries);
+  if (m->n_entries) printf(" - counter %u to %u - time %llu to %llu",m->entry[0].counter,m->entry[m->n_entries-1].counter,
+			   (unsigned long long)m->entry[0].time,(unsigned long long)m->entry[m->n_entries-1].time);
+  printf("\n");
+
+  if (findEvent) {
+    i = event_index_find_event(m,event);
+    if (i < 0) {
+      printf("No event with counter %u or higher\n",event);
+    } else {
+      index_print_entry(m,i);
+      bad += index_check_entry(m,fd,i);
+    }
+  }
+
+  if (findTime) {
+    n = event_index_time_range(m,tStart,tEnd,&first);
+    printf("%lu events with time in [%llu,%llu)\n",(unsigned long)n,tStart,tEnd);
+    for(j=first;j<first+n;j++) {
+      index_print_entry(m,j);
+      bad += index_check_entry(m,fd,j);
+    }
+  }
+
+  if ( ! findEvent && ! findTime ) {
+    for(j=0;j<m->n_entries;j++) {
+      bad += index_check_entry(m,fd,j);
+      if ( j && ( m->entry[j].offset <= m->entry[j-1].offset || m->entry[j].counter < m->entry[j-1].counter ||
+		  m->entry[j].time < m->entry[j-1].time ) ) {
+	printf("*** ERROR *** Entry %lu is out of order\n",(unsigned long)j);
+	bad++;
+      }
+    }
+    printf("Checked %lu entries: %u errors\n",(unsigned long)m->n_entries,bad);
+  }
+
+  close(fd);
+  event_index_unload(m);
+  exit(bad ? 1 : 0);
+
+}
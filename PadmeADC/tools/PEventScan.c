@@ -0,0 +1,164 @@
+// Scan throughput of the PEvent reader (see PEventReader.h) in GB/s.
+// Each pass reads all the given files with the reader, checking every record, either decoding only the event
+// structure (walk) or also adding up all samples of all channels and trigger blocks (sum), which reads every byte.
+// With -c the files are dropped from the page cache before each pass, to measure reads from disk and the effect of
+// the readahead window. Streams (e.g. /dev/stdin fed by a pipe) can only be read once.
+// Usage: PEventScan.exe [-r repetitions] [-a readahead] [-b buffer] [-c] pevent_file [pevent_file ...]
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "PEventReader.h"
+
+static double scan_now()
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC,&t);
+  return t.tv_sec+t.tv_nsec*1.e-9;
+}
+
+// Drop a file from the page cache. Only clean pages can be dropped
+static void scan_drop_cache(const char* fileName)
+{
+  int fd = open(fileName,O_RDONLY);
+  if (fd == -1) return;
+  posix_fadvise(fd,0,0,POSIX_FADV_DONTNEED);
+  close(fd);
+}
+
+// Read all files once. Return 0 if OK, 1 if error
+static int scan_pass(char** files, int nFiles, size_t bufSize, size_t readahead, int sum,
+		     uint64_t* nEvents, uint64_t* nBytes, int64_t* total)
+{
+
+  int i,rc;
+  unsigned int iGr,iCh,iSm;
+  pevent_reader_t* r;
+  pevent_view_t v;
+  const int16_t* s;
+  int32_t chSum;
+  int64_t acc = 0;
+
+  *nEvents = 0;
+  *nBytes = 0;
+  for(i=0;i<nFiles;i++) {
+    if ( (r = pevent_reader_open(files[i],bufSize,readahead)) == NULL ) return 1;
+    while ( (rc = pevent_reader_next(r,&v)) == 1 ) {
+      if (sum) {
+	// Sums of the samples of a channel (at most 1024) fit in 32 bits
+	for(iGr=0;iGr<v.n_groups;iGr++) {
+	  s = v.group[iGr].trigger;
+	  chSum = 0;
+	  for(iSm=0;iSm<v.group[iGr].n_trigger;iSm++) chSum += s[iSm];
+	  acc += chSum;
+	}
+	for(iCh=0;iCh<PEVENT_READER_MAX_CHANNELS;iCh++) {
+	  if ( (s = v.channel[iCh]) == NULL ) continue;
+	  chSum = 0;
+	  for(iSm=0;iSm<v.n_samples;iSm++) chSum += s[iSm];
+	  acc += chSum;
+	}
+      } else {
+	acc += v.counter;
+      }
+    }
+    *nEvents += r->n_events;
+    *nBytes += r->n_bytes;
+    pevent_reader_close(r);
+    if (rc < 0) return 1;
+  }
+  *total = acc;
+  return 0;
+
+}
+
+int main(int argc, char* argv[])
+{
+
+  int c,i,mode,rep;
+  unsigned int nRep = 5;
+  unsigned long long ra = PEVENT_READER_READAHEAD;
+  unsigned long long buf = PEVENT_READER_BUFFER;
+  int dropCache = 0;
+  struct stat st;
+  uint64_t nEvents,nBytes;
+  int64_t total;
+  double t0,dt,rate,best,mean;
+  const char* modeName[2] = { "walk", "sum" };
+
+  while ((c = getopt (argc, argv, "r:a:b:ch")) != -1)
+    switch (c)
+      {
+      case 'r':
+	if ( sscanf(optarg,"%u",&nRep) != 1 || nRep == 0 ) {
+	  printf("*** ERROR *** Invalid number of repetitions '%s'.\n",optarg);
+	  exit(1);
+	}
+	break;
+      case 'a':
+	if ( sscanf(optarg,"%llu",&ra) != 1 ) {
+	  printf("*** ERROR *** Invalid readahead window '%s'.\n",optarg);
+	  exit(1);
+	}
+	break;
+      case 'b':
+	if ( sscanf(optarg,"%llu",&buf) != 1 || buf == 0 ) {
+	  printf("*** ERROR *** Invalid buffer size '%s'.\n",optarg);
+	  exit(1);
+	}
+	break;
+      case 'c':
+	dropCache = 1;
+	break;
+      case 'h':
+	fprintf(stdout,"\nPEventScan [-r repetitions] [-a readahead] [-b buffer] [-c] pevent_file [pevent_file ...]\n\n");
+	fprintf(stdout,"  -r: number of passes over the files in each mode (default 5)\n");
+	fprintf(stdout,"  -a: readahead window for mapped files in bytes (default %d, 0: none)\n",PEVENT_READER_READAHEAD);
+	fprintf(stdout,"  -b: refill buffer for streams in bytes (default %d)\n",PEVENT_READER_BUFFER);
+	fprintf(stdout,"  -c: drop the files from the page cache before each pass\n");
+	fprintf(stdout,"  -h: show this help message and exit\n\n");
+	exit(0);
+      default:
+	exit(1);
+      }
+
+  if (optind >= argc) {
+    printf("*** ERROR *** No PEvent file given. Use -h for help.\n");
+    exit(1);
+  }
+
+  // Streams can be read only once: scan them in sum mode
+  for(i=optind;i<argc;i++) {
+    if ( stat(argv[i],&st) == 0 && ! S_ISREG(st.st_mode) ) {
+      if ( scan_pass(argv+optind,argc-optind,buf,ra,1,&nEvents,&nBytes,&total) ) exit(1);
+      printf("Stream scan: %llu events %llu bytes - checksum %lld\n",
+	     (unsigned long long)nEvents,(unsigned long long)nBytes,(long long)total);
+      exit(0);
+    }
+  }
+
+  for(mode=0;mode<2;mode++) {
+    best = 0.;
+    mean = 0.;
+    for(rep=0;rep<(int)nRep;rep++) {
+      if (dropCache) for(i=optind;i<argc;i++) scan_drop_cache(argv[i]);
+      t0 = scan_now();
+      if ( scan_pass(argv+optind,argc-optind,buf,ra,mode,&nEvents,&nBytes,&total) ) exit(1);
+      dt = scan_now()-t0;
+      rate = dt > 0. ? nBytes/dt*1.e-9 : 0.;
+      if (rate > best) best = rate;
+      mean += rate/nRep;
+    }
+    printf("%-4s: %llu events %llu bytes - %.2f GB/s best %.2f GB/s mean over %u passes - %.0f events/s - checksum %lld\n",
+	   modeName[mode],(unsigned long long)nEvents,(unsigned long long)nBytes,best,mean,nRep,
+	   best > 0. ? best*1.e9/nBytes*nEvents : 0.,(long long)total);
+  }
+  exit(0);
+
+}
@@ -0,0 +1,408 @@
+// Convert raw BLT files written by PadmeADC in DAQRAW process mode to PEvent (version 3) files
+// Events are decoded with the native V1742 decoder using several threads.
+// Zero suppression, channel mask, autopass, and DRS4 corrections settings are taken
+// from the (optional) PadmeADC configuration file.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <string.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "Config.h"
+#include "PEvent.h"
+#include "RawBLT.h"
+#include "V1742.h"
+#include "DRS4.h"
+
+// Default number of conversion threads
+#define RAW2PEVT_N_THREADS 4
+
+// Number of BLT records processed in each conversion cycle for each thread
+#define RAW2PEVT_BLT_PER_THREAD 4
+
+// Max size of a PEvent event in bytes (same as in DAQ.c)
+#define RAW2PEVT_MAX_PEVT_SIZE ((PEVT_HEADER_LEN + 4*(PEVT_GRPHEAD_LEN + 512 + PEVT_GRPTTT_LEN) + 32*512)*4)
+
+typedef struct blt_s {
+  char* data;         // Raw data (sequence of V1742 events)
+  uint32_t size;      // Size of raw data in bytes
+  uint32_t nevents;   // Number of V1742 events in raw data
+  char* out;          // Formatted PEvent events
+  uint64_t out_size;  // Size of formatted events in bytes
+  uint32_t out_events;// Number of accepted events
+  int error;          // Set if raw data could not be converted
+  uint32_t max_size;   // Allocated size of data buffer
+  uint32_t max_events; // Number of events which fit in out buffer
+} blt_t;
+
+typedef struct worker_s {
+  pthread_t thread;
+  unsigned int id;
+  unsigned int n_threads;
+  blt_t* blt;
+  unsigned int n_blt;
+  int board_id;
+  const drs4_table_t* drs4; // DRS4 correction tables (NULL: no corrections)
+} worker_t;
+
+// Read exactly n bytes from file. Return 0 if OK, 1 if end of file, 2 if error
+static int read_full(int fd, void* buf, size_t n)
+{
+  ssize_t r;
+  size_t done = 0;
+  while (done < n) {
+    r = read(fd,(char*)buf+done,n-done);
+    if (r == 0) return (done == 0) ? 1 : 2;
+    if (r < 0) {
+      if (errno == EINTR) continue;
+      return 2;
+    }
+    done += r;
+  }
+  return 0;
+}
+
+// Convert all events contained in one BLT record
+static void convert_blt(blt_t* blt, int boardId, const drs4_table_t* drs4)
+{
+
+  uint32_t iEv;
+  uint32_t offset = 0;
+  uint32_t evtSize;
+  int pEvtSize;
+  uint32_t* raw = (uint32_t*)blt->data;
+
+  blt->out_size = 0;
+  blt->out_events = 0;
+  blt->error = 0;
+
+  for (iEv=0;iEv<blt->nevents;iEv++) {
+
+    // Check V1742 event header
+    if ( offset+V1742_EVT_HEADER_LEN > blt->size/4 || (raw[offset] >> 28) != 0xA ) {
+      printf("ERROR - Event %u of BLT has an invalid header\n",iEv);
+      blt->error = 1;
+      return;
+    }
+    evtSize = raw[offset] & 0x0FFFFFFF;
+    if ( evtSize < V1742_EVT_HEADER_LEN || offset+evtSize > blt->size/4 ) {
+      printf("ERROR - Event %u of BLT has an invalid size %u\n",iEv,evtSize);
+      blt->error = 1;
+      return;
+    }
+
+    pEvtSize = create_pevent_native((void*)(raw+offset),(void*)(blt->out+blt->out_size),boardId,drs4);
+    if (pEvtSize < 0) {
+      printf("ERROR - Unable to convert event %u of BLT. RC %d\n",iEv,pEvtSize);
+      blt->error = 1;
+      return;
+    }
+    if (pEvtSize > 0) {
+      blt->out_size += pEvtSize;
+      blt->out_events++;
+    }
+
+    offset += evtSize;
+
+  }
+
+}
+
+// Conversion thread: convert BLT records id, id+n_threads, id+2*n_threads, ...
+static void* convert_thread(void* arg)
+{
+  worker_t* w = (worker_t*)arg;
+  unsigned int i;
+  for (i=w->id;i<w->n_blt;i+=w->n_threads) convert_blt(&w->blt[i],w->board_id,w->drs4);
+  return NULL;
+}
+
+// Get sampling frequency from the first group header of a V1742 event
+static int get_sampfreq(uint32_t* raw)
+{
+  if ( (raw[1] & 0xF) == 0 ) return -1; // No groups in event
+  return V1742_GRP_FREQ(raw[V1742_EVT_HEADER_LEN]);
+}
+
+int main(int argc, char*argv[])
+{
+
+  int c;
+  int rc;
+  char* inFile = NULL;
+  char* outFile = NULL;
+  unsigned int nThreads = RAW2PEVT_N_THREADS;
+  unsigned int nBltMax;
+  unsigned int nBlt;
+  unsigned int i;
+  int inHandle,outHandle;
+  int initDone = 0;
+  int freq;
+
+  uint32_t fHead[RAW_FHEAD_LEN];
+  uint32_t bHead[RAW_BLT_HEADER_LEN];
+  uint32_t fTail[PEVT_FTAIL_LEN];
+  char outBuffer[PEVT_FHEAD_LEN*4+PEVT_FTAIL_LEN*4];
+  unsigned int outSize;
+
+  unsigned int fIndex;
+  int runNr;
+  int boardId;
+  uint32_t boardSN;
+  time_t tOpen, tClose;
+
+  uint64_t totalInEvents = 0;
+  uint64_t totalOutEvents = 0;
+  uint64_t totalBlt = 0;
+  uint64_t fileSize = 0;
+
+  blt_t* blt;
+  worker_t* worker;
+
+  // Initialize configuration (used by event formatting)
+  if ( init_config() ) {
+    printf("*** ERROR *** Problem initializing configuration.\n");
+    exit(1);
+  }
+
+  // Parse options
+  while ((c = getopt (argc, argv, "i:o:c:j:h")) != -1)
+    switch (c)
+      {
+      case 'i':
+	inFile = optarg;
+	break;
+      case 'o':
+	outFile = optarg;
+	break;
+      case 'c':
+	if ( read_config(optarg) ) {
+	  printf("*** ERROR *** Problem while reading configuration file '%s'.\n",optarg);
+	  exit(1);
+	}
+	break;
+      case 'j':
+	if ( sscanf(optarg,"%u",&nThreads) != 1 || nThreads == 0 ) {
+	  printf("*** ERROR *** Invalid number of threads '%s'.\n",optarg);
+	  exit(1);
+	}
+	break;
+      case 'h':
+	fprintf(stdout,"\nPadmeRaw2PEvent -i raw_file -o pevent_file [-c cfg_file] [-j n_threads] [-h]\n\n");
+	fprintf(stdout,"  -i: raw BLT file written by PadmeADC in DAQRAW mode\n");
+	fprintf(stdout,"  -o: PEvent file to create\n");
+	fprintf(stdout,"  -c: use file 'cfg_file' to set zero suppression, channel mask, and DRS4 corrections parameters\n");
+	fprintf(stdout,"  -j: number of conversion threads (default %d)\n",RAW2PEVT_N_THREADS);
+	fprintf(stdout,"  -h: show this help message and exit\n\n");
+	exit(0);
+      case '?':
+        if (optopt == 'i' || optopt == 'o' || optopt == 'c' || optopt == 'j')
+          fprintf (stderr, "Option -%c requires an argument.\n", optopt);
+        else if (isprint (optopt))
+          fprintf (stderr, "Unknown option '-%c'.\n", optopt);
+        else
+          fprintf (stderr,"Unknown option character '\\x%x'.\n",optopt);
+        exit(1);
+      default:
+        abort ();
+      }
+
+  if (inFile == NULL || outFile == NULL) {
+    printf("*** ERROR *** Both input (-i) and output (-o) files must be specified.\n");
+    exit(1);
+  }
+
+  // Open input file and check its header
+  inHandle = open(inFile,O_RDONLY);
+  if (inHandle == -1) {
+    printf("*** ERROR *** Unable to open input file '%s': %s\n",inFile,strerror(errno));
+    exit(1);
+  }
+  if ( read_full(inHandle,fHead,RAW_FHEAD_LEN*4) ) {
+    printf("*** ERROR *** Unable to read header of input file '%s'.\n",inFile);
+    exit(1);
+  }
+  if ( (fHead[0] >> 28) != RAW_FHEAD_TAG || ((fHead[0] >> 16) & 0xFFF) != RAW_CURRENT_VERSION ) {
+    printf("*** ERROR *** File '%s' is not a raw BLT file (head 0x%08x).\n",inFile,fHead[0]);
+    exit(1);
+  }
+  fIndex  = fHead[0] & 0xFFFF;
+  memcpy(&runNr,&fHead[1],4);
+  boardId = (fHead[2] >> 24) & 0xFF;
+  boardSN = fHead[2] & 0xFFFFFF;
+  tOpen   = fHead[3];
+  tClose  = tOpen;
+  printf("- Input file '%s' index %u run %d board id %d S/N %u\n",inFile,fIndex,runNr,boardId,boardSN);
+
+  // Open output file and write its header
+  outHandle = open(outFile,O_WRONLY | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+  if (outHandle == -1) {
+    printf("*** ERROR *** Unable to open output file '%s': %s\n",outFile,strerror(errno));
+    exit(1);
+  }
+  outSize = create_file_head(fIndex,runNr,boardId,boardSN,tOpen,(void*)outBuffer);
+  if ( write(outHandle,outBuffer,outSize) != outSize ) {
+    printf("*** ERROR *** Unable to write header to output file '%s'.\n",outFile);
+    exit(1);
+  }
+  fileSize += outSize;
+
+  // Allocate BLT records and workers
+  nBltMax = nThreads*RAW2PEVT_BLT_PER_THREAD;
+  blt = (blt_t*)calloc(nBltMax,sizeof(blt_t));
+  worker = (worker_t*)calloc(nThreads,sizeof(worker_t));
+  if (blt == NULL || worker == NULL) {
+    printf("*** ERROR *** Unable to allocate memory for %u BLT records.\n",nBltMax);
+    exit(1);
+  }
+
+  V1742_init();
+  printf("- Converting with %u threads (%s kernel)\n",nThreads,V1742_unpack_kernel());
+
+  rc = 0;
+  while (rc == 0) {
+
+    // Read next group of BLT records
+    nBlt = 0;
+    while (nBlt < nBltMax) {
+
+      rc = read_full(inHandle,bHead,4);
+      if (rc) break;
+
+      // File tail: save closing time and stop reading
+      if ( (bHead[0] >> 28) == PEVT_FTAIL_TAG ) {
+	fTail[0] = bHead[0];
+	if ( read_full(inHandle,&fTail[1],(PEVT_FTAIL_LEN-1)*4) ) {
+	  rc = 2;
+	  break;
+	}
+	tClose = fTail[3];
+	if ( (fTail[0] & 0x0FFFFFFF) != (totalInEvents & 0x0FFFFFFF) ) {
+	  printf("*** WARNING *** File tail reports %u events, %llu found\n",fTail[0] & 0x0FFFFFFF,(unsigned long long)totalInEvents);
+	}
+	rc = 1;
+	break;
+      }
+
+      if ( (bHead[0] >> 28) != RAW_BLT_TAG ) {
+	printf("*** ERROR *** Unexpected record with header 0x%08x after %llu BLT records\n",bHead[0],(unsigned long long)totalBlt);
+	rc = 2;
+	break;
+      }
+      if ( read_full(inHandle,&bHead[1],(RAW_BLT_HEADER_LEN-1)*4) ) {
+	rc = 2;
+	break;
+      }
+
+      // Allocate buffers large enough for raw data and formatted events
+      if ( blt[nBlt].max_size < bHead[2] || blt[nBlt].max_events < bHead[3] ) {
+	free(blt[nBlt].data);
+	free(blt[nBlt].out);
+	blt[nBlt].data = (char*)malloc(bHead[2]);
+	blt[nBlt].out = (char*)malloc((uint64_t)bHead[3]*RAW2PEVT_MAX_PEVT_SIZE);
+	if (blt[nBlt].data == NULL || blt[nBlt].out == NULL) {
+	  printf("*** ERROR *** Unable to allocate buffers for BLT with %u bytes and %u events\n",bHead[2],bHead[3]);
+	  rc = 2;
+	  break;
+	}
+	blt[nBlt].max_size = bHead[2];
+	blt[nBlt].max_events = bHead[3];
+      }
+      blt[nBlt].size = bHead[2];
+      blt[nBlt].nevents = bHead[3];
+      if ( read_full(inHandle,blt[nBlt].data,blt[nBlt].size) ) {
+	printf("*** ERROR *** Input file is truncated after %llu BLT records\n",(unsigned long long)totalBlt);
+	rc = 2;
+	break;
+      }
+
+      // Get sampling frequency and DRS4 corrections from first event
+      if (! initDone) {
+	freq = get_sampfreq((uint32_t*)blt[nBlt].data);
+	if (freq >= 0) Config->drs4_sampfreq = freq;
+	if ( Config->drs4corr_enable ) {
+	  if ( DRS4_init(-1,boardId,boardSN,Config->drs4_sampfreq) ) {
+	    printf("*** ERROR *** Unable to load DRS4 correction tables. Use drs4corr_enable 0 to convert without corrections.\n");
+	    rc = 2;
+	    break;
+	  }
+	}
+	initDone = 1;
+      }
+
+      totalInEvents += blt[nBlt].nevents;
+      totalBlt++;
+      nBlt++;
+
+    }
+    if (rc == 2) break;
+
+    // Convert all BLT records in parallel
+    for (i=0;i<nThreads;i++) {
+      worker[i].id = i;
+      worker[i].n_threads = nThreads;
+      worker[i].blt = blt;
+      worker[i].n_blt = nBlt;
+      worker[i].board_id = boardId;
+      worker[i].drs4 = DRS4_table(boardId);
+      if ( pthread_create(&worker[i].thread,NULL,convert_thread,(void*)&worker[i]) ) {
+	printf("*** ERROR *** Unable to start conversion thread %u\n",i);
+	exit(1);
+      }
+    }
+    for (i=0;i<nThreads;i++) pthread_join(worker[i].thread,NULL);
+
+    // Write formatted events in the original order
+    for (i=0;i<nBlt;i++) {
+      if (blt[i].error) {
+	rc = 2;
+	break;
+      }
+      if ( write(outHandle,blt[i].out,blt[i].out_size) != blt[i].out_size ) {
+	printf("*** ERROR *** Unable to write events to output file '%s'.\n",outFile);
+	rc = 2;
+	break;
+      }
+      fileSize += blt[i].out_size;
+      totalOutEvents += blt[i].out_events;
+    }
+
+  }
+
+  if (rc == 2) {
+    printf("*** ERROR *** Conversion of '%s' failed.\n",inFile);
+    close(outHandle);
+    exit(1);
+  }
+
+  // Write tail and close output file
+  outSize = create_file_tail(totalOutEvents,fileSize,tClose,(void*)outBuffer);
+  if ( write(outHandle,outBuffer,outSize) != outSize ) {
+    printf("*** ERROR *** Unable to write tail to output file '%s'.\n",outFile);
+    exit(1);
+  }
+  fileSize += outSize;
+  close(outHandle);
+  close(inHandle);
+
+  printf("- Converted %llu BLT records with %llu events: %llu events written to '%s' (%llu bytes)\n",
+	 (unsigned long long)totalBlt,(unsigned long long)totalInEvents,(unsigned long long)totalOutEvents,outFile,(unsigned long long)fileSize);
+
+  for (i=0;i<nBltMax;i++) {
+    free(blt[i].data);
+    free(blt[i].out);
+  }
+  free(blt);
+  free(worker);
+  end_config();
+
+  exit(0);
+
+}
@@ -0,0 +1,298 @@
+// Check and time the native V1742 decoder (see V1742.h) against CAEN_DGTZ_DecodeEvent.
+// Events are read from the digitizer (from the mock library if built with "make CAENDIR=mock") with the DRS4
+// corrections of the CAEN library disabled, so that CAEN_DGTZ_DecodeEvent returns the 12 bits samples as floats.
+// All channel and trigger samples of each event are unpacked with the kernel selected at runtime by V1742_init,
+// as done by the DAQ, and with the scalar kernel: both are compared bit by bit with the output of CAEN_DGTZ_DecodeEvent
+// rounded to int16 as in create_pevent. Then the time to decode all events is given for the three decoders
+// (CAEN_DGTZ_DecodeEvent includes the conversion of its float samples to int16).
+// With a real board, triggers must reach the digitizer while events are collected.
+// Usage: V1742Bench.exe [-l link] [-s slot] [-n events] [-r repetitions]
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "CAENDigitizer.h"
+
+#include "V1742.h"
+#include "Convert.h"
+
+#define BENCH_N_SAMPLES 1024
+#define BENCH_TIMEOUT 30 // Seconds without events before giving up
+
+typedef void (*unpack_channels_t)(const uint32_t*,unsigned int,int16_t**);
+typedef void (*unpack_trigger_t)(const uint32_t*,unsigned int,int16_t*);
+
+typedef struct bench_event_s {
+  int16_t ch[MAX_X742_GROUP_SIZE][MAX_X742_CHANNEL_SIZE][BENCH_N_SAMPLES]; // Index 8: trigger
+  unsigned int nSm[MAX_X742_GROUP_SIZE][MAX_X742_CHANNEL_SIZE];
+  unsigned int grMask;
+} bench_event_t;
+
+static double bench_now()
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC,&t);
+  return t.tv_sec+t.tv_nsec*1.e-9;
+}
+
+// Read nEvents raw events from the digitizer into a single buffer. Return buffer (NULL if error)
+static char* bench_collect(int handle, unsigned int nEvents, uint32_t* size, uint32_t** evtStart)
+{
+
+  char* readout;
+  char* data;
+  char* evt;
+  char* more;
+  uint32_t readoutSize,bltSize,nBlt,dataSize = 0,dataMax;
+  uint32_t iEv,nEv = 0;
+  CAEN_DGTZ_EventInfo_t info;
+  double tLast;
+
+  if ( CAEN_DGTZ_MallocReadoutBuffer(handle,&readout,&readoutSize) != CAEN_DGTZ_Success ) {
+    printf("*** ERROR *** Unable to allocate readout buffer\n");
+    return NULL;
+  }
+  dataMax = readoutSize;
+  if ( (data = (char*)malloc(dataMax)) == NULL ) {
+    printf("*** ERROR *** Unable to allocate event buffer\n");
+    CAEN_DGTZ_FreeReadoutBuffer(&readout);
+    return NULL;
+  }
+
+  CAEN_DGTZ_SWStartAcquisition(handle);
+  tLast = bench_now();
+  while (nEv < nEvents) {
+    if ( CAEN_DGTZ_ReadData(handle,CAEN_DGTZ_SLAVE_TERMINATED_READOUT_MBLT,readout,&bltSize) != CAEN_DGTZ_Success ||
+	 CAEN_DGTZ_GetNumEvents(handle,readout,bltSize,&nBlt) != CAEN_DGTZ_Success ) {
+      printf("*** ERROR *** Unable to read data from the digitizer\n");
+      nEv = 0;
+      break;
+    }
+    if (nBlt == 0) {
+      if (bench_now()-tLast > BENCH_TIMEOUT) {
+	printf("*** ERROR *** No events in %d seconds\n",BENCH_TIMEOUT);
+	nEv = 0;
+	break;
+      }
+      usleep(1000);
+      continue;
+    }
+    tLast = bench_now();
+    for (iEv=0;iEv<nBlt && nEv<nEvents;iEv++) {
+      CAEN_DGTZ_GetEventInfo(handle,readout,bltSize,iEv,&info,&evt);
+      if (dataSize+info.EventSize*4 > dataMax) {
+	dataMax = 2*dataMax+info.EventSize*4;
+	if ( (more = (char*)realloc(data,dataMax)) == NULL ) {
+	  printf("*** ERROR *** Unable to allocate event buffer\n");
+	  break;
+	}
+	data = more;
+      }
+      memcpy(data+dataSize,evt,info.EventSize*4);
+      evtStart[nEv++] = (uint32_t*)(uintptr_t)dataSize; // Offset: the buffer can still move
+      dataSize += info.EventSize*4;
+    }
+    if (iEv < nBlt && nEv < nEvents) break;
+  }
+  CAEN_DGTZ_SWStopAcquisition(handle);
+  CAEN_DGTZ_FreeReadoutBuffer(&readout);
+
+  if (nEv < nEvents) {
+    free(data);
+    return NULL;
+  }
+  for (iEv=0;iEv<nEv;iEv++) evtStart[iEv] = (uint32_t*)(data+(uintptr_t)evtStart[iEv]);
+  *size = dataSize;
+  return data;
+
+}
+
+// Unpack all channels and trigger samples of a raw event with the given kernels
+static void bench_native(const uint32_t* w, bench_event_t* e, unpack_channels_t unpackCh, unpack_trigger_t unpackTr)
+{
+
+  unsigned int iGr,iCh,size,nSm,trWords;
+  unsigned int pos = V1742_EVT_HEADER_LEN;
+  int16_t* ch[8];
+
+  e->grMask = w[1] & 0xF;
+  for (iGr=0;iGr<MAX_X742_GROUP_SIZE;iGr++) {
+    if ( ! (e->grMask & (1 << iGr)) ) continue;
+    size = V1742_GRP_SIZE(w[pos]);
+    trWords = V1742_GRP_TR(w[pos]) ? size/8 : 0;
+    pos++;
+    nSm = size/3;
+    for (iCh=0;iCh<8;iCh++) {
+      ch[iCh] = e->ch[iGr][iCh];
+      e->nSm[iGr][iCh] = nSm;
+    }
+    unpackCh(w+pos,nSm,ch);
+    pos += size;
+    e->nSm[iGr][8] = trWords*8/3;
+    if (trWords) unpackTr(w+pos,e->nSm[iGr][8],e->ch[iGr][8]);
+    pos += trWords+1; // Trigger samples and group trigger time tag
+  }
+
+}
+
+// Decode a raw event with the CAEN library and convert its samples as create_pevent does
+static void bench_caen(int handle, const uint32_t* w, CAEN_DGTZ_X742_EVENT_t* evt, bench_event_t* e)
+{
+
+  unsigned int iGr,iCh;
+  CAEN_DGTZ_X742_GROUP_t* g;
+
+  CAEN_DGTZ_DecodeEvent(handle,(char*)w,(void**)&evt);
+  e->grMask = 0;
+  for (iGr=0;iGr<MAX_X742_GROUP_SIZE;iGr++) {
+    if ( ! evt->GrPresent[iGr] ) continue;
+    e->grMask |= (1 << iGr);
+    g = &evt->DataGroup[iGr];
+    for (iCh=0;iCh<MAX_X742_CHANNEL_SIZE;iCh++) {
+      e->nSm[iGr][iCh] = g->ChSize[iCh];
+      convert_samples(g->DataChannel[iCh],e->ch[iGr][iCh],g->ChSize[iCh]);
+    }
+  }
+
+}
+
+// Compare two decoded events. Return number of channels (trigger included) which differ
+static unsigned int bench_compare(bench_event_t* a, bench_event_t* b)
+{
+  unsigned int iGr,iCh,bad = 0;
+  if (a->grMask != b->grMask) return 1;
+  for (iGr=0;iGr<MAX_X742_GROUP_SIZE;iGr++) {
+    if ( ! (a->grMask & (1 << iGr)) ) continue;
+    for (iCh=0;iCh<MAX_X742_CHANNEL_SIZE;iCh++) {
+      if ( a->nSm[iGr][iCh] != b->nSm[iGr][iCh] ||
+	   memcmp(a->ch[iGr][iCh],b->ch[iGr][iCh],a->nSm[iGr][iCh]*2) ) bad++;
+    }
+  }
+  return bad;
+}
+
+int main(int argc, char* argv[])
+{
+
+  int c,handle;
+  int link = 0, slot = 0;
+  unsigned int nEvents = 1000;
+  unsigned int nRep = 20;
+  unsigned int iEv,iRep;
+  unsigned int badScalar = 0, badKernel = 0;
+  uint32_t size;
+  uint32_t** evtStart;
+  char* data;
+  CAEN_DGTZ_X742_EVENT_t* evt = NULL;
+  bench_event_t *ref,*out;
+  double t0,tCaen,tScalar,tKernel;
+
+  while ((c = getopt (argc, argv, "l:s:n:r:h")) != -1)
+    switch (c)
+      {
+      case 'l':
+	if ( sscanf(optarg,"%d",&link) != 1 ) {
+	  printf("*** ERROR *** Invalid optical link '%s'.\n",optarg);
+	  exit(1);
+	}
+	break;
+      case 's':
+	if ( sscanf(optarg,"%d",&slot) != 1 ) {
+	  printf("*** ERROR *** Invalid slot '%s'.\n",optarg);
+	  exit(1);
+	}
+	break;
+      case 'n':
+	if ( sscanf(optarg,"%u",&nEvents) != 1 || nEvents == 0 ) {
+	  printf("*** ERROR *** Invalid number of events '%s'.\n",optarg);
+	  exit(1);
+	}
+	break;
+      case 'r':
+	if ( sscanf(optarg,"%u",&nRep) != 1 || nRep == 0 ) {
+	  printf("*** ERROR *** Invalid number of repetitions '%s'.\n",optarg);
+	  exit(1);
+	}
+	break;
+      case 'h':
+	fprintf(stdout,"\nV1742Bench [-l link] [-s slot] [-n events] [-r repetitions]\n\n");
+	fprintf(stdout,"  -l: optical link of the digitizer (default 0)\n");
+	fprintf(stdout,"  -s: slot of the digitizer on the optical link (default 0)\n");
+	fprintf(stdout,"  -n: number of events read from the digitizer (default %u)\n",nEvents);
+	fprintf(stdout,"  -r: number of passes over all events to time the decoders (default %u)\n",nRep);
+	fprintf(stdout,"  -h: show this help message and exit\n\n");
+	exit(0);
+      default:
+	exit(1);
+      }
+
+  V1742_init();
+  convert_init();
+
+  if ( CAEN_DGTZ_OpenDigitizer(CAEN_DGTZ_OpticalLink,link,slot,0,&handle) != CAEN_DGTZ_Success ) {
+    printf("*** ERROR *** Unable to open digitizer on optical link %d slot %d\n",link,slot);
+    exit(1);
+  }
+  CAEN_DGTZ_DisableDRS4Correction(handle);
+  CAEN_DGTZ_SetRecordLength(handle,BENCH_N_SAMPLES);
+  CAEN_DGTZ_SetFastTriggerDigitizing(handle,CAEN_DGTZ_ENABLE);
+  CAEN_DGTZ_SetAcquisitionMode(handle,CAEN_DGTZ_SW_CONTROLLED);
+
+  evtStart = (uint32_t**)malloc(nEvents*sizeof(uint32_t*));
+  ref = (bench_event_t*)malloc(sizeof(bench_event_t));
+  out = (bench_event_t*)malloc(sizeof(bench_event_t));
+  if ( evtStart == NULL || ref == NULL || out == NULL ||
+       CAEN_DGTZ_AllocateEvent(handle,(void**)&evt) != CAEN_DGTZ_Success ) {
+    printf("*** ERROR *** Unable to allocate event buffers\n");
+    exit(1);
+  }
+  if ( (data = bench_collect(handle,nEvents,&size,evtStart)) == NULL ) exit(1);
+  printf("V1742 native decoder: kernel %s - %u events (%u bytes) - conversion of CAEN samples with %s kernels\n",
+	 V1742_unpack_kernel(),nEvents,size,convert_name());
+
+  // Bit by bit comparison with the CAEN library
+  for (iEv=0;iEv<nEvents;iEv++) {
+    bench_caen(handle,evtStart[iEv],evt,ref);
+    bench_native(evtStart[iEv],out,V1742_unpack_channels_scalar,V1742_unpack_trigger_scalar);
+    badScalar += bench_compare(ref,out);
+    bench_native(evtStart[iEv],out,V1742_unpack_channels,V1742_unpack_trigger);
+    badKernel += bench_compare(ref,out);
+  }
+
+  // Decoding time of all events
+  t0 = bench_now();
+  for (iRep=0;iRep<nRep;iRep++)
+    for (iEv=0;iEv<nEvents;iEv++) bench_caen(handle,evtStart[iEv],evt,ref);
+  tCaen = (bench_now()-t0)*1.e6/(nRep*nEvents);
+  t0 = bench_now();
+  for (iRep=0;iRep<nRep;iRep++)
+    for (iEv=0;iEv<nEvents;iEv++) bench_native(evtStart[iEv],out,V1742_unpack_channels_scalar,V1742_unpack_trigger_scalar);
+  tScalar = (bench_now()-t0)*1.e6/(nRep*nEvents);
+  t0 = bench_now();
+  for (iRep=0;iRep<nRep;iRep++)
+    for (iEv=0;iEv<nEvents;iEv++) bench_native(evtStart[iEv],out,V1742_unpack_channels,V1742_unpack_trigger);
+  tKernel = (bench_now()-t0)*1.e6/(nRep*nEvents);
+
+  printf("%-8s %16s %12s %10s\n","decoder","channel errors","us/event","speedup");
+  printf("%-8s %16s %12.2f %10.2f\n","CAEN","-",tCaen,1.);
+  printf("%-8s %16u %12.2f %10.2f\n","scalar",badScalar,tScalar,tScalar > 0. ? tCaen/tScalar : 0.);
+  printf("%-8s %16u %12.2f %10.2f\n",V1742_unpack_kernel(),badKernel,tKernel,tKernel > 0. ? tCaen/tKernel : 0.);
+
+  CAEN_DGTZ_FreeEvent(handle,(void**)&evt);
+  CAEN_DGTZ_CloseDigitizer(handle);
+  free(data);
+  free(evtStart);
+  free(ref);
+  free(out);
+
+  if (badScalar || badKernel) {
+    printf("*** ERROR *** Native decoder does not match CAEN_DGTZ_DecodeEvent\n");
+    return 1;
+  }
+  return 0;
+
+}
@@ -0,0 +1,244 @@
+// Check and time the zero suppression kernels used by the ZSUP process on a corpus of recorded PEvent files.
+// All kernels supported by the cpu are applied to every channel of every event with algorithms 1 and 2:
+// their decisions are compared with those of the scalar kernels and their speed is given in events/s
+// on a single core. Zero suppression parameters are taken from the (optional) configuration file.
+// Usage: ZsupBench.exe [-c cfg_file] [-r repetitions] pevent_file [pevent_file ...]
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "Config.h"
+#include "PEvent.h"
+#include "ZsupAlgo.h"
+
+static const char* BenchKernels[] = { "scalar", "sse2", "neon", "avx2" };
+
+typedef struct corpus_s {
+  char* data;          // Content of all input files
+  uint64_t size;       // Size of data in bytes
+  unsigned int nEvents;
+  unsigned int nChannels;
+  char** chPtr;        // Samples of each channel
+  unsigned int* chId;  // Channel number of each channel
+  unsigned int* chEvt; // Index of the event of each channel
+} corpus_t;
+
+static double bench_now()
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC,&t);
+  return t.tv_sec+t.tv_nsec*1.e-9;
+}
+
+// Append a PEvent file to the corpus. Return 0 if OK, 1 if error
+static int corpus_load(corpus_t* c, const char* fileName)
+{
+
+  FILE* f;
+  long fSize;
+
+  if ( (f = fopen(fileName,"rb")) == NULL ) {
+    printf("*** ERROR *** Unable to open file '%s'\n",fileName);
+    return 1;
+  }
+  fseek(f,0,SEEK_END);
+  fSize = ftell(f);
+  fseek(f,0,SEEK_SET);
+  c->data = (char*)realloc(c->data,c->size+fSize);
+  if ( c->data == NULL || fread(c->data+c->size,1,fSize,f) != (size_t)fSize ) {
+    printf("*** ERROR *** Unable to read file '%s'\n",fileName);
+    fclose(f);
+    return 1;
+  }
+  fclose(f);
+  c->size += fSize;
+  return 0;
+
+}
+
+// Find all events and channels in the corpus, as done by apply_zero_suppression
+static int corpus_index(corpus_t* c)
+{
+
+  uint64_t pos = 0;
+  uint32_t line,size,status,groupMask,presentMask;
+  unsigned int maxChannels = 1024;
+  unsigned int iGr,iCh;
+  char* cursor;
+
+  c->chPtr = (char**)malloc(maxChannels*sizeof(char*));
+  c->chId = (unsigned int*)malloc(maxChannels*sizeof(unsigned int));
+  c->chEvt = (unsigned int*)malloc(maxChannels*sizeof(unsigned int));
+
+  while (pos+4 <= c->size) {
+
+    memcpy(&line,c->data+pos,4);
+    if ( (line >> 28) == PEVT_FHEAD_TAG ) { pos += PEVT_FHEAD_LEN*4; continue; }
+    if ( (line >> 28) == PEVT_FTAIL_TAG ) { pos += PEVT_FTAIL_LEN*4; continue; }
+    if ( (line >> 28) != PEVT_EVENT_TAG ) {
+      printf("*** ERROR *** Unknown structure 0x%08x at byte %lu\n",line,(unsigned long)pos);
+      return 1;
+    }
+    size = 4*(line & 0x0FFFFFFF);
+    if (size < PEVT_HEADER_LEN*4 || pos+size > c->size) {
+      printf("*** ERROR *** Event at byte %lu is truncated\n",(unsigned long)pos);
+      return 1;
+    }
+
+    // Channels present in input: all active channels if zero suppression was applied in flagging mode
+    cursor = c->data+pos;
+    memcpy(&line,cursor+4,4); groupMask = line & 0xF;
+    memcpy(&status,cursor+8,4);
+    memcpy(&presentMask,cursor+(status & 0x01000000 ? 16 : 20),4);
+    cursor += PEVT_HEADER_LEN*4;
+    for (iGr=0;iGr<4;iGr++) {
+      if ( groupMask & (1 << iGr) ) {
+	memcpy(&line,cursor,4);
+	cursor += 4*(line & 0xFFF);
+      }
+    }
+    for (iCh=0;iCh<32;iCh++) {
+      if ( presentMask & (1 << iCh) ) {
+	if (c->nChannels == maxChannels) {
+	  maxChannels *= 2;
+	  c->chPtr = (char**)realloc(c->chPtr,maxChannels*sizeof(char*));
+	  c->chId = (unsigned int*)realloc(c->chId,maxChannels*sizeof(unsigned int));
+	  c->chEvt = (unsigned int*)realloc(c->chEvt,maxChannels*sizeof(unsigned int));
+	}
+	c->chPtr[c->nChannels] = cursor;
+	c->chId[c->nChannels] = iCh;
+	c->chEvt[c->nChannels] = c->nEvents;
+	c->nChannels++;
+	cursor += 1024*2;
+      }
+    }
+    if (cursor != c->data+pos+size) {
+      printf("*** ERROR *** Inconsistent size of event at byte %lu\n",(unsigned long)pos);
+      return 1;
+    }
+
+    c->nEvents++;
+    pos += size;
+
+  }
+
+  return 0;
+
+}
+
+// Apply current kernels of one algorithm to all channels. Return number of accepted channels
+static unsigned int bench_apply(corpus_t* c, unsigned int algr, unsigned char* accept)
+{
+  unsigned int i,n = 0;
+  for(i=0;i<c->nChannels;i++) {
+    if (algr == 1) {
+      accept[i] = zsup_algorithm_1(c->chPtr[i]);
+    } else {
+      accept[i] = zsup_algorithm_2(c->chId[i],c->chPtr[i]);
+    }
+    n += accept[i];
+  }
+  return n;
+}
+
+int main(int argc, char* argv[])
+{
+
+  int c;
+  unsigned int k,i,algr,rep,nAcc,bad;
+  unsigned int nRep = 10;
+  unsigned int failed = 0;
+  double t0,dt;
+  corpus_t corpus;
+  unsigned char *ref[3],*accept;
+
+  memset(&corpus,0,sizeof(corpus));
+
+  if ( init_config() ) {
+    printf("*** ERROR *** Problem initializing configuration.\n");
+    exit(1);
+  }
+
+  while ((c = getopt (argc, argv, "c:r:h")) != -1)
+    switch (c)
+      {
+      case 'c':
+	if ( read_config(optarg) ) {
+	  printf("*** ERROR *** Problem while reading configuration file '%s'.\n",optarg);
+	  exit(1);
+	}
+	break;
+      case 'r':
+	if ( sscanf(optarg,"%u",&nRep) != 1 || nRep == 0 ) {
+	  printf("*** ERROR *** Invalid number of repetitions '%s'.\n",optarg);
+	  exit(1);
+	}
+	break;
+      case 'h':
+	fprintf(stdout,"\nZsupBench [-c cfg_file] [-r repetitions] pevent_file [pevent_file ...]\n\n");
+	fprintf(stdout,"  -c: use file 'cfg_file' to set zero suppression parameters\n");
+	fprintf(stdout,"  -r: number of passes over the corpus used for timing (default 10)\n");
+	fprintf(stdout,"  -h: show this help message and exit\n\n");
+	exit(0);
+      default:
+	exit(1);
+      }
+
+  if (optind >= argc) {
+    printf("*** ERROR *** No PEvent file given. Use -h for help.\n");
+    exit(1);
+  }
+  for(i=optind;i<(unsigned int)argc;i++) if ( corpus_load(&corpus,argv[i]) ) exit(1);
+  if ( corpus_index(&corpus) ) exit(1);
+  printf("Corpus: %u events with %u channels\n",corpus.nEvents,corpus.nChannels);
+  if (corpus.nChannels == 0) exit(1);
+
+  ref[1] = (unsigned char*)malloc(corpus.nChannels);
+  ref[2] = (unsigned char*)malloc(corpus.nChannels);
+  accept = (unsigned char*)malloc(corpus.nChannels);
+
+  printf("%-8s %5s %10s %10s %14s\n","kernels","algr","accepted","mismatch","events/s/core");
+  for(k=0;k<sizeof(BenchKernels)/sizeof(BenchKernels[0]);k++) {
+
+    if ( zsup_algorithm_select(BenchKernels[k]) ) {
+      printf("%-8s not supported\n",BenchKernels[k]);
+      continue;
+    }
+
+    for(algr=1;algr<=2;algr++) {
+
+      // Decisions of scalar kernels are the reference
+      nAcc = bench_apply(&corpus,algr,(k==0) ? ref[algr] : accept);
+      bad = 0;
+      if (k) {
+	for(i=0;i<corpus.nChannels;i++) {
+	  if (accept[i] != ref[algr][i]) {
+	    if (bad < 10) printf("Mismatch: algorithm %u event %u channel %u: %s %u scalar %u\n",
+				 algr,corpus.chEvt[i],corpus.chId[i],BenchKernels[k],accept[i],ref[algr][i]);
+	    bad++;
+	  }
+	}
+      }
+      if (bad) failed++;
+
+      t0 = bench_now();
+      for(rep=0;rep<nRep;rep++) bench_apply(&corpus,algr,accept);
+      dt = bench_now()-t0;
+
+      printf("%-8s %5u %10u %10u %14.0f\n",BenchKernels[k],algr,nAcc,bad,corpus.nEvents*(double)nRep/dt);
+
+    }
+
+  }
+
+  if (failed) {
+    printf("*** ERROR *** %u kernel(s) do not take the same decisions as the scalar ones\n",failed);
+    return 1;
+  }
+  return 0;
+
+}
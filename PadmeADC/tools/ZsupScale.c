@@ -0,0 +1,197 @@
+// Scaling of the zero suppression of the ZSUP process with the number of worker threads.
+// Events are generated as in FAKE mode and zero suppressed with apply_zero_suppression by a worker pool,
+// in batches of ZSUP_EVENTS_PER_THREAD events per worker as done by ZSUP_readdata, for 1 to N workers.
+// The output of each event is checked against the one of the single worker run.
+// Zero suppression parameters are taken from the (optional) configuration file.
+// Usage: ZsupScale.exe [-c cfg_file] [-n events] [-t max_threads] [-r repetitions] [-p]
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/uio.h>
+
+#include "Config.h"
+#include "PEvent.h"
+#include "FAKE.h"
+#include "ZSUP.h"
+#include "ZsupAlgo.h"
+#include "WorkerPool.h"
+
+// Same batch size per worker used by ZSUP_readdata
+#define ZSUP_EVENTS_PER_THREAD 4
+#define SCALE_MAX_THREADS 16
+
+typedef struct scale_s {
+  char* in;                // Input events (maxPEvtSize bytes each)
+  char* head;              // Output event headers
+  struct iovec* iov;       // Output sections (ZSUP_MAX_IOVEC for each event)
+  int* iovCnt;
+  unsigned int* outSize;
+  unsigned int first;      // First event of current batch
+  unsigned int zsupMode, zsupAlgr;
+} scale_t;
+
+static int MaxPEvtSize;
+
+static double scale_now()
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC,&t);
+  return t.tv_sec+t.tv_nsec*1.e-9;
+}
+
+static int scale_event(void* ctx, unsigned int worker, unsigned int item)
+{
+  scale_t* s = (scale_t*)ctx;
+  unsigned int i = s->first+item;
+  s->outSize[i] = apply_zero_suppression(s->zsupMode,s->zsupAlgr,s->in+(size_t)i*MaxPEvtSize,s->head+i*PEVT_HEADER_LEN*4,
+					 s->iov+i*ZSUP_MAX_IOVEC,&s->iovCnt[i]);
+  return 0;
+}
+
+// Zero suppress all events once in batches. Return 0 if OK, 1 if error
+static int scale_pass(scale_t* s, pool_t* pool, unsigned int nEvents, unsigned int batch)
+{
+  unsigned int n;
+  for(s->first=0;s->first<nEvents;s->first+=n) {
+    n = nEvents-s->first;
+    if (n > batch) n = batch;
+    if ( pool_run(pool,n) ) return 1;
+  }
+  return 0;
+}
+
+int main(int argc, char* argv[])
+{
+
+  int c;
+  unsigned int i,n,nThreads,rep,bad,nAcc;
+  unsigned int nEvents = 2000;
+  unsigned int maxThreads = sysconf(_SC_NPROCESSORS_ONLN);
+  unsigned int nRep = 5;
+  int pin = 0;
+  double t0,dt,rate,rate1 = 0.;
+  scale_t s;
+  unsigned int *refSize;
+  char *refHead;
+  pool_t* pool;
+
+  memset(&s,0,sizeof(s));
+
+  if ( init_config() ) {
+    printf("*** ERROR *** Problem initializing configuration.\n");
+    exit(1);
+  }
+
+  while ((c = getopt (argc, argv, "c:n:t:r:ph")) != -1)
+    switch (c)
+      {
+      case 'c':
+	if ( read_config(optarg) ) {
+	  printf("*** ERROR *** Problem while reading configuration file '%s'.\n",optarg);
+	  exit(1);
+	}
+	break;
+      case 'n':
+	if ( sscanf(optarg,"%u",&nEvents) != 1 || nEvents == 0 ) {
+	  printf("*** ERROR *** Invalid number of events '%s'.\n",optarg);
+	  exit(1);
+	}
+	break;
+      case 't':
+	if ( sscanf(optarg,"%u",&maxThreads) != 1 || maxThreads == 0 || maxThreads > SCALE_MAX_THREADS ) {
+	  printf("*** ERROR *** Invalid number of threads '%s': must be in [1,%d].\n",optarg,SCALE_MAX_THREADS);
+	  exit(1);
+	}
+	break;
+      case 'r':
+	if ( sscanf(optarg,"%u",&nRep) != 1 || nRep == 0 ) {
+	  printf("*** ERROR *** Invalid number of repetitions '%s'.\n",optarg);
+	  exit(1);
+	}
+	break;
+      case 'p':
+	pin = 1;
+	break;
+      case 'h':
+	fprintf(stdout,"\nZsupScale [-c cfg_file] [-n events] [-t max_threads] [-r repetitions] [-p]\n\n");
+	fprintf(stdout,"  -c: use file 'cfg_file' to set FAKE event and zero suppression parameters\n");
+	fprintf(stdout,"  -n: number of FAKE events (default 2000)\n");
+	fprintf(stdout,"  -t: largest number of worker threads (default: number of cpus, at most %d)\n",SCALE_MAX_THREADS);
+	fprintf(stdout,"  -r: number of passes over the events used for timing (default 5)\n");
+	fprintf(stdout,"  -p: pin worker threads to cpus\n");
+	fprintf(stdout,"  -h: show this help message and exit\n\n");
+	exit(0);
+      default:
+	exit(1);
+      }
+  if (maxThreads > SCALE_MAX_THREADS) maxThreads = SCALE_MAX_THREADS;
+
+  s.zsupMode = (Config->zero_suppression / 100) & 0x1;
+  s.zsupAlgr = (Config->zero_suppression % 100) & 0xF;
+  if (s.zsupAlgr == 0) {
+    printf("*** ERROR *** Zero suppression is switched off (zero_suppression %d).\n",Config->zero_suppression);
+    exit(1);
+  }
+  zsup_algorithm_init();
+
+  // Generate all events. Event numbers skip multiples of 100, which create_fake_event reports on stdout
+  MaxPEvtSize = (PEVT_HEADER_LEN + 4*(PEVT_GRPHEAD_LEN + 512 + PEVT_GRPTTT_LEN) + 32*512)*4;
+  s.in = (char*)malloc((size_t)nEvents*MaxPEvtSize);
+  s.head = (char*)malloc(nEvents*PEVT_HEADER_LEN*4);
+  s.iov = (struct iovec*)malloc(nEvents*ZSUP_MAX_IOVEC*sizeof(struct iovec));
+  s.iovCnt = (int*)malloc(nEvents*sizeof(int));
+  s.outSize = (unsigned int*)malloc(nEvents*sizeof(unsigned int));
+  refSize = (unsigned int*)malloc(nEvents*sizeof(unsigned int));
+  refHead = (char*)malloc(nEvents*PEVT_HEADER_LEN*4);
+  if (s.in == NULL || s.head == NULL || s.iov == NULL || s.iovCnt == NULL || s.outSize == NULL || refSize == NULL || refHead == NULL) {
+    printf("*** ERROR *** Unable to allocate buffers for %u events.\n",nEvents);
+    exit(1);
+  }
+  srand(1);
+  for(i=0;i<nEvents;i++) create_fake_event(i+i/99+1,i*1000,s.in+(size_t)i*MaxPEvtSize);
+  printf("FAKE events: %u - zero suppression mode %u algorithm %u with %s kernels\n",
+	 nEvents,s.zsupMode,s.zsupAlgr,zsup_algorithm_name());
+
+  printf("%7s %7s %12s %8s %10s %10s %9s\n","threads","batch","events/s","speedup","efficiency","accepted","mismatch");
+  for(nThreads=1;nThreads<=maxThreads;nThreads++) {
+
+    pool = pool_create(nThreads,pin,scale_event,&s);
+    if (pool == NULL) exit(1);
+    n = (nThreads > 1) ? nThreads*ZSUP_EVENTS_PER_THREAD : 1;
+
+    // Output of the single worker run is the reference
+    if ( scale_pass(&s,pool,nEvents,n) ) exit(1);
+    bad = 0;
+    nAcc = 0;
+    for(i=0;i<nEvents;i++) {
+      if (nThreads == 1) {
+	refSize[i] = s.outSize[i];
+	memcpy(refHead+i*PEVT_HEADER_LEN*4,s.head+i*PEVT_HEADER_LEN*4,PEVT_HEADER_LEN*4);
+      } else if ( s.outSize[i] != refSize[i] || memcmp(s.head+i*PEVT_HEADER_LEN*4,refHead+i*PEVT_HEADER_LEN*4,PEVT_HEADER_LEN*4) ) {
+	if (bad < 10) printf("Mismatch: event %u with %u threads\n",i,nThreads);
+	bad++;
+      }
+      nAcc += __builtin_popcount(((uint32_t*)(s.head+i*PEVT_HEADER_LEN*4))[PEVT_CHMASK_ACCEPTED_LINE]);
+    }
+
+    t0 = scale_now();
+    for(rep=0;rep<nRep;rep++) if ( scale_pass(&s,pool,nEvents,n) ) exit(1);
+    dt = scale_now()-t0;
+    pool_destroy(pool);
+
+    rate = nEvents*(double)nRep/dt;
+    if (nThreads == 1) rate1 = rate;
+    printf("%7u %7u %12.0f %8.2f %9.0f%% %10u %9u\n",nThreads,n,rate,rate/rate1,100.*rate/rate1/nThreads,nAcc,bad);
+    if (bad) {
+      printf("*** ERROR *** Zero suppression with %u threads differs from the single thread one\n",nThreads);
+      exit(1);
+    }
+
+  }
+  exit(0);
+
+}